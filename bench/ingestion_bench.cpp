@@ -0,0 +1,436 @@
+// Copyright (c) 2020 Intel Corporation.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM,OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+/**
+ * @file
+ * @brief Microbenchmarks for the VideoIngestion hot paths
+ */
+
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include <benchmark/benchmark.h>
+#include <gst/gst.h>
+#include <gst/video/video.h>
+#include <opencv2/opencv.hpp>
+#include <librealsense2/rs.hpp>
+#include <eii/utils/logger.h>
+#include <eii/utils/json_config.h>
+#include <eii/msgbus/msg_envelope.h>
+#include <eii/udf/frame.h>
+#include "eii/vi/ingestor.h"
+#include "eii/vi/gstreamer_ingestor.h"
+#include "eii/vi/realsense_ingestor.h"
+#include "eii/vi/gva_roi_meta.h"
+#include "eii/vi/latency_histogram.h"
+#include "eii/vi/frame_pyramid.h"
+#include "eii/vi/motion_gate.h"
+#include "eii/vi/duplicate_filter.h"
+#include "eii/vi/frame_compressor.h"
+
+using namespace eii::vi;
+using namespace eii::udf;
+
+/**
+ * Build a buffer carrying num_rois GVA regions of interest, each with a
+ * detection and a classification tensor, as produced by
+ * gvadetect ! gvaclassify.
+ */
+static GstBuffer* make_gva_buffer(int num_rois) {
+    GstBuffer* buf = gst_buffer_new();
+    for(int i = 0; i < num_rois; i++) {
+        GstVideoRegionOfInterestMeta* meta =
+            gst_buffer_add_video_region_of_interest_meta(
+                    buf, "object", 10 * i, 20 * i, 64, 128);
+        GstStructure* detection = gst_structure_new("detection",
+                "confidence", G_TYPE_DOUBLE, 0.87,
+                "label_id", G_TYPE_INT, 1,
+                "label", G_TYPE_STRING, "person", NULL);
+        gst_video_region_of_interest_meta_add_param(meta, detection);
+        GstStructure* classification = gst_structure_new("classification",
+                "confidence", G_TYPE_DOUBLE, 0.64,
+                "label_id", G_TYPE_INT, 3,
+                "label", G_TYPE_STRING, "helmet",
+                "layer_name", G_TYPE_STRING, "prob", NULL);
+        gst_video_region_of_interest_meta_add_param(meta, classification);
+    }
+    return buf;
+}
+
+static void BM_GvaMetaConversion(benchmark::State& state) {
+    GstBuffer* buf = make_gva_buffer(state.range(0));
+    for(auto _ : state) {
+        msg_envelope_t* meta = msgbus_msg_envelope_new(CT_JSON);
+        if(!add_gva_meta(buf, meta)) {
+            msgbus_msg_envelope_destroy(meta);
+            state.SkipWithError("add_gva_meta() failed");
+            break;
+        }
+        msgbus_msg_envelope_destroy(meta);
+    }
+    gst_buffer_unref(buf);
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_GvaMetaConversion)->Arg(0)->Arg(10)->Arg(100);
+
+static void BM_GvaMetaSerialize(benchmark::State& state) {
+    GstBuffer* buf = make_gva_buffer(state.range(0));
+    for(auto _ : state) {
+        msg_envelope_t* meta = msgbus_msg_envelope_new(CT_JSON);
+        if(!add_gva_meta(buf, meta)) {
+            msgbus_msg_envelope_destroy(meta);
+            state.SkipWithError("add_gva_meta() failed");
+            break;
+        }
+        msg_envelope_serialized_part_t* parts = NULL;
+        int num_parts = msgbus_msg_envelope_serialize(meta, &parts);
+        if(num_parts <= 0) {
+            msgbus_msg_envelope_destroy(meta);
+            state.SkipWithError("msgbus_msg_envelope_serialize() failed");
+            break;
+        }
+        benchmark::DoNotOptimize(parts[0].bytes);
+        msgbus_msg_envelope_serialize_destroy(parts, num_parts);
+        msgbus_msg_envelope_destroy(meta);
+    }
+    gst_buffer_unref(buf);
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_GvaMetaSerialize)->Arg(0)->Arg(10)->Arg(100);
+
+static void BM_GvaMetaBinary(benchmark::State& state) {
+    GstBuffer* buf = make_gva_buffer(state.range(0));
+    for(auto _ : state) {
+        msg_envelope_t* meta = msgbus_msg_envelope_new(CT_JSON);
+        if(!add_gva_meta_binary(buf, meta)) {
+            msgbus_msg_envelope_destroy(meta);
+            state.SkipWithError("add_gva_meta_binary() failed");
+            break;
+        }
+        msg_envelope_serialized_part_t* parts = NULL;
+        int num_parts = msgbus_msg_envelope_serialize(meta, &parts);
+        if(num_parts <= 0) {
+            msgbus_msg_envelope_destroy(meta);
+            state.SkipWithError("msgbus_msg_envelope_serialize() failed");
+            break;
+        }
+        benchmark::DoNotOptimize(parts[0].bytes);
+        msgbus_msg_envelope_serialize_destroy(parts, num_parts);
+        msgbus_msg_envelope_destroy(meta);
+    }
+    gst_buffer_unref(buf);
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_GvaMetaBinary)->Arg(0)->Arg(10)->Arg(100);
+
+static void free_noop(void* obj) {}
+
+static void free_malloc(void* obj) {
+    free(obj);
+}
+
+// Frame wrapping an already allocated buffer, i.e. the GStreamer and
+// RealSense ingestor case
+static void BM_FrameWrap(benchmark::State& state) {
+    const int width = state.range(0);
+    const int height = state.range(1);
+    std::vector<uint8_t> pixels(width * height * 3);
+    for(auto _ : state) {
+        Frame* frame = new Frame(
+                NULL, free_noop, (void*) pixels.data(), width, height, 3);
+        benchmark::DoNotOptimize(frame->get_meta_data());
+        delete frame;
+    }
+}
+BENCHMARK(BM_FrameWrap)->Args({1920, 1080})->Args({3840, 2160});
+
+// Frame owning a freshly allocated and touched buffer, i.e. the OpenCV
+// ingestor case
+static void BM_FrameAllocate(benchmark::State& state) {
+    const int width = state.range(0);
+    const int height = state.range(1);
+    const size_t size = width * height * 3;
+    for(auto _ : state) {
+        void* pixels = malloc(size);
+        memset(pixels, 0, size);
+        Frame* frame = new Frame(
+                pixels, free_malloc, pixels, width, height, 3);
+        benchmark::DoNotOptimize(frame->get_meta_data());
+        delete frame;
+    }
+    state.SetBytesProcessed(state.iterations() * size);
+}
+BENCHMARK(BM_FrameAllocate)->Args({1920, 1080})->Args({3840, 2160});
+
+// Shared state for the queue contention benchmark. The queue only transports
+// pointers, so a token which is never dereferenced stands in for a frame.
+static FrameQueue* g_queue = NULL;
+static std::thread* g_consumer = NULL;
+static std::atomic<bool> g_consumer_stop(false);
+static char g_frame_token;
+
+static void drain_queue() {
+    while(!g_consumer_stop.load()) {
+        if(g_queue->wait_for(std::chrono::milliseconds(10))) {
+            g_queue->pop();
+        }
+    }
+}
+
+// Producers (one per benchmark thread) against a single consumer, which is
+// how the ingestor, the UDF manager and the publisher share their queues
+static void BM_FrameQueueContention(benchmark::State& state) {
+    if(state.thread_index() == 0) {
+        g_queue = new FrameQueue(state.range(0));
+        g_consumer_stop.store(false);
+        g_consumer = new std::thread(drain_queue);
+    }
+    Frame* token = reinterpret_cast<Frame*>(&g_frame_token);
+    for(auto _ : state) {
+        if(g_queue->push(token) == QueueRetCode::QUEUE_FULL) {
+            g_queue->push_wait(token);
+        }
+    }
+    if(state.thread_index() == 0) {
+        g_consumer_stop.store(true);
+        g_consumer->join();
+        delete g_consumer;
+        while(!g_queue->empty()) {
+            g_queue->pop();
+        }
+        delete g_queue;
+        g_queue = NULL;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_FrameQueueContention)
+    ->Arg(10)->ThreadRange(1, 8)->UseRealTime();
+
+static void BM_LatencyHistogram(benchmark::State& state) {
+    LatencyHistogram hist;
+    uint64_t latency_us = 1;
+    for(auto _ : state) {
+        hist.record(latency_us);
+        // Spread the values over the buckets of typical latencies
+        latency_us = (latency_us * 7 + 13) % 200000;
+    }
+    benchmark::DoNotOptimize(hist.percentile(99));
+}
+BENCHMARK(BM_LatencyHistogram);
+
+/**
+ * Synthetic camera-like image; pure noise would not be representative of
+ * the compression ratio of real content.
+ */
+static cv::Mat make_test_image(int width, int height) {
+    cv::Mat img(height, width, CV_8UC3);
+    cv::randn(img, cv::Scalar::all(128), cv::Scalar::all(40));
+    cv::GaussianBlur(img, img, cv::Size(7, 7), 0);
+    return img;
+}
+
+static void BM_EncodeJpeg(benchmark::State& state) {
+    cv::Mat img = make_test_image(state.range(0), state.range(1));
+    std::vector<int> params = {cv::IMWRITE_JPEG_QUALITY, (int) state.range(2)};
+    std::vector<uchar> out;
+    for(auto _ : state) {
+        cv::imencode(".jpeg", img, out, params);
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetBytesProcessed(state.iterations() * img.total() * img.elemSize());
+    state.counters["ratio"] = (double) (img.total() * img.elemSize()) / out.size();
+}
+BENCHMARK(BM_EncodeJpeg)
+    ->Args({640, 480, 95})->Args({1280, 720, 95})
+    ->Args({1920, 1080, 95})->Args({1920, 1080, 50})
+    ->Args({3840, 2160, 95});
+
+static void BM_EncodePng(benchmark::State& state) {
+    cv::Mat img = make_test_image(state.range(0), state.range(1));
+    std::vector<int> params = {cv::IMWRITE_PNG_COMPRESSION, (int) state.range(2)};
+    std::vector<uchar> out;
+    for(auto _ : state) {
+        cv::imencode(".png", img, out, params);
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetBytesProcessed(state.iterations() * img.total() * img.elemSize());
+    state.counters["ratio"] = (double) (img.total() * img.elemSize()) / out.size();
+}
+BENCHMARK(BM_EncodePng)
+    ->Args({640, 480, 3})->Args({1280, 720, 3})
+    ->Args({1920, 1080, 3})->Args({1920, 1080, 9})
+    ->Args({3840, 2160, 3});
+
+/**
+ * Lossless compression of a 12-bit mono image stored in 16-bit samples, as
+ * delivered by industrial cameras, with each codec and filter.
+ */
+static const char* const g_compression_configs[] = {
+    "{\"encoding\": {\"type\": \"lz4\", \"level\": 1}}",
+    "{\"encoding\": {\"type\": \"lz4\", \"level\": 1, \"filter\": \"delta\"}}",
+    "{\"encoding\": {\"type\": \"lz4\", \"level\": 1, \"filter\": \"predict\"}}",
+    "{\"encoding\": {\"type\": \"zstd\", \"level\": 1}}",
+    "{\"encoding\": {\"type\": \"zstd\", \"level\": 1, \"filter\": \"delta\"}}",
+    "{\"encoding\": {\"type\": \"zstd\", \"level\": 1, \"filter\": \"predict\"}}",
+    "{\"encoding\": {\"type\": \"zstd\", \"level\": 9, \"filter\": \"predict\"}}"
+};
+
+static void BM_CompressMono16(benchmark::State& state) {
+    config_t* config = json_config_new_from_buffer(g_compression_configs[state.range(0)]);
+    config_value_t* encoding = config->get_config_value(config->cfg, "encoding");
+    FrameCompressor compressor(encoding);
+    cv::Mat gray;
+    cv::cvtColor(make_test_image(4096, 3000), gray, cv::COLOR_BGR2GRAY);
+    cv::Mat img;
+    gray.convertTo(img, CV_16UC1, 16.0);
+    size_t len = img.total() * img.elemSize();
+    std::vector<unsigned char> out;
+    for(auto _ : state) {
+        compressor.compress(img.data, img.cols, img.rows, 2, "GRAY16_LE", out);
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetBytesProcessed(state.iterations() * len);
+    state.counters["ratio"] = (double) len / out.size();
+    config_value_destroy(encoding);
+    config_destroy(config);
+}
+BENCHMARK(BM_CompressMono16)->DenseRange(0, 6);
+
+/**
+ * Detector and classifier inputs plus a preview, resized from a 1080p frame
+ * either independently from the frame or cascaded by FramePyramid.
+ */
+static const cv::Size g_pyramid_sizes[] = {
+    cv::Size(960, 540), cv::Size(300, 300), cv::Size(224, 224)
+};
+
+static void BM_PyramidDirect(benchmark::State& state) {
+    cv::Mat img = make_test_image(1920, 1080);
+    std::vector<cv::Mat> levels(3);
+    for(auto _ : state) {
+        for(int i = 0; i < 3; i++)
+            cv::resize(img, levels[i], g_pyramid_sizes[i], 0, 0, cv::INTER_AREA);
+        benchmark::DoNotOptimize(levels.data());
+    }
+    state.SetBytesProcessed(state.iterations() * img.total() * img.elemSize());
+}
+BENCHMARK(BM_PyramidDirect);
+
+static void BM_PyramidCascade(benchmark::State& state) {
+    cv::Mat img = make_test_image(1920, 1080);
+    config_t* config = json_config_new_from_buffer(
+            "{\"pyramid\": ["
+            "{\"name\": \"preview\", \"width\": 960, \"height\": 540},"
+            "{\"name\": \"detector\", \"width\": 300, \"height\": 300},"
+            "{\"name\": \"classifier\", \"width\": 224, \"height\": 224}]}");
+    FramePyramid* pyramid = get_frame_pyramid(config);
+    std::vector<cv::Mat> levels;
+    for(auto _ : state) {
+        pyramid->build(img, levels);
+        benchmark::DoNotOptimize(levels.data());
+    }
+    state.SetBytesProcessed(state.iterations() * img.total() * img.elemSize());
+    delete pyramid;
+    config_destroy(config);
+}
+BENCHMARK(BM_PyramidCascade);
+
+/**
+ * Change score computed by the motion gate per frame on the default 1/8
+ * scale luma plane of a 1080p and a 12MP frame.
+ */
+static void BM_MotionScore(benchmark::State& state) {
+    config_t* config = json_config_new_from_buffer("{\"motion_gate\": {}}");
+    MotionGate* gate = get_motion_gate(config);
+    cv::Mat img = make_test_image(state.range(0), state.range(1));
+    cv::Mat reference = make_test_image(state.range(0), state.range(1));
+    cv::Size size(img.cols / 8, img.rows / 8);
+    cv::Mat small, luma, ref_small, ref_luma, diff;
+    cv::resize(reference, ref_small, size, 0, 0, cv::INTER_AREA);
+    cv::cvtColor(ref_small, ref_luma, cv::COLOR_BGR2GRAY);
+    for(auto _ : state) {
+        cv::resize(img, small, size, 0, 0, cv::INTER_AREA);
+        cv::cvtColor(small, luma, cv::COLOR_BGR2GRAY);
+        benchmark::DoNotOptimize(gate->score(luma, ref_luma, diff));
+    }
+    state.SetBytesProcessed(state.iterations() * img.total() * img.elemSize());
+    delete gate;
+    config_destroy(config);
+}
+BENCHMARK(BM_MotionScore)->Args({1920, 1080})->Args({4000, 3000});
+
+static void BM_Crc32c(benchmark::State& state) {
+    cv::Mat img = make_test_image(state.range(0), state.range(1));
+    size_t len = img.total() * img.elemSize();
+    for(auto _ : state)
+        benchmark::DoNotOptimize(crc32c(img.data, len));
+    state.SetBytesProcessed(state.iterations() * len);
+}
+BENCHMARK(BM_Crc32c)->Args({1920, 1080})->Args({4000, 3000});
+
+static void BM_DHash(benchmark::State& state) {
+    cv::Mat img = make_test_image(state.range(0), state.range(1));
+    cv::Mat thumb;
+    for(auto _ : state)
+        benchmark::DoNotOptimize(dhash(img, thumb));
+    state.SetBytesProcessed(state.iterations() * img.total() * img.elemSize());
+}
+BENCHMARK(BM_DHash)->Args({1920, 1080})->Args({4000, 3000});
+
+static void BM_Rs2IntrinsicsMeta(benchmark::State& state) {
+    rs2_intrinsics intrinsics = {};
+    intrinsics.width = 1280;
+    intrinsics.height = 720;
+    intrinsics.ppx = 640.5f;
+    intrinsics.ppy = 360.5f;
+    intrinsics.fx = 920.1f;
+    intrinsics.fy = 919.7f;
+    intrinsics.model = RS2_DISTORTION_BROWN_CONRADY;
+    for(auto _ : state) {
+        msg_envelope_t* meta = msgbus_msg_envelope_new(CT_JSON);
+        try {
+            add_rs2_intrinsics_meta(meta, "rs2_depth_intrinsics", intrinsics);
+            add_rs2_intrinsics_meta(meta, "rs2_color_intrinsics", intrinsics);
+        } catch(const char* err) {
+            msgbus_msg_envelope_destroy(meta);
+            state.SkipWithError(err);
+            break;
+        }
+        msgbus_msg_envelope_destroy(meta);
+    }
+}
+BENCHMARK(BM_Rs2IntrinsicsMeta);
+
+int main(int argc, char** argv) {
+    gst_init(&argc, &argv);
+    // Same default as the service so that LOG_DEBUG calls are measured as
+    // they are in production
+    set_log_level(LOG_LVL_ERROR);
+
+    benchmark::Initialize(&argc, argv);
+    if(benchmark::ReportUnrecognizedArguments(argc, argv)) {
+        return 1;
+    }
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -0,0 +1,81 @@
+// Copyright (c) 2020 Intel Corporation.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM,OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+/**
+ * @file
+ * @brief Microbenchmarks for the rc_genicam_api YCbCr conversion helpers
+ */
+
+#include <vector>
+#include <benchmark/benchmark.h>
+#include "rc_genicam_api/image.h"
+
+/**
+ * Synthetic YCbCr411_8 image, 6 bytes for every group of four pixels
+ */
+static std::vector<uint8_t> make_ycbcr411_image(int width, int height) {
+    std::vector<uint8_t> img((width >> 2) * 6 * height);
+    for(size_t i = 0; i < img.size(); i++) {
+        img[i] = static_cast<uint8_t>((i * 31) ^ (i >> 7));
+    }
+    return img;
+}
+
+static void BM_YCbCr411toRGB(benchmark::State& state) {
+    const int width = state.range(0);
+    const int height = state.range(1);
+    const size_t lstep = (width >> 2) * 6;
+    std::vector<uint8_t> img = make_ycbcr411_image(width, height);
+    std::vector<uint8_t> rgb(width * height * 3);
+    for(auto _ : state) {
+        uint8_t* out = rgb.data();
+        for(int k = 0; k < height; k++) {
+            const uint8_t* row = img.data() + k * lstep;
+            for(int i = 0; i < width; i++) {
+                rcg::convYCbCr411toRGB(out, row, i);
+                out += 3;
+            }
+        }
+        benchmark::DoNotOptimize(rgb.data());
+    }
+    state.SetItemsProcessed(state.iterations() * width * height);
+}
+BENCHMARK(BM_YCbCr411toRGB)->Args({1920, 1200})->Args({4096, 3000});
+
+static void BM_YCbCr411toQuadRGB(benchmark::State& state) {
+    const int width = state.range(0);
+    const int height = state.range(1);
+    const size_t lstep = (width >> 2) * 6;
+    std::vector<uint8_t> img = make_ycbcr411_image(width, height);
+    std::vector<uint8_t> rgb(width * height * 3);
+    for(auto _ : state) {
+        uint8_t* out = rgb.data();
+        for(int k = 0; k < height; k++) {
+            const uint8_t* row = img.data() + k * lstep;
+            for(int i = 0; i < width; i += 4) {
+                rcg::convYCbCr411toQuadRGB(out, row, i);
+                out += 12;
+            }
+        }
+        benchmark::DoNotOptimize(rgb.data());
+    }
+    state.SetItemsProcessed(state.iterations() * width * height);
+}
+BENCHMARK(BM_YCbCr411toQuadRGB)->Args({1920, 1200})->Args({4096, 3000});
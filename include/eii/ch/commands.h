@@ -40,6 +40,7 @@ namespace eii {
         START_INGESTION,
         STOP_INGESTION,
         SNAPSHOT,
+        FORCE_KEYFRAME,
         COMMAND_INVALID
         // MORE COMMANDS TO BE ADDED BASED ON THE NEED
     };
@@ -0,0 +1,167 @@
+// Copyright (c) 2021 Intel Corporation.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM,OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+
+/**
+ * @file
+ * @brief Helpers for frames passed on in the compressed form of the source
+ */
+
+#ifndef _EII_VI_COMPRESSED_FRAME_H
+#define _EII_VI_COMPRESSED_FRAME_H
+
+#include <stddef.h>
+#include <eii/udf/frame.h>
+
+// Pixel format of frames holding a JPEG image, e.g. of an MJPEG camera
+#define PIXEL_FORMAT_JPEG "JPEG"
+
+// Pixel formats of frames holding an H.264 or H.265 access unit in
+// byte-stream format, e.g. of an RTSP camera
+#define PIXEL_FORMAT_H264 "H264"
+#define PIXEL_FORMAT_H265 "H265"
+
+// Metadata key of the base64 encoded parameter sets (SPS/PPS and the VPS
+// of H.265) of video keyframes, in byte-stream format
+#define CODEC_CONFIG "codec_config"
+
+// Ingestor config key to decode compressed frames for the UDFs
+#define DECODE_COMPRESSED "decode_compressed"
+
+// Metadata keys of the size of the image held by a compressed frame, the
+// frame itself is a byte blob
+#define IMAGE_WIDTH "image_width"
+#define IMAGE_HEIGHT "image_height"
+
+// Metadata key of the data size of compressed frames when published
+#define COMPRESSED_SIZE "compressed_size"
+
+namespace eii {
+    namespace vi {
+
+        /**
+         * Frame holding the compressed data of the source as a byte blob,
+         * i.e. with the data size as width and a height and channels of 1.
+         * It is published with the size of the image instead, see
+         * put_compressed_size().
+         */
+        class CompressedFrame : public udf::Frame {
+            public:
+                /**
+                 * Constructor
+                 * @param frame      - Underlying object owning the data
+                 * @param free_frame - Method freeing the underlying object
+                 * @param data       - Compressed data
+                 * @param len        - Compressed data size
+                 */
+                CompressedFrame(void* frame, void (*free_frame)(void*), void* data, size_t len);
+
+                /**
+                 * Overridden serialize method, frames decoded for the UDFs
+                 * are published as usual.
+                 */
+                msg_envelope_t* serialize() override;
+        };
+
+        /**
+         * Get the encoding of a frame which holds the compressed data of
+         * the source, as published in the "encoding_type" metadata key.
+         * @param frame - Frame to check
+         * @return encoding type or NULL for raw frames
+         */
+        const char* get_compressed_codec(udf::Frame* frame);
+
+        /**
+         * Set the "pixel_format", "encoding_type" and image size metadata
+         * of a frame holding compressed data.
+         * @param frame        - Frame, whose width is the size of the
+         *                       data, with a height and channels of 1
+         * @param pixel_format - Compressed pixel format, e.g.
+         *                       PIXEL_FORMAT_JPEG
+         * @param width        - Image width, 0 if unknown in which case
+         *                       it is read from JPEG images
+         * @param height       - Image height, 0 if unknown
+         * @return false if the metadata could not be set
+         */
+        bool set_compressed_format(udf::Frame* frame, const char* pixel_format,
+                                   int width=0, int height=0);
+
+        /**
+         * Get the image size of a frame holding compressed data.
+         * @return false if the size is unknown
+         */
+        bool get_image_size(udf::Frame* frame, int& width, int& height);
+
+        /**
+         * Put the "width", "height" and "channels" of the image held by a
+         * compressed frame into a message, along with its data size in
+         * COMPRESSED_SIZE. Replaces the values of the byte blob. The
+         * channels are those of the decoded image, i.e. 3.
+         * @param msg    - Message
+         * @param width  - Image width, 0 if unknown
+         * @param height - Image height, 0 if unknown
+         * @param len    - Compressed data size
+         * @return false if the values could not be put
+         */
+        bool put_compressed_size(msg_envelope_t* msg, int width, int height, size_t len);
+
+        /**
+         * Read the image size from the start of frame segment of a JPEG
+         * image.
+         * @return false if the data has no valid start of frame segment
+         */
+        bool get_jpeg_size(const void* data, size_t len, int& width, int& height);
+
+        /**
+         * Check whether a video frame is a keyframe, i.e. whether its
+         * KEYFRAME metadata is set.
+         */
+        bool is_keyframe(udf::Frame* frame);
+
+        /**
+         * Replace the compressed data of a frame with its decoded BGR
+         * pixels and remove the metadata of the compressed data.
+         * @param frame      - Compressed frame
+         * @param obj        - Object owning the pixels
+         * @param free_frame - Method releasing obj
+         * @param data       - Packed BGR pixels
+         * @param width      - Frame width
+         * @param height     - Frame height
+         * @return false if the metadata could not be updated
+         */
+        bool set_decoded_data(udf::Frame* frame, void* obj, void (*free_frame)(void*),
+                              void* data, int width, int height);
+
+        /**
+         * Check whether a buffer starts with a JPEG start of image marker.
+         */
+        bool is_jpeg(const void* data, size_t len);
+
+        /**
+         * Decode a JPEG frame in place into a BGR frame, updating its
+         * metadata accordingly.
+         * @return false if the frame could not be decoded
+         */
+        bool decode_jpeg(udf::Frame* frame);
+
+    } // vi
+} // eii
+
+#endif // _EII_VI_COMPRESSED_FRAME_H
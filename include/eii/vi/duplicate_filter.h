@@ -0,0 +1,130 @@
+// Copyright (c) 2021 Intel Corporation.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM,OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+
+/**
+ * @file
+ * @brief Exact and near duplicate frame suppression
+ */
+
+#ifndef _EII_VI_DUPLICATE_FILTER_H
+#define _EII_VI_DUPLICATE_FILTER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <opencv2/opencv.hpp>
+#include <eii/utils/config.h>
+#include <eii/udf/frame.h>
+
+#define DUPLICATE_FILTER "duplicate_filter"
+#define DUPLICATE_METHOD_CRC32C "crc32c"
+#define DUPLICATE_METHOD_DHASH "dhash"
+#define DUPLICATE_ACTION_DROP "drop"
+#define DUPLICATE_ACTION_MARK "mark"
+
+// Metadata keys set on duplicates by the mark action
+#define DUPLICATE_KEY "duplicate"
+#define DUPLICATE_COUNT_KEY "duplicate_count"
+
+// Metadata key set on the frames passed on while the camera is stuck
+#define CAMERA_STUCK_KEY "camera_stuck"
+
+namespace eii {
+    namespace vi {
+
+        /**
+         * CRC32C (Castagnoli) checksum, computed with the SSE4.2 crc32
+         * instruction if the CPU supports it.
+         * @param data - Data to checksum
+         * @param len  - Length of the data in bytes
+         * @return The checksum
+         */
+        uint32_t crc32c(const void* data, size_t len);
+
+        /**
+         * 64 bit difference hash of an image, every bit tells whether the
+         * brightness increases between neighbouring pixels of a 9x8
+         * thumbnail. Similar images have hashes with a small Hamming
+         * distance.
+         * @param img   - Image to hash, of any number of 8 bit channels
+         * @param thumb - Scratch buffer
+         * @return The hash
+         */
+        uint64_t dhash(const cv::Mat& img, cv::Mat& thumb);
+
+        /**
+         * Drops or marks frames which are identical (CRC32C) or nearly
+         * identical (difference hash) to the previous frame, and raises a
+         * stuck camera alarm after a number of consecutive duplicates.
+         */
+        class DuplicateFilter {
+            private:
+                // Config
+                bool m_near;
+                int m_max_distance;
+                bool m_drop;
+                int m_stuck_frames;
+
+                // Fingerprint of the previous frame, only accessed from the
+                // ingestion thread
+                bool m_has_previous;
+                uint64_t m_previous;
+                size_t m_previous_size;
+                cv::Mat m_thumb;
+
+                // Consecutive duplicates and whether the alarm was raised
+                int m_duplicates;
+                bool m_stuck;
+
+            public:
+                /**
+                 * Constructor
+                 *
+                 * \note Throws a const char* error if the config is invalid.
+                 *
+                 * @param config - Duplicate filter config object
+                 */
+                DuplicateFilter(const config_value_t* config);
+
+                /**
+                 * Fingerprint a frame and compare it to the previous one.
+                 * Duplicates raising or repeating the stuck camera alarm
+                 * are marked with camera_stuck and always passed on.
+                 * @param frame - Frame to check
+                 * @return false if the frame is a duplicate and has to be
+                 *         dropped
+                 */
+                bool check(udf::Frame* frame);
+        };
+
+        /**
+         * Create the duplicate filter configured in the ingestor config.
+         *
+         * \note Throws a const char* error if the config is invalid.
+         *
+         * @param config - Ingestor config
+         * @return The duplicate filter or NULL if none is configured
+         */
+        DuplicateFilter* get_duplicate_filter(config_t* config);
+
+    } // vi
+} // eii
+
+#endif // _EII_VI_DUPLICATE_FILTER_H
@@ -0,0 +1,178 @@
+// Copyright (c) 2021 Intel Corporation.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM,OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+
+/**
+ * @file
+ * @brief Huge page backed frame allocator shared by the ingestors and the
+ *        gencamsrc plugin
+ */
+
+#ifndef _EII_VI_FRAME_ALLOCATOR_H
+#define _EII_VI_FRAME_ALLOCATOR_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include <set>
+#include <mutex>
+#include <chrono>
+#include <eii/utils/config.h>
+
+#define FRAME_ALLOCATOR "frame_allocator"
+#define FRAME_ALLOCATOR_PAGE_2MB "2MB"
+#define FRAME_ALLOCATOR_PAGE_1GB "1GB"
+
+namespace eii {
+    namespace vi {
+
+        /**
+         * Frame allocator statistics
+         */
+        struct FrameAllocatorStats {
+            // Allocations served from the pool
+            uint64_t hits;
+
+            // Allocations served from the heap since the pool was
+            // exhausted
+            uint64_t misses;
+
+            // Pool size and heap memory of outstanding misses
+            size_t resident_bytes;
+
+            // Pool memory handed out in blocks
+            size_t pool_used_bytes;
+        };
+
+        /**
+         * Allocates frame buffers from a pool of pre-faulted huge pages.
+         * The pool is split into power-of-two size classes (a buddy
+         * allocator): larger free blocks are split for smaller requests
+         * and released blocks are merged with their free buddy, so blocks
+         * of a resolution no longer ingested are reused for the new one.
+         * Allocations are served from the heap if no free block fits.
+         *
+         * A single allocator is shared by the whole process and is never
+         * released, so that frames may outlive the ingestor which
+         * allocated them.
+         */
+        class FrameAllocator {
+            private:
+                std::mutex m_mtx;
+
+                // Pool, and the part handed out in blocks
+                uint8_t* m_pool;
+                size_t m_pool_size;
+                size_t m_pool_used;
+                size_t m_page_size;
+                bool m_huge_pages;
+
+                // Pool offsets of the free blocks of each size class, class
+                // i holding blocks of the minimum block size << i bytes
+                std::vector<std::set<size_t>> m_free;
+
+                // Statistics
+                uint64_t m_hits;
+                uint64_t m_misses;
+                size_t m_heap_bytes;
+                std::chrono::steady_clock::time_point m_report_time;
+
+                /**
+                 * Log the statistics if the report interval elapsed, the
+                 * lock must be held.
+                 */
+                void report();
+
+            public:
+                /**
+                 * Constructor
+                 *
+                 * \note Throws a const char* error if the config is invalid
+                 *      or the pool cannot be mapped.
+                 *
+                 * @param config - Frame allocator config object
+                 */
+                FrameAllocator(const config_value_t* config);
+
+                /**
+                 * Allocate a frame buffer, 64 byte aligned.
+                 * @param size - Size in bytes
+                 * @return The buffer or NULL if out of memory
+                 */
+                void* allocate(size_t size);
+
+                /**
+                 * Release a buffer returned by allocate().
+                 * @param ptr - Buffer
+                 */
+                void release(void* ptr);
+
+                /**
+                 * Get the statistics.
+                 */
+                FrameAllocatorStats get_stats();
+
+                /**
+                 * Whether the pool is backed by huge pages, or by
+                 * transparent huge pages if none were reserved.
+                 */
+                bool has_huge_pages() const;
+        };
+
+        /**
+         * Create the shared frame allocator configured in the ingestor
+         * config, if it does not exist yet. The pool is faulted in by the
+         * calling thread, i.e. on its NUMA node.
+         *
+         * \note Throws a const char* error if the config is invalid.
+         *
+         * @param config - Ingestor config
+         * @return The shared allocator, NULL if none is configured
+         */
+        FrameAllocator* init_frame_allocator(config_t* config);
+
+        /**
+         * Get the shared frame allocator.
+         * @return The allocator, NULL if none was created
+         */
+        FrameAllocator* get_frame_allocator();
+
+    } // vi
+} // eii
+
+extern "C" {
+
+/**
+ * Allocate a frame buffer from the shared frame allocator. Looked up at
+ * runtime by the gencamsrc plugin.
+ * @param size - Size in bytes
+ * @return The buffer, NULL if there is no shared allocator
+ */
+void* eii_frame_alloc(size_t size);
+
+/**
+ * Release a buffer returned by eii_frame_alloc().
+ * @param ptr - Buffer
+ */
+void eii_frame_free(void* ptr);
+
+}
+
+#endif // _EII_VI_FRAME_ALLOCATOR_H
@@ -0,0 +1,189 @@
+// Copyright (c) 2021 Intel Corporation.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM,OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+
+/**
+ * @file
+ * @brief Batched frame hand-off to the UDFs
+ */
+
+#ifndef _EII_VI_FRAME_BATCHER_H
+#define _EII_VI_FRAME_BATCHER_H
+
+#include <stdint.h>
+#include <map>
+#include <set>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <eii/utils/config.h>
+#include <eii/udf/frame.h>
+#include <eii/udf/udf_manager.h>
+
+#define BATCHING "batching"
+
+// Metadata keys of a batch
+#define BATCH_KEY "batch"
+#define BATCH_ID_KEY "batch_id"
+#define BATCH_SIZE_KEY "batch_size"
+
+namespace eii {
+    namespace vi {
+
+        class FrameBatcher;
+
+        /**
+         * Frames handed to the UDFs as one batch. Owned by the batch frame
+         * and released along with it.
+         */
+        struct FrameBatch {
+            FrameBatcher* batcher;
+            int64_t id;
+
+            // Batched frames, taken once the batch left the UDFs
+            std::vector<udf::Frame*> frames;
+        };
+
+        /**
+         * Groups the frames of a queue into batches for batch-aware UDFs and
+         * restores the individual frames, in order, once the batches left
+         * the UDFs.
+         *
+         * A batch is a single frame whose sub-frames refer to the data of
+         * the batched frames without copying. Its metadata has the
+         * metadata of every batched frame in the "batch" array, the results
+         * the UDFs add to these entries are copied to the frames when they
+         * are unbatched.
+         */
+        class FrameBatcher {
+            private:
+                // Config
+                size_t m_max_frames;
+                std::chrono::milliseconds m_max_wait;
+
+                // Queue of the ingested frames and queue the unbatched
+                // frames are pushed to
+                udf::FrameQueue* m_input_queue;
+                udf::FrameQueue* m_output_queue;
+
+                // Input and output queues of the UDF manager
+                udf::FrameQueue* m_batch_queue;
+                udf::FrameQueue* m_result_queue;
+
+                // Batches in the UDF manager, and the ones released without
+                // leaving it (i.e. dropped by a UDF)
+                std::mutex m_mtx;
+                std::map<int64_t, FrameBatch*> m_batches;
+                std::set<int64_t> m_dropped;
+
+                // Id of the next batch, only accessed from the batcher
+                // thread
+                int64_t m_next_id;
+
+                // Batches which left the UDF manager ahead of earlier ones
+                // and id of the next batch to unbatch, only accessed from
+                // the unbatcher thread
+                std::map<int64_t, udf::Frame*> m_reorder;
+                int64_t m_next_unbatch;
+
+                std::thread* m_batcher_th;
+                std::thread* m_unbatcher_th;
+                std::atomic<bool> m_stop;
+
+                /**
+                 * Batcher thread run method
+                 */
+                void run_batcher();
+
+                /**
+                 * Unbatcher thread run method
+                 */
+                void run_unbatcher();
+
+                /**
+                 * Hand the pending frames to the UDF manager as one batch.
+                 */
+                void flush(std::vector<udf::Frame*>& pending);
+
+                /**
+                 * Unbatch the batches which are next in order.
+                 */
+                void unbatch_ready();
+
+                /**
+                 * Push the frames of a batch to the output queue, along with
+                 * the results the UDFs added to the batch.
+                 */
+                void unbatch(udf::Frame* batch);
+
+                /**
+                 * Free method of a batch frame, releases the frames which
+                 * were not unbatched.
+                 */
+                static void free_batch(void* obj);
+
+            public:
+                /**
+                 * Constructor
+                 *
+                 * \note Throws a const char* error if the config is invalid.
+                 *
+                 * @param config       - Batching config object
+                 * @param input_queue  - Queue the frames are taken from
+                 * @param output_queue - Queue the unbatched frames are
+                 *                       pushed to
+                 * @param queue_size   - Size of the batch queues
+                 */
+                FrameBatcher(const config_value_t* config, udf::FrameQueue* input_queue, udf::FrameQueue* output_queue, size_t queue_size);
+
+                /**
+                 * Destructor, the UDF manager must be released before.
+                 */
+                ~FrameBatcher();
+
+                /**
+                 * Input queue of the UDF manager.
+                 */
+                udf::FrameQueue* get_udf_input_queue();
+
+                /**
+                 * Output queue of the UDF manager.
+                 */
+                udf::FrameQueue* get_udf_output_queue();
+
+                /**
+                 * Start the batcher and unbatcher threads.
+                 */
+                void start();
+
+                /**
+                 * Stop the batcher and unbatcher threads. The pending frames
+                 * are handed to the UDF manager, which must still be
+                 * running.
+                 */
+                void stop();
+        };
+
+    } // vi
+} // eii
+
+#endif // _EII_VI_FRAME_BATCHER_H
@@ -0,0 +1,127 @@
+// Copyright (c) 2021 Intel Corporation.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM,OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+/**
+ * @file
+ * @brief Lossless LZ4/zstd compression of the raw frames published by an
+ * output
+ */
+
+#ifndef _EII_VI_FRAME_COMPRESSOR_H
+#define _EII_VI_FRAME_COMPRESSOR_H
+
+#include <string>
+#include <vector>
+#include <eii/utils/config.h>
+
+#define COMPRESSION_LZ4 "lz4"
+#define COMPRESSION_ZSTD "zstd"
+
+// Config key of the filter applied before compression
+#define COMPRESSION_FILTER "filter"
+
+// Metadata key of the filter applied before compression, only set if a
+// filter is applied
+#define COMPRESSION_FILTER_KEY "compression_filter"
+
+namespace eii {
+    namespace vi {
+
+        /**
+         * Filter applied to the pixel rows before compression, to turn
+         * smooth image content into small residuals that compress better.
+         */
+        enum class CompressionFilter {
+            // Rows are compressed as is
+            NONE,
+            // Difference to the left neighbour of the same channel
+            DELTA,
+            // Residual of the median edge detector predictor of LOCO-I /
+            // JPEG-LS, using the left, upper and upper left neighbours
+            PREDICT
+        };
+
+        /**
+         * Compresses raw frames losslessly with LZ4 or zstd. The
+         * compression contexts and the filter buffer are kept per thread
+         * and reused for every frame.
+         */
+        class FrameCompressor {
+            private:
+                std::string m_type;
+                int m_level;
+                CompressionFilter m_filter;
+
+                /**
+                 * Apply the filter to a frame.
+                 * @param sample_size - 1 or 2 bytes per sample
+                 */
+                void filter(const unsigned char* src, unsigned char* dst, int width, int height,
+                            int samples, int sample_size) const;
+
+            public:
+                /**
+                 * Constructor
+                 * @param encoding - "encoding" object of an output with an
+                 *                   lz4 or zstd type
+                 */
+                FrameCompressor(const config_value_t* encoding);
+
+                /**
+                 * Check whether an encoding type is a lossless compression.
+                 */
+                static bool is_compression(const char* type);
+
+                /**
+                 * Compress a frame.
+                 * @param data         - Frame data
+                 * @param width        - Frame width
+                 * @param height       - Frame height, including the
+                 *                       chroma rows of 4:2:0 formats
+                 * @param channels     - Bytes per pixel
+                 * @param pixel_format - "pixel_format" metadata of the
+                 *                       frame, NULL if it has none
+                 * @param out          - Compressed data
+                 * @return false if the frame could not be compressed
+                 */
+                bool compress(const void* data, int width, int height, int channels,
+                              const char* pixel_format, std::vector<unsigned char>& out) const;
+
+                /**
+                 * Compression type, "lz4" or "zstd".
+                 */
+                const std::string& get_type() const;
+
+                /**
+                 * Compression level.
+                 */
+                int get_level() const;
+
+                /**
+                 * Filter name as published in the metadata, NULL if no
+                 * filter is applied.
+                 */
+                const char* get_filter_name() const;
+        };
+
+    } // vi
+} // eii
+
+#endif // _EII_VI_FRAME_COMPRESSOR_H
@@ -0,0 +1,122 @@
+// Copyright (c) 2021 Intel Corporation.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM,OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+
+/**
+ * @file
+ * @brief Downscaled frame variants computed once at ingest
+ */
+
+#ifndef _EII_VI_FRAME_PYRAMID_H
+#define _EII_VI_FRAME_PYRAMID_H
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <opencv2/opencv.hpp>
+#include <eii/utils/config.h>
+#include <eii/udf/frame.h>
+
+#define PYRAMID "pyramid"
+#define PYRAMID_INTER_AREA "area"
+#define PYRAMID_INTER_LINEAR "linear"
+
+// Metadata key describing the pyramid levels
+#define PYRAMID_META_KEY "pyramid"
+
+namespace eii {
+    namespace vi {
+
+        /**
+         * Downscaled variant of the ingested frame.
+         */
+        struct PyramidLevel {
+            std::string name;
+            cv::Size size;
+
+            // cv::INTER_AREA or cv::INTER_LINEAR
+            int interpolation;
+
+            // Level the variant is resized from, -1 for the ingested frame
+            int source;
+        };
+
+        /**
+         * Computes a configurable set of downscaled variants of the ingested
+         * frames and attaches them as additional frames, so that UDFs and
+         * other consumers do not each resize the full frame.
+         *
+         * Levels are computed from the largest to the smallest, each one from
+         * the smallest previously computed level it fits into, so that only
+         * the largest levels are resized from the full frame.
+         */
+        class FramePyramid {
+            private:
+                // Levels in the configured order
+                std::vector<PyramidLevel> m_levels;
+
+                // Order in which the levels are computed
+                std::vector<size_t> m_order;
+
+                // Log unsupported frames only once
+                std::atomic<bool> m_format_warned;
+
+            public:
+                /**
+                 * Constructor
+                 *
+                 * \note Throws a const char* error if the config is invalid.
+                 *
+                 * @param pyramid - Array of pyramid level configs
+                 */
+                FramePyramid(const config_value_t* pyramid);
+
+                /**
+                 * Compute the levels of an image.
+                 * @param src    - Image to downscale
+                 * @param levels - Output, one image per level in the
+                 *                 configured order
+                 */
+                void build(const cv::Mat& src, std::vector<cv::Mat>& levels);
+
+                /**
+                 * Compute the levels of the first frame of @p frame and add
+                 * them as additional frames.
+                 * @param frame    - Frame to downscale
+                 * @param enc_type - Encoding of the added frames
+                 * @param enc_lvl  - Encoding level of the added frames
+                 */
+                void apply(udf::Frame* frame, udf::EncodeType enc_type, int enc_lvl);
+        };
+
+        /**
+         * Create the frame pyramid configured in the ingestor config.
+         *
+         * \note Throws a const char* error if the config is invalid.
+         *
+         * @param config - Ingestor config
+         * @return The pyramid or NULL if none is configured
+         */
+        FramePyramid* get_frame_pyramid(config_t* config);
+
+    } // vi
+} // eii
+
+#endif // _EII_VI_FRAME_PYRAMID_H
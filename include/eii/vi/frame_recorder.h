@@ -0,0 +1,288 @@
+// Copyright (c) 2021 Intel Corporation.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM,OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+/**
+ * @file
+ * @brief Raw frame recorder interface and on-disk recording format
+ */
+
+#ifndef _EII_VI_FRAME_RECORDER_H
+#define _EII_VI_FRAME_RECORDER_H
+
+#include <stdint.h>
+#include <string>
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <eii/utils/config.h>
+#include <eii/udf/frame.h>
+
+#define RECORDER "recorder"
+
+// Every block written to a segment file is a multiple of this size and every
+// staging buffer is aligned to it, so segments can be written with O_DIRECT
+#define VI_REC_ALIGN 4096
+
+// Alignment of frame payloads inside a record
+#define VI_REC_DATA_ALIGN 64
+
+// Size of the pixel format field of a frame descriptor, including the
+// terminating null character
+#define VI_REC_FORMAT_SIZE 16
+
+#define VI_REC_VERSION 1
+#define VI_REC_SEGMENT_MAGIC "EIIVIREC"
+#define VI_REC_RECORD_MAGIC 0x43455256 // "VREC"
+
+#define VI_REC_DATA_EXT ".dat"
+#define VI_REC_INDEX_EXT ".idx"
+
+namespace eii {
+    namespace vi {
+
+        /**
+         * Header at the start of every segment data file. It occupies the
+         * whole first VI_REC_ALIGN block of the segment.
+         *
+         * All fields of the recording format are stored in host (little
+         * endian) byte order.
+         */
+        struct RecSegmentHeader {
+            char magic[8];
+            uint32_t version;
+            uint32_t alignment;
+            uint64_t created_ns;
+        };
+
+        /**
+         * Header at the start of every record. It is followed by
+         * @c num_frames @c RecFrameDesc entries, the JSON serialized frame
+         * metadata and the frame payloads. Records are padded to
+         * VI_REC_ALIGN.
+         */
+        struct RecRecordHeader {
+            uint32_t magic;
+            uint32_t header_size;
+            uint64_t record_size;
+            uint64_t capture_ts_ns;
+            uint32_t num_frames;
+            uint32_t meta_size;
+            uint64_t meta_offset;
+            uint64_t reserved[3];
+        };
+
+        /**
+         * Description of one frame payload within a record. Offsets are
+         * relative to the start of the record. The pixel format is the
+         * "pixel_format" metadata of the frame, empty if it had none.
+         */
+        struct RecFrameDesc {
+            int32_t width;
+            int32_t height;
+            int32_t channels;
+            int32_t reserved;
+            char pixel_format[VI_REC_FORMAT_SIZE];
+            uint64_t data_offset;
+            uint64_t data_size;
+        };
+
+        /**
+         * Entry of a segment index file, one per record in the segment.
+         */
+        struct RecIndexEntry {
+            uint64_t offset;
+            uint64_t record_size;
+            uint64_t capture_ts_ns;
+            uint64_t reserved;
+        };
+
+        static_assert(sizeof(RecSegmentHeader) <= VI_REC_ALIGN, "Segment header too large");
+        static_assert(sizeof(RecRecordHeader) == 64, "Unexpected record header size");
+        static_assert(sizeof(RecFrameDesc) == 48, "Unexpected frame descriptor size");
+        static_assert(sizeof(RecIndexEntry) == 32, "Unexpected index entry size");
+
+        /**
+         * Records raw frames and their metadata to segmented, append-only
+         * files so that a session can be replayed later by the replay
+         * ingestor.
+         *
+         * Frames are copied into aligned staging blocks on the ingestion
+         * thread and written to disk by a dedicated writer thread. If the
+         * writer falls behind and no staging block is free, frames are
+         * dropped from the recording instead of blocking ingestion.
+         */
+        class FrameRecorder {
+            private:
+                // Staging block handed over to the writer thread
+                struct Block {
+                    uint8_t* data;
+                    size_t capacity;
+                    size_t used;
+                    // Index entries with offsets relative to the block
+                    std::vector<RecIndexEntry> entries;
+                };
+
+                // Recording directory
+                std::string m_path;
+
+                // Maximum size of one segment file in bytes
+                size_t m_segment_size;
+
+                // Size and number of the pooled staging blocks
+                size_t m_block_size;
+                size_t m_num_blocks;
+
+                // Maximum time a partially filled block is held back
+                std::chrono::milliseconds m_flush_interval;
+
+                // Open segments with O_DIRECT
+                bool m_o_direct;
+
+                // Staging blocks that are free to be filled
+                std::vector<Block*> m_free_blocks;
+
+                // Blocks waiting to be written
+                std::deque<Block*> m_write_queue;
+
+                // Block currently being filled by the ingestion thread
+                Block* m_current;
+                std::chrono::steady_clock::time_point m_current_start;
+
+                // Writer thread state
+                std::thread* m_th;
+                std::mutex m_mtx;
+                std::condition_variable m_cv;
+                bool m_stop;
+                bool m_writing;
+
+                // Segment state, only touched by the writer thread
+                int m_seg_fd;
+                int m_idx_fd;
+                uint64_t m_seg_size;
+                uint32_t m_seg_seq;
+
+                // Statistics
+                std::atomic<uint64_t> m_recorded;
+                std::atomic<uint64_t> m_dropped;
+                std::atomic<uint64_t> m_bytes;
+
+                /**
+                 * Writer thread run method.
+                 */
+                void run();
+
+                /**
+                 * Write a filled block to the current segment, rolling over
+                 * to a new segment if needed.
+                 */
+                bool write_block(Block* block);
+
+                /**
+                 * Open the next segment data and index files.
+                 */
+                bool open_segment();
+
+                /**
+                 * Close the current segment files.
+                 */
+                void close_segment();
+
+                /**
+                 * Queue the current block for writing. Must be called with
+                 * m_mtx held.
+                 */
+                void submit_current();
+
+                /**
+                 * Get a staging block able to hold @p size bytes, or NULL if
+                 * none is available. Must be called with m_mtx held.
+                 */
+                Block* acquire_block(size_t size);
+
+                /**
+                 * Private @c FrameRecorder copy constructor.
+                 */
+                FrameRecorder(const FrameRecorder& src);
+
+                /**
+                 * Private @c FrameRecorder assignment operator.
+                 */
+                FrameRecorder& operator=(const FrameRecorder& src);
+
+            public:
+                /**
+                 * Constructor
+                 * @param config - "recorder" configuration object
+                 */
+                FrameRecorder(const config_value_t* config);
+
+                /**
+                 * Destructor, flushes any staged frames to disk.
+                 */
+                ~FrameRecorder();
+
+                /**
+                 * Stage the given frame for recording. The frame is not
+                 * modified and remains owned by the caller.
+                 * @param frame         - Frame to record
+                 * @param capture_ts_ns - Wall clock time the frame was
+                 *                        captured at by the source in
+                 *                        nanoseconds, 0 to use the current
+                 *                        time
+                 * @return false if the frame was dropped from the recording
+                 */
+                bool record(udf::Frame* frame, uint64_t capture_ts_ns);
+
+                /**
+                 * Flush any staged frames and wait for them to be written.
+                 */
+                void flush();
+        };
+
+        /**
+         * List the segments of a recording.
+         * @param path - Recording directory
+         * @return Sorted segment sequence numbers
+         */
+        std::vector<uint32_t> list_recording_segments(const std::string& path);
+
+        /**
+         * Get the path of a recording segment, without file extension.
+         * @param path - Recording directory
+         * @param seq  - Segment sequence number
+         */
+        std::string recording_segment_path(const std::string& path, uint32_t seq);
+
+        /**
+         * Create a frame recorder if the ingestor configuration contains a
+         * "recorder" object.
+         * @param config - Ingestor configuration
+         * @return FrameRecorder or NULL if recording is not configured
+         */
+        FrameRecorder* get_frame_recorder(config_t* config);
+
+    } // vi
+} // eii
+
+#endif // _EII_VI_FRAME_RECORDER_H
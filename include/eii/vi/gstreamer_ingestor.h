@@ -27,16 +27,101 @@
 #ifndef _EII_VI_GSTREAMER_H
 #define _EII_VI_GSTREAMER_H
 
+#include <string>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
 #include <gst/gst.h>
+#include <gst/video/video.h>
 #include <glib.h>
 #include <eii/utils/thread_safe_queue.h>
 #include <eii/utils/json_config.h>
 #include <eii/udf/frame.h>
 #include "eii/vi/ingestor.h"
+#include "eii/vi/latency_histogram.h"
+
+#define GVA_META_FORMAT "gva_meta_format"
+#define GVA_META_FORMAT_JSON "json"
+#define GVA_META_FORMAT_BINARY "binary"
+#define GVA_RAW_TENSORS "gva_raw_tensors"
+
+#define LATENCY_MODE "latency_mode"
+#define LATENCY_MODE_DEFAULT "default"
+#define LATENCY_MODE_LIVE "live"
+#define LIVE_MAX_BUFFERS "live_max_buffers"
+#define LATENCY_REPORT_INTERVAL "latency_report_interval"
+
+#define RECONNECT "reconnect"
+#define RECONNECT_STALL_TIMEOUT "stall_timeout_ms"
+#define RECONNECT_BACKOFF_INITIAL "backoff_initial_ms"
+#define RECONNECT_BACKOFF_MAX "backoff_max_ms"
+#define RECONNECT_STANDBY "standby"
+
+#define FRAME_RATE_CONTROL "frame_rate_control"
+#define FRAME_RATE_MIN "min_fps"
+#define FRAME_RATE_MAX "max_fps"
+#define FRAME_RATE_INTERVAL "interval_ms"
+#define FRAME_RATE_HIGH_WATERMARK "high_watermark"
+#define FRAME_RATE_LOW_WATERMARK "low_watermark"
+#define FRAME_RATE_INCREASE_STEP "increase_step"
+#define FRAME_RATE_DECREASE_FACTOR "decrease_factor"
+
+// Binary GVA metadata layout, all values are little endian. See
+// docs/gva_doc.md for the description of the fields.
+#define GVA_META_BIN_MAGIC "GVAM"
+#define GVA_META_BIN_VERSION 1
+#define GVA_META_BIN_HEADER_SIZE 32
+#define GVA_META_BIN_ROI_SIZE 24
+#define GVA_META_BIN_TENSOR_SIZE 24
+#define GVA_META_BIN_STRINGS_SIZE_OFFSET 20
+
+// Name of the appsink feeding the UDF input queue of the ingestor
+#define MAIN_SINK "sink"
 
 namespace eii {
     namespace vi {
 
+        class GstreamerIngestor;
+
+        /**
+         * Appsink of the pipeline and the queue its frames are pushed to,
+         * along with the caps negotiated on it.
+         */
+        struct GstreamerStream {
+            GstreamerIngestor* ingestor;
+
+            // Name of the appsink element
+            std::string sink_name;
+
+            // Queue the frames are pushed to, NULL for the UDF input queue
+            // of the ingestor
+            FrameQueue* queue;
+
+            // Frame count
+            int64_t frame_count;
+
+            // Negotiated caps of the samples, parsed once per caps change.
+            // A reference is held on caps so that the pointer comparison
+            // cannot match recycled caps.
+            GstCaps* caps;
+            GstVideoInfo video_info;
+            int frame_width;
+            int frame_height;
+            int frame_channels;
+            bool encodable;
+
+            // Pixel format of compressed samples, e.g. image/jpeg samples
+            // of an MJPEG camera, which are passed on as is. NULL for raw
+            // video samples.
+            const char* compressed_format;
+
+            GstreamerStream(GstreamerIngestor* ingestor, const std::string& sink_name, FrameQueue* queue) :
+                ingestor(ingestor), sink_name(sink_name), queue(queue), frame_count(0),
+                caps(NULL), frame_width(0), frame_height(0), frame_channels(0),
+                encodable(false), compressed_format(NULL) {}
+        };
+
         /**
          * GStreamer Ingestor
          */
@@ -45,21 +130,178 @@ namespace eii {
             private:
                 // Gstreamer state/elements
                 GstElement* m_gst_pipeline;
-                GstElement* m_sink;
                 guint m_bus_watch_id;
 
                 // Glib main loop
                 GMainLoop* m_loop;
 
-                // Frame count
-                int64_t m_frame_count;
+                // Appsinks of the pipeline, the first one is MAIN_SINK
+                std::vector<GstreamerStream*> m_streams;
+
+                // Attach the GVA metadata in the binary instead of the JSON
+                // format
+                bool m_gva_meta_binary;
+
+                // Names or layer names of the GVA tensors whose raw data is
+                // attached to the frames
+                std::vector<std::string> m_raw_tensors;
+
+                // Low latency live mode, see configure_live()
+                bool m_live;
+                guint m_live_max_buffers;
+
+                // Glass to ingest latency of the frames in live mode, for
+                // the current report interval and since the start
+                LatencyHistogram m_latency;
+                LatencyHistogram m_latency_total;
+                std::chrono::seconds m_latency_report_interval;
+                std::chrono::steady_clock::time_point m_latency_report_time;
+
+                // Rebuild the pipeline on end of stream, errors and stalls
+                // instead of stopping the ingestion
+                bool m_reconnect;
+                int m_stall_timeout_ms;
+                int m_backoff_initial_ms;
+                int m_backoff_max_ms;
+
+                // Keep a prerolled standby pipeline to fail over to
+                bool m_standby;
+                GstElement* m_standby_pipeline;
+
+                // Stall watchdog state, the time of the last frame is taken
+                // from the steady clock
+                guint m_watchdog_id;
+                std::atomic<int64_t> m_last_frame_ns;
+                std::atomic<bool> m_frame_received;
+
+                // Closed loop control of the acquisition frame rate of a
+                // gencamsrc source from the UDF input queue backpressure,
+                // see control_frame_rate()
+                bool m_fps_control;
+                double m_fps_min;
+                double m_fps_max;
+                int m_fps_interval_ms;
+                double m_fps_high_watermark;
+                double m_fps_low_watermark;
+                double m_fps_increase_step;
+                double m_fps_decrease_factor;
+                size_t m_queue_capacity;
+
+                // Controlled source of the running pipeline, its current
+                // frame rate and the queue wait time at the last update
+                GstElement* m_fps_source;
+                double m_fps;
+                int64_t m_fps_last_wait_ns;
+                guint m_fps_control_id;
+
+                // Guards creation and quitting of the main loop
+                std::mutex m_loop_mtx;
+
+                // Signalled when run() has torn down the pipeline
+                std::mutex m_run_mtx;
+                std::condition_variable m_run_cv;
+                bool m_run_done;
+
+                // Signalled by stop() to interrupt the reconnection backoff,
+                // used with m_run_mtx
+                std::condition_variable m_stop_cv;
+
+                /**
+                 * Gstreamer initialization function. Creates the main loop
+                 * and either takes over the standby pipeline or loads a new
+                 * pipeline.
+                 */
+                void gstreamer_init();
+
+                /**
+                 * Load the pipeline, connect its appsinks and preroll it to
+                 * the PAUSED state.
+                 * @param wait - Wait for the preroll to complete
+                 * @return The pipeline or NULL if it could not be loaded
+                 */
+                GstElement* create_pipeline(bool wait);
+
+                /**
+                 * Stop and release a pipeline created by create_pipeline().
+                 */
+                void destroy_pipeline(GstElement*& pipeline);
+
+                /**
+                 * Configure the appsink of a stream and connect it to
+                 * new_sample().
+                 * @return false if the appsink is not part of the pipeline
+                 */
+                bool connect_stream(GstElement* pipeline, GstreamerStream* stream);
+
+                /**
+                 * Stop the pipeline and release all Gstreamer state created
+                 * by gstreamer_init().
+                 */
+                void gstreamer_deinit();
+
+                /**
+                 * Configure the pipeline for low latency live ingestion. The
+                 * appsink does not synchronize on the clock and only keeps
+                 * the latest buffers, queues are made leaky and a leaky
+                 * queue is inserted in front of the appsink.
+                 */
+                void configure_live(GstElement* pipeline, GstElement* sink);
+
+                /**
+                 * Record the glass to ingest latency of a frame and
+                 * periodically log the latency histogram.
+                 * @param latency_us - Latency in microseconds
+                 */
+                void record_latency(uint64_t latency_us);
+
+                /**
+                 * Parse and validate newly negotiated sample caps.
+                 * @param stream - Stream the sample was received on
+                 * @param caps   - Caps of the current sample
+                 * @return false if the caps are not supported
+                 */
+                bool update_caps(GstreamerStream* stream, GstCaps* caps);
+
+                static GstFlowReturn new_sample(GstElement* sink, GstreamerStream* stream);
 
                 /**
-                 * Gstreamer initialization function
+                 * Gstreamer bus event callback, quits the main loop on end
+                 * of stream and errors.
                  */
-                void gstreamer_init(bool snapshot_mode=false);
+                static gboolean bus_call(GstBus* bus, GstMessage* msg, gpointer data);
 
-                static GstFlowReturn new_sample(GstElement* sink, GstreamerIngestor* ctx);
+                /**
+                 * Synchronous bus handler, called from the streaming thread
+                 * posting a stream status message. Places the streaming
+                 * threads as they start.
+                 */
+                static GstBusSyncReply stream_status(GstBus* bus, GstMessage* msg, gpointer data);
+
+                /**
+                 * Periodic callback quitting the main loop if no frame was
+                 * received within the stall timeout.
+                 */
+                static gboolean watchdog(gpointer data);
+
+                /**
+                 * Start controlling the frame rate of the gencamsrc element
+                 * of the running pipeline, if there is one.
+                 */
+                void start_frame_rate_control();
+
+                /**
+                 * Stop controlling the frame rate and release the source.
+                 */
+                void stop_frame_rate_control();
+
+                /**
+                 * Periodic frame rate controller. The frame rate is reduced
+                 * multiplicatively when the UDF input queue fills beyond
+                 * the high watermark or ingestion blocked on it, and
+                 * increased additively when it drains below the low
+                 * watermark.
+                 */
+                static gboolean control_frame_rate(gpointer data);
 
             protected:
                 /**
@@ -90,12 +332,65 @@ namespace eii {
                 ~GstreamerIngestor();
 
                 /**
-                 * Overridden stop method.
+                 * Overridden stop method. Waits a bounded time for the
+                 * pipeline to shut down.
                  */
                 void stop() override;
 
+                /**
+                 * Overridden add_stream method. Frames of the appsink with
+                 * the given name are pushed to @p queue.
+                 */
+                void add_stream(const std::string& name, FrameQueue* queue) override;
+
+                /**
+                 * Overridden set_queue method, the frame rate control
+                 * watermarks follow the capacity of the new queue.
+                 */
+                void set_queue(FrameQueue* frame_queue, size_t queue_size) override;
+
         };
 
+        /**
+         * Convert the GVA regions of interest and tensors attached to a
+         * GStreamer buffer into msgbus metadata under the "gva_meta" key.
+         * @param buf       - GStreamer buffer carrying the GVA metadata
+         * @param meta_data - Frame metadata envelope to add "gva_meta" to
+         * @return true on success, false otherwise
+         */
+        bool add_gva_meta(GstBuffer* buf, msg_envelope_t* meta_data);
+
+        /**
+         * Encode the GVA regions of interest and tensors attached to a
+         * GStreamer buffer into the compact binary GVA metadata format.
+         * @param buf - GStreamer buffer carrying the GVA metadata
+         * @param out - Output buffer
+         * @return true on success, false otherwise
+         */
+        bool encode_gva_meta_binary(GstBuffer* buf, std::string& out);
+
+        /**
+         * Binary counterpart of add_gva_meta(). Adds the base64 encoded
+         * binary GVA metadata under the "gva_meta" key and sets
+         * "gva_meta_format" to "binary".
+         * @param buf       - GStreamer buffer carrying the GVA metadata
+         * @param meta_data - Frame metadata envelope to add "gva_meta" to
+         * @return true on success, false otherwise
+         */
+        bool add_gva_meta_binary(GstBuffer* buf, msg_envelope_t* meta_data);
+
+        /**
+         * Attach the raw data of the selected GVA tensors to a frame as
+         * additional frames without copying, and describe them under the
+         * "gva_tensors" metadata key. The tensor frames hold a reference
+         * on the sample which keeps the tensor data alive.
+         * @param sample   - GStreamer sample carrying the GVA metadata
+         * @param frame    - Frame to attach the tensors to
+         * @param selected - Names or layer names of the tensors to attach
+         * @return true on success, false otherwise
+         */
+        bool add_gva_raw_tensors(GstSample* sample, udf::Frame* frame, const std::vector<std::string>& selected);
+
     } // vi
 } // eii
 
@@ -30,11 +30,21 @@
 #include <string>
 #include <thread>
 #include <atomic>
+#include <mutex>
 #include <eii/utils/thread_safe_queue.h>
 #include <eii/udf/frame.h>
 #include <eii/utils/config.h>
 #include <eii/utils/profiling.h>
 #include <chrono>
+#include "eii/vi/frame_recorder.h"
+#include "eii/vi/roi_cropper.h"
+#include "eii/vi/frame_pyramid.h"
+#include "eii/vi/motion_gate.h"
+#include "eii/vi/duplicate_filter.h"
+#include "eii/vi/thread_placement.h"
+#include "eii/vi/frame_allocator.h"
+#include "eii/vi/compressed_frame.h"
+#include "eii/vi/video_decoder.h"
 
 #define TYPE1 "type"
 #define PIPELINE "pipeline"
@@ -113,6 +123,17 @@ namespace eii {
                 // Underlying ingestion thread
                 std::thread* m_th;
 
+                // Placement of the ingestion thread and of the threads
+                // capturing frames on its behalf
+                ThreadPlacement m_placement;
+
+                // Whether frames are captured on the ingestion thread, which
+                // then gets the real-time priority of the placement
+                bool m_capture_thread;
+
+                // Shared huge page frame allocator, NULL if not configured
+                FrameAllocator* m_allocator;
+
                 // Flag indicating the ingestor thread (running run()) has started & is running;
                 std::atomic<bool> m_running;
 
@@ -122,16 +143,24 @@ namespace eii {
                 // Flag to stop the ingestor from running
                 std::atomic<bool> m_stop;
 
+                // Flag set if stop() gave up waiting for the ingestion
+                // thread, which is then still running detached
+                std::atomic<bool> m_hung;
+
                 // UDF input queue
                 FrameQueue* m_udf_input_queue;
 
+                // Total time push_frame() waited on a full UDF input queue
+                std::atomic<int64_t> m_queue_wait_ns;
+
                 // Queue blocked variable
                 std::string m_ingestor_block_key;
 
                 // Snapshot condition variable
                 std::condition_variable& m_snapshot_cv;
 
-                // Encoding details
+                // Encoding details, may be changed while ingesting
+                std::mutex m_enc_mtx;
                 EncodeType m_enc_type;
                 int m_enc_lvl;
 
@@ -139,7 +168,7 @@ namespace eii {
                 std::string m_pipeline;
 
                 // poll interval
-                double m_poll_interval;
+                std::atomic<double> m_poll_interval;
 
                 // profiling
                 Profiling* m_profile = NULL;
@@ -147,6 +176,38 @@ namespace eii {
                 // Flag for snapshot mode
                 bool m_snapshot;
 
+                // Optional raw frame recorder
+                FrameRecorder* m_recorder;
+
+                // Regions of interest cropped out of the frames
+                RoiCropper* m_roi_cropper;
+
+                // Optional downscaled variants attached to the frames
+                FramePyramid* m_pyramid;
+
+                // Optional gate dropping or marking static frames
+                MotionGate* m_motion_gate;
+
+                // Optional filter dropping or marking duplicate frames
+                DuplicateFilter* m_duplicate_filter;
+
+                // "decode_compressed" config, -1 if not set in which case
+                // compressed frames are decoded if UDFs are configured
+                int m_decode_config;
+
+                // Decode compressed frames, e.g. of MJPEG cameras, before
+                // they are handed over to the UDFs
+                std::atomic<bool> m_decode_compressed;
+
+                // Decoder of H.264/HEVC frames, created once the first one
+                // is decoded
+                VideoDecoder* m_decoder;
+
+                // Time of the last start(), used to log the time until the
+                // first frame is ingested
+                std::chrono::steady_clock::time_point m_start_time;
+                std::atomic<bool> m_first_frame_pending;
+
                 /**
                  * Ingestion thread run method
                  */
@@ -158,6 +219,53 @@ namespace eii {
                  */
                 virtual void read(udf::Frame*& frame) = 0;
 
+                /**
+                 * Hand a frame over to the UDF input queue, blocking if the
+                 * queue is full. Applies the configured encoding, records
+                 * the frame if a recorder is configured, drops duplicate
+                 * and static frames if configured to, crops the
+                 * configured regions of interest and attaches the pyramid
+                 * levels. Compressed frames are either decoded first or
+                 * passed on as is, skipping the stages working on pixels.
+                 * @param frame         - Frame to push, owned by the queue
+                 *                        afterwards
+                 * @param encode        - Apply the configured encoding, false
+                 *                        for pixel formats which cannot be
+                 *                        encoded
+                 * @param capture_ts_ns - Wall clock capture time of the frame
+                 *                        in nanoseconds for the recording, 0
+                 *                        if the source does not provide one
+                 */
+                void push_frame(udf::Frame* frame, bool encode=true,
+                                uint64_t capture_ts_ns=0);
+
+                /**
+                 * Hand a frame over to the given queue, see push_frame().
+                 * Only frames pushed to the UDF input queue are recorded.
+                 * @param frame         - Frame to push, owned by the queue
+                 *                        afterwards
+                 * @param queue         - Queue to push the frame to
+                 * @param encode        - Apply the configured encoding
+                 * @param capture_ts_ns - Wall clock capture time of the frame
+                 *                        in nanoseconds for the recording
+                 */
+                void push_frame(udf::Frame* frame, FrameQueue* queue, bool encode,
+                                uint64_t capture_ts_ns=0);
+
+                /**
+                 * Release the frame processing stages, i.e. the recorder, ROI
+                 * cropper, pyramid, motion gate, duplicate filter and decoder.
+                 */
+                void release_stages();
+
+                /**
+                 * Decode a compressed frame in place for the UDFs.
+                 * @param frame - Compressed frame
+                 * @param codec - Encoding of the frame
+                 * @return false if the frame could not be decoded
+                 */
+                bool decode_frame(udf::Frame* frame, const char* codec);
+
                 /**
                  * Private @c Ingestor assignment operator.
                  */
@@ -189,6 +297,66 @@ namespace eii {
                  * Stop the ingestor.
                  */
                 virtual void stop() = 0;
+
+                /**
+                 * Change the encoding applied to frames, takes effect from
+                 * the next frame.
+                 * @param enc_type - Frame encoding type
+                 * @param enc_lvl  - Frame encoding level
+                 */
+                void set_encoding(EncodeType enc_type, int enc_lvl);
+
+                /**
+                 * Change the poll interval, takes effect from the next frame.
+                 * @param poll_interval - Poll interval in seconds
+                 */
+                void set_poll_interval(double poll_interval);
+
+                /**
+                 * Change the regions of interest, takes effect from the next
+                 * frame.
+                 *
+                 * \note Throws a const char* error if the config is invalid,
+                 *      the current regions are kept in that case.
+                 *
+                 * @param roi - ROI config object, NULL to stop cropping
+                 */
+                void set_roi(const config_value_t* roi);
+
+                /**
+                 * Set whether UDFs are configured, which decides whether
+                 * compressed frames are decoded unless the ingestor config
+                 * explicitly sets "decode_compressed".
+                 * @param configured - Whether UDFs process the frames
+                 */
+                void set_udfs_configured(bool configured);
+
+                /**
+                 * Change the UDF input queue frames are pushed to. Must only
+                 * be called while the ingestor is stopped.
+                 * @param frame_queue - New UDF input queue
+                 * @param queue_size  - Capacity of the new queue
+                 */
+                virtual void set_queue(FrameQueue* frame_queue, size_t queue_size);
+
+                /**
+                 * Push the frames of an additional output of the source,
+                 * e.g. a second appsink of a GStreamer pipeline, to their
+                 * own queue. Must be called before the ingestor is started.
+                 *
+                 * \note Throws a const char* error if the ingestor does not
+                 *      support multiple outputs or the output does not exist.
+                 *
+                 * @param name  - Name of the output
+                 * @param queue - Queue the frames of the output are pushed to
+                 */
+                virtual void add_stream(const std::string& name, FrameQueue* queue);
+
+                /**
+                 * Check whether the last stop() timed out, in which case the
+                 * ingestor must not be reused.
+                 */
+                bool is_hung() const;
         };
         /**
          * Method to get the ingestor object based on the ingestor type
@@ -202,6 +370,17 @@ namespace eii {
          */
         Ingestor* get_ingestor(config_t* ingestor_cfg, FrameQueue* udf_input_queue, const char* type, std::string service_name, std::condition_variable& snapshot_cv, EncodeType enc_type, int enc_lvl);
 
+        /**
+         * Milliseconds elapsed since the given time point
+         * @param start - Start of the measured interval
+         */
+        int64_t elapsed_ms(std::chrono::steady_clock::time_point start);
+
+        /**
+         * Milliseconds elapsed since the process started
+         */
+        int64_t uptime_ms();
+
     } // vi
 } // eii
 #endif // _EII_VI_INGESTOR_H
@@ -0,0 +1,108 @@
+// Copyright (c) 2021 Intel Corporation.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM,OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+
+/**
+ * @file
+ * @brief Latency histogram interface
+ */
+
+#ifndef _EII_VI_LATENCY_HISTOGRAM_H
+#define _EII_VI_LATENCY_HISTOGRAM_H
+
+#include <stdint.h>
+#include <atomic>
+#include <string>
+
+// Each power of two range is split into 2^VI_HIST_SUB_BITS buckets, which
+// bounds the relative error of the reported percentiles to 12.5%
+#define VI_HIST_SUB_BITS 3
+#define VI_HIST_SUB_BUCKETS (1 << VI_HIST_SUB_BITS)
+#define VI_HIST_NUM_BUCKETS ((64 - VI_HIST_SUB_BITS + 1) * VI_HIST_SUB_BUCKETS)
+
+namespace eii {
+    namespace vi {
+
+        /**
+         * Fixed size, log-linear histogram of latencies in microseconds.
+         * Recording is lock free and may be done from several threads.
+         */
+        class LatencyHistogram {
+            private:
+                std::atomic<uint64_t> m_buckets[VI_HIST_NUM_BUCKETS];
+                std::atomic<uint64_t> m_count;
+                std::atomic<uint64_t> m_max;
+
+                /**
+                 * Private @c LatencyHistogram copy constructor.
+                 */
+                LatencyHistogram(const LatencyHistogram& src);
+
+                /**
+                 * Private @c LatencyHistogram assignment operator.
+                 */
+                LatencyHistogram& operator=(const LatencyHistogram& src);
+
+            public:
+                /**
+                 * Constructor
+                 */
+                LatencyHistogram();
+
+                /**
+                 * Record a latency.
+                 * @param value_us - Latency in microseconds
+                 */
+                void record(uint64_t value_us);
+
+                /**
+                 * Number of recorded latencies.
+                 */
+                uint64_t count() const;
+
+                /**
+                 * Largest recorded latency in microseconds.
+                 */
+                uint64_t max() const;
+
+                /**
+                 * Get a percentile of the recorded latencies.
+                 * @param percentile - Percentile in the range [0, 100]
+                 * @return Upper bound in microseconds of the bucket holding
+                 *         the percentile, 0 if nothing was recorded
+                 */
+                uint64_t percentile(double percentile) const;
+
+                /**
+                 * Clear all recorded latencies.
+                 */
+                void reset();
+
+                /**
+                 * One line summary with the count, common percentiles and
+                 * the maximum, for logging.
+                 */
+                std::string summary() const;
+        };
+
+    } // vi
+} // eii
+
+#endif // _EII_VI_LATENCY_HISTOGRAM_H
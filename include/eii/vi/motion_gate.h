@@ -0,0 +1,134 @@
+// Copyright (c) 2021 Intel Corporation.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM,OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+
+/**
+ * @file
+ * @brief Motion gate skipping static frames before the UDFs
+ */
+
+#ifndef _EII_VI_MOTION_GATE_H
+#define _EII_VI_MOTION_GATE_H
+
+#include <string>
+#include <chrono>
+#include <atomic>
+#include <opencv2/opencv.hpp>
+#include <eii/utils/config.h>
+#include <eii/udf/frame.h>
+
+#define MOTION_GATE "motion_gate"
+#define MOTION_GATE_ACTION_DROP "drop"
+#define MOTION_GATE_ACTION_MARK "mark"
+
+// Metadata keys set by the motion gate
+#define MOTION_SCORE_KEY "motion_score"
+#define MOTION_STATIC_KEY "motion_static"
+
+namespace eii {
+    namespace vi {
+
+        /**
+         * Gates frames on the amount of change against a reference frame.
+         *
+         * The change score is the fraction of pixels of a downscaled luma
+         * plane whose absolute difference to the reference exceeds a pixel
+         * threshold. The gate opens once the score reaches the threshold,
+         * stays open while it is above the release threshold and for a
+         * number of hold frames afterwards. While closed, a frame is still
+         * let through at the keep alive interval. The reference is the last
+         * frame let through, so slow changes add up until they open the gate.
+         */
+        class MotionGate {
+            private:
+                // Config
+                double m_threshold;
+                double m_release_threshold;
+                double m_pixel_threshold;
+                int m_hold_frames;
+                std::chrono::milliseconds m_keep_alive;
+                int m_scale;
+                bool m_drop;
+
+                // Gate state, only accessed from the ingestion thread
+                cv::Mat m_reference;
+                cv::Mat m_luma;
+                cv::Mat m_diff;
+                bool m_open;
+                int m_hold;
+                std::chrono::steady_clock::time_point m_last_pass;
+
+                // Statistics, logged periodically
+                uint64_t m_passed;
+                uint64_t m_gated;
+                std::chrono::steady_clock::time_point m_report_time;
+
+                // Log unsupported frames only once
+                std::atomic<bool> m_format_warned;
+
+                /**
+                 * Downscaled luma plane of the first frame of @p frame into
+                 * m_luma.
+                 * @return false if the pixel format is not supported
+                 */
+                bool extract_luma(udf::Frame* frame);
+
+            public:
+                /**
+                 * Constructor
+                 *
+                 * \note Throws a const char* error if the config is invalid.
+                 *
+                 * @param config - Motion gate config object
+                 */
+                MotionGate(const config_value_t* config);
+
+                /**
+                 * Change score of a downscaled luma plane against another
+                 * one of the same size.
+                 * @param luma      - Current luma plane
+                 * @param reference - Reference luma plane
+                 * @param diff      - Scratch buffer
+                 * @return Fraction of changed pixels
+                 */
+                double score(const cv::Mat& luma, const cv::Mat& reference, cv::Mat& diff);
+
+                /**
+                 * Score a frame and update the gate.
+                 * @param frame - Frame to check
+                 * @return false if the frame is static and has to be dropped
+                 */
+                bool check(udf::Frame* frame);
+        };
+
+        /**
+         * Create the motion gate configured in the ingestor config.
+         *
+         * \note Throws a const char* error if the config is invalid.
+         *
+         * @param config - Ingestor config
+         * @return The motion gate or NULL if none is configured
+         */
+        MotionGate* get_motion_gate(config_t* config);
+
+    } // vi
+} // eii
+
+#endif // _EII_VI_MOTION_GATE_H
@@ -57,6 +57,20 @@ namespace eii {
 
             bool m_double_frames;
 
+            // Pass the JPEG images of MJPEG cameras on without decoding
+            bool m_jpeg_passthrough;
+
+            // Geometry of the last frame read, the next frame is read into
+            // a block of the frame allocator of this size
+            int m_frame_rows;
+            int m_frame_cols;
+            int m_frame_type;
+
+            /**
+             * Open the video capture of the pipeline.
+             */
+            void open_capture();
+
         protected:
             /**
              * Overridden run method.
@@ -0,0 +1,272 @@
+// Copyright (c) 2021 Intel Corporation.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM,OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+
+/**
+ * @file
+ * @brief Output router interface, publishes the frames of a queue on several
+ * outputs with their own frame rate, resolution and encoding
+ */
+
+#ifndef _EII_VI_OUTPUT_ROUTER_H
+#define _EII_VI_OUTPUT_ROUTER_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <opencv2/opencv.hpp>
+#include <eii/utils/config.h>
+#include <eii/udf/frame.h>
+#include <eii/udf/udf_manager.h>
+#include "eii/vi/ingestor.h"
+#include "eii/vi/shm_ring.h"
+#include "eii/vi/video_encoder.h"
+#include "eii/vi/frame_compressor.h"
+
+#define OUTPUTS "outputs"
+
+namespace eii {
+    namespace vi {
+
+        /**
+         * Variant of a frame published by one or more outputs: the frame as
+         * it was ingested, or downscaled and/or encoded.
+         */
+        struct FrameVariant {
+            // Source frame, only referenced by the variant if its data is
+            // published as is
+            std::shared_ptr<udf::Frame> source;
+
+            // Downscaled pixels and encoded bytes
+            cv::Mat pixels;
+            std::vector<unsigned char> encoded;
+
+            // Published data
+            const void* data;
+            size_t len;
+            int width;
+            int height;
+            int channels;
+            EncodeType enc_type;
+            int enc_lvl;
+
+            // Video codec or compression of the data, empty if it is
+            // neither video encoded nor compressed
+            std::string codec;
+            // Whether a video encoded frame is a keyframe
+            bool keyframe;
+            // Compression level and filter, NULL if not filtered
+            int codec_level;
+            const char* filter;
+
+            // Encoding of the source frame if its compressed data, e.g.
+            // the JPEG image of an MJPEG camera, is published as is
+            const char* source_codec;
+
+            // Size of the image held by the compressed source data, 0 if
+            // unknown
+            int image_width;
+            int image_height;
+        };
+
+        /**
+         * Message published by an output, the metadata of the source frame
+         * along with a frame variant. The variant is shared with the other
+         * outputs publishing it and is not copied. If the variant has been
+         * written to shared memory, only its slot is published.
+         */
+        class OutputFrame : public udf::Serializable {
+            private:
+                std::shared_ptr<FrameVariant> m_variant;
+
+                // Metadata of the source frame as JSON
+                std::shared_ptr<std::string> m_meta;
+
+                // Image handle of the source frame
+                std::string m_img_handle;
+
+                // Shared memory socket and slot the variant has been
+                // written to, socket empty if it is published inline
+                std::string m_shm_socket;
+                ShmSlot m_shm_slot;
+
+                /**
+                 * Put the metadata into a message.
+                 * @return NULL if it failed, the message is destroyed
+                 */
+                msg_envelope_t* serialize_meta(msg_envelope_t* msg);
+
+            public:
+                OutputFrame(std::shared_ptr<FrameVariant> variant, std::shared_ptr<std::string> meta, const std::string& img_handle);
+
+                /**
+                 * Publish the slot the variant has been written to instead
+                 * of the variant data.
+                 * @param socket - Socket of the shared memory ring
+                 * @param slot   - Slot the variant has been written to
+                 */
+                void set_shm_slot(const std::string& socket, const ShmSlot& slot);
+
+                /**
+                 * Overridden serialize method. The object is owned by the
+                 * returned envelope and released along with it, or released
+                 * once the envelope has been created if it has no blob.
+                 */
+                msg_envelope_t* serialize() override;
+        };
+
+        /**
+         * Publishes the frames of a queue on several outputs. Every output
+         * has its own publisher and can limit the frame rate, downscale and
+         * encode the frames. Outputs requiring the same variant of a frame
+         * share it.
+         */
+        class OutputRouter {
+            public:
+                /**
+                 * Creates the publisher of an output
+                 * @param publisher - Name of the Publishers interface
+                 * @param queue     - Queue the publisher takes messages from
+                 */
+                typedef std::function<msgbus::Publisher*(const std::string& publisher, msgbus::MessageQueue* queue)> PublisherFactory;
+
+            private:
+                /**
+                 * Output configuration and state
+                 */
+                struct Output {
+                    std::string publisher_name;
+
+                    // Minimum time between published frames, zero to
+                    // publish every frame
+                    std::chrono::steady_clock::duration interval;
+                    std::chrono::steady_clock::time_point next;
+
+                    // Maximum resolution, zero if not limited
+                    int max_width;
+                    int max_height;
+
+                    EncodeType enc_type;
+                    int enc_lvl;
+
+                    // H.264/HEVC encoder of the output, NULL if its
+                    // frames are not video encoded
+                    VideoEncoder* encoder;
+
+                    // LZ4/zstd compressor of the output, NULL if its
+                    // frames are not compressed
+                    FrameCompressor* compressor;
+
+                    msgbus::MessageQueue* queue;
+                    msgbus::Publisher* publisher;
+
+                    // Shared memory ring the frames are written to, NULL
+                    // if they are published inline
+                    ShmRing* shm;
+
+                    // Set once a frame could not be downscaled or encoded
+                    bool conversion_warned;
+                };
+
+                std::vector<Output> m_outputs;
+
+                // Queue the frames are taken from
+                FrameQueue* m_input_queue;
+
+                std::thread* m_th;
+                std::atomic<bool> m_stop;
+
+                /**
+                 * Router thread run method
+                 */
+                void run();
+
+                /**
+                 * Publish a frame on every output it is due on.
+                 */
+                void route(udf::Frame* frame);
+
+                /**
+                 * Create the variant of a frame required by an output.
+                 * @return NULL if the frame could not be converted
+                 */
+                std::shared_ptr<FrameVariant> create_variant(const std::shared_ptr<udf::Frame>& source, int width, int height, EncodeType enc_type, int enc_lvl);
+
+                /**
+                 * Video encode a variant for an output. Video encoded
+                 * variants are not shared, every output has its own stream.
+                 * @return NULL if the frame could not be encoded
+                 */
+                std::shared_ptr<FrameVariant> encode_variant(Output& output, const std::shared_ptr<FrameVariant>& raw);
+
+                /**
+                 * Compress a variant for an output.
+                 * @return NULL if the frame could not be compressed
+                 */
+                std::shared_ptr<FrameVariant> compress_variant(const FrameCompressor& compressor, const std::shared_ptr<FrameVariant>& raw, const char* pixel_format);
+
+            public:
+                /**
+                 * Constructor
+                 * @param outputs          - "outputs" array of the
+                 *                           VideoIngestion config
+                 * @param input_queue      - Queue the frames are taken from
+                 * @param queue_size       - Size of the output queues
+                 * @param create_publisher - Creates the output publishers
+                 */
+                OutputRouter(const config_value_t* outputs, FrameQueue* input_queue, size_t queue_size, PublisherFactory create_publisher);
+
+                /**
+                 * Destructor
+                 */
+                ~OutputRouter();
+
+                /**
+                 * Start the publishers and the router thread.
+                 */
+                void start();
+
+                /**
+                 * Stop the router thread and the publishers.
+                 */
+                void stop();
+
+                /**
+                 * Change the queue the frames are taken from. Must only be
+                 * called while the router is stopped.
+                 */
+                void set_queue(FrameQueue* input_queue);
+
+                /**
+                 * Encode the next frame of every video encoded output as a
+                 * keyframe, e.g. for subscribers joining a stream.
+                 * @return false if no output is video encoded
+                 */
+                bool force_keyframe();
+        };
+
+    } // vi
+} // eii
+
+#endif // _EII_VI_OUTPUT_ROUTER_H
@@ -105,6 +105,20 @@ namespace eii {
            bool check_imu_is_supported();
         };
 
+        /**
+         * Add the RealSense stream intrinsics to the frame meta-data as
+         * <prefix>_width, <prefix>_height, <prefix>_ppx, <prefix>_ppy,
+         * <prefix>_fx, <prefix>_fy and <prefix>_model.
+         *
+         * \note Throws a const char* error on failure.
+         *
+         * @param meta          - Frame meta-data envelope
+         * @param prefix        - Key prefix, e.g. "rs2_depth_intrinsics"
+         * @param intrinsics    - Stream intrinsics
+         */
+        void add_rs2_intrinsics_meta(msg_envelope_t* meta, const char* prefix,
+                                     const rs2_intrinsics& intrinsics);
+
     } // vi
 } // eii
 
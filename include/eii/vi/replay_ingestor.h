@@ -0,0 +1,128 @@
+// Copyright (c) 2021 Intel Corporation.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM,OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+/**
+ * @file
+ * @brief Replay ingestor interface
+ */
+
+#ifndef _EII_VI_REPLAY_H
+#define _EII_VI_REPLAY_H
+
+#include <memory>
+#include <vector>
+#include <eii/utils/thread_safe_queue.h>
+#include "eii/vi/ingestor.h"
+#include "eii/vi/frame_recorder.h"
+
+namespace eii {
+    namespace vi {
+
+        /**
+         * Memory mapped segment of a recording. The mapping is released once
+         * the ingestor and every frame referencing it are done with it.
+         */
+        struct ReplaySegment {
+            uint8_t* addr;
+            size_t size;
+            std::vector<RecIndexEntry> index;
+
+            ReplaySegment() : addr(NULL), size(0) {}
+            ~ReplaySegment();
+        };
+
+        /**
+         * Replay ingestor, ingests a recording made by the frame recorder.
+         * Frames are served directly from the memory mapped segments
+         * without copying.
+         */
+        class ReplayIngestor : public Ingestor {
+        private:
+            // Recording directory
+            std::string m_path;
+
+            // Segment sequence numbers of the recording
+            std::vector<uint32_t> m_segments;
+
+            // Position in the recording
+            size_t m_seg_pos;
+            size_t m_record_pos;
+            std::shared_ptr<ReplaySegment> m_segment;
+
+            // Replay with the recorded frame timing instead of as fast
+            // as possible
+            bool m_realtime;
+
+            // Restart from the first segment at the end of the recording
+            bool m_loop_video;
+
+            // Pacing reference points
+            uint64_t m_pace_ts;
+            std::chrono::steady_clock::time_point m_pace_start;
+
+            /**
+             * Map the given segment and load its index.
+             */
+            std::shared_ptr<ReplaySegment> open_segment(uint32_t seq);
+
+            /**
+             * Sleep until the recorded capture time of a record is due.
+             */
+            void pace(uint64_t capture_ts_ns);
+
+        protected:
+            /**
+             * Overridden run method.
+             */
+            void run(bool snapshot_mode=false) override;
+
+            /**
+             * Overridden read method. Sets @p frame to NULL at the end of
+             * the recording.
+             */
+            void read(udf::Frame*& frame) override;
+
+        public:
+            /**
+             * Constructor
+             * @param config        - Ingestion config
+             * @param frame_queue   - Frame Queue context
+             * @param service_name  - Service Name env variable
+             * @param snapshot_cv   - Snapshot condition variable
+             * @param enc_type      - Frame encoding type(Optional)
+             * @param enc_lvl       - Frame encoding level(Optional)
+             */
+            ReplayIngestor(config_t* config, FrameQueue* frame_queue, std::string service_name, std::condition_variable& snapshot_cv, EncodeType enc_type, int enc_lvl);
+
+            /**
+             * Destructor
+             */
+            ~ReplayIngestor();
+
+            /**
+             * Overridden stop method.
+             */
+            void stop() override;
+        };
+
+    } // vi
+} // eii
+
+#endif // _EII_VI_REPLAY_H
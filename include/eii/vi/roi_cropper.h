@@ -0,0 +1,129 @@
+// Copyright (c) 2021 Intel Corporation.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM,OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+
+/**
+ * @file
+ * @brief Static region of interest cropping of ingested frames
+ */
+
+#ifndef _EII_VI_ROI_CROPPER_H
+#define _EII_VI_ROI_CROPPER_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <opencv2/opencv.hpp>
+#include <eii/utils/config.h>
+#include <eii/udf/frame.h>
+
+#define ROI "roi"
+#define ROI_MODE "mode"
+#define ROI_MODE_APPEND "append"
+#define ROI_MODE_REPLACE "replace"
+#define ROI_REGIONS "regions"
+
+// Metadata key describing the cropped regions
+#define ROI_META_KEY "rois"
+
+namespace eii {
+    namespace vi {
+
+        /**
+         * Named region of interest, in pixels of the ingested frame.
+         */
+        struct RoiRegion {
+            std::string name;
+            cv::Rect rect;
+        };
+
+        /**
+         * Parsed ROI config, replaced as a whole on updates.
+         */
+        struct RoiConfig {
+            std::vector<RoiRegion> regions;
+
+            // Replace the frame by its regions instead of appending them
+            bool replace;
+        };
+
+        /**
+         * Crops a configurable set of named regions of interest out of the
+         * ingested frames.
+         *
+         * In the append mode the regions are added as additional frames.
+         * They are cv::Mat ROI headers on the buffer of the ingested frame
+         * whenever the region is contiguous in memory, i.e. spans whole
+         * rows, and packed copies otherwise, since frames carry no row
+         * stride. In the replace mode the frame is replaced by packed copies
+         * of its regions. The regions are described under the "rois"
+         * metadata key.
+         */
+        class RoiCropper {
+            private:
+                // Current config, swapped as a whole by update()
+                std::mutex m_mtx;
+                std::shared_ptr<const RoiConfig> m_config;
+
+                // Log unsupported frames and empty regions only once
+                std::atomic<bool> m_format_warned;
+                std::atomic<bool> m_region_warned;
+
+                /**
+                 * Parse and validate a ROI config object.
+                 *
+                 * \note Throws a const char* error if the config is invalid.
+                 *
+                 * @param roi - ROI config, NULL for no regions
+                 */
+                static std::shared_ptr<const RoiConfig> parse(const config_value_t* roi);
+
+            public:
+                /**
+                 * Constructor
+                 * @param roi - ROI config object, NULL for no regions
+                 */
+                RoiCropper(const config_value_t* roi);
+
+                /**
+                 * Replace the regions, takes effect from the next frame. The
+                 * current regions are kept if the config is invalid.
+                 *
+                 * \note Throws a const char* error if the config is invalid.
+                 *
+                 * @param roi - ROI config object, NULL for no regions
+                 */
+                void update(const config_value_t* roi);
+
+                /**
+                 * Crop the regions out of the first frame of @p frame.
+                 * @param frame    - Frame to crop
+                 * @param enc_type - Encoding of the cropped frames
+                 * @param enc_lvl  - Encoding level of the cropped frames
+                 */
+                void crop(udf::Frame* frame, udf::EncodeType enc_type, int enc_lvl);
+        };
+
+    } // vi
+} // eii
+
+#endif // _EII_VI_ROI_CROPPER_H
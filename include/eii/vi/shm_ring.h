@@ -0,0 +1,236 @@
+// Copyright (c) 2021 Intel Corporation.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM,OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+/**
+ * @file
+ * @brief Shared memory ring the frames of an output are published through to
+ * subscribers on the same host
+ */
+
+#ifndef _EII_VI_SHM_RING_H
+#define _EII_VI_SHM_RING_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <set>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <eii/utils/config.h>
+
+#define SHARED_MEMORY "shared_memory"
+
+// Magic and version at the start of the shared memory
+#define VI_SHM_MAGIC "EIIVISHM"
+#define VI_SHM_VERSION 1
+
+// Size of the header at the start of the shared memory, the slots follow it
+#define VI_SHM_HEADER_SIZE 4096
+
+// Metadata keys of the frame descriptors published instead of the frames
+#define SHM_SOCKET "shm_socket"
+#define SHM_SLOT "shm_slot"
+#define SHM_SEQ "shm_seq"
+#define SHM_OFFSET "shm_offset"
+#define SHM_SIZE "shm_size"
+
+namespace eii {
+    namespace vi {
+
+        /**
+         * Header at the start of the shared memory. All values are in host
+         * byte order.
+         */
+        struct ShmRingHeader {
+            char magic[8];
+            uint32_t version;
+            uint32_t num_slots;
+            uint64_t slot_size;
+            // Offset of the first slot
+            uint64_t slots_offset;
+            // Offset of the num_slots 64-bit sequence numbers of the frames
+            // in the slots. A sequence number is 0 while its slot is written.
+            uint64_t seqs_offset;
+        };
+
+        /**
+         * Slot a frame has been written to
+         */
+        struct ShmSlot {
+            uint32_t index;
+            uint64_t seq;
+            // Offset and size of the frame data in the shared memory
+            uint64_t offset;
+            uint64_t size;
+        };
+
+        /**
+         * Ring of frame slots in a memfd, shared with the subscribers
+         * connected to its unix socket. Subscribers receive a read-only
+         * descriptor of the memfd when they connect, map it and release the
+         * frames they received by sending back their 64-bit sequence
+         * numbers. A slot is reused once every subscriber connected when its
+         * frame was written released it. Subscribers holding a frame past
+         * its lease are disconnected, so a stuck subscriber cannot hold up
+         * the ring.
+         *
+         * Frames are written by a single thread.
+         */
+        class ShmRing {
+            private:
+                /**
+                 * Slot state
+                 */
+                struct Slot {
+                    uint64_t seq;
+                    // Number of subscribers still holding the frame
+                    size_t refs;
+                    std::chrono::steady_clock::time_point written;
+                };
+
+                /**
+                 * Connected subscriber
+                 */
+                struct Client {
+                    int fd;
+                    // Sequence numbers of the frames held by the subscriber
+                    std::set<uint64_t> held;
+                    // Partially received sequence number
+                    std::string pending;
+                    // Disconnected for holding a frame past its lease, the
+                    // socket thread drops it
+                    bool evicted;
+                };
+
+                std::string m_socket_path;
+                size_t m_num_slots;
+                size_t m_slot_size;
+                std::chrono::milliseconds m_lease;
+
+                int m_memfd;
+                // Read-only descriptor of the memfd passed to subscribers
+                int m_ro_fd;
+                int m_listen_fd;
+                // Pipe waking up the socket thread when stopping
+                int m_wake_fd[2];
+
+                uint8_t* m_base;
+                size_t m_map_size;
+                std::atomic<uint64_t>* m_seqs;
+
+                std::vector<Slot> m_slots;
+                std::vector<Client> m_clients;
+                size_t m_next;
+                uint64_t m_seq;
+
+                // Frames written, frames no slot was available for and
+                // subscribers evicted since the last report
+                uint64_t m_written;
+                uint64_t m_busy;
+                uint64_t m_evicted;
+                std::chrono::steady_clock::time_point m_last_report;
+
+                std::mutex m_mtx;
+
+                std::thread* m_th;
+                std::atomic<bool> m_stop;
+
+                /**
+                 * Socket thread run method, accepts subscribers and
+                 * receives their releases
+                 */
+                void run();
+
+                /**
+                 * Pass the memfd to a new subscriber.
+                 */
+                void accept_client();
+
+                /**
+                 * Receive the releases of a subscriber.
+                 * @return false if the subscriber disconnected
+                 */
+                bool receive_releases(Client& client);
+
+                /**
+                 * Drop a subscriber, releasing the frames it holds.
+                 */
+                void drop_client(size_t index);
+
+                /**
+                 * Release a frame held by a subscriber.
+                 */
+                void release(Client& client, uint64_t seq);
+
+                /**
+                 * Evict the subscribers holding a frame whose lease
+                 * expired, releasing the frames they hold.
+                 */
+                void evict_expired(std::chrono::steady_clock::time_point now);
+
+                /**
+                 * Find a slot no subscriber holds.
+                 * @return m_num_slots if there is none
+                 */
+                size_t find_free_slot();
+
+                /**
+                 * Release the resources acquired by the constructor.
+                 */
+                void cleanup();
+
+            public:
+                /**
+                 * Constructor, creates the memfd and starts accepting
+                 * subscribers.
+                 * @param config - "shared_memory" object of an output
+                 * @param name   - Name the default socket path is derived
+                 *                 from
+                 */
+                ShmRing(const config_value_t* config, const std::string& name);
+
+                /**
+                 * Destructor
+                 */
+                ~ShmRing();
+
+                /**
+                 * Copy a frame into a free slot. Never waits for a slot, so
+                 * subscribers cannot throttle the outputs.
+                 * @param data - Frame data
+                 * @param len  - Frame data size
+                 * @param slot - Slot the frame has been written to
+                 * @return false if the frame does not fit into a slot or no
+                 *         slot is free
+                 */
+                bool write(const void* data, size_t len, ShmSlot& slot);
+
+                /**
+                 * Path of the unix socket subscribers connect to.
+                 */
+                const std::string& get_socket_path() const;
+        };
+
+    } // vi
+} // eii
+
+#endif // _EII_VI_SHM_RING_H
@@ -0,0 +1,165 @@
+// Copyright (c) 2021 Intel Corporation.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM,OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+
+/**
+ * @file
+ * @brief CPU affinity, NUMA memory placement and real-time priority of the
+ *        pipeline threads
+ */
+
+#ifndef _EII_VI_THREAD_PLACEMENT_H
+#define _EII_VI_THREAD_PLACEMENT_H
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <sched.h>
+#include <string>
+#include <eii/utils/config.h>
+
+#define PLACEMENT "placement"
+
+// Pipeline stages of the VideoIngestion "placement" object
+#define PLACEMENT_UDFS "udfs"
+#define PLACEMENT_PUBLISHER "publisher"
+#define PLACEMENT_COMMAND_HANDLER "command_handler"
+
+// Maximum number of NUMA nodes supported
+#define MAX_NUMA_NODES 256
+
+namespace eii {
+    namespace vi {
+
+        /**
+         * Placement of the threads of a pipeline stage: the CPUs they run
+         * on, the NUMA node their memory is allocated on and their
+         * SCHED_FIFO priority.
+         */
+        class ThreadPlacement {
+            private:
+                // Name of the stage, used for reporting
+                std::string m_stage;
+
+                cpu_set_t m_cpus;
+                bool m_has_cpus;
+
+                // SCHED_FIFO priority, 0 to keep the scheduling policy
+                int m_priority;
+
+                // Preferred NUMA node of allocations, -1 for the default
+                // policy (i.e. the node of the CPU the thread runs on)
+                int m_numa_node;
+
+            public:
+                /**
+                 * Default constructor, threads are not placed.
+                 */
+                ThreadPlacement();
+
+                /**
+                 * Constructor
+                 *
+                 * \note Throws a const char* error if the config is invalid.
+                 *
+                 * @param stage  - Name of the stage
+                 * @param config - Placement config object, NULL if the stage
+                 *                 is not placed
+                 */
+                ThreadPlacement(const char* stage, const config_value_t* config);
+
+                /**
+                 * Whether anything is configured.
+                 */
+                bool empty() const;
+
+                /**
+                 * Place the calling thread and report the applied
+                 * placement. Failures (e.g. missing CAP_SYS_NICE for
+                 * real-time priorities) are logged and the thread is placed
+                 * as far as possible.
+                 * @param realtime - Apply the SCHED_FIFO priority, false to
+                 *                   only pin the thread, e.g. for threads
+                 *                   which do not capture frames
+                 * @return false if any setting could not be applied
+                 */
+                bool apply(bool realtime=true) const;
+
+                /**
+                 * Description of the placement, e.g.
+                 * "CPUs 2-3 (NUMA node 0), SCHED_FIFO 50".
+                 */
+                std::string to_string() const;
+        };
+
+        /**
+         * Places the calling thread for as long as the object exists, so
+         * that threads created meanwhile, e.g. by a library starting its
+         * workers, inherit the placement. The previous placement is
+         * restored afterwards.
+         */
+        class ScopedPlacement {
+            private:
+                bool m_applied;
+                cpu_set_t m_cpus;
+                int m_policy;
+                struct sched_param m_param;
+                int m_mem_mode;
+                unsigned long m_mem_nodes[MAX_NUMA_NODES / (8 * sizeof(unsigned long))];
+
+                /**
+                 * Private @c ScopedPlacement copy constructor.
+                 */
+                ScopedPlacement(const ScopedPlacement& src);
+
+                /**
+                 * Private @c ScopedPlacement assignment operator.
+                 */
+                ScopedPlacement& operator=(const ScopedPlacement& src);
+
+            public:
+                /**
+                 * Constructor
+                 * @param placement - Placement applied to the calling thread
+                 */
+                ScopedPlacement(const ThreadPlacement& placement);
+
+                /**
+                 * Destructor, restores the previous placement.
+                 */
+                ~ScopedPlacement();
+        };
+
+        /**
+         * Get the placement of a stage from the "placement" object of the
+         * VideoIngestion config.
+         *
+         * \note Throws a const char* error if the config is invalid.
+         *
+         * @param config - VideoIngestion config
+         * @param stage  - Stage, e.g. PLACEMENT_UDFS
+         * @return The placement, empty if not configured
+         */
+        ThreadPlacement get_thread_placement(config_t* config, const char* stage);
+
+    } // vi
+} // eii
+
+#endif // _EII_VI_THREAD_PLACEMENT_H
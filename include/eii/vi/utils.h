@@ -0,0 +1,117 @@
+// Copyright (c) 2021 Intel Corporation.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM,OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+
+/**
+ * @file
+ * @brief Helpers shared by the Video Ingestion stages to read their config
+ *        and frame metadata
+ */
+
+#ifndef _EII_VI_UTILS_H
+#define _EII_VI_UTILS_H
+
+#include <stdint.h>
+#include <limits.h>
+#include <cjson/cJSON.h>
+#include <eii/msgbus/msg_envelope.h>
+#include <eii/utils/config.h>
+#include <eii/udf/frame.h>
+
+namespace eii {
+    namespace vi {
+
+        /**
+         * Read an optional integer within [min, max] from a config object.
+         * @param config - Config object
+         * @param key    - Key of the value
+         * @param def    - Value returned if the key is missing
+         * @param min    - Minimum value
+         * @param max    - Maximum value
+         * @return the configured value or @p def
+         * @throw const char* if the value is not an integer in range
+         */
+        int64_t get_config_int(const config_value_t* config, const char* key,
+                               int64_t def, int64_t min, int64_t max=INT_MAX);
+
+        /**
+         * Read a required integer within [min, max] from a config object.
+         * @param config - Config object
+         * @param key    - Key of the value
+         * @param min    - Minimum value
+         * @param max    - Maximum value
+         * @return the configured value
+         * @throw const char* if the key is missing or the value is not an
+         *        integer in range
+         */
+        int64_t get_required_config_int(const config_value_t* config, const char* key,
+                                        int64_t min, int64_t max=INT_MAX);
+
+        /**
+         * Read an optional number of at least min from a config object,
+         * integers are accepted as well.
+         * @param config - Config object
+         * @param key    - Key of the value
+         * @param def    - Value returned if the key is missing
+         * @param min    - Minimum value
+         * @return the configured value or @p def
+         * @throw const char* if the value is not a number in range
+         */
+        double get_config_number(const config_value_t* config, const char* key,
+                                 double def, double min);
+
+        /**
+         * Get the "pixel_format" metadata of a frame.
+         * @param frame - Frame to check
+         * @return pixel format or NULL if the frame has none
+         */
+        const char* get_pixel_format(udf::Frame* frame);
+
+        /**
+         * Convert a JSON value into a msgbus element, e.g. to restore
+         * meta-data serialized as JSON
+         * @param json - JSON value
+         * @return msgbus element or NULL on failure
+         */
+        msg_envelope_elem_body_t* json_to_elem(const cJSON* json);
+
+        /**
+         * Get meta-data as JSON, the inverse of merge_json_meta()
+         * @param meta - Meta-data to convert
+         * @return JSON object to be freed with cJSON_Delete(), NULL on
+         *         failure
+         */
+        cJSON* meta_to_json(msg_envelope_t* meta);
+
+        /**
+         * Add the keys of a JSON object to meta-data, e.g. to restore
+         * meta-data serialized as JSON. Keys already present in the
+         * meta-data are kept.
+         * @param meta      - Meta-data to add the keys to
+         * @param json      - JSON object
+         * @param skip_keys - NULL terminated list of keys not to add
+         */
+        void merge_json_meta(msg_envelope_t* meta, const cJSON* json,
+                             const char* const* skip_keys);
+
+    } // vi
+} // eii
+
+#endif // _EII_VI_UTILS_H
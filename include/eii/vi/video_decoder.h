@@ -0,0 +1,97 @@
+// Copyright (c) 2021 Intel Corporation.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM,OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+
+/**
+ * @file
+ * @brief Decoder of H.264/HEVC frames passed on in compressed form
+ */
+
+#ifndef _EII_VI_VIDEO_DECODER_H
+#define _EII_VI_VIDEO_DECODER_H
+
+#include <string>
+#include <chrono>
+#include <gst/gst.h>
+#include <eii/udf/frame.h>
+
+namespace eii {
+    namespace vi {
+
+        /**
+         * Decodes H.264 or HEVC access units in byte-stream format into
+         * BGR frames with a GStreamer pipeline (decodebin, which selects a
+         * hardware decoder if one is available). Decoding starts at the
+         * first keyframe.
+         */
+        class VideoDecoder {
+            private:
+                std::string m_codec;
+
+                // Pipeline, NULL until the first keyframe
+                GstElement* m_pipeline;
+                GstElement* m_src;
+                GstElement* m_sink;
+
+                // Whether access units are dropped until the next keyframe
+                bool m_wait_keyframe;
+
+                std::chrono::steady_clock::time_point m_start;
+
+                /**
+                 * Create and start the pipeline.
+                 */
+                bool create_pipeline();
+
+                /**
+                 * Stop and release the pipeline.
+                 */
+                void destroy_pipeline();
+
+            public:
+                /**
+                 * Constructor
+                 * @param codec - "h264" or "hevc"
+                 */
+                VideoDecoder(const std::string& codec);
+
+                /**
+                 * Destructor
+                 */
+                ~VideoDecoder();
+
+                /**
+                 * Decode a frame holding an access unit in place into a
+                 * BGR frame, see set_decoded_data().
+                 * @return false if the frame could not be decoded, e.g.
+                 *         while waiting for a keyframe
+                 */
+                bool decode(udf::Frame* frame);
+
+                /**
+                 * Codec of the decoded frames, "h264" or "hevc".
+                 */
+                const std::string& get_codec() const;
+        };
+
+    } // vi
+} // eii
+
+#endif // _EII_VI_VIDEO_DECODER_H
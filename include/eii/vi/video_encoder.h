@@ -0,0 +1,134 @@
+// Copyright (c) 2021 Intel Corporation.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM,OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+/**
+ * @file
+ * @brief H.264/HEVC software encoder of the frames published by an output
+ */
+
+#ifndef _EII_VI_VIDEO_ENCODER_H
+#define _EII_VI_VIDEO_ENCODER_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include <gst/gst.h>
+#include <eii/utils/config.h>
+
+#define VIDEO_CODEC_H264 "h264"
+#define VIDEO_CODEC_HEVC "hevc"
+
+// Metadata key flagging the frames which can be decoded on their own
+#define KEYFRAME "keyframe"
+
+namespace eii {
+    namespace vi {
+
+        /**
+         * Encodes BGR or grayscale frames into an H.264 or HEVC byte-stream
+         * with a software encoder (x264enc/x265enc) in a GStreamer pipeline.
+         * Every frame is encoded into one access unit, the SPS/PPS (and VPS)
+         * are repeated before every keyframe so that subscribers can start
+         * decoding at any keyframe.
+         */
+        class VideoEncoder {
+            private:
+                std::string m_name;
+                std::string m_codec;
+                int m_bitrate;
+                int m_gop;
+                std::string m_preset;
+
+                // Pipeline for the current resolution and channels, NULL
+                // until the first frame
+                GstElement* m_pipeline;
+                GstElement* m_src;
+                GstElement* m_sink;
+                int m_width;
+                int m_height;
+                int m_channels;
+
+                std::chrono::steady_clock::time_point m_start;
+                std::atomic<bool> m_force_keyframe;
+
+                /**
+                 * Create the pipeline for a resolution and number of
+                 * channels.
+                 */
+                bool create_pipeline(int width, int height, int channels);
+
+                /**
+                 * Stop and release the pipeline.
+                 */
+                void destroy_pipeline();
+
+            public:
+                /**
+                 * Constructor
+                 * @param encoding - "encoding" object of an output with an
+                 *                   h264 or hevc type
+                 * @param name     - Name of the output, used in log messages
+                 */
+                VideoEncoder(const config_value_t* encoding, const std::string& name);
+
+                /**
+                 * Destructor
+                 */
+                ~VideoEncoder();
+
+                /**
+                 * Check whether an encoding type is a video codec.
+                 */
+                static bool is_video_codec(const char* type);
+
+                /**
+                 * Encode a frame. The encoder is recreated if the
+                 * resolution or the channels change.
+                 * @param data     - Frame data
+                 * @param width    - Frame width
+                 * @param height   - Frame height
+                 * @param channels - 1 for grayscale, 3 for BGR
+                 * @param owner    - Kept alive until the encoder is done
+                 *                   with the frame data
+                 * @param out      - Encoded access unit
+                 * @param keyframe - Whether the access unit is a keyframe
+                 * @return false if the frame could not be encoded
+                 */
+                bool encode(const void* data, int width, int height, int channels,
+                            std::shared_ptr<void> owner, std::vector<unsigned char>& out,
+                            bool& keyframe);
+
+                /**
+                 * Encode the next frame as a keyframe (IDR).
+                 */
+                void force_keyframe();
+
+                /**
+                 * Codec of the encoded frames, "h264" or "hevc".
+                 */
+                const std::string& get_codec() const;
+        };
+
+    } // vi
+} // eii
+
+#endif // _EII_VI_VIDEO_ENCODER_H
@@ -28,8 +28,10 @@
 #define _EII_VI_VIDEOINGESTION_H
 
 #include <thread>
+#include <vector>
 #include <functional>
 #include <atomic>
+#include <mutex>
 #include <condition_variable>
 #include <eii/udf/frame.h>
 #include <string.h>
@@ -40,6 +42,9 @@
 #include <eii/msgbus/msg_envelope.h>
 #include <eii/udf/udf_manager.h>
 #include "eii/vi/ingestor.h"
+#include "eii/vi/output_router.h"
+#include "eii/vi/frame_batcher.h"
+#include "eii/vi/thread_placement.h"
 #include "eii/config_manager/config_mgr.hpp"
 #include "eii/ch/command_handler.h"
 
@@ -51,6 +56,29 @@ using namespace eii::config_manager;
 namespace eii {
     namespace vi {
 
+        /**
+         * Additional output of the ingestor, e.g. a second appsink of a
+         * GStreamer pipeline, with its own UDFs and publisher.
+         */
+        struct IngestionStream {
+            // Name of the ingestor output
+            std::string name;
+
+            // UDF input and output queues, the same queue without UDFs
+            FrameQueue* udf_input_queue;
+            FrameQueue* udf_output_queue;
+
+            // UDF manager, NULL without UDFs
+            UdfManager* udf_manager;
+
+            // Publisher of the UDF output queue
+            msgbus::Publisher* publisher;
+
+            IngestionStream() :
+                udf_input_queue(NULL), udf_output_queue(NULL),
+                udf_manager(NULL), publisher(NULL) {}
+        };
+
         /**
          * VideoIngestion class
          */
@@ -60,6 +88,16 @@ namespace eii {
                 // App name
                 std::string m_app_name;
 
+                // Currently applied VideoIngestion/config
+                std::string m_vi_config;
+
+                // ConfigManager object
+                ConfigMgr* m_cfg_mgr;
+
+                // Serializes reconfiguration against the software trigger
+                // commands
+                std::mutex m_mtx;
+
                 // Ingestor type - opencv or gstreamer
                 std::string m_ingestor_type;
 
@@ -69,18 +107,37 @@ namespace eii {
                 // CommandHandler object
                 CommandHandler* m_commandhandler;
 
-                // EII MsgBus Publisher
+                // EII MsgBus Publisher, NULL if "outputs" are configured
                 msgbus::Publisher* m_publisher;
 
+                // Router publishing the UDF output queue on the configured
+                // "outputs", NULL otherwise
+                OutputRouter* m_output_router;
+
                 // EII UDFManager
                 UdfManager* m_udf_manager;
 
+                // Groups the frames handed to the UDF manager into batches,
+                // NULL if "batching" is not configured
+                FrameBatcher* m_batcher;
+
                 // UDF input queue
                 FrameQueue* m_udf_input_queue;
 
                 // UDF output queue
                 FrameQueue* m_udf_output_queue;
 
+                // Size of the UDF input and output queues
+                size_t m_queue_size;
+
+                // Placement of the UDF and batcher threads, and of the
+                // publisher threads
+                ThreadPlacement m_udf_placement;
+                ThreadPlacement m_publisher_placement;
+
+                // Additional streams of the ingestor
+                std::vector<IngestionStream*> m_streams;
+
                 // Error condition variable
                 std::condition_variable& m_err_cv;
 
@@ -124,6 +181,59 @@ namespace eii {
                  */
                 msg_envelope_elem_body_t* process_snapshot(msg_envelope_elem_body_t *arg_payload);
 
+                /**
+                 * Process the force keyframe request, the next frame of every
+                 * H.264/HEVC encoded output is encoded as a keyframe
+                 * @param arg_payload -- Argument Payload object received (in the main payload) from client
+                 * @return reply_payload - return values payload JSON buffer to be returned back to the client
+                 */
+                msg_envelope_elem_body_t* process_force_keyframe(msg_envelope_elem_body_t *arg_payload);
+
+                /**
+                 * Create a publisher for a UDF output queue.
+                 * @param pub_ctx - Publisher interface config
+                 * @param queue   - Queue the published messages are taken from
+                 */
+                msgbus::Publisher* create_publisher(PublisherCfg* pub_ctx, msgbus::MessageQueue* queue);
+
+                /**
+                 * Create the UDF manager between the UDF input and output
+                 * queues, along with the batcher if "batching" is
+                 * configured.
+                 * @param config - VideoIngestion config
+                 */
+                UdfManager* create_udf_manager(config_t* config);
+
+                /**
+                 * Stop and release the UDF manager and the batcher.
+                 */
+                void destroy_udf_manager();
+
+                /**
+                 * Create the queues, UDF managers and publishers of the
+                 * "streams" of the VideoIngestion config.
+                 */
+                void create_streams(const char* vi_config);
+
+                /**
+                 * Register the streams with the ingestor.
+                 */
+                void add_streams();
+
+                /**
+                 * Release all streams, the ingestor must be stopped.
+                 * @param keep_input_queues - Leak the input queues of the
+                 *                            streams, which a hung ingestor
+                 *                            may still push to
+                 */
+                void destroy_streams(bool keep_input_queues=false);
+
+                /**
+                 * Replace the ingestor with one created from the given
+                 * ingestor config, restarting it if ingestion is running.
+                 */
+                void rebuild_ingestor(config_t* ingestor_cfg, const char* type);
+
                 /**
                  * Private @c VideoIngestion assignment operator.
                  *
@@ -160,6 +270,29 @@ namespace eii {
                  * Stop the VI pipeline in reverse order
                  */
                 void stop();
+
+                /**
+                 * Check whether the ingestor failed to stop, in which case
+                 * its ingestion thread is still running and VideoIngestion
+                 * must not be deleted.
+                 */
+                bool is_hung() const;
+
+                /**
+                 * Apply a changed VideoIngestion/config in place. Encoding
+                 * and poll_interval changes are applied live, the queues,
+                 * UDF manager, publisher and ingestor are only rebuilt if
+                 * affected by the change.
+                 *
+                 * \note Throws a const char* error if the pipeline was left
+                 *      in an unusable state, in which case the process has to
+                 *      be restarted.
+                 *
+                 * @param vi_config - New VideoIngestion/config
+                 * @return false if the change cannot be applied in place and
+                 *      VideoIngestion has to be recreated
+                 */
+                bool reconfigure(const char* vi_config);
         };
     }
 }
@@ -95,9 +95,11 @@ gencamsrc_stop (GstBaseSrc * src)
   Genicam *genicam = (Genicam *) gencamsrc->gencam;
   retVal = genicam->Stop ();
 
+  GST_OBJECT_LOCK (gencamsrc);
   delete genicam;
   genicam = nullptr;
   gencamsrc->gencam = genicam;
+  GST_OBJECT_UNLOCK (gencamsrc);
 
   GST_DEBUG_OBJECT (gencamsrc, "END: %s", __func__);
   return retVal;
@@ -119,3 +121,25 @@ gencamsrc_create (GstBuffer ** buf, GstMapInfo * mapInfo, GstBaseSrc * src)
 
   return retVal;
 }
+
+
+EXTERNC bool
+gencamsrc_set_frame_rate (GstBaseSrc * src, float frameRate)
+{
+  bool retVal = false;
+  GstGencamsrc *gencamsrc = GST_GENCAMSRC (src);
+
+  GST_DEBUG_OBJECT (gencamsrc, "START: %s", __func__);
+
+  // Held so that the camera object is not deleted by a concurrent stop
+  GST_OBJECT_LOCK (gencamsrc);
+  Genicam *genicam = (Genicam *) gencamsrc->gencam;
+  if (genicam) {
+    retVal = genicam->SetFrameRate (frameRate);
+  }
+  GST_OBJECT_UNLOCK (gencamsrc);
+
+  GST_DEBUG_OBJECT (gencamsrc, "END: %s", __func__);
+
+  return retVal;
+}
@@ -116,6 +116,9 @@ extern "C"
 
   /* Receive the frame to create output buffer */
   bool gencamsrc_create (GstBuffer ** buf, GstMapInfo * mapInfo, GstBaseSrc *src);
+
+  /* Change the acquisition frame rate, also while streaming */
+  bool gencamsrc_set_frame_rate (GstBaseSrc * src, float frameRate);
 #ifdef __cplusplus
 }
 #endif
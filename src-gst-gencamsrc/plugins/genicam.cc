@@ -52,6 +52,17 @@ Genicam::Init (GencamParams * params, GstBaseSrc * src)
   triggerMode.assign ("Off\0");
   deviceLinkThroughputLimitMode.assign ("Off\0");
 
+  // Frames are allocated from the huge page pool of the hosting process if
+  // it provides one, e.g. Video Ingestion with a frame allocator configured
+  frameAlloc = (void *(*)(size_t)) dlsym (RTLD_DEFAULT, "eii_frame_alloc");
+  frameFree = (void (*)(void *)) dlsym (RTLD_DEFAULT, "eii_frame_free");
+  if (frameAlloc == NULL || frameFree == NULL) {
+    frameAlloc = NULL;
+    frameFree = NULL;
+  } else {
+    GST_INFO_OBJECT (gencamsrc, "Using the frame allocator of the process");
+  }
+
   GST_DEBUG_OBJECT (gencamsrc, "END: %s", __func__);
   return TRUE;
 }
@@ -63,6 +74,7 @@ Genicam::Start (void)
   /* Enumerate & open device.
      Set the property (resolution, pixel format, etc.,)
      allocate buffers and start streaming from the camera */
+  std::lock_guard < std::mutex > lock (featureMutex);
 
   GST_DEBUG_OBJECT (gencamsrc, "START: %s", __func__);
 
@@ -306,6 +318,8 @@ Genicam::Start (void)
 bool
 Genicam::Stop (void)
 {
+  std::lock_guard < std::mutex > lock (featureMutex);
+
   GST_DEBUG_OBJECT (gencamsrc, "START: %s", __func__);
   try {
     // Stop and close the streams opened
@@ -328,6 +342,9 @@ Genicam::Stop (void)
     GST_WARNING_OBJECT (gencamsrc, "Exception: unknown");
   }
 
+  // Runtime feature changes are only stored from now on
+  nodemap.reset ();
+
   // Clear the system
   rcg::System::clearSystems ();
 
@@ -367,7 +384,15 @@ bool Genicam::Create (GstBuffer ** buf, GstMapInfo * mapInfo)
     guint64
         timestampNS = buffer->getTimestampNS ();
 
-    *buf = gst_buffer_new_allocate (NULL, globalSize, NULL);
+    // Falls back to the default allocator if the frame allocator has no
+    // pool or is out of memory
+    gpointer frameMem = (frameAlloc) ? frameAlloc (globalSize) : NULL;
+    if (frameMem != NULL) {
+      *buf = gst_buffer_new_wrapped_full ((GstMemoryFlags) 0, frameMem,
+          globalSize, 0, globalSize, frameMem, (GDestroyNotify) frameFree);
+    } else {
+      *buf = gst_buffer_new_allocate (NULL, globalSize, NULL);
+    }
     if (*buf == NULL) {
       GST_ERROR_OBJECT (gencamsrc, "Buffer couldn't be allocated");
       return FALSE;
@@ -411,6 +436,39 @@ bool Genicam::Create (GstBuffer ** buf, GstMapInfo * mapInfo)
 }
 
 
+bool
+Genicam::SetFrameRate (float frameRate)
+{
+  std::lock_guard < std::mutex > lock (featureMutex);
+  bool isFrameRateSet = TRUE;
+
+  GST_DEBUG_OBJECT (gencamsrc, "START: %s", __func__);
+  gencamParams->acquisitionFrameRate = frameRate;
+
+  // Device not opened, Start applies the stored value
+  if (nodemap) {
+    try {
+      isFrameRateSet = setAcquisitionFrameRate ();
+    }
+    catch (const std::exception & ex) {
+      GST_WARNING_OBJECT (gencamsrc, "Exception: %s", ex.what ());
+      isFrameRateSet = FALSE;
+    }
+    catch (const GENICAM_NAMESPACE::GenericException & ex) {
+      GST_WARNING_OBJECT (gencamsrc, "Exception: %s", ex.what ());
+      isFrameRateSet = FALSE;
+    }
+    catch ( ...) {
+      GST_WARNING_OBJECT (gencamsrc, "Exception: unknown");
+      isFrameRateSet = FALSE;
+    }
+  }
+
+  GST_DEBUG_OBJECT (gencamsrc, "END: %s", __func__);
+  return isFrameRateSet;
+}
+
+
 bool
 Genicam::isFeature (const char *featureName, featureType * fType)
 {
@@ -1292,6 +1350,7 @@ Genicam::setAcquisitionFrameRate (void)
   } else {
     GST_WARNING_OBJECT (gencamsrc,
         "AcquisitionFrameRate: feature not supported");
+    return FALSE;
   }
 
   frameRate =
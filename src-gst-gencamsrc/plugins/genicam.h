@@ -57,12 +57,14 @@
 #include <Base/GCException.h>
 
 #include <signal.h>
+#include <dlfcn.h>
 #include <algorithm>
 #include <atomic>
 #include <chrono>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <mutex>
 #include <thread>
 // ------------------------------------------------------------------------------
 
@@ -112,6 +114,17 @@ public:
    */
   bool Create (GstBuffer ** buf, GstMapInfo * mapInfo);
 
+  /*
+   * Changes the acquisition frame rate. Applied to the camera right away
+   if the device is opened, otherwise on the next Start
+
+   @param frameRate    Acquisition frame rate in Hertz, 0 for the camera
+   default
+   @return             True if the frame rate is stored or configured.
+   False otherwise.
+   */
+  bool SetFrameRate (float frameRate);
+
 private:
   /* Pointer to gencamParams structure */
     GencamParams * gencamParams;
@@ -131,6 +144,14 @@ private:
   /* Shared pointer to nodemap */
     std::shared_ptr < GenApi::CNodeMapRef > nodemap;
 
+  /* Serializes runtime feature changes with Start and Stop */
+    std::mutex featureMutex;
+
+  /* Frame allocator of the hosting process (eii_frame_alloc and
+   * eii_frame_free of Video Ingestion), NULL if not available */
+  void *(*frameAlloc) (size_t);
+  void (*frameFree) (void *);
+
   /*Camera information*/
   struct camInfo_t {
       std::string vendorName; // Camera vendor name
@@ -432,7 +432,8 @@ gst_gencamsrc_class_init (GstGencamsrcClass * klass)
       g_param_spec_float ("frame-rate", "AcquisitionFrameRate",
           "Controls the acquisition rate (in Hertz) at which the frames are captured.",
           0 /*Min */ , 120 /*Max */ , 0 /*Default */ ,
-          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+          (GParamFlags) (G_PARAM_READWRITE | GST_PARAM_MUTABLE_PLAYING |
+              G_PARAM_STATIC_STRINGS)));
 
   g_object_class_install_property (gobject_class, PROP_RESET,
       g_param_spec_boolean ("reset", "DeviceReset",
@@ -649,7 +650,15 @@ gst_gencamsrc_set_property (GObject * object, guint property_id,
       prop->channelPacketDelay = g_value_get_int (value);
       break;
     case PROP_FRAMERATE:
-      prop->acquisitionFrameRate = g_value_get_float (value);
+      if (gencamsrc->gencam) {
+        if (!gencamsrc_set_frame_rate ((GstBaseSrc *) gencamsrc,
+                g_value_get_float (value))) {
+          GST_WARNING_OBJECT (gencamsrc, "Failed to set frame rate %f",
+              g_value_get_float (value));
+        }
+      } else {
+        prop->acquisitionFrameRate = g_value_get_float (value);
+      }
       break;
     case PROP_RESET:
       prop->deviceReset = g_value_get_boolean (value);
@@ -200,6 +200,8 @@ msg_envelope_elem_body_t* CommandHandler::process_command(msg_envelope_elem_body
             cmnd = STOP_INGESTION;
         } else if (!command_name_str.compare("SNAPSHOT")) {
             cmnd = SNAPSHOT;
+        } else if (!command_name_str.compare("FORCE_KEYFRAME")) {
+            cmnd = FORCE_KEYFRAME;
         }
 
         msg_envelope_elem_body_t *final_reply_payload;
@@ -0,0 +1,238 @@
+// Copyright (c) 2021 Intel Corporation.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM,OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+
+/**
+ * @file
+ * @brief Compressed frame helpers implementation
+ */
+
+#include <string.h>
+#include <opencv2/opencv.hpp>
+#include <eii/utils/logger.h>
+#include "eii/vi/compressed_frame.h"
+#include "eii/vi/utils.h"
+#include "eii/vi/video_encoder.h"
+
+using namespace eii::vi;
+using namespace eii::udf;
+
+/**
+ * Compressed pixel formats and the encoding type they are published with
+ */
+static const char* g_compressed_formats[][2] = {
+    { PIXEL_FORMAT_JPEG, "jpeg" },
+    { PIXEL_FORMAT_H264, VIDEO_CODEC_H264 },
+    { PIXEL_FORMAT_H265, VIDEO_CODEC_HEVC },
+    { NULL, NULL }
+};
+
+/**
+ * Replace a string metadata value
+ */
+static bool put_string(msg_envelope_t* meta_data, const char* key, const char* value) {
+    msgbus_msg_envelope_remove(meta_data, key);
+    msg_envelope_elem_body_t* elem = msgbus_msg_envelope_new_string(value);
+    if(elem == NULL)
+        return false;
+    if(msgbus_msg_envelope_put(meta_data, key, elem) != MSG_SUCCESS) {
+        msgbus_msg_envelope_elem_destroy(elem);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Replace an integer metadata value
+ */
+static bool put_int(msg_envelope_t* meta_data, const char* key, int64_t value) {
+    msgbus_msg_envelope_remove(meta_data, key);
+    msg_envelope_elem_body_t* elem = msgbus_msg_envelope_new_integer(value);
+    if(elem == NULL)
+        return false;
+    if(msgbus_msg_envelope_put(meta_data, key, elem) != MSG_SUCCESS) {
+        msgbus_msg_envelope_elem_destroy(elem);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Get an integer metadata value
+ */
+static bool get_int(msg_envelope_t* meta_data, const char* key, int& value) {
+    msg_envelope_elem_body_t* elem = NULL;
+    if(msgbus_msg_envelope_get(meta_data, key, &elem) != MSG_SUCCESS ||
+       elem->type != MSG_ENV_DT_INT)
+        return false;
+    value = (int) elem->body.integer;
+    return true;
+}
+
+/**
+ * Free callback of the decoded frames
+ */
+static void free_decoded_frame(void* obj) {
+    delete (cv::Mat*) obj;
+}
+
+CompressedFrame::CompressedFrame(void* frame, void (*free_frame)(void*), void* data, size_t len) :
+    Frame(frame, free_frame, data, (int) len, 1, 1) {}
+
+msg_envelope_t* CompressedFrame::serialize() {
+    // Frames decoded for the UDFs are published as usual
+    if(get_compressed_codec(this) == NULL)
+        return Frame::serialize();
+
+    int width = 0;
+    int height = 0;
+    get_image_size(this, width, height);
+    size_t len = (size_t) get_width(0);
+    msg_envelope_t* meta_data = get_meta_data();
+    msgbus_msg_envelope_remove(meta_data, IMAGE_WIDTH);
+    msgbus_msg_envelope_remove(meta_data, IMAGE_HEIGHT);
+
+    msg_envelope_t* msg = Frame::serialize();
+    if(msg != NULL && !put_compressed_size(msg, width, height, len))
+        LOG_ERROR_0("Failed to put the image size of a compressed frame");
+    return msg;
+}
+
+const char* eii::vi::get_compressed_codec(Frame* frame) {
+    const char* format = get_pixel_format(frame);
+    if(format == NULL)
+        return NULL;
+    for(int i = 0; g_compressed_formats[i][0] != NULL; i++) {
+        if(!strcmp(format, g_compressed_formats[i][0]))
+            return g_compressed_formats[i][1];
+    }
+    return NULL;
+}
+
+bool eii::vi::set_compressed_format(Frame* frame, const char* pixel_format, int width, int height) {
+    const char* codec = NULL;
+    for(int i = 0; g_compressed_formats[i][0] != NULL; i++) {
+        if(!strcmp(pixel_format, g_compressed_formats[i][0]))
+            codec = g_compressed_formats[i][1];
+    }
+    msg_envelope_t* meta_data = frame->get_meta_data();
+    if(codec == NULL || meta_data == NULL)
+        return false;
+    if((width <= 0 || height <= 0) && !strcmp(pixel_format, PIXEL_FORMAT_JPEG) &&
+       !get_jpeg_size(frame->get_data(0), (size_t) frame->get_width(0), width, height)) {
+        width = 0;
+        height = 0;
+    }
+    return put_string(meta_data, "pixel_format", pixel_format) &&
+           put_string(meta_data, "encoding_type", codec) &&
+           put_int(meta_data, IMAGE_WIDTH, width) &&
+           put_int(meta_data, IMAGE_HEIGHT, height);
+}
+
+bool eii::vi::get_image_size(Frame* frame, int& width, int& height) {
+    msg_envelope_t* meta_data = frame->get_meta_data();
+    return get_int(meta_data, IMAGE_WIDTH, width) &&
+           get_int(meta_data, IMAGE_HEIGHT, height) && width > 0 && height > 0;
+}
+
+bool eii::vi::put_compressed_size(msg_envelope_t* msg, int width, int height, size_t len) {
+    return put_int(msg, "width", width) && put_int(msg, "height", height) &&
+           put_int(msg, "channels", 3) && put_int(msg, COMPRESSED_SIZE, (int64_t) len);
+}
+
+bool eii::vi::get_jpeg_size(const void* data, size_t len, int& width, int& height) {
+    if(!is_jpeg(data, len))
+        return false;
+    const unsigned char* bytes = (const unsigned char*) data;
+    size_t pos = 2;
+    while(pos + 4 <= len) {
+        if(bytes[pos] != 0xFF)
+            return false;
+        unsigned char marker = bytes[pos + 1];
+        if(marker == 0xFF) {
+            // Fill byte
+            pos++;
+            continue;
+        }
+        if(marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7)) {
+            // Markers without a segment
+            pos += 2;
+            continue;
+        }
+        // The image data follows the start of scan, the frame header has
+        // to come first
+        if(marker == 0xD9 || marker == 0xDA)
+            return false;
+        size_t segment_len = ((size_t) bytes[pos + 2] << 8) | bytes[pos + 3];
+        // Start of frame markers, all of 0xC0-0xCF except DHT, JPG and DAC
+        if(marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 &&
+           marker != 0xCC) {
+            if(segment_len < 7 || pos + 9 > len)
+                return false;
+            height = (bytes[pos + 5] << 8) | bytes[pos + 6];
+            width = (bytes[pos + 7] << 8) | bytes[pos + 8];
+            return width > 0 && height > 0;
+        }
+        pos += 2 + segment_len;
+    }
+    return false;
+}
+
+bool eii::vi::is_keyframe(Frame* frame) {
+    msg_envelope_elem_body_t* keyframe = NULL;
+    return msgbus_msg_envelope_get(frame->get_meta_data(), KEYFRAME, &keyframe) == MSG_SUCCESS &&
+           keyframe->type == MSG_ENV_DT_BOOLEAN && keyframe->body.boolean;
+}
+
+bool eii::vi::set_decoded_data(Frame* frame, void* obj, void (*free_frame)(void*),
+                               void* data, int width, int height) {
+    // Releases the compressed data
+    frame->set_data(0, obj, free_frame, data, width, height, 3);
+
+    msg_envelope_t* meta_data = frame->get_meta_data();
+    msgbus_msg_envelope_remove(meta_data, "encoding_type");
+    msgbus_msg_envelope_remove(meta_data, KEYFRAME);
+    msgbus_msg_envelope_remove(meta_data, CODEC_CONFIG);
+    msgbus_msg_envelope_remove(meta_data, IMAGE_WIDTH);
+    msgbus_msg_envelope_remove(meta_data, IMAGE_HEIGHT);
+    if(!put_string(meta_data, "pixel_format", "BGR")) {
+        LOG_ERROR_0("Failed to put pixel_format meta-data");
+        return false;
+    }
+    return true;
+}
+
+bool eii::vi::is_jpeg(const void* data, size_t len) {
+    const unsigned char* bytes = (const unsigned char*) data;
+    return len >= 3 && bytes[0] == 0xFF && bytes[1] == 0xD8 && bytes[2] == 0xFF;
+}
+
+bool eii::vi::decode_jpeg(Frame* frame) {
+    int len = frame->get_width(0);
+    cv::Mat encoded(1, len, CV_8UC1, frame->get_data(0));
+    cv::Mat* decoded = new cv::Mat(cv::imdecode(encoded, cv::IMREAD_COLOR));
+    if(decoded->empty()) {
+        LOG_ERROR("Failed to decode JPEG frame of %d bytes", len);
+        delete decoded;
+        return false;
+    }
+    return set_decoded_data(frame, (void*) decoded, free_decoded_frame,
+                            (void*) decoded->data, decoded->cols, decoded->rows);
+}
@@ -0,0 +1,250 @@
+// Copyright (c) 2021 Intel Corporation.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM,OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+
+/**
+ * @file
+ * @brief Duplicate frame suppression implementation
+ */
+
+#include <string.h>
+#include <eii/utils/logger.h>
+#include "eii/vi/duplicate_filter.h"
+#include "eii/vi/utils.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <nmmintrin.h>
+#define HAVE_CRC32C_SSE42
+#endif
+
+// Reflected CRC32C polynomial
+#define CRC32C_POLY 0x82F63B78
+
+// Defaults
+#define DEFAULT_MAX_DISTANCE 2
+#define DEFAULT_STUCK_FRAMES 300
+
+using namespace eii::vi;
+using namespace eii::udf;
+
+/**
+ * Byte wise lookup table of the software CRC32C
+ */
+struct Crc32cTable {
+    uint32_t entries[256];
+
+    Crc32cTable() {
+        for(uint32_t i = 0; i < 256; i++) {
+            uint32_t crc = i;
+            for(int j = 0; j < 8; j++)
+                crc = (crc >> 1) ^ ((crc & 1) ? CRC32C_POLY : 0);
+            entries[i] = crc;
+        }
+    }
+};
+
+static uint32_t crc32c_sw(uint32_t crc, const uint8_t* p, size_t len) {
+    static const Crc32cTable table;
+    while(len--)
+        crc = table.entries[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    return crc;
+}
+
+#ifdef HAVE_CRC32C_SSE42
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_sse42(uint32_t crc, const uint8_t* p, size_t len) {
+    uint64_t crc64 = crc;
+    // memcpy keeps the unaligned loads well defined, it compiles to a
+    // single load
+    for(; len >= 8; len -= 8, p += 8) {
+        uint64_t word;
+        memcpy(&word, p, sizeof(word));
+        crc64 = _mm_crc32_u64(crc64, word);
+    }
+    crc = (uint32_t) crc64;
+    for(; len > 0; len--)
+        crc = _mm_crc32_u8(crc, *p++);
+    return crc;
+}
+#endif
+
+uint32_t eii::vi::crc32c(const void* data, size_t len) {
+    const uint8_t* p = (const uint8_t*) data;
+#ifdef HAVE_CRC32C_SSE42
+    static const bool sse42 = __builtin_cpu_supports("sse4.2");
+    if(sse42)
+        return ~crc32c_sse42(0xffffffff, p, len);
+#endif
+    return ~crc32c_sw(0xffffffff, p, len);
+}
+
+uint64_t eii::vi::dhash(const cv::Mat& img, cv::Mat& thumb) {
+    cv::resize(img, thumb, cv::Size(9, 8), 0, 0, cv::INTER_AREA);
+    int channels = thumb.channels();
+    uint64_t hash = 0;
+    for(int y = 0; y < 8; y++) {
+        const uint8_t* row = thumb.ptr(y);
+        int prev = 0;
+        for(int x = 0; x < 9; x++) {
+            int value = 0;
+            for(int c = 0; c < channels; c++)
+                value += row[x * channels + c];
+            if(x > 0)
+                hash = (hash << 1) | (value > prev ? 1 : 0);
+            prev = value;
+        }
+    }
+    return hash;
+}
+
+/**
+ * Add an element to the frame metadata, destroying it on failure
+ */
+static void put_meta(msg_envelope_t* meta_data, const char* key, msg_envelope_elem_body_t* elem) {
+    if(elem != NULL && msgbus_msg_envelope_put(meta_data, key, elem) != MSG_SUCCESS)
+        msgbus_msg_envelope_elem_destroy(elem);
+}
+
+/**
+ * Helper to read an optional string from the config
+ */
+static std::string get_filter_string(const config_value_t* config, const char* key, const char* def) {
+    config_value_t* cvt = config_value_object_get(config, key);
+    if(cvt == NULL)
+        return def;
+    if(cvt->type != CVT_STRING) {
+        config_value_destroy(cvt);
+        const char* err = "JSON value must be a string";
+        LOG_ERROR("%s for \'%s\'", err, key);
+        throw(err);
+    }
+    std::string value = cvt->body.string;
+    config_value_destroy(cvt);
+    return value;
+}
+
+DuplicateFilter::DuplicateFilter(const config_value_t* config) :
+    m_has_previous(false), m_previous(0), m_previous_size(0),
+    m_duplicates(0), m_stuck(false) {
+    if(config->type != CVT_OBJECT) {
+        const char* err = "JSON value must be an object";
+        LOG_ERROR("%s for \'%s\'", err, DUPLICATE_FILTER);
+        throw(err);
+    }
+    std::string method = get_filter_string(config, "method", DUPLICATE_METHOD_CRC32C);
+    if(method == DUPLICATE_METHOD_DHASH) {
+        m_near = true;
+    } else if(method == DUPLICATE_METHOD_CRC32C) {
+        m_near = false;
+    } else {
+        const char* err = "Unsupported duplicate filter method";
+        LOG_ERROR("%s \'%s\'", err, method.c_str());
+        throw(err);
+    }
+    std::string action = get_filter_string(config, "action", DUPLICATE_ACTION_DROP);
+    if(action == DUPLICATE_ACTION_MARK) {
+        m_drop = false;
+    } else if(action == DUPLICATE_ACTION_DROP) {
+        m_drop = true;
+    } else {
+        const char* err = "Unsupported duplicate filter action";
+        LOG_ERROR("%s \'%s\'", err, action.c_str());
+        throw(err);
+    }
+    m_max_distance = (int) get_config_int(config, "max_distance", DEFAULT_MAX_DISTANCE, 0);
+    m_stuck_frames = (int) get_config_int(config, "stuck_frames", DEFAULT_STUCK_FRAMES, 0);
+    if(m_near) {
+        LOG_INFO("Duplicate filter: %s, max distance %d, stuck alarm after "
+                 "%d duplicates, action %s", method.c_str(), m_max_distance,
+                 m_stuck_frames, action.c_str());
+    } else {
+        LOG_INFO("Duplicate filter: %s, stuck alarm after %d duplicates, "
+                 "action %s", method.c_str(), m_stuck_frames, action.c_str());
+    }
+}
+
+bool DuplicateFilter::check(Frame* frame) {
+    int width = frame->get_width(0);
+    int height = frame->get_height(0);
+    int channels = frame->get_channels(0);
+    size_t size = (size_t) width * height * channels;
+    uint64_t fingerprint;
+    if(m_near) {
+        cv::Mat img(height, width, CV_MAKETYPE(CV_8U, channels), frame->get_data(0));
+        fingerprint = dhash(img, m_thumb);
+    } else {
+        fingerprint = crc32c(frame->get_data(0), size);
+    }
+
+    bool duplicate = false;
+    if(m_has_previous && size == m_previous_size) {
+        if(m_near) {
+            duplicate = __builtin_popcountll(fingerprint ^ m_previous) <= m_max_distance;
+        } else {
+            duplicate = fingerprint == m_previous;
+        }
+    }
+    m_has_previous = true;
+    m_previous = fingerprint;
+    m_previous_size = size;
+
+    if(!duplicate) {
+        if(m_stuck) {
+            LOG_INFO("Camera recovered after %d duplicate frames", m_duplicates);
+            m_stuck = false;
+        }
+        m_duplicates = 0;
+        return true;
+    }
+
+    m_duplicates++;
+    // Every stuck_frames duplicates the alarm is raised or repeated
+    bool alarm = m_stuck_frames > 0 && m_duplicates % m_stuck_frames == 0;
+    if(alarm && !m_stuck) {
+        LOG_ERROR("Camera stuck: %d consecutive duplicate frames", m_duplicates);
+        m_stuck = true;
+    }
+    // The alarm frames are passed on even when dropping duplicates, so that
+    // consumers learn about the stuck camera
+    if(m_drop && !alarm)
+        return false;
+
+    msg_envelope_t* meta_data = frame->get_meta_data();
+    put_meta(meta_data, DUPLICATE_KEY, msgbus_msg_envelope_new_bool(true));
+    put_meta(meta_data, DUPLICATE_COUNT_KEY, msgbus_msg_envelope_new_integer(m_duplicates));
+    if(m_stuck)
+        put_meta(meta_data, CAMERA_STUCK_KEY, msgbus_msg_envelope_new_bool(true));
+    return true;
+}
+
+DuplicateFilter* eii::vi::get_duplicate_filter(config_t* config) {
+    config_value_t* cvt_filter = config->get_config_value(config->cfg, DUPLICATE_FILTER);
+    if(cvt_filter == NULL)
+        return NULL;
+    DuplicateFilter* filter = NULL;
+    try {
+        filter = new DuplicateFilter(cvt_filter);
+    } catch(...) {
+        config_value_destroy(cvt_filter);
+        throw;
+    }
+    config_value_destroy(cvt_filter);
+    return filter;
+}
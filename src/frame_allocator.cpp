@@ -0,0 +1,307 @@
+// Copyright (c) 2021 Intel Corporation.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM,OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+
+/**
+ * @file
+ * @brief Huge page backed frame allocator implementation
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <string>
+#include <sys/mman.h>
+#include <eii/utils/logger.h>
+#include "eii/vi/frame_allocator.h"
+#include "eii/vi/utils.h"
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+#ifndef MAP_HUGE_2MB
+#define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+#endif
+#ifndef MAP_HUGE_1GB
+#define MAP_HUGE_1GB (30 << MAP_HUGE_SHIFT)
+#endif
+
+// Defaults
+#define DEFAULT_POOL_SIZE_MB 512
+
+// Pool blocks are powers of two from 64KB up to the largest one fitting in the
+// pool. Heap blocks are rounded up to whole pages. The block header keeps the
+// data 64 byte aligned
+#define MIN_BLOCK_SIZE ((size_t) 64 << 10)
+#define BLOCK_ALIGN 4096
+#define HEADER_SIZE 64
+#define BLOCK_MAGIC 0x45494946
+#define HEAP_CLASS -1
+
+// Interval of the allocator statistics
+#define REPORT_INTERVAL_S 60
+
+using namespace eii::vi;
+
+/**
+ * Header in front of every block
+ */
+struct BlockHeader {
+    uint32_t magic;
+
+    // Size class, HEAP_CLASS for blocks allocated from the heap
+    int32_t size_class;
+
+    // Size of heap blocks
+    size_t block_size;
+};
+
+static_assert(sizeof(BlockHeader) <= HEADER_SIZE, "Block header too large");
+
+static std::mutex g_allocator_mtx;
+static std::atomic<FrameAllocator*> g_allocator(NULL);
+
+FrameAllocator::FrameAllocator(const config_value_t* config) :
+    m_pool(NULL), m_pool_size(0), m_pool_used(0), m_huge_pages(false),
+    m_hits(0), m_misses(0), m_heap_bytes(0) {
+    if(config->type != CVT_OBJECT) {
+        const char* err = "JSON value must be an object";
+        LOG_ERROR("%s for \'%s\'", err, FRAME_ALLOCATOR);
+        throw(err);
+    }
+
+    std::string page_size = FRAME_ALLOCATOR_PAGE_2MB;
+    config_value_t* cvt_page_size = config_value_object_get(config, "page_size");
+    if(cvt_page_size != NULL) {
+        if(cvt_page_size->type != CVT_STRING) {
+            config_value_destroy(cvt_page_size);
+            const char* err = "JSON value must be a string";
+            LOG_ERROR("%s for \'page_size\'", err);
+            throw(err);
+        }
+        page_size = cvt_page_size->body.string;
+        config_value_destroy(cvt_page_size);
+    }
+    int huge_flag = MAP_HUGE_2MB;
+    m_page_size = 2UL << 20;
+    if(page_size == FRAME_ALLOCATOR_PAGE_1GB) {
+        huge_flag = MAP_HUGE_1GB;
+        m_page_size = 1UL << 30;
+    } else if(page_size != FRAME_ALLOCATOR_PAGE_2MB) {
+        const char* err = "Unsupported frame allocator page size";
+        LOG_ERROR("%s \'%s\'", err, page_size.c_str());
+        throw(err);
+    }
+
+    int64_t pool_size_mb = get_config_int(config, "pool_size_mb",
+                                          DEFAULT_POOL_SIZE_MB, 1);
+    m_pool_size = ((((size_t) pool_size_mb << 20) + m_page_size - 1) /
+                   m_page_size) * m_page_size;
+
+    // Reserved huge pages are faulted in right away, without them the pool
+    // falls back to transparent huge pages which are faulted in by hand
+    void* pool = mmap(NULL, m_pool_size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE |
+                      MAP_HUGETLB | huge_flag, -1, 0);
+    if(pool != MAP_FAILED) {
+        m_huge_pages = true;
+    } else {
+        LOG_WARN("Failed to map %zu MB of %s huge pages: %s, falling back "
+                 "to transparent huge pages", m_pool_size >> 20,
+                 page_size.c_str(), strerror(errno));
+        pool = mmap(NULL, m_pool_size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(pool == MAP_FAILED) {
+            const char* err = "Failed to map the frame allocator pool";
+            LOG_ERROR("%s: %s", err, strerror(errno));
+            throw(err);
+        }
+        if(madvise(pool, m_pool_size, MADV_HUGEPAGE) == 0) {
+            m_huge_pages = true;
+        } else {
+            LOG_WARN("Transparent huge pages not available: %s", strerror(errno));
+        }
+        memset(pool, 0, m_pool_size);
+    }
+    m_pool = (uint8_t*) pool;
+
+    // The pool starts out as the largest blocks covering it, which is at
+    // most one block per class as the pool size is a multiple of 64KB
+    size_t classes = 1;
+    while((MIN_BLOCK_SIZE << classes) <= m_pool_size)
+        classes++;
+    m_free.resize(classes);
+    size_t offset = 0;
+    for(size_t i = classes; i-- > 0;) {
+        if(offset + (MIN_BLOCK_SIZE << i) <= m_pool_size) {
+            m_free[i].insert(offset);
+            offset += MIN_BLOCK_SIZE << i;
+        }
+    }
+    m_report_time = std::chrono::steady_clock::now();
+    LOG_INFO("Frame allocator: %zu MB pool of %s pages", m_pool_size >> 20,
+             (m_huge_pages) ? page_size.c_str() : "4KB");
+}
+
+void* FrameAllocator::allocate(size_t size) {
+    size_t size_class = 0;
+    while(size_class < m_free.size() &&
+          (MIN_BLOCK_SIZE << size_class) < size + HEADER_SIZE)
+        size_class++;
+    uint8_t* block = NULL;
+    size_t block_size = 0;
+    {
+        std::lock_guard<std::mutex> lk(m_mtx);
+        // Split the smallest free block that fits down to the size class
+        size_t i = size_class;
+        while(i < m_free.size() && m_free[i].empty())
+            i++;
+        if(i < m_free.size()) {
+            size_t offset = *m_free[i].begin();
+            m_free[i].erase(m_free[i].begin());
+            while(i > size_class) {
+                i--;
+                m_free[i].insert(offset + (MIN_BLOCK_SIZE << i));
+            }
+            block = m_pool + offset;
+            m_pool_used += MIN_BLOCK_SIZE << size_class;
+            m_hits++;
+        } else {
+            block_size = ((size + HEADER_SIZE + BLOCK_ALIGN - 1) / BLOCK_ALIGN) * BLOCK_ALIGN;
+            m_misses++;
+            m_heap_bytes += block_size;
+        }
+        report();
+    }
+
+    if(block == NULL &&
+       posix_memalign((void**) &block, BLOCK_ALIGN, block_size) != 0) {
+        std::lock_guard<std::mutex> lk(m_mtx);
+        m_heap_bytes -= block_size;
+        return NULL;
+    }
+    BlockHeader* header = (BlockHeader*) block;
+    header->magic = BLOCK_MAGIC;
+    header->size_class = (block_size == 0) ? (int32_t) size_class : HEAP_CLASS;
+    header->block_size = block_size;
+    return block + HEADER_SIZE;
+}
+
+void FrameAllocator::release(void* ptr) {
+    if(ptr == NULL)
+        return;
+    uint8_t* block = (uint8_t*) ptr - HEADER_SIZE;
+    BlockHeader* header = (BlockHeader*) block;
+    if(header->magic != BLOCK_MAGIC) {
+        LOG_ERROR_0("Frame allocator: releasing an invalid block");
+        return;
+    }
+    header->magic = 0;
+    std::lock_guard<std::mutex> lk(m_mtx);
+    if(header->size_class == HEAP_CLASS) {
+        m_heap_bytes -= header->block_size;
+        free(block);
+        return;
+    }
+
+    // Merge the block with its buddy while that is free, so that idle blocks
+    // are available to any size class again
+    size_t size_class = (size_t) header->size_class;
+    size_t offset = block - m_pool;
+    m_pool_used -= MIN_BLOCK_SIZE << size_class;
+    while(size_class + 1 < m_free.size()) {
+        size_t block_size = MIN_BLOCK_SIZE << size_class;
+        size_t merged = offset & ~(2 * block_size - 1);
+        if(merged + 2 * block_size > m_pool_size)
+            break;
+        auto buddy = m_free[size_class].find(offset ^ block_size);
+        if(buddy == m_free[size_class].end())
+            break;
+        m_free[size_class].erase(buddy);
+        offset = merged;
+        size_class++;
+    }
+    m_free[size_class].insert(offset);
+}
+
+FrameAllocatorStats FrameAllocator::get_stats() {
+    std::lock_guard<std::mutex> lk(m_mtx);
+    FrameAllocatorStats stats;
+    stats.hits = m_hits;
+    stats.misses = m_misses;
+    stats.resident_bytes = m_pool_size + m_heap_bytes;
+    stats.pool_used_bytes = m_pool_used;
+    return stats;
+}
+
+bool FrameAllocator::has_huge_pages() const {
+    return m_huge_pages;
+}
+
+void FrameAllocator::report() {
+    auto now = std::chrono::steady_clock::now();
+    if(now - m_report_time < std::chrono::seconds(REPORT_INTERVAL_S))
+        return;
+    m_report_time = now;
+    LOG_INFO("Frame allocator: %lu hits, %lu misses, %zu MB resident, "
+             "%zu of %zu MB of the pool in use",
+             (unsigned long) m_hits, (unsigned long) m_misses,
+             (m_pool_size + m_heap_bytes) >> 20, m_pool_used >> 20,
+             m_pool_size >> 20);
+}
+
+FrameAllocator* eii::vi::init_frame_allocator(config_t* config) {
+    config_value_t* cvt = config->get_config_value(config->cfg, FRAME_ALLOCATOR);
+    if(cvt == NULL)
+        return NULL;
+    std::lock_guard<std::mutex> lk(g_allocator_mtx);
+    FrameAllocator* allocator = g_allocator.load();
+    if(allocator != NULL) {
+        LOG_INFO_0("Frame allocator already created, config changes are "
+                   "applied once the process is restarted");
+        config_value_destroy(cvt);
+        return allocator;
+    }
+    try {
+        allocator = new FrameAllocator(cvt);
+    } catch(const char*) {
+        config_value_destroy(cvt);
+        throw;
+    }
+    config_value_destroy(cvt);
+    g_allocator.store(allocator);
+    return allocator;
+}
+
+FrameAllocator* eii::vi::get_frame_allocator() {
+    return g_allocator.load();
+}
+
+void* eii_frame_alloc(size_t size) {
+    FrameAllocator* allocator = g_allocator.load();
+    return (allocator != NULL) ? allocator->allocate(size) : NULL;
+}
+
+void eii_frame_free(void* ptr) {
+    FrameAllocator* allocator = g_allocator.load();
+    if(allocator != NULL)
+        allocator->release(ptr);
+}
@@ -0,0 +1,317 @@
+// Copyright (c) 2021 Intel Corporation.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM,OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+
+/**
+ * @file
+ * @brief Batched frame hand-off implementation
+ */
+
+#include <string.h>
+#include <string>
+#include <algorithm>
+#include <cjson/cJSON.h>
+#include <eii/utils/logger.h>
+#include "eii/vi/frame_batcher.h"
+#include "eii/vi/ingestor.h"
+#include "eii/vi/utils.h"
+
+// Defaults
+#define DEFAULT_MAX_FRAMES 4
+#define DEFAULT_MAX_WAIT_MS 100
+
+// Maximum time the threads wait for a frame before checking whether they
+// have to stop
+#define QUEUE_WAIT_MS 250
+
+using namespace eii::vi;
+using namespace eii::udf;
+
+// Metadata keys describing the frame itself, which are never copied from a
+// batch to the batched frames
+static const char* const g_frame_keys[] = {
+    "img_handle", "width", "height", "channels", "encoding_type",
+    "encoding_level", BATCH_KEY, BATCH_ID_KEY, BATCH_SIZE_KEY, NULL
+};
+
+/**
+ * Free method of the batched frames other than the first one, which are
+ * released along with the batch
+ */
+static void free_nothing(void* obj) {}
+
+FrameBatcher::FrameBatcher(const config_value_t* config, FrameQueue* input_queue, FrameQueue* output_queue, size_t queue_size) :
+    m_input_queue(input_queue), m_output_queue(output_queue),
+    m_batch_queue(NULL), m_result_queue(NULL), m_next_id(0),
+    m_next_unbatch(0), m_batcher_th(NULL), m_unbatcher_th(NULL),
+    m_stop(false) {
+    if(config->type != CVT_OBJECT) {
+        const char* err = "JSON value must be an object";
+        LOG_ERROR("%s for \'%s\'", err, BATCHING);
+        throw(err);
+    }
+    m_max_frames = (size_t) get_config_int(config, "max_frames",
+                                           DEFAULT_MAX_FRAMES, 1);
+    m_max_wait = std::chrono::milliseconds(get_config_int(
+                config, "max_wait_ms", DEFAULT_MAX_WAIT_MS, 0));
+    m_batch_queue = new FrameQueue(queue_size);
+    m_result_queue = new FrameQueue(queue_size);
+    LOG_INFO("Batching up to %zu frames within %ld ms", m_max_frames,
+             (long) m_max_wait.count());
+}
+
+FrameBatcher::~FrameBatcher() {
+    stop();
+    // Releasing a batch also releases its frames
+    FrameQueue* queues[] = { m_batch_queue, m_result_queue };
+    for(FrameQueue* queue : queues) {
+        while(!queue->empty()) {
+            Frame* frame = queue->front();
+            queue->pop();
+            delete frame;
+        }
+        delete queue;
+    }
+    for(auto& it : m_reorder)
+        delete it.second;
+}
+
+FrameQueue* FrameBatcher::get_udf_input_queue() {
+    return m_batch_queue;
+}
+
+FrameQueue* FrameBatcher::get_udf_output_queue() {
+    return m_result_queue;
+}
+
+void FrameBatcher::start() {
+    if(m_batcher_th != NULL)
+        return;
+    m_stop.store(false);
+    m_unbatcher_th = new std::thread(&FrameBatcher::run_unbatcher, this);
+    m_batcher_th = new std::thread(&FrameBatcher::run_batcher, this);
+}
+
+void FrameBatcher::stop() {
+    if(m_batcher_th == NULL)
+        return;
+    m_stop.store(true);
+    m_batcher_th->join();
+    m_unbatcher_th->join();
+    delete m_batcher_th;
+    delete m_unbatcher_th;
+    m_batcher_th = NULL;
+    m_unbatcher_th = NULL;
+}
+
+void FrameBatcher::run_batcher() {
+    LOG_INFO_0("Batcher thread started");
+    std::vector<Frame*> pending;
+    pending.reserve(m_max_frames);
+    auto deadline = std::chrono::steady_clock::now();
+    while(!m_stop.load()) {
+        // Wait no longer than the pending frames may be held back, rounded
+        // up to full milliseconds
+        auto timeout = std::chrono::milliseconds(QUEUE_WAIT_MS);
+        if(!pending.empty()) {
+            auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    deadline - std::chrono::steady_clock::now() +
+                    std::chrono::microseconds(999));
+            timeout = std::max(std::chrono::milliseconds(0),
+                               std::min(timeout, left));
+        }
+        if(m_input_queue->wait_for(timeout)) {
+            Frame* frame = m_input_queue->front();
+            m_input_queue->pop();
+            if(pending.empty())
+                deadline = std::chrono::steady_clock::now() + m_max_wait;
+            pending.push_back(frame);
+        }
+        if(!pending.empty() && (pending.size() >= m_max_frames ||
+                                std::chrono::steady_clock::now() >= deadline))
+            flush(pending);
+    }
+    if(!pending.empty())
+        flush(pending);
+    LOG_INFO_0("Batcher thread stopped");
+}
+
+void FrameBatcher::flush(std::vector<Frame*>& pending) {
+    FrameBatch* batch = new FrameBatch();
+    batch->batcher = this;
+    batch->id = m_next_id++;
+    batch->frames.swap(pending);
+
+    cJSON* entries = cJSON_CreateArray();
+    for(Frame* frame : batch->frames) {
+        cJSON* entry = meta_to_json(frame->get_meta_data());
+        if(entry == NULL) {
+            LOG_WARN_0("Failed to serialize frame meta-data for the batch");
+            entry = cJSON_CreateObject();
+        }
+        cJSON_AddItemToArray(entries, entry);
+    }
+
+    {
+        std::lock_guard<std::mutex> lk(m_mtx);
+        m_batches[batch->id] = batch;
+    }
+
+    // The batch refers to the data of the frames, the batch object is
+    // released along with the first one
+    Frame* first = batch->frames[0];
+    Frame* frame = new Frame(batch, free_batch, first->get_data(0),
+                             first->get_width(0), first->get_height(0),
+                             first->get_channels(0));
+    for(size_t i = 1; i < batch->frames.size(); i++) {
+        Frame* batched = batch->frames[i];
+        frame->add_frame(NULL, free_nothing, batched->get_data(0),
+                         batched->get_width(0), batched->get_height(0),
+                         batched->get_channels(0));
+    }
+
+    msg_envelope_t* meta = frame->get_meta_data();
+    msg_envelope_elem_body_t* id = msgbus_msg_envelope_new_integer(batch->id);
+    msg_envelope_elem_body_t* size = msgbus_msg_envelope_new_integer(
+            (int64_t) batch->frames.size());
+    msg_envelope_elem_body_t* array = json_to_elem(entries);
+    cJSON_Delete(entries);
+    bool ret = true;
+    msg_envelope_elem_body_t* elems[] = { id, size, array };
+    const char* keys[] = { BATCH_ID_KEY, BATCH_SIZE_KEY, BATCH_KEY };
+    for(int i = 0; i < 3; i++) {
+        if(!ret || elems[i] == NULL ||
+           msgbus_msg_envelope_put(meta, keys[i], elems[i]) != MSG_SUCCESS) {
+            if(elems[i] != NULL)
+                msgbus_msg_envelope_elem_destroy(elems[i]);
+            ret = false;
+        }
+    }
+    if(!ret) {
+        LOG_ERROR_0("Failed to put batch meta-data, frames dropped");
+        delete frame;
+        return;
+    }
+
+    QueueRetCode ret_queue = m_batch_queue->push(frame);
+    if(ret_queue == QueueRetCode::QUEUE_FULL &&
+       m_batch_queue->push_wait(frame) != QueueRetCode::SUCCESS) {
+        LOG_ERROR_0("Failed to enqueue batch, frames dropped");
+        delete frame;
+    }
+}
+
+void FrameBatcher::free_batch(void* obj) {
+    FrameBatch* batch = (FrameBatch*) obj;
+    FrameBatcher* batcher = batch->batcher;
+    {
+        std::lock_guard<std::mutex> lk(batcher->m_mtx);
+        batcher->m_batches.erase(batch->id);
+        // Frames which were not unbatched were dropped by the UDFs, the
+        // unbatcher skips the batch
+        if(!batch->frames.empty())
+            batcher->m_dropped.insert(batch->id);
+    }
+    for(Frame* frame : batch->frames)
+        delete frame;
+    delete batch;
+}
+
+void FrameBatcher::run_unbatcher() {
+    LOG_INFO_0("Unbatcher thread started");
+    while(!m_stop.load()) {
+        if(m_result_queue->wait_for(std::chrono::milliseconds(QUEUE_WAIT_MS))) {
+            Frame* frame = m_result_queue->front();
+            m_result_queue->pop();
+            msg_envelope_elem_body_t* id = NULL;
+            if(msgbus_msg_envelope_get(frame->get_meta_data(), BATCH_ID_KEY, &id) == MSG_SUCCESS &&
+               id->type == MSG_ENV_DT_INT) {
+                m_reorder[id->body.integer] = frame;
+            } else {
+                // Not a batch, e.g. created by a UDF
+                QueueRetCode ret = m_output_queue->push(frame);
+                if(ret == QueueRetCode::QUEUE_FULL &&
+                   m_output_queue->push_wait(frame) != QueueRetCode::SUCCESS) {
+                    LOG_ERROR_0("Failed to enqueue frame, frame dropped");
+                    delete frame;
+                }
+            }
+        }
+        unbatch_ready();
+    }
+    LOG_INFO_0("Unbatcher thread stopped");
+}
+
+void FrameBatcher::unbatch_ready() {
+    while(true) {
+        auto it = m_reorder.find(m_next_unbatch);
+        if(it != m_reorder.end()) {
+            Frame* batch = it->second;
+            m_reorder.erase(it);
+            m_next_unbatch++;
+            unbatch(batch);
+            continue;
+        }
+        std::lock_guard<std::mutex> lk(m_mtx);
+        if(m_dropped.erase(m_next_unbatch) == 0)
+            break;
+        m_next_unbatch++;
+    }
+}
+
+void FrameBatcher::unbatch(Frame* batch) {
+    msg_envelope_elem_body_t* id = NULL;
+    msgbus_msg_envelope_get(batch->get_meta_data(), BATCH_ID_KEY, &id);
+    std::vector<Frame*> frames;
+    {
+        std::lock_guard<std::mutex> lk(m_mtx);
+        auto it = m_batches.find(id->body.integer);
+        if(it != m_batches.end())
+            frames.swap(it->second->frames);
+    }
+
+    // Results of the UDFs for the whole batch and for every frame
+    cJSON* meta = meta_to_json(batch->get_meta_data());
+    if(meta == NULL)
+        LOG_ERROR_0("Failed to serialize batch meta-data, UDF results dropped");
+    const cJSON* entry = (meta != NULL) ?
+        cJSON_GetObjectItem(meta, BATCH_KEY) : NULL;
+    entry = (cJSON_IsArray(entry)) ? entry->child : NULL;
+    for(Frame* frame : frames) {
+        if(meta != NULL) {
+            if(cJSON_IsObject(entry))
+                merge_json_meta(frame->get_meta_data(), entry, g_frame_keys);
+            merge_json_meta(frame->get_meta_data(), meta, g_frame_keys);
+        }
+        if(entry != NULL)
+            entry = entry->next;
+    }
+    cJSON_Delete(meta);
+    delete batch;
+
+    for(Frame* frame : frames) {
+        QueueRetCode ret = m_output_queue->push(frame);
+        if(ret == QueueRetCode::QUEUE_FULL &&
+           m_output_queue->push_wait(frame) != QueueRetCode::SUCCESS) {
+            LOG_ERROR_0("Failed to enqueue frame, frame dropped");
+            delete frame;
+        }
+    }
+}
@@ -0,0 +1,233 @@
+// Copyright (c) 2021 Intel Corporation.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM,OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+/**
+ * @file
+ * @brief Lossless LZ4/zstd frame compression implementation
+ */
+
+#include <stdint.h>
+#include <cstring>
+#include <algorithm>
+#include <lz4.h>
+#include <lz4hc.h>
+#include <zstd.h>
+#include <eii/utils/logger.h>
+#include "eii/vi/frame_compressor.h"
+
+using namespace eii::vi;
+
+#define DEFAULT_LEVEL 1
+
+// Pixel format with 16-bit samples, all other formats have 8-bit samples
+#define PIXEL_FORMAT_GRAY16 "GRAY16_LE"
+
+/**
+ * Compression state of a thread, reused for every frame it compresses
+ */
+struct CompressionContext {
+    ZSTD_CCtx* zstd;
+    std::vector<char> lz4_state;
+    std::vector<char> lz4hc_state;
+    std::vector<unsigned char> filtered;
+    // Compression buffer of the largest bound seen, so that it is neither
+    // reallocated nor zeroed for every frame
+    std::vector<char> compressed;
+
+    CompressionContext() : zstd(NULL) {}
+
+    ~CompressionContext() {
+        if(zstd != NULL)
+            ZSTD_freeCCtx(zstd);
+    }
+};
+
+static thread_local CompressionContext g_ctx;
+
+/**
+ * Apply a filter to the rows of a frame with samples of type T, residuals
+ * wrap around modulo the sample range so the filter is lossless
+ * @param samples - Samples per pixel
+ */
+template <typename T>
+static void filter_rows(const T* src, T* dst, int width, int height, int samples,
+                        CompressionFilter filter) {
+    size_t row_len = (size_t) width * samples;
+    for(int y = 0; y < height; ++y) {
+        const T* cur = src + y * row_len;
+        const T* up = (y > 0) ? cur - row_len : NULL;
+        T* out = dst + y * row_len;
+        if(filter == CompressionFilter::DELTA) {
+            for(size_t i = 0; i < row_len; ++i)
+                out[i] = (T) (cur[i] - ((i >= (size_t) samples) ? cur[i - samples] : 0));
+            continue;
+        }
+        for(size_t i = 0; i < row_len; ++i) {
+            int a = (i >= (size_t) samples) ? cur[i - samples] : ((up != NULL) ? up[i] : 0);
+            int b = (up != NULL) ? up[i] : a;
+            int c = (up != NULL && i >= (size_t) samples) ? up[i - samples] : b;
+            int pred = 0;
+            if(c >= std::max(a, b))
+                pred = std::min(a, b);
+            else if(c <= std::min(a, b))
+                pred = std::max(a, b);
+            else
+                pred = a + b - c;
+            out[i] = (T) (cur[i] - pred);
+        }
+    }
+}
+
+FrameCompressor::FrameCompressor(const config_value_t* encoding) :
+    m_level(DEFAULT_LEVEL), m_filter(CompressionFilter::NONE) {
+    config_value_t* type = config_value_object_get(encoding, "type");
+    if(type == NULL || type->type != CVT_STRING || !is_compression(type->body.string)) {
+        if(type != NULL)
+            config_value_destroy(type);
+        const char* err = "Compression type has to be lz4 or zstd";
+        LOG_ERROR("%s", err);
+        throw(err);
+    }
+    m_type = type->body.string;
+    config_value_destroy(type);
+
+    const char* err = NULL;
+    config_value_t* level = config_value_object_get(encoding, "level");
+    if(level != NULL) {
+        int max_level = (m_type == COMPRESSION_LZ4) ? LZ4HC_CLEVEL_MAX : ZSTD_maxCLevel();
+        if(level->type != CVT_INTEGER || level->body.integer < 1 || level->body.integer > max_level) {
+            err = (m_type == COMPRESSION_LZ4) ?
+                "Output lz4 compression level has to be between 1 and 12" :
+                "Output zstd compression level has to be between 1 and the maximum zstd level";
+        } else {
+            m_level = (int) level->body.integer;
+        }
+        config_value_destroy(level);
+    }
+    config_value_t* filter = config_value_object_get(encoding, COMPRESSION_FILTER);
+    if(err == NULL && filter != NULL) {
+        if(filter->type == CVT_STRING && !strcmp(filter->body.string, "none")) {
+            m_filter = CompressionFilter::NONE;
+        } else if(filter->type == CVT_STRING && !strcmp(filter->body.string, "delta")) {
+            m_filter = CompressionFilter::DELTA;
+        } else if(filter->type == CVT_STRING && !strcmp(filter->body.string, "predict")) {
+            m_filter = CompressionFilter::PREDICT;
+        } else {
+            err = "Output compression filter has to be none, delta or predict";
+        }
+    }
+    if(filter != NULL)
+        config_value_destroy(filter);
+    if(err != NULL) {
+        LOG_ERROR("%s", err);
+        throw(err);
+    }
+}
+
+bool FrameCompressor::is_compression(const char* type) {
+    return !strcmp(type, COMPRESSION_LZ4) || !strcmp(type, COMPRESSION_ZSTD);
+}
+
+const std::string& FrameCompressor::get_type() const {
+    return m_type;
+}
+
+int FrameCompressor::get_level() const {
+    return m_level;
+}
+
+const char* FrameCompressor::get_filter_name() const {
+    switch(m_filter) {
+        case CompressionFilter::DELTA:
+            return "delta";
+        case CompressionFilter::PREDICT:
+            return "predict";
+        default:
+            return NULL;
+    }
+}
+
+void FrameCompressor::filter(const unsigned char* src, unsigned char* dst, int width, int height,
+                             int samples, int sample_size) const {
+    if(sample_size == 2) {
+        filter_rows((const uint16_t*) src, (uint16_t*) dst, width, height, samples, m_filter);
+    } else {
+        filter_rows(src, dst, width, height, samples, m_filter);
+    }
+}
+
+bool FrameCompressor::compress(const void* data, int width, int height, int channels,
+                               const char* pixel_format, std::vector<unsigned char>& out) const {
+    size_t len = (size_t) width * height * channels;
+    const char* src = (const char*) data;
+    if(m_filter != CompressionFilter::NONE) {
+        int sample_size = (pixel_format != NULL && !strcmp(pixel_format, PIXEL_FORMAT_GRAY16)) ? 2 : 1;
+        g_ctx.filtered.resize(len);
+        filter((const unsigned char*) data, g_ctx.filtered.data(), width, height,
+               channels / sample_size, sample_size);
+        src = (const char*) g_ctx.filtered.data();
+    }
+
+    if(m_type == COMPRESSION_LZ4) {
+        if(len > LZ4_MAX_INPUT_SIZE) {
+            LOG_ERROR("Frame of %zu bytes is too large for lz4", len);
+            return false;
+        }
+        size_t bound = LZ4_compressBound((int) len);
+        if(g_ctx.compressed.size() < bound)
+            g_ctx.compressed.resize(bound);
+        int size = 0;
+        if(m_level == 1) {
+            if(g_ctx.lz4_state.empty())
+                g_ctx.lz4_state.resize(LZ4_sizeofState());
+            size = LZ4_compress_fast_extState(g_ctx.lz4_state.data(), src, g_ctx.compressed.data(),
+                                              (int) len, (int) bound, 1);
+        } else {
+            if(g_ctx.lz4hc_state.empty())
+                g_ctx.lz4hc_state.resize(LZ4_sizeofStateHC());
+            size = LZ4_compress_HC_extStateHC(g_ctx.lz4hc_state.data(), src, g_ctx.compressed.data(),
+                                              (int) len, (int) bound, m_level);
+        }
+        if(size <= 0) {
+            LOG_ERROR_0("Failed to lz4 compress frame");
+            return false;
+        }
+        out.assign(g_ctx.compressed.data(), g_ctx.compressed.data() + size);
+        return true;
+    }
+
+    if(g_ctx.zstd == NULL) {
+        g_ctx.zstd = ZSTD_createCCtx();
+        if(g_ctx.zstd == NULL) {
+            LOG_ERROR_0("Failed to create zstd context");
+            return false;
+        }
+    }
+    size_t bound = ZSTD_compressBound(len);
+    if(g_ctx.compressed.size() < bound)
+        g_ctx.compressed.resize(bound);
+    size_t size = ZSTD_compressCCtx(g_ctx.zstd, g_ctx.compressed.data(), bound, src, len, m_level);
+    if(ZSTD_isError(size)) {
+        LOG_ERROR("Failed to zstd compress frame: %s", ZSTD_getErrorName(size));
+        return false;
+    }
+    out.assign(g_ctx.compressed.data(), g_ctx.compressed.data() + size);
+    return true;
+}
@@ -0,0 +1,213 @@
+// Copyright (c) 2021 Intel Corporation.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM,OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+
+/**
+ * @file
+ * @brief Frame pyramid implementation
+ */
+
+#include <string.h>
+#include <algorithm>
+#include <cjson/cJSON.h>
+#include <eii/utils/logger.h>
+#include "eii/vi/ingestor.h"
+#include "eii/vi/frame_pyramid.h"
+#include "eii/vi/utils.h"
+
+using namespace eii::vi;
+using namespace eii::udf;
+
+// Packed 8 bit pixel formats which can be resized
+static const char* const g_resizable_formats[] = {
+    "BGR", "RGB", "BGRx", "BGRA", "RGBx", "RGBA", "GRAY8", NULL
+};
+
+/**
+ * Free callback of the pyramid frames
+ */
+static void free_pyramid_frame(void* obj) {
+    delete (cv::Mat*) obj;
+}
+
+/**
+ * Check whether a frame consists of packed 8 bit pixels
+ */
+static bool is_resizable(Frame* frame) {
+    int channels = frame->get_channels(0);
+    if(channels != 1 && channels != 3 && channels != 4)
+        return false;
+    const char* format = get_pixel_format(frame);
+    if(format == NULL)
+        return true;
+    for(int i = 0; g_resizable_formats[i] != NULL; i++) {
+        if(!strcmp(format, g_resizable_formats[i]))
+            return true;
+    }
+    return false;
+}
+
+/**
+ * Parse a single pyramid level config
+ */
+static PyramidLevel parse_level(const config_value_t* cvt_level) {
+    if(cvt_level == NULL || cvt_level->type != CVT_OBJECT) {
+        const char* err = "Pyramid levels must be objects";
+        LOG_ERROR("%s", err);
+        throw(err);
+    }
+    PyramidLevel level;
+    config_value_t* cvt_name = config_value_object_get(cvt_level, "name");
+    if(cvt_name == NULL || cvt_name->type != CVT_STRING) {
+        if(cvt_name != NULL)
+            config_value_destroy(cvt_name);
+        const char* err = "Pyramid level name must be a string";
+        LOG_ERROR("%s", err);
+        throw(err);
+    }
+    level.name = cvt_name->body.string;
+    config_value_destroy(cvt_name);
+    level.size = cv::Size((int) get_required_config_int(cvt_level, "width", 1),
+                          (int) get_required_config_int(cvt_level, "height", 1));
+
+    level.interpolation = cv::INTER_AREA;
+    config_value_t* cvt_inter = config_value_object_get(cvt_level, "interpolation");
+    if(cvt_inter != NULL) {
+        if(cvt_inter->type != CVT_STRING) {
+            config_value_destroy(cvt_inter);
+            const char* err = "Pyramid level interpolation must be a string";
+            LOG_ERROR("%s", err);
+            throw(err);
+        }
+        std::string inter = cvt_inter->body.string;
+        config_value_destroy(cvt_inter);
+        if(inter == PYRAMID_INTER_LINEAR) {
+            level.interpolation = cv::INTER_LINEAR;
+        } else if(inter != PYRAMID_INTER_AREA) {
+            const char* err = "Unsupported pyramid interpolation";
+            LOG_ERROR("%s \'%s\'", err, inter.c_str());
+            throw(err);
+        }
+    }
+    level.source = -1;
+    return level;
+}
+
+FramePyramid::FramePyramid(const config_value_t* pyramid) :
+    m_format_warned(false) {
+    if(pyramid->type != CVT_ARRAY || config_value_array_len(pyramid) == 0) {
+        const char* err = "Pyramid config must be a non empty array";
+        LOG_ERROR("%s", err);
+        throw(err);
+    }
+    size_t len = config_value_array_len(pyramid);
+    for(size_t i = 0; i < len; i++) {
+        config_value_t* cvt_level = config_value_array_get(pyramid, i);
+        try {
+            m_levels.push_back(parse_level(cvt_level));
+        } catch(const char*) {
+            if(cvt_level != NULL)
+                config_value_destroy(cvt_level);
+            throw;
+        }
+        config_value_destroy(cvt_level);
+    }
+
+    // Compute the largest levels first and resize every level from the
+    // smallest computed level it fits into
+    for(size_t i = 0; i < m_levels.size(); i++)
+        m_order.push_back(i);
+    std::stable_sort(m_order.begin(), m_order.end(), [this](size_t a, size_t b) {
+        return m_levels[a].size.area() > m_levels[b].size.area();
+    });
+    for(size_t i = 0; i < m_order.size(); i++) {
+        PyramidLevel& level = m_levels[m_order[i]];
+        for(size_t j = 0; j < i; j++) {
+            const PyramidLevel& candidate = m_levels[m_order[j]];
+            if(candidate.size.width >= level.size.width &&
+               candidate.size.height >= level.size.height)
+                level.source = (int) m_order[j];
+        }
+        LOG_INFO("Pyramid level %s: %dx%d from %s", level.name.c_str(),
+                 level.size.width, level.size.height,
+                 level.source < 0 ? "the frame" : m_levels[level.source].name.c_str());
+    }
+}
+
+void FramePyramid::build(const cv::Mat& src, std::vector<cv::Mat>& levels) {
+    levels.resize(m_levels.size());
+    for(size_t index : m_order) {
+        const PyramidLevel& level = m_levels[index];
+        const cv::Mat& from = level.source < 0 ? src : levels[level.source];
+        cv::resize(from, levels[index], level.size, 0, 0, level.interpolation);
+    }
+}
+
+void FramePyramid::apply(Frame* frame, EncodeType enc_type, int enc_lvl) {
+    if(!is_resizable(frame)) {
+        if(!m_format_warned.exchange(true)) {
+            LOG_WARN_0("Pyramid levels are only computed for packed 8 bit frames");
+        }
+        return;
+    }
+    int channels = frame->get_channels(0);
+    cv::Mat src(frame->get_height(0), frame->get_width(0),
+                CV_MAKETYPE(CV_8U, channels), frame->get_data(0));
+    std::vector<cv::Mat> levels;
+    build(src, levels);
+
+    cJSON* desc = cJSON_CreateArray();
+    int index = frame->get_number_of_frames();
+    for(size_t i = 0; i < levels.size(); i++) {
+        cv::Mat* mat = new cv::Mat(levels[i]);
+        frame->add_frame((void*) mat, free_pyramid_frame, (void*) mat->data,
+                         mat->cols, mat->rows, channels, enc_type, enc_lvl);
+        cJSON* item = cJSON_CreateObject();
+        cJSON_AddStringToObject(item, "name", m_levels[i].name.c_str());
+        cJSON_AddNumberToObject(item, "frame", index++);
+        cJSON_AddNumberToObject(item, "width", mat->cols);
+        cJSON_AddNumberToObject(item, "height", mat->rows);
+        cJSON_AddItemToArray(desc, item);
+    }
+
+    msg_envelope_elem_body_t* elem = json_to_elem(desc);
+    cJSON_Delete(desc);
+    if(elem == NULL ||
+       msgbus_msg_envelope_put(frame->get_meta_data(), PYRAMID_META_KEY, elem) != MSG_SUCCESS) {
+        LOG_ERROR_0("Failed to put pyramid meta-data");
+        if(elem != NULL)
+            msgbus_msg_envelope_elem_destroy(elem);
+    }
+}
+
+FramePyramid* eii::vi::get_frame_pyramid(config_t* config) {
+    config_value_t* cvt_pyramid = config->get_config_value(config->cfg, PYRAMID);
+    if(cvt_pyramid == NULL)
+        return NULL;
+    FramePyramid* pyramid = NULL;
+    try {
+        pyramid = new FramePyramid(cvt_pyramid);
+    } catch(...) {
+        config_value_destroy(cvt_pyramid);
+        throw;
+    }
+    config_value_destroy(cvt_pyramid);
+    return pyramid;
+}
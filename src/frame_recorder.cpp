@@ -0,0 +1,521 @@
+// Copyright (c) 2021 Intel Corporation.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM,OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+/**
+ * @file
+ * @brief Raw frame recorder implementation
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <eii/msgbus/msgbus.h>
+#include <eii/utils/logger.h>
+#include "eii/vi/frame_recorder.h"
+#include "eii/vi/utils.h"
+
+using namespace eii::vi;
+using namespace eii::udf;
+
+#define SEGMENT_SIZE_MB "segment_size_mb"
+#define BLOCK_SIZE_MB "block_size_mb"
+#define NUM_BLOCKS "num_blocks"
+#define O_DIRECT_KEY "o_direct"
+#define FLUSH_INTERVAL_MS "flush_interval_ms"
+#define PATH "path"
+
+#define DEFAULT_SEGMENT_SIZE_MB 1024
+#define DEFAULT_BLOCK_SIZE_MB 16
+#define DEFAULT_NUM_BLOCKS 4
+#define DEFAULT_FLUSH_INTERVAL_MS 500
+
+// Log every Nth dropped frame to avoid flooding the logs when the disk
+// cannot keep up
+#define DROP_LOG_INTERVAL 100
+
+#define ALIGN_UP(x, a) ((((x) + (a) - 1) / (a)) * (a))
+
+/**
+ * Helper to create a directory and all of its parents
+ */
+static bool make_dirs(const std::string& path) {
+    for(size_t pos = 1; pos <= path.size(); ++pos) {
+        if(pos != path.size() && path[pos] != '/')
+            continue;
+        std::string dir = path.substr(0, pos);
+        if(mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) {
+            LOG_ERROR("Failed to create directory %s: %s", dir.c_str(), strerror(errno));
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Helper to write a buffer completely, retrying on short writes
+ */
+static bool write_all(int fd, const uint8_t* buf, size_t len) {
+    while(len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if(n < 0) {
+            if(errno == EINTR)
+                continue;
+            return false;
+        }
+        buf += n;
+        len -= n;
+    }
+    return true;
+}
+
+static uint64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+std::vector<uint32_t> eii::vi::list_recording_segments(const std::string& path) {
+    std::vector<uint32_t> segments;
+    DIR* dir = opendir(path.c_str());
+    if(dir == NULL)
+        return segments;
+    struct dirent* entry = NULL;
+    while((entry = readdir(dir)) != NULL) {
+        unsigned int seq = 0;
+        char ext[8] = {0};
+        if(sscanf(entry->d_name, "segment_%u%7s", &seq, ext) == 2 &&
+                !strcmp(ext, VI_REC_DATA_EXT)) {
+            segments.push_back(seq);
+        }
+    }
+    closedir(dir);
+    std::sort(segments.begin(), segments.end());
+    return segments;
+}
+
+std::string eii::vi::recording_segment_path(const std::string& path, uint32_t seq) {
+    char name[32];
+    snprintf(name, sizeof(name), "segment_%08u", seq);
+    return path + "/" + name;
+}
+
+FrameRecorder::FrameRecorder(const config_value_t* config) :
+    m_current(NULL), m_th(NULL), m_stop(false), m_writing(false),
+    m_seg_fd(-1), m_idx_fd(-1), m_seg_size(0), m_seg_seq(0),
+    m_recorded(0), m_dropped(0), m_bytes(0) {
+    config_value_t* cvt_path = config_value_object_get(config, PATH);
+    if(cvt_path == NULL || cvt_path->type != CVT_STRING) {
+        if(cvt_path != NULL)
+            config_value_destroy(cvt_path);
+        const char* err = "Recorder config must contain a string";
+        LOG_ERROR("%s \'%s\'", err, PATH);
+        throw(err);
+    }
+    m_path = cvt_path->body.string;
+    config_value_destroy(cvt_path);
+
+    m_segment_size = get_config_int(config, SEGMENT_SIZE_MB, DEFAULT_SEGMENT_SIZE_MB, 1) << 20;
+    m_block_size = get_config_int(config, BLOCK_SIZE_MB, DEFAULT_BLOCK_SIZE_MB, 1) << 20;
+    m_num_blocks = get_config_int(config, NUM_BLOCKS, DEFAULT_NUM_BLOCKS, 1);
+    m_flush_interval = std::chrono::milliseconds(
+            get_config_int(config, FLUSH_INTERVAL_MS, DEFAULT_FLUSH_INTERVAL_MS, 1));
+
+    m_o_direct = false;
+    config_value_t* cvt_o_direct = config_value_object_get(config, O_DIRECT_KEY);
+    if(cvt_o_direct != NULL) {
+        if(cvt_o_direct->type != CVT_BOOLEAN) {
+            config_value_destroy(cvt_o_direct);
+            const char* err = "Recorder o_direct must be a boolean";
+            LOG_ERROR("%s", err);
+            throw(err);
+        }
+        m_o_direct = cvt_o_direct->body.boolean;
+        config_value_destroy(cvt_o_direct);
+    }
+
+    if(!make_dirs(m_path)) {
+        const char* err = "Failed to create recording directory";
+        LOG_ERROR("%s", err);
+        throw(err);
+    }
+
+    // Recordings are append-only, continue after any existing segment
+    std::vector<uint32_t> segments = list_recording_segments(m_path);
+    if(!segments.empty())
+        m_seg_seq = segments.back() + 1;
+
+    for(size_t i = 0; i < m_num_blocks; ++i) {
+        Block* block = new Block();
+        void* data = NULL;
+        if(posix_memalign(&data, VI_REC_ALIGN, m_block_size) != 0) {
+            delete block;
+            for(auto b : m_free_blocks) {
+                free(b->data);
+                delete b;
+            }
+            const char* err = "Failed to allocate recorder staging blocks";
+            LOG_ERROR("%s", err);
+            throw(err);
+        }
+        block->data = (uint8_t*) data;
+        block->capacity = m_block_size;
+        block->used = 0;
+        m_free_blocks.push_back(block);
+    }
+
+    LOG_INFO("Recording frames to %s (segment size: %zu MB, %zu x %zu MB "
+             "staging blocks, O_DIRECT: %s)", m_path.c_str(),
+             m_segment_size >> 20, m_num_blocks, m_block_size >> 20,
+             m_o_direct ? "true" : "false");
+
+    m_th = new std::thread(&FrameRecorder::run, this);
+}
+
+FrameRecorder::FrameRecorder(const FrameRecorder& src) {
+    throw "This object should not be copied";
+}
+
+FrameRecorder& FrameRecorder::operator=(const FrameRecorder& src) {
+    return *this;
+}
+
+FrameRecorder::~FrameRecorder() {
+    LOG_DEBUG_0("Frame recorder destructor");
+    {
+        std::lock_guard<std::mutex> lk(m_mtx);
+        submit_current();
+        m_stop = true;
+    }
+    m_cv.notify_all();
+    if(m_th != NULL) {
+        m_th->join();
+        delete m_th;
+    }
+    close_segment();
+    for(auto b : m_free_blocks) {
+        free(b->data);
+        delete b;
+    }
+    LOG_INFO("Frame recorder stopped: %lu frames recorded (%lu bytes), "
+             "%lu frames dropped", m_recorded.load(), m_bytes.load(),
+             m_dropped.load());
+}
+
+FrameRecorder::Block* FrameRecorder::acquire_block(size_t size) {
+    if(size <= m_block_size) {
+        if(m_free_blocks.empty())
+            return NULL;
+        Block* block = m_free_blocks.back();
+        m_free_blocks.pop_back();
+        return block;
+    }
+
+    // Frames larger than a staging block get a dedicated block, bounded
+    // by the same number of outstanding writes as the pooled blocks
+    if(m_write_queue.size() >= m_num_blocks)
+        return NULL;
+    void* data = NULL;
+    if(posix_memalign(&data, VI_REC_ALIGN, size) != 0)
+        return NULL;
+    Block* block = new Block();
+    block->data = (uint8_t*) data;
+    block->capacity = size;
+    block->used = 0;
+    return block;
+}
+
+void FrameRecorder::submit_current() {
+    if(m_current == NULL)
+        return;
+    if(m_current->used == 0) {
+        m_free_blocks.push_back(m_current);
+    } else {
+        m_write_queue.push_back(m_current);
+        m_cv.notify_all();
+    }
+    m_current = NULL;
+}
+
+bool FrameRecorder::record(Frame* frame, uint64_t capture_ts_ns) {
+    if(capture_ts_ns == 0)
+        capture_ts_ns = now_ns();
+
+    msg_envelope_serialized_part_t* parts = NULL;
+    int num_parts = msgbus_msg_envelope_serialize(frame->get_meta_data(), &parts);
+    if(num_parts <= 0) {
+        LOG_ERROR_0("Failed to serialize frame meta-data for recording");
+        m_dropped++;
+        return false;
+    }
+
+    int num_frames = frame->get_number_of_frames();
+    size_t header_size = sizeof(RecRecordHeader) + num_frames * sizeof(RecFrameDesc);
+    size_t meta_size = parts[0].len;
+
+    const char* pixel_format = get_pixel_format(frame);
+    if(pixel_format == NULL)
+        pixel_format = "";
+
+    std::vector<RecFrameDesc> descs(num_frames);
+    size_t offset = ALIGN_UP(header_size + meta_size, VI_REC_DATA_ALIGN);
+    for(int i = 0; i < num_frames; ++i) {
+        RecFrameDesc& desc = descs[i];
+        desc.width = frame->get_width(i);
+        desc.height = frame->get_height(i);
+        desc.channels = frame->get_channels(i);
+        desc.reserved = 0;
+        memset(desc.pixel_format, 0, sizeof(desc.pixel_format));
+        strncpy(desc.pixel_format, pixel_format, sizeof(desc.pixel_format) - 1);
+        desc.data_offset = offset;
+        desc.data_size = (uint64_t) desc.width * desc.height * desc.channels;
+        offset = ALIGN_UP(offset + desc.data_size, VI_REC_DATA_ALIGN);
+    }
+    size_t record_size = ALIGN_UP(offset, VI_REC_ALIGN);
+
+    std::unique_lock<std::mutex> lk(m_mtx);
+
+    if(m_current != NULL && m_current->capacity - m_current->used < record_size)
+        submit_current();
+    if(m_current == NULL) {
+        m_current = acquire_block(record_size);
+        if(m_current == NULL) {
+            lk.unlock();
+            msgbus_msg_envelope_serialize_destroy(parts, num_parts);
+            uint64_t dropped = ++m_dropped;
+            if(dropped % DROP_LOG_INTERVAL == 1) {
+                LOG_WARN("Recorder cannot keep up, %lu frames dropped from "
+                         "the recording so far", dropped);
+            }
+            return false;
+        }
+        m_current_start = std::chrono::steady_clock::now();
+    }
+
+    uint8_t* dst = m_current->data + m_current->used;
+    memset(dst, 0, header_size);
+
+    RecRecordHeader* hdr = (RecRecordHeader*) dst;
+    hdr->magic = VI_REC_RECORD_MAGIC;
+    hdr->header_size = header_size;
+    hdr->record_size = record_size;
+    hdr->capture_ts_ns = capture_ts_ns;
+    hdr->num_frames = num_frames;
+    hdr->meta_size = meta_size;
+    hdr->meta_offset = header_size;
+    memcpy(dst + sizeof(RecRecordHeader), descs.data(), num_frames * sizeof(RecFrameDesc));
+    memcpy(dst + header_size, parts[0].bytes, meta_size);
+
+    size_t pos = header_size + meta_size;
+    for(int i = 0; i < num_frames; ++i) {
+        memset(dst + pos, 0, descs[i].data_offset - pos);
+        memcpy(dst + descs[i].data_offset, frame->get_data(i), descs[i].data_size);
+        pos = descs[i].data_offset + descs[i].data_size;
+    }
+    memset(dst + pos, 0, record_size - pos);
+
+    RecIndexEntry entry;
+    entry.offset = m_current->used;
+    entry.record_size = record_size;
+    entry.capture_ts_ns = hdr->capture_ts_ns;
+    entry.reserved = 0;
+    m_current->entries.push_back(entry);
+    m_current->used += record_size;
+
+    if(std::chrono::steady_clock::now() - m_current_start >= m_flush_interval)
+        submit_current();
+    lk.unlock();
+
+    msgbus_msg_envelope_serialize_destroy(parts, num_parts);
+    m_recorded++;
+    m_bytes += record_size;
+    return true;
+}
+
+void FrameRecorder::flush() {
+    std::unique_lock<std::mutex> lk(m_mtx);
+    submit_current();
+    m_cv.wait(lk, [this] { return m_write_queue.empty() && !m_writing; });
+}
+
+bool FrameRecorder::open_segment() {
+    std::string base = recording_segment_path(m_path, m_seg_seq);
+    std::string data_path = base + VI_REC_DATA_EXT;
+    std::string idx_path = base + VI_REC_INDEX_EXT;
+
+    int flags = O_WRONLY | O_CREAT | O_EXCL;
+    if(m_o_direct) {
+        m_seg_fd = open(data_path.c_str(), flags | O_DIRECT, 0644);
+        if(m_seg_fd < 0 && errno == EINVAL) {
+            LOG_WARN("O_DIRECT not supported for %s, using buffered writes",
+                     m_path.c_str());
+            m_o_direct = false;
+        }
+    }
+    if(!m_o_direct)
+        m_seg_fd = open(data_path.c_str(), flags, 0644);
+    if(m_seg_fd < 0) {
+        LOG_ERROR("Failed to create segment %s: %s", data_path.c_str(), strerror(errno));
+        return false;
+    }
+
+    m_idx_fd = open(idx_path.c_str(), flags | O_APPEND, 0644);
+    if(m_idx_fd < 0) {
+        LOG_ERROR("Failed to create index %s: %s", idx_path.c_str(), strerror(errno));
+        close(m_seg_fd);
+        m_seg_fd = -1;
+        return false;
+    }
+
+    // The segment header occupies a full aligned block so that all records
+    // start on an O_DIRECT compatible offset
+    void* buf = NULL;
+    if(posix_memalign(&buf, VI_REC_ALIGN, VI_REC_ALIGN) != 0) {
+        LOG_ERROR_0("Failed to allocate segment header");
+        close_segment();
+        return false;
+    }
+    memset(buf, 0, VI_REC_ALIGN);
+    RecSegmentHeader* hdr = (RecSegmentHeader*) buf;
+    memcpy(hdr->magic, VI_REC_SEGMENT_MAGIC, sizeof(hdr->magic));
+    hdr->version = VI_REC_VERSION;
+    hdr->alignment = VI_REC_ALIGN;
+    hdr->created_ns = now_ns();
+    bool ok = write_all(m_seg_fd, (uint8_t*) buf, VI_REC_ALIGN);
+    free(buf);
+    if(!ok) {
+        LOG_ERROR("Failed to write segment header: %s", strerror(errno));
+        close_segment();
+        return false;
+    }
+
+    LOG_INFO("Recording to segment %s", data_path.c_str());
+    m_seg_size = VI_REC_ALIGN;
+    m_seg_seq++;
+    return true;
+}
+
+void FrameRecorder::close_segment() {
+    if(m_seg_fd >= 0) {
+        fdatasync(m_seg_fd);
+        close(m_seg_fd);
+        m_seg_fd = -1;
+    }
+    if(m_idx_fd >= 0) {
+        close(m_idx_fd);
+        m_idx_fd = -1;
+    }
+    m_seg_size = 0;
+}
+
+bool FrameRecorder::write_block(Block* block) {
+    if(m_seg_fd >= 0 && m_seg_size > VI_REC_ALIGN &&
+            m_seg_size + block->used > m_segment_size) {
+        close_segment();
+    }
+    if(m_seg_fd < 0 && !open_segment())
+        return false;
+
+    if(!write_all(m_seg_fd, block->data, block->used)) {
+        LOG_ERROR("Failed to write recording segment: %s", strerror(errno));
+        close_segment();
+        return false;
+    }
+
+    // The index is only appended after the records it points to have been
+    // written, so a crash never leaves entries pointing past the data
+    for(auto& entry : block->entries)
+        entry.offset += m_seg_size;
+    if(!write_all(m_idx_fd, (const uint8_t*) block->entries.data(),
+                  block->entries.size() * sizeof(RecIndexEntry))) {
+        LOG_ERROR("Failed to write recording index: %s", strerror(errno));
+        close_segment();
+        return false;
+    }
+    m_seg_size += block->used;
+    return true;
+}
+
+void FrameRecorder::run() {
+    LOG_DEBUG_0("Frame recorder writer thread started");
+    std::unique_lock<std::mutex> lk(m_mtx);
+    while(true) {
+        if(m_write_queue.empty()) {
+            if(m_stop)
+                break;
+            m_cv.wait_for(lk, m_flush_interval);
+            // Flush a partially filled block if no new frames arrived
+            if(m_write_queue.empty() && m_current != NULL &&
+                    std::chrono::steady_clock::now() - m_current_start >= m_flush_interval) {
+                submit_current();
+            }
+            continue;
+        }
+
+        Block* block = m_write_queue.front();
+        m_write_queue.pop_front();
+        m_writing = true;
+        lk.unlock();
+
+        if(!write_block(block)) {
+            m_dropped += block->entries.size();
+            m_recorded -= block->entries.size();
+        }
+
+        lk.lock();
+        m_writing = false;
+        block->used = 0;
+        block->entries.clear();
+        if(block->capacity == m_block_size) {
+            m_free_blocks.push_back(block);
+        } else {
+            free(block->data);
+            delete block;
+        }
+        m_cv.notify_all();
+    }
+    LOG_DEBUG_0("Frame recorder writer thread stopped");
+}
+
+FrameRecorder* eii::vi::get_frame_recorder(config_t* config) {
+    config_value_t* cvt_recorder = config->get_config_value(config->cfg, RECORDER);
+    if(cvt_recorder == NULL)
+        return NULL;
+    if(cvt_recorder->type != CVT_OBJECT) {
+        config_value_destroy(cvt_recorder);
+        const char* err = "Recorder config must be an object";
+        LOG_ERROR("%s", err);
+        throw(err);
+    }
+    FrameRecorder* recorder = NULL;
+    try {
+        recorder = new FrameRecorder(cvt_recorder);
+    } catch(...) {
+        config_value_destroy(cvt_recorder);
+        throw;
+    }
+    config_value_destroy(cvt_recorder);
+    return recorder;
+}
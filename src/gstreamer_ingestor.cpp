@@ -27,10 +27,17 @@
 #include <chrono>
 #endif
 
+#include <algorithm>
+#include <utility>
 #include <cstring>
+#include <climits>
+#include <cfloat>
 #include "eii/utils/logger.h"
 #include "eii/vi/gstreamer_ingestor.h"
 #include "eii/vi/gva_roi_meta.h"
+#include "eii/vi/utils.h"
+#include "eii/vi/video_encoder.h"
+#include <gst/video/video.h>
 #include <eii/udf/frame.h>
 #include <eii/utils/thread_safe_queue.h>
 #include <sstream>
@@ -41,20 +48,56 @@
 #define UUID_LENGTH 5
 #define PIPELINE "pipeline"
 
+// Maximum time stop() waits for the pipeline to shut down
+#define STOP_TIMEOUT_MS 5000
+
+// Maximum time gstreamer_init() waits for the pipeline to preroll
+#define PREROLL_TIMEOUT_MS 10000
+
+// Live latency mode defaults
+#define DEFAULT_LIVE_MAX_BUFFERS 1
+#define DEFAULT_LATENCY_REPORT_INTERVAL 10
+
+// Reconnection defaults
+#define DEFAULT_STALL_TIMEOUT_MS 5000
+#define DEFAULT_BACKOFF_INITIAL_MS 500
+#define DEFAULT_BACKOFF_MAX_MS 30000
+
+// Lower bound of the stall watchdog period
+#define MIN_WATCHDOG_PERIOD_MS 100
+
+// Frame rate control defaults, the queue size default matches the one of
+// VideoIngestion
+#define DEFAULT_FPS_INTERVAL_MS 1000
+#define DEFAULT_FPS_HIGH_WATERMARK 0.75
+#define DEFAULT_FPS_LOW_WATERMARK 0.25
+#define DEFAULT_FPS_INCREASE_STEP 1.0
+#define DEFAULT_FPS_DECREASE_FACTOR 0.8
+#define DEFAULT_QUEUE_SIZE 10
+
+// Element and property the frame rate is controlled on
+#define GENCAMSRC "gencamsrc"
+#define GENCAMSRC_FRAME_RATE "frame-rate"
+
 using namespace eii::vi;
 using namespace eii::udf;
 
-static EncodeType g_enc_type;
-static bool g_first_frame = true;
-static int g_enc_lvl;
 // Prototypes
-static gboolean bus_call(GstBus* bus, GstMessage* msg, gpointer data);
+static gboolean quit_loop(gpointer data);
+
+/**
+ * Current time of the steady clock in nanoseconds
+ */
+static int64_t steady_now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
 
 GstreamerIngestor::GstreamerIngestor(config_t* config, FrameQueue* frame_queue, std::string service_name, std::condition_variable& snapshot_cv, EncodeType enc_type, int enc_lvl):
     Ingestor(config, frame_queue, service_name, snapshot_cv, enc_type, enc_lvl) {
-    g_enc_type = enc_type;
-    g_enc_lvl = enc_lvl;
-
+    // The ingestion thread only runs the main loop, frames are captured by
+    // the streaming threads of the source elements
+    m_capture_thread = false;
     config_value_t* cvt_pipeline = config->get_config_value(config->cfg, PIPELINE);
     LOG_INFO("cvt_pipeline initialized");
     if(cvt_pipeline == NULL) {
@@ -67,68 +110,560 @@ GstreamerIngestor::GstreamerIngestor(config_t* config, FrameQueue* frame_queue,
         throw(err);
     }
     m_pipeline = std::string(cvt_pipeline->body.string);
-    m_pipeline.append(" name=\"sink\"");
+    m_pipeline.append(" name=\"" MAIN_SINK "\"");
     LOG_INFO("Pipeline: %s", m_pipeline.c_str());
     config_value_destroy(cvt_pipeline);
 
-    m_frame_count = 0;
+    m_gva_meta_binary = false;
+    config_value_t* cvt_gva_meta_format = config->get_config_value(
+            config->cfg, GVA_META_FORMAT);
+    if(cvt_gva_meta_format != NULL) {
+        if(cvt_gva_meta_format->type != CVT_STRING) {
+            const char* err = "JSON value must be a string";
+            LOG_ERROR("%s for \'%s\'", err, GVA_META_FORMAT);
+            config_value_destroy(cvt_gva_meta_format);
+            throw(err);
+        }
+        std::string gva_meta_format = cvt_gva_meta_format->body.string;
+        config_value_destroy(cvt_gva_meta_format);
+        if(gva_meta_format == GVA_META_FORMAT_BINARY) {
+            m_gva_meta_binary = true;
+        } else if(gva_meta_format != GVA_META_FORMAT_JSON) {
+            const char* err = "Unsupported GVA metadata format";
+            LOG_ERROR("%s \'%s\'", err, gva_meta_format.c_str());
+            throw(err);
+        }
+    }
+    LOG_INFO("GVA metadata format: %s", m_gva_meta_binary ?
+             GVA_META_FORMAT_BINARY : GVA_META_FORMAT_JSON);
+
+    config_value_t* cvt_raw_tensors = config->get_config_value(
+            config->cfg, GVA_RAW_TENSORS);
+    if(cvt_raw_tensors != NULL) {
+        if(cvt_raw_tensors->type != CVT_ARRAY) {
+            const char* err = "JSON value must be an array";
+            LOG_ERROR("%s for \'%s\'", err, GVA_RAW_TENSORS);
+            config_value_destroy(cvt_raw_tensors);
+            throw(err);
+        }
+        size_t len = config_value_array_len(cvt_raw_tensors);
+        for(size_t i = 0; i < len; i++) {
+            config_value_t* cvt_tensor = config_value_array_get(cvt_raw_tensors, i);
+            if(cvt_tensor == NULL || cvt_tensor->type != CVT_STRING) {
+                const char* err = "JSON array values must be strings";
+                LOG_ERROR("%s for \'%s\'", err, GVA_RAW_TENSORS);
+                if(cvt_tensor != NULL)
+                    config_value_destroy(cvt_tensor);
+                config_value_destroy(cvt_raw_tensors);
+                throw(err);
+            }
+            m_raw_tensors.push_back(std::string(cvt_tensor->body.string));
+            LOG_INFO("Attaching raw data of GVA tensor: %s", cvt_tensor->body.string);
+            config_value_destroy(cvt_tensor);
+        }
+        config_value_destroy(cvt_raw_tensors);
+    }
+
+    m_live = false;
+    config_value_t* cvt_latency_mode = config->get_config_value(
+            config->cfg, LATENCY_MODE);
+    if(cvt_latency_mode != NULL) {
+        if(cvt_latency_mode->type != CVT_STRING) {
+            const char* err = "JSON value must be a string";
+            LOG_ERROR("%s for \'%s\'", err, LATENCY_MODE);
+            config_value_destroy(cvt_latency_mode);
+            throw(err);
+        }
+        std::string latency_mode = cvt_latency_mode->body.string;
+        config_value_destroy(cvt_latency_mode);
+        if(latency_mode == LATENCY_MODE_LIVE) {
+            m_live = true;
+        } else if(latency_mode != LATENCY_MODE_DEFAULT) {
+            const char* err = "Unsupported latency mode";
+            LOG_ERROR("%s \'%s\'", err, latency_mode.c_str());
+            throw(err);
+        }
+    }
+    m_live_max_buffers = DEFAULT_LIVE_MAX_BUFFERS;
+    config_value_t* cvt_max_buffers = config->get_config_value(
+            config->cfg, LIVE_MAX_BUFFERS);
+    if(cvt_max_buffers != NULL) {
+        if(cvt_max_buffers->type != CVT_INTEGER || cvt_max_buffers->body.integer < 1) {
+            const char* err = "JSON value must be a positive integer";
+            LOG_ERROR("%s for \'%s\'", err, LIVE_MAX_BUFFERS);
+            config_value_destroy(cvt_max_buffers);
+            throw(err);
+        }
+        m_live_max_buffers = (guint) cvt_max_buffers->body.integer;
+        config_value_destroy(cvt_max_buffers);
+    }
+    m_latency_report_interval = std::chrono::seconds(DEFAULT_LATENCY_REPORT_INTERVAL);
+    config_value_t* cvt_report_interval = config->get_config_value(
+            config->cfg, LATENCY_REPORT_INTERVAL);
+    if(cvt_report_interval != NULL) {
+        if(cvt_report_interval->type != CVT_INTEGER || cvt_report_interval->body.integer < 1) {
+            const char* err = "JSON value must be a positive integer";
+            LOG_ERROR("%s for \'%s\'", err, LATENCY_REPORT_INTERVAL);
+            config_value_destroy(cvt_report_interval);
+            throw(err);
+        }
+        m_latency_report_interval = std::chrono::seconds(cvt_report_interval->body.integer);
+        config_value_destroy(cvt_report_interval);
+    }
+    if(m_live) {
+        LOG_INFO("Live latency mode, appsink max-buffers: %u", m_live_max_buffers);
+    }
+
+    m_reconnect = false;
+    m_stall_timeout_ms = DEFAULT_STALL_TIMEOUT_MS;
+    m_backoff_initial_ms = DEFAULT_BACKOFF_INITIAL_MS;
+    m_backoff_max_ms = DEFAULT_BACKOFF_MAX_MS;
+    m_standby = false;
+    config_value_t* cvt_reconnect = config->get_config_value(
+            config->cfg, RECONNECT);
+    if(cvt_reconnect != NULL) {
+        if(cvt_reconnect->type != CVT_OBJECT) {
+            const char* err = "JSON value must be an object";
+            LOG_ERROR("%s for \'%s\'", err, RECONNECT);
+            config_value_destroy(cvt_reconnect);
+            throw(err);
+        }
+        try {
+            m_stall_timeout_ms = (int) get_config_int(cvt_reconnect,
+                    RECONNECT_STALL_TIMEOUT, DEFAULT_STALL_TIMEOUT_MS, 1);
+            m_backoff_initial_ms = (int) get_config_int(cvt_reconnect,
+                    RECONNECT_BACKOFF_INITIAL, DEFAULT_BACKOFF_INITIAL_MS, 1);
+            m_backoff_max_ms = (int) get_config_int(cvt_reconnect,
+                    RECONNECT_BACKOFF_MAX, DEFAULT_BACKOFF_MAX_MS, 1);
+        } catch(const char* err) {
+            config_value_destroy(cvt_reconnect);
+            throw;
+        }
+        config_value_t* cvt_standby = config_value_object_get(
+                cvt_reconnect, RECONNECT_STANDBY);
+        if(cvt_standby != NULL) {
+            if(cvt_standby->type != CVT_BOOLEAN) {
+                const char* err = "JSON value must be a boolean";
+                LOG_ERROR("%s for \'%s\'", err, RECONNECT_STANDBY);
+                config_value_destroy(cvt_standby);
+                config_value_destroy(cvt_reconnect);
+                throw(err);
+            }
+            m_standby = cvt_standby->body.boolean;
+            config_value_destroy(cvt_standby);
+        }
+        config_value_destroy(cvt_reconnect);
+        if(m_backoff_max_ms < m_backoff_initial_ms)
+            m_backoff_max_ms = m_backoff_initial_ms;
+        m_reconnect = true;
+        LOG_INFO("Pipeline reconnection enabled, stall timeout: %d ms, "
+                 "backoff: %d - %d ms, standby pipeline: %s",
+                 m_stall_timeout_ms, m_backoff_initial_ms, m_backoff_max_ms,
+                 m_standby ? "yes" : "no");
+    }
+    m_standby_pipeline = NULL;
+    m_watchdog_id = 0;
+    m_last_frame_ns.store(0);
+    m_frame_received.store(false);
+
+    m_fps_control = false;
+    m_fps_min = 0.0;
+    m_fps_max = 0.0;
+    m_fps_interval_ms = DEFAULT_FPS_INTERVAL_MS;
+    m_fps_high_watermark = DEFAULT_FPS_HIGH_WATERMARK;
+    m_fps_low_watermark = DEFAULT_FPS_LOW_WATERMARK;
+    m_fps_increase_step = DEFAULT_FPS_INCREASE_STEP;
+    m_fps_decrease_factor = DEFAULT_FPS_DECREASE_FACTOR;
+    m_queue_capacity = DEFAULT_QUEUE_SIZE;
+    config_value_t* cvt_fps_control = config->get_config_value(
+            config->cfg, FRAME_RATE_CONTROL);
+    if(cvt_fps_control != NULL) {
+        if(cvt_fps_control->type != CVT_OBJECT) {
+            const char* err = "JSON value must be an object";
+            LOG_ERROR("%s for '%s'", err, FRAME_RATE_CONTROL);
+            config_value_destroy(cvt_fps_control);
+            throw(err);
+        }
+        try {
+            // All frame rate control values have to be positive
+            m_fps_min = get_config_number(cvt_fps_control, FRAME_RATE_MIN, 0.0, DBL_MIN);
+            m_fps_max = get_config_number(cvt_fps_control, FRAME_RATE_MAX, 0.0, DBL_MIN);
+            m_fps_interval_ms = (int) get_config_number(cvt_fps_control,
+                    FRAME_RATE_INTERVAL, DEFAULT_FPS_INTERVAL_MS, DBL_MIN);
+            m_fps_high_watermark = get_config_number(cvt_fps_control,
+                    FRAME_RATE_HIGH_WATERMARK, DEFAULT_FPS_HIGH_WATERMARK, DBL_MIN);
+            m_fps_low_watermark = get_config_number(cvt_fps_control,
+                    FRAME_RATE_LOW_WATERMARK, DEFAULT_FPS_LOW_WATERMARK, DBL_MIN);
+            m_fps_increase_step = get_config_number(cvt_fps_control,
+                    FRAME_RATE_INCREASE_STEP, DEFAULT_FPS_INCREASE_STEP, DBL_MIN);
+            m_fps_decrease_factor = get_config_number(cvt_fps_control,
+                    FRAME_RATE_DECREASE_FACTOR, DEFAULT_FPS_DECREASE_FACTOR, DBL_MIN);
+        } catch(const char* err) {
+            config_value_destroy(cvt_fps_control);
+            throw;
+        }
+        config_value_destroy(cvt_fps_control);
+        if(m_fps_min <= 0.0 || m_fps_max < m_fps_min) {
+            const char* err = "Frame rate control requires 0 < min_fps <= max_fps";
+            LOG_ERROR("%s", err);
+            throw(err);
+        }
+        if(m_fps_low_watermark >= m_fps_high_watermark || m_fps_high_watermark > 1.0) {
+            const char* err = "Frame rate control requires low_watermark < high_watermark <= 1";
+            LOG_ERROR("%s", err);
+            throw(err);
+        }
+        if(m_fps_decrease_factor >= 1.0) {
+            const char* err = "Frame rate control decrease_factor must be below 1";
+            LOG_ERROR("%s", err);
+            throw(err);
+        }
+        m_fps_interval_ms = std::max(m_fps_interval_ms, 1);
+        config_value_t* cvt_queue_size = config->get_config_value(
+                config->cfg, "queue_size");
+        if(cvt_queue_size != NULL) {
+            if(cvt_queue_size->type == CVT_INTEGER && cvt_queue_size->body.integer > 0)
+                m_queue_capacity = (size_t) cvt_queue_size->body.integer;
+            config_value_destroy(cvt_queue_size);
+        }
+        m_fps_control = true;
+        LOG_INFO("Frame rate control enabled, %.2f - %.2f fps, queue "
+                 "watermarks: %.2f - %.2f of %zu frames",
+                 m_fps_min, m_fps_max, m_fps_low_watermark,
+                 m_fps_high_watermark, m_queue_capacity);
+    }
+    m_fps_source = NULL;
+    m_fps = 0.0;
+    m_fps_last_wait_ns = 0;
+    m_fps_control_id = 0;
+
     m_bus_watch_id = 0;
+    m_streams.push_back(new GstreamerStream(this, MAIN_SINK, NULL));
 
     int argc = 1;
     m_loop = NULL;
     m_gst_pipeline = NULL;
-    m_sink = NULL;
     m_snapshot = false;
+    m_run_done = true;
     char** argv = new char*[1];
     gst_init(&argc, &argv);
+
+    // Load and preroll the pipeline right away so that opening the source
+    // overlaps with the initialization of the other components
+    LOG_INFO_0("Initializing Gstreamer pipeline");
+    gstreamer_init();
+    m_initialized.store(true);
 }
 
 GstreamerIngestor::~GstreamerIngestor() {
-    if(m_gst_pipeline != NULL)
-        gst_object_unref(GST_OBJECT(m_gst_pipeline));
-    if(m_bus_watch_id != 0)
-        g_source_remove(m_bus_watch_id);
-    if(m_loop != NULL)
-        g_main_loop_unref(m_loop);
-    // TODO: What about the m_sink? TO BE VERIFIED...
+    stop();
+    // If the pipeline did not shut down in time it is still in use by the
+    // detached ingestion thread and is intentionally leaked
+    if(!m_hung.load()) {
+        gstreamer_deinit();
+        destroy_pipeline(m_standby_pipeline);
+        for(GstreamerStream* stream : m_streams)
+            delete stream;
+    }
 }
 
-void GstreamerIngestor::gstreamer_init(bool snapshot_mode) {
-    m_snapshot = snapshot_mode;
+void GstreamerIngestor::gstreamer_init() {
     // Initialize Glib loop
-    m_loop = g_main_loop_new(NULL, FALSE);
-    // TODO: Verify correctly initialized
-    // Load Gstreamer pipeline
-    m_gst_pipeline = gst_parse_launch((char*)&m_pipeline[0], NULL);
-    // TODO: Verify correctly loaded
-    // Get and configure the sink element
-    m_sink = gst_bin_get_by_name(GST_BIN(m_gst_pipeline), "sink");
-    // TODO: Check that the sink was correctly found
-    g_object_set(m_sink, "emit-signals", TRUE, NULL);
-    gulong ret = g_signal_connect(m_sink, "new-sample", G_CALLBACK(this->new_sample), this);
-    if (!ret) {
-        const char* err = "Connection to GCallback not successfull";
-        LOG_ERROR("%s", err);
-        throw err;
+    {
+        std::lock_guard<std::mutex> lk(m_loop_mtx);
+        m_loop = g_main_loop_new(NULL, FALSE);
+        // Honour a stop() issued before the loop existed
+        if(m_stop.load())
+            g_idle_add_full(G_PRIORITY_DEFAULT_IDLE, quit_loop, g_main_loop_ref(m_loop),
+                            (GDestroyNotify) g_main_loop_unref);
     }
-    // Get the GST bus
+    if(m_standby_pipeline != NULL) {
+        LOG_INFO_0("Failing over to the standby Gstreamer pipeline");
+        m_gst_pipeline = m_standby_pipeline;
+        m_standby_pipeline = NULL;
+    } else {
+        m_gst_pipeline = create_pipeline(true);
+        if(m_gst_pipeline == NULL) {
+            const char* err = "Failed to load Gstreamer pipeline";
+            LOG_ERROR("%s", err);
+            throw err;
+        }
+    }
+    // Get the GST bus. Messages posted while the pipeline was a standby
+    // are queued on the bus and dispatched now.
     GstBus* bus = gst_pipeline_get_bus(GST_PIPELINE(m_gst_pipeline));
     if ( bus == NULL ) {
         const char* err = "Failed to initialize GST bus";
         LOG_ERROR("%s", err);
         throw err;
     }
-    m_bus_watch_id = gst_bus_add_watch(bus, bus_call, m_loop);
+    m_bus_watch_id = gst_bus_add_watch(bus, bus_call, this);
     gst_object_unref(bus);
     // TODO: Verify bus actions happened correctly
 }
 
-void GstreamerIngestor::stop() {
-    if (m_loop != NULL)
-        g_main_loop_quit(m_loop);
-    // TODO: Should there be a wait here???
-    if (m_gst_pipeline != NULL)
+GstElement* GstreamerIngestor::create_pipeline(bool wait) {
+    // Load Gstreamer pipeline
+    GError* error = NULL;
+    GstElement* pipeline = gst_parse_launch((char*)&m_pipeline[0], &error);
+    if(error != NULL) {
+        if(pipeline == NULL) {
+            LOG_ERROR("Failed to parse Gstreamer pipeline: %s", error->message);
+        } else {
+            LOG_WARN("Gstreamer pipeline parsed with: %s", error->message);
+        }
+        g_error_free(error);
+    }
+    if(pipeline == NULL)
+        return NULL;
+    if(!m_placement.empty()) {
+        GstBus* bus = gst_pipeline_get_bus(GST_PIPELINE(pipeline));
+        gst_bus_set_sync_handler(bus, stream_status, this, NULL);
+        gst_object_unref(bus);
+    }
+    for(GstreamerStream* stream : m_streams) {
+        if(!connect_stream(pipeline, stream)) {
+            destroy_pipeline(pipeline);
+            return NULL;
+        }
+    }
+
+    // Preroll so that the source is opened and negotiated before the
+    // pipeline is started. Live sources return NO_PREROLL here, which is
+    // fine since they only start producing once PLAYING.
+    auto start = std::chrono::steady_clock::now();
+    GstStateChangeReturn state_ret = gst_element_set_state(
+            pipeline, GST_STATE_PAUSED);
+    if(!wait)
+        return pipeline;
+    if(state_ret == GST_STATE_CHANGE_ASYNC) {
+        state_ret = gst_element_get_state(
+                pipeline, NULL, NULL, PREROLL_TIMEOUT_MS * GST_MSECOND);
+    }
+    if(state_ret == GST_STATE_CHANGE_FAILURE) {
+        LOG_WARN_0("Failed to preroll Gstreamer pipeline, errors are reported once it is started");
+    } else {
+        LOG_INFO("Gstreamer pipeline prerolled in %ld ms",
+                 (long) elapsed_ms(start));
+    }
+    return pipeline;
+}
+
+void GstreamerIngestor::destroy_pipeline(GstElement*& pipeline) {
+    if(pipeline != NULL) {
+        gst_element_set_state(pipeline, GST_STATE_NULL);
+        gst_object_unref(GST_OBJECT(pipeline));
+        pipeline = NULL;
+    }
+}
+
+bool GstreamerIngestor::connect_stream(GstElement* pipeline, GstreamerStream* stream) {
+    // Get and configure the sink element, the pipeline holds a reference
+    // on it for as long as it exists
+    GstElement* sink = gst_bin_get_by_name(GST_BIN(pipeline), stream->sink_name.c_str());
+    if(sink == NULL) {
+        LOG_ERROR("appsink \'%s\' not found in the Gstreamer pipeline",
+                  stream->sink_name.c_str());
+        return false;
+    }
+    g_object_set(sink, "emit-signals", TRUE, NULL);
+    if(m_live)
+        configure_live(pipeline, sink);
+    gulong ret = g_signal_connect(sink, "new-sample", G_CALLBACK(new_sample), stream);
+    gst_object_unref(sink);
+    if (!ret) {
+        LOG_ERROR_0("Connection to GCallback not successfull");
+        return false;
+    }
+    return true;
+}
+
+void GstreamerIngestor::set_queue(FrameQueue* frame_queue, size_t queue_size) {
+    Ingestor::set_queue(frame_queue, queue_size);
+    m_queue_capacity = queue_size;
+    if(m_fps_control) {
+        LOG_INFO("Frame rate control queue capacity changed to %zu frames",
+                 m_queue_capacity);
+    }
+}
+
+void GstreamerIngestor::add_stream(const std::string& name, FrameQueue* queue) {
+    for(GstreamerStream* stream : m_streams) {
+        if(stream->sink_name == name) {
+            const char* err = "Stream already exists";
+            LOG_ERROR("%s \'%s\'", err, name.c_str());
+            throw(err);
+        }
+    }
+    GstreamerStream* stream = new GstreamerStream(this, name, queue);
+    m_streams.push_back(stream);
+    // The pipelines loaded so far are connected right away, later ones
+    // connect all streams when they are created
+    if((m_gst_pipeline != NULL && !connect_stream(m_gst_pipeline, stream)) ||
+       (m_standby_pipeline != NULL && !connect_stream(m_standby_pipeline, stream))) {
+        const char* err = "Failed to connect stream";
+        LOG_ERROR("%s \'%s\'", err, name.c_str());
+        throw(err);
+    }
+    LOG_INFO("Frames of appsink %s are pushed to a separate stream", name.c_str());
+}
+
+void GstreamerIngestor::gstreamer_deinit() {
+    if(m_gst_pipeline != NULL)
         gst_element_set_state(m_gst_pipeline, GST_STATE_NULL);
+    if(m_bus_watch_id != 0) {
+        g_source_remove(m_bus_watch_id);
+        m_bus_watch_id = 0;
+    }
+    destroy_pipeline(m_gst_pipeline);
+    // Caps are negotiated again when the pipeline is recreated
+    for(GstreamerStream* stream : m_streams) {
+        if(stream->caps != NULL) {
+            gst_caps_unref(stream->caps);
+            stream->caps = NULL;
+        }
+        stream->frame_width = 0;
+    }
+    std::lock_guard<std::mutex> lk(m_loop_mtx);
+    if(m_loop != NULL) {
+        g_main_loop_unref(m_loop);
+        m_loop = NULL;
+    }
+}
+
+/**
+ * Check whether an element is a queue
+ */
+static bool is_queue(GstElement* element) {
+    GstElementFactory* factory = gst_element_get_factory(element);
+    return factory != NULL &&
+        !strcmp(gst_plugin_feature_get_name(GST_PLUGIN_FEATURE(factory)), "queue");
+}
+
+/**
+ * Make a queue element drop old buffers instead of blocking upstream
+ */
+static void make_queue_leaky(const GValue* item, gpointer user_data) {
+    GstElement* element = GST_ELEMENT(g_value_get_object(item));
+    if(!is_queue(element))
+        return;
+    gst_util_set_object_arg(G_OBJECT(element), "leaky", "downstream");
+    LOG_DEBUG("Queue %s set to leak downstream", GST_OBJECT_NAME(element));
+}
+
+void GstreamerIngestor::configure_live(GstElement* pipeline, GstElement* sink) {
+    g_object_set(sink, "sync", FALSE, "max-buffers", m_live_max_buffers,
+                 "drop", TRUE, NULL);
+
+    // Elements created later on, e.g. by decodebin or rtspsrc, are not
+    // visited. Their queues do not block on the appsink as it drops.
+    GstIterator* it = gst_bin_iterate_recurse(GST_BIN(pipeline));
+    gst_iterator_foreach(it, make_queue_leaky, NULL);
+    gst_iterator_free(it);
+
+    // Insert a leaky queue in front of the appsink, so that the frame
+    // handoff in new_sample() runs in its own thread and never stalls the
+    // decoder. This is only possible if the appsink is already linked.
+    GstPad* sink_pad = gst_element_get_static_pad(sink, "sink");
+    GstPad* peer = gst_pad_get_peer(sink_pad);
+    if(peer == NULL) {
+        LOG_DEBUG_0("appsink not linked yet, no queue inserted");
+        gst_object_unref(sink_pad);
+        return;
+    }
+    GstElement* upstream = gst_pad_get_parent_element(peer);
+    bool upstream_queue = upstream != NULL && is_queue(upstream);
+    if(upstream != NULL)
+        gst_object_unref(upstream);
+    if(!upstream_queue) {
+        GstElement* queue = gst_element_factory_make("queue", NULL);
+        GstObject* parent = gst_object_get_parent(GST_OBJECT(sink));
+        if(queue != NULL && parent != NULL) {
+            g_object_set(queue, "max-size-buffers", m_live_max_buffers,
+                         "max-size-bytes", 0, "max-size-time", (guint64) 0, NULL);
+            gst_util_set_object_arg(G_OBJECT(queue), "leaky", "downstream");
+            gst_bin_add(GST_BIN(parent), queue);
+            GstPad* queue_sink = gst_element_get_static_pad(queue, "sink");
+            GstPad* queue_src = gst_element_get_static_pad(queue, "src");
+            gst_pad_unlink(peer, sink_pad);
+            if(GST_PAD_LINK_FAILED(gst_pad_link(peer, queue_sink)) ||
+               GST_PAD_LINK_FAILED(gst_pad_link(queue_src, sink_pad))) {
+                LOG_WARN_0("Failed to insert a leaky queue in front of the appsink");
+            } else {
+                LOG_DEBUG_0("Inserted a leaky queue in front of the appsink");
+            }
+            gst_object_unref(queue_sink);
+            gst_object_unref(queue_src);
+        } else if(queue != NULL) {
+            gst_object_unref(queue);
+        }
+        if(parent != NULL)
+            gst_object_unref(parent);
+    }
+    gst_object_unref(peer);
+    gst_object_unref(sink_pad);
+}
+
+void GstreamerIngestor::record_latency(uint64_t latency_us) {
+    m_latency.record(latency_us);
+    m_latency_total.record(latency_us);
+    auto now = std::chrono::steady_clock::now();
+    if(now - m_latency_report_time >= m_latency_report_interval) {
+        LOG_INFO("Glass to ingest latency: %s", m_latency.summary().c_str());
+        m_latency.reset();
+        m_latency_report_time = now;
+    }
+}
+
+/**
+ * Idle callback quitting the main loop from within the loop, so that a quit
+ * requested before the loop started running is not lost
+ */
+static gboolean quit_loop(gpointer data) {
+    g_main_loop_quit((GMainLoop*) data);
+    return G_SOURCE_REMOVE;
+}
+
+void GstreamerIngestor::stop() {
+    if(m_th == NULL)
+        return;
+
+    {
+        std::lock_guard<std::mutex> lk(m_loop_mtx);
+        m_stop.store(true);
+        // The idle source holds a reference on the loop as it may only be
+        // dispatched after the loop ended and was released
+        if(m_loop != NULL)
+            g_idle_add_full(G_PRIORITY_DEFAULT_IDLE, quit_loop, g_main_loop_ref(m_loop),
+                            (GDestroyNotify) g_main_loop_unref);
+    }
+    // Interrupt a pending reconnection backoff
+    {
+        std::lock_guard<std::mutex> lk(m_run_mtx);
+    }
+    m_stop_cv.notify_all();
+
+    // Wait a bounded time for run() to stop the pipeline. If it does not,
+    // the ingestion thread is abandoned and the ingestor flagged as hung.
+    bool done = false;
+    {
+        std::unique_lock<std::mutex> lk(m_run_mtx);
+        done = m_run_cv.wait_for(lk, std::chrono::milliseconds(STOP_TIMEOUT_MS),
+                                 [this] { return m_run_done; });
+    }
+    if(done) {
+        m_th->join();
+    } else {
+        LOG_ERROR("Gstreamer pipeline did not stop within %d ms", STOP_TIMEOUT_MS);
+        m_hung.store(true);
+        m_th->detach();
+    }
+    delete m_th;
+    m_th = NULL;
+
+    // Reset so that the ingestor is ready for the next ingestion
+    m_running.store(false);
+    m_stop.store(false);
 }
 
 // This method does nothing in this implementation since the frames are
@@ -140,13 +675,89 @@ void GstreamerIngestor::run(bool snapshot_mode) {
     auto start = std::chrono::system_clock::now();
 #endif
     if (snapshot_mode) {
-        m_frame_count = 0;
+        m_streams[0]->frame_count = 0;
     }
-    LOG_INFO_0("Initializing Gstreamer pipeline");
-    gstreamer_init(snapshot_mode);
+    {
+        std::lock_guard<std::mutex> lk(m_run_mtx);
+        m_run_done = false;
+    }
+    m_snapshot = snapshot_mode;
+    m_latency.reset();
+    m_latency_total.reset();
+    m_latency_report_time = std::chrono::steady_clock::now();
     LOG_INFO_0("Gstreamer ingestor thread started");
-    gst_element_set_state(m_gst_pipeline, GST_STATE_PLAYING);
-    g_main_loop_run(m_loop);
+    int backoff_ms = m_backoff_initial_ms;
+    while(true) {
+        // The pipeline is released at the end of every run, so it has to be
+        // loaded again if the ingestor is restarted or reconnects
+        bool loaded = true;
+        if(m_gst_pipeline == NULL) {
+            LOG_INFO_0("Initializing Gstreamer pipeline");
+            try {
+                gstreamer_init();
+            } catch(const char*) {
+                gstreamer_deinit();
+                loaded = false;
+            }
+        }
+        if(loaded) {
+            m_frame_received.store(false);
+            m_last_frame_ns.store(steady_now_ns());
+            gst_element_set_state(m_gst_pipeline, GST_STATE_PLAYING);
+            if(m_reconnect && !snapshot_mode) {
+                // Preroll the standby while the active pipeline runs
+                if(m_standby && m_standby_pipeline == NULL) {
+                    m_standby_pipeline = create_pipeline(false);
+                    if(m_standby_pipeline == NULL) {
+                        LOG_WARN_0("Failed to create the standby Gstreamer pipeline");
+                    }
+                }
+                m_watchdog_id = g_timeout_add(
+                        std::max(m_stall_timeout_ms / 4, MIN_WATCHDOG_PERIOD_MS),
+                        watchdog, this);
+            }
+            if(m_fps_control && !snapshot_mode)
+                start_frame_rate_control();
+            g_main_loop_run(m_loop);
+            if(m_watchdog_id != 0) {
+                g_source_remove(m_watchdog_id);
+                m_watchdog_id = 0;
+            }
+            stop_frame_rate_control();
+            gstreamer_deinit();
+        }
+
+        if(m_stop.load() || snapshot_mode || !m_reconnect)
+            break;
+
+        // Fail over right away if the pipeline had been producing frames
+        // and a standby is ready, otherwise back off exponentially while
+        // the source keeps failing
+        if(m_frame_received.load()) {
+            backoff_ms = m_backoff_initial_ms;
+            if(m_standby_pipeline != NULL)
+                continue;
+        }
+        LOG_WARN("Reconnecting Gstreamer pipeline in %d ms", backoff_ms);
+        {
+            std::unique_lock<std::mutex> lk(m_run_mtx);
+            m_stop_cv.wait_for(lk, std::chrono::milliseconds(backoff_ms),
+                               [this] { return m_stop.load(); });
+        }
+        if(m_stop.load())
+            break;
+        backoff_ms = std::min(backoff_ms * 2, m_backoff_max_ms);
+    }
+    destroy_pipeline(m_standby_pipeline);
+    {
+        std::lock_guard<std::mutex> lk(m_run_mtx);
+        m_run_done = true;
+    }
+    m_run_cv.notify_all();
+    if(m_live && m_latency_total.count() > 0) {
+        LOG_INFO("Glass to ingest latency since start: %s",
+                 m_latency_total.summary().c_str());
+    }
     LOG_INFO_0("Gstreamer ingestor thread stopped");
 
 #ifdef WITH_PROFILE
@@ -155,21 +766,127 @@ void GstreamerIngestor::run(bool snapshot_mode) {
     auto end = std::chrono::system_clock::now();
     int elapsed = std::chrono::duration_cast<std::chrono::seconds>(
             end - start).count();
-    LOG_INFO("GStreamer FPS: %d", m_frame_count / elapsed);
+    LOG_INFO("GStreamer FPS: %d", m_streams[0]->frame_count / elapsed);
     char* str_app_name = NULL;
     str_app_name = getenv("AppName");
     std::ofstream fps_file;
     fps_file.open("/var/tmp/fps.txt", std::ofstream::app);
-    fps_file << str_app_name << " FPS : " << (m_frame_count / elapsed) << std::endl ;
+    fps_file << str_app_name << " FPS : " << (m_streams[0]->frame_count / elapsed) << std::endl ;
     fps_file.close();
 #endif
 }
 
 /**
- * Gstreamer bus event callback
+ * Find the first element created by the given factory in a pipeline. The
+ * returned element holds a reference.
  */
-static gboolean bus_call(GstBus* bus, GstMessage* msg, gpointer data) {
-    GMainLoop *loop = (GMainLoop *) data;
+static void find_factory_element(const GValue* item, gpointer user_data) {
+    std::pair<const char*, GstElement*>* search =
+        (std::pair<const char*, GstElement*>*) user_data;
+    if(search->second != NULL)
+        return;
+    GstElement* element = GST_ELEMENT(g_value_get_object(item));
+    GstElementFactory* factory = gst_element_get_factory(element);
+    if(factory != NULL &&
+       !strcmp(gst_plugin_feature_get_name(GST_PLUGIN_FEATURE(factory)), search->first))
+        search->second = GST_ELEMENT(gst_object_ref(element));
+}
+
+void GstreamerIngestor::start_frame_rate_control() {
+    std::pair<const char*, GstElement*> search(GENCAMSRC, NULL);
+    GstIterator* it = gst_bin_iterate_recurse(GST_BIN(m_gst_pipeline));
+    gst_iterator_foreach(it, find_factory_element, &search);
+    gst_iterator_free(it);
+    if(search.second == NULL) {
+        LOG_WARN_0("Frame rate control requires a " GENCAMSRC " source, "
+                   "frame rate is not controlled");
+        return;
+    }
+    m_fps_source = search.second;
+
+    // Start from the configured frame rate, or the upper bound if the
+    // camera default is used
+    gfloat frame_rate = 0;
+    g_object_get(m_fps_source, GENCAMSRC_FRAME_RATE, &frame_rate, NULL);
+    m_fps = frame_rate > 0 ? (double) frame_rate : m_fps_max;
+    m_fps = std::min(std::max(m_fps, m_fps_min), m_fps_max);
+    if(m_fps != (double) frame_rate)
+        g_object_set(m_fps_source, GENCAMSRC_FRAME_RATE, (gfloat) m_fps, NULL);
+    LOG_INFO("Controlling camera frame rate, starting at %.2f fps", m_fps);
+
+    m_fps_last_wait_ns = m_queue_wait_ns.load();
+    m_fps_control_id = g_timeout_add(m_fps_interval_ms, control_frame_rate, this);
+}
+
+void GstreamerIngestor::stop_frame_rate_control() {
+    if(m_fps_control_id != 0) {
+        g_source_remove(m_fps_control_id);
+        m_fps_control_id = 0;
+    }
+    if(m_fps_source != NULL) {
+        gst_object_unref(m_fps_source);
+        m_fps_source = NULL;
+    }
+}
+
+gboolean GstreamerIngestor::control_frame_rate(gpointer data) {
+    GstreamerIngestor* ctx = (GstreamerIngestor*) data;
+    double occupancy = (double) ctx->m_udf_input_queue->size() /
+        ctx->m_queue_capacity;
+    int64_t wait_ns = ctx->m_queue_wait_ns.load();
+    int64_t blocked_ns = wait_ns - ctx->m_fps_last_wait_ns;
+    ctx->m_fps_last_wait_ns = wait_ns;
+
+    // Additive increase, multiplicative decrease. Any time spent blocked on
+    // the queue means the UDFs did not keep up with the camera.
+    double fps = ctx->m_fps;
+    if(blocked_ns > 0 || occupancy >= ctx->m_fps_high_watermark) {
+        fps = std::max(fps * ctx->m_fps_decrease_factor, ctx->m_fps_min);
+    } else if(occupancy <= ctx->m_fps_low_watermark) {
+        fps = std::min(fps + ctx->m_fps_increase_step, ctx->m_fps_max);
+    }
+    if(fps == ctx->m_fps)
+        return G_SOURCE_CONTINUE;
+
+    g_object_set(ctx->m_fps_source, GENCAMSRC_FRAME_RATE, (gfloat) fps, NULL);
+    LOG_INFO("Camera frame rate %s to %.2f fps, queue occupancy: %.0f%%, "
+             "blocked: %ld ms", fps < ctx->m_fps ? "lowered" : "raised", fps,
+             occupancy * 100, (long) (blocked_ns / 1000000));
+    ctx->m_fps = fps;
+    return G_SOURCE_CONTINUE;
+}
+
+gboolean GstreamerIngestor::watchdog(gpointer data) {
+    GstreamerIngestor* ctx = (GstreamerIngestor*) data;
+    int64_t idle_ns = steady_now_ns() - ctx->m_last_frame_ns.load();
+    if(idle_ns < (int64_t) ctx->m_stall_timeout_ms * 1000000)
+        return G_SOURCE_CONTINUE;
+    LOG_WARN("No frame received for %ld ms, restarting Gstreamer pipeline",
+             (long) (idle_ns / 1000000));
+    ctx->m_watchdog_id = 0;
+    g_main_loop_quit(ctx->m_loop);
+    return G_SOURCE_REMOVE;
+}
+
+GstBusSyncReply GstreamerIngestor::stream_status(GstBus* bus, GstMessage* msg, gpointer data) {
+    if(GST_MESSAGE_TYPE(msg) == GST_MESSAGE_STREAM_STATUS) {
+        GstStreamStatusType type;
+        GstElement* owner = NULL;
+        gst_message_parse_stream_status(msg, &type, &owner);
+        if(type == GST_STREAM_STATUS_TYPE_ENTER) {
+            // All streaming threads are pinned, only those of the source
+            // elements capturing the frames get the real-time priority
+            GstreamerIngestor* ingestor = (GstreamerIngestor*) data;
+            bool source = owner != NULL &&
+                GST_OBJECT_FLAG_IS_SET(owner, GST_ELEMENT_FLAG_SOURCE);
+            ingestor->m_placement.apply(source);
+        }
+    }
+    return GST_BUS_PASS;
+}
+
+gboolean GstreamerIngestor::bus_call(GstBus* bus, GstMessage* msg, gpointer data) {
+    GMainLoop *loop = ((GstreamerIngestor*) data)->m_loop;
 
     switch (GST_MESSAGE_TYPE (msg)) {
         case GST_MESSAGE_EOS:
@@ -202,14 +919,23 @@ static gboolean bus_call(GstBus* bus, GstMessage* msg, gpointer data) {
 class GstreamerFrame {
 public:
     GstSample* sample;
-    GstBuffer* buf;
-    GstMapInfo* info;
-    GstreamerFrame(GstSample* sample, GstBuffer* buf, GstMapInfo* info) :
-        sample(sample), buf(buf), info(info)
+    GstVideoFrame vframe;
+    bool mapped;
+    // Buffer mapped into map if the sample holds compressed data
+    GstBuffer* buffer;
+    GstMapInfo map;
+    // Packed copy of the frame if the buffer layout could not be used as is
+    void* copy;
+    GstreamerFrame(GstSample* sample) :
+        sample(sample), mapped(false), buffer(NULL), copy(NULL)
     {}
 
     ~GstreamerFrame() {
-        gst_buffer_unmap(buf, info);
+        if(mapped)
+            gst_video_frame_unmap(&vframe);
+        if(buffer != NULL)
+            gst_buffer_unmap(buffer, &map);
+        free(copy);
         gst_sample_unref(sample);
     }
 };
@@ -223,267 +949,896 @@ void free_gst_frame(void* obj) {
 }
 
 /**
- * A new sample has been received in the appsink
+ * Get the Frame dimensions of a supported raw video format. Packed formats
+ * map to one byte per channel, 4:2:0 formats to a single channel with the
+ * chroma planes stacked below the luma plane, as expected by OpenCV.
+ * @return false if the format is not supported
  */
-GstFlowReturn GstreamerIngestor::new_sample(GstElement *sink,
-GstreamerIngestor* ctx) {
-    GstSample* sample;
-    g_signal_emit_by_name(sink, "pull-sample", &sample);
-    if(sample) {
-        GstBuffer* buf = gst_sample_get_buffer(sample); // no lifetime transfer
-        if(buf) {
-            //GstMapInfo info = {};
-            GstMapInfo* info = (GstMapInfo*) malloc(sizeof(GstMapInfo));
-            if(info == NULL) {
-                throw "Failed to allocate memory for GstMapInfo";
+static bool get_frame_layout(const GstVideoInfo* info, int& width, int& height, int& channels) {
+    width = GST_VIDEO_INFO_WIDTH(info);
+    height = GST_VIDEO_INFO_HEIGHT(info);
+    switch(GST_VIDEO_INFO_FORMAT(info)) {
+        case GST_VIDEO_FORMAT_BGR:
+            channels = 3;
+            return true;
+        case GST_VIDEO_FORMAT_BGRx:
+            channels = 4;
+            return true;
+        case GST_VIDEO_FORMAT_GRAY8:
+            channels = 1;
+            return true;
+        case GST_VIDEO_FORMAT_GRAY16_LE:
+            channels = 2;
+            return true;
+        case GST_VIDEO_FORMAT_NV12:
+        case GST_VIDEO_FORMAT_I420:
+            if(width % 2 != 0 || height % 2 != 0) {
+                LOG_ERROR("%s frames must have even dimensions, got %dx%d",
+                          GST_VIDEO_INFO_NAME(info), width, height);
+                return false;
             }
-            if(!gst_buffer_map(buf, info, GST_MAP_READ)) {
-                // Taken from OpenCV ???
-                LOG_ERROR_0("Failed to map GStreamer buffer to system memory");
-            } else {
-                //LOG_INFO("Got frame of size: %ld", info.size);
-                GstCaps * frame_caps = gst_sample_get_caps(sample);
-                GstStructure* structure = gst_caps_get_structure(frame_caps, 0);  // no lifetime transfer
-                gint width;
-                gint height;
-                gst_structure_get_int(structure, "width", &width);
-                gst_structure_get_int(structure, "height", &height);
-                // Check for image format is done for the first frame
-                // The only accepted image format is BGR
-                if (g_first_frame) {
-                    g_first_frame = false; // first frame has been recieved
-                    const gchar* format = gst_structure_get_string(structure, "format");
-                    if (format != NULL) {
-                        LOG_INFO("Format: %s, Size: %dx%d", format, width, height);
-                        int ind_bgr = 0;
-                        strcmp_s(format, strlen(format), "BGR", &ind_bgr);
-                        if (ind_bgr != 0) {
-                            LOG_ERROR("%s image format is not supported please use BGR", format);
-                            return GST_FLOW_ERROR;
-                        }
-                    } else {
-                        LOG_ERROR_0("Failed to read image format");
-                    }
-                }
+            channels = 1;
+            height = height * 3 / 2;
+            return true;
+        default:
+            return false;
+    }
+}
 
-                GstreamerFrame* gst_frame = new GstreamerFrame(
-                        sample, buf, info);
+/**
+ * Whether frames of the given format can be JPEG/PNG encoded
+ */
+static bool is_encodable(GstVideoFormat format) {
+    return format == GST_VIDEO_FORMAT_BGR || format == GST_VIDEO_FORMAT_GRAY8;
+}
 
-                Frame* frame = new Frame(
-                        (void*) gst_frame, free_gst_frame, (void*) info->data,
-                        (int) width, (int) height, 3);
+/**
+ * Check whether the planes of a mapped video frame are tightly packed and
+ * contiguous, i.e. whether it can be handed out without copying
+ */
+static bool is_packed(GstVideoFrame* vframe) {
+    guint8* expected = (guint8*) GST_VIDEO_FRAME_PLANE_DATA(vframe, 0);
+    for(guint p = 0; p < GST_VIDEO_FRAME_N_PLANES(vframe); p++) {
+        // The first component of every plane of the supported formats is
+        // the component with the same index
+        gint row_size = GST_VIDEO_FRAME_COMP_WIDTH(vframe, p) *
+            GST_VIDEO_FRAME_COMP_PSTRIDE(vframe, p);
+        if(GST_VIDEO_FRAME_PLANE_STRIDE(vframe, p) != row_size ||
+           (guint8*) GST_VIDEO_FRAME_PLANE_DATA(vframe, p) != expected)
+            return false;
+        expected += (size_t) row_size * GST_VIDEO_FRAME_COMP_HEIGHT(vframe, p);
+    }
+    return true;
+}
 
-                //Get the GVA metadata from the GST buffer
-                GVA::RegionOfInterestList roi_list(buf);
+/**
+ * Copy the planes of a mapped video frame into a tightly packed buffer
+ */
+static void copy_packed(GstVideoFrame* vframe, guint8* dst) {
+    for(guint p = 0; p < GST_VIDEO_FRAME_N_PLANES(vframe); p++) {
+        const guint8* src = (const guint8*) GST_VIDEO_FRAME_PLANE_DATA(vframe, p);
+        gint stride = GST_VIDEO_FRAME_PLANE_STRIDE(vframe, p);
+        gint row_size = GST_VIDEO_FRAME_COMP_WIDTH(vframe, p) *
+            GST_VIDEO_FRAME_COMP_PSTRIDE(vframe, p);
+        gint rows = GST_VIDEO_FRAME_COMP_HEIGHT(vframe, p);
+        for(gint r = 0; r < rows; r++) {
+            memcpy(dst, src + (size_t) r * stride, row_size);
+            dst += row_size;
+        }
+    }
+}
 
-                msgbus_ret_t ret = MSG_SUCCESS;
+/**
+ * Helper to add an integer field to a msgbus object
+ */
+static bool gva_put_integer(msg_envelope_elem_body_t* obj, const char* key, int64_t value) {
+    msg_envelope_elem_body_t* elem = msgbus_msg_envelope_new_integer(value);
+    if(elem == NULL) {
+        LOG_ERROR("Failed to initialize %s metadata", key);
+        return false;
+    }
+    if(msgbus_msg_envelope_elem_object_put(obj, key, elem) != MSG_SUCCESS) {
+        LOG_ERROR("Failed to put %s metadata", key);
+        msgbus_msg_envelope_elem_destroy(elem);
+        return false;
+    }
+    return true;
+}
 
-                msg_envelope_elem_body_t* gva_meta_arr = msgbus_msg_envelope_new_array();
-		        if(gva_meta_arr == NULL) {
-                    LOG_ERROR_0("Failed to initialize gva metadata");
-                    delete frame;
-                    return GST_FLOW_ERROR;
+/**
+ * Helper to add a floating point field to a msgbus object
+ */
+static bool gva_put_floating(msg_envelope_elem_body_t* obj, const char* key, double value) {
+    msg_envelope_elem_body_t* elem = msgbus_msg_envelope_new_floating(value);
+    if(elem == NULL) {
+        LOG_ERROR("Failed to initialize %s metadata", key);
+        return false;
+    }
+    if(msgbus_msg_envelope_elem_object_put(obj, key, elem) != MSG_SUCCESS) {
+        LOG_ERROR("Failed to put %s metadata", key);
+        msgbus_msg_envelope_elem_destroy(elem);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Helper to add a string field to a msgbus object
+ */
+static bool gva_put_string(msg_envelope_elem_body_t* obj, const char* key, const char* value) {
+    msg_envelope_elem_body_t* elem = msgbus_msg_envelope_new_string(value);
+    if(elem == NULL) {
+        LOG_ERROR("Failed to initialize %s metadata", key);
+        return false;
+    }
+    if(msgbus_msg_envelope_elem_object_put(obj, key, elem) != MSG_SUCCESS) {
+        LOG_ERROR("Failed to put %s metadata", key);
+        msgbus_msg_envelope_elem_destroy(elem);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Build the msgbus object for a single GVA tensor
+ */
+static msg_envelope_elem_body_t* gva_tensor_to_elem(GVA::Tensor& tensor) {
+    LOG_DEBUG("Attribute: %s, Label: %s, Confidence: %f Label_id:%d",
+            tensor.name().c_str(), tensor.label().c_str(),
+            tensor.confidence(), tensor.label_id());
+
+    msg_envelope_elem_body_t* tensor_obj = msgbus_msg_envelope_new_object();
+    if(tensor_obj == NULL) {
+        LOG_ERROR_0("Failed to initialize tensor metadata for each roi");
+        return NULL;
+    }
+
+    if(!gva_put_string(tensor_obj, "attribute", tensor.name().c_str()) ||
+       !gva_put_string(tensor_obj, "label", tensor.label().c_str()) ||
+       !gva_put_floating(tensor_obj, "confidence", tensor.confidence()) ||
+       !gva_put_integer(tensor_obj, "label_id", tensor.label_id())) {
+        msgbus_msg_envelope_elem_destroy(tensor_obj);
+        return NULL;
+    }
+    return tensor_obj;
+}
+
+/**
+ * Build the msgbus object for a single GVA region of interest including
+ * all of its tensors
+ */
+static msg_envelope_elem_body_t* gva_roi_to_elem(GVA::RegionOfInterest& roi) {
+    GstVideoRegionOfInterestMeta* meta = roi.meta();
+
+    LOG_DEBUG("Object Bounding Box: [%d, %d] [%d, %d]",
+            meta->x, meta->y, meta->w, meta->h)
+
+    msg_envelope_elem_body_t* roi_obj = msgbus_msg_envelope_new_object();
+    if(roi_obj == NULL) {
+        LOG_ERROR_0("Failed to initialize roi metadata");
+        return NULL;
+    }
+
+    if(!gva_put_integer(roi_obj, "x", meta->x) ||
+       !gva_put_integer(roi_obj, "y", meta->y) ||
+       !gva_put_integer(roi_obj, "width", meta->w) ||
+       !gva_put_integer(roi_obj, "height", meta->h)) {
+        msgbus_msg_envelope_elem_destroy(roi_obj);
+        return NULL;
+    }
+
+    msg_envelope_elem_body_t* tensor_arr = msgbus_msg_envelope_new_array();
+    if(tensor_arr == NULL) {
+        LOG_ERROR_0("Failed to initialize tensor metadata");
+        msgbus_msg_envelope_elem_destroy(roi_obj);
+        return NULL;
+    }
+
+    for(GVA::Tensor& tensor : roi) {
+        msg_envelope_elem_body_t* tensor_obj = gva_tensor_to_elem(tensor);
+        if(tensor_obj == NULL) {
+            msgbus_msg_envelope_elem_destroy(tensor_arr);
+            msgbus_msg_envelope_elem_destroy(roi_obj);
+            return NULL;
+        }
+        if(msgbus_msg_envelope_elem_array_add(tensor_arr, tensor_obj) != MSG_SUCCESS) {
+            LOG_ERROR_0("Failed to add tensor object to tensor array metadata");
+            msgbus_msg_envelope_elem_destroy(tensor_obj);
+            msgbus_msg_envelope_elem_destroy(tensor_arr);
+            msgbus_msg_envelope_elem_destroy(roi_obj);
+            return NULL;
+        }
+    }
+
+    if(msgbus_msg_envelope_elem_object_put(roi_obj, "tensor", tensor_arr) != MSG_SUCCESS) {
+        LOG_ERROR_0("Failed to put tensor array to roi object metadata");
+        msgbus_msg_envelope_elem_destroy(tensor_arr);
+        msgbus_msg_envelope_elem_destroy(roi_obj);
+        return NULL;
+    }
+    return roi_obj;
+}
+
+bool eii::vi::add_gva_meta(GstBuffer* buf, msg_envelope_t* meta_data) {
+    GVA::RegionOfInterestList roi_list(buf);
+
+    msg_envelope_elem_body_t* gva_meta_arr = msgbus_msg_envelope_new_array();
+    if(gva_meta_arr == NULL) {
+        LOG_ERROR_0("Failed to initialize gva metadata");
+        return false;
+    }
+
+    for(GVA::RegionOfInterest& roi : roi_list) {
+        msg_envelope_elem_body_t* roi_obj = gva_roi_to_elem(roi);
+        if(roi_obj == NULL) {
+            msgbus_msg_envelope_elem_destroy(gva_meta_arr);
+            return false;
+        }
+        if(msgbus_msg_envelope_elem_array_add(gva_meta_arr, roi_obj) != MSG_SUCCESS) {
+            LOG_ERROR_0("Failed to add roi object to gva metadata");
+            msgbus_msg_envelope_elem_destroy(roi_obj);
+            msgbus_msg_envelope_elem_destroy(gva_meta_arr);
+            return false;
+        }
+    }
+
+    if(msgbus_msg_envelope_put(meta_data, "gva_meta", gva_meta_arr) != MSG_SUCCESS) {
+        LOG_ERROR_0("Failed to put gva metadata");
+        msgbus_msg_envelope_elem_destroy(gva_meta_arr);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Append little endian integers to a binary GVA metadata buffer
+ */
+static void gva_bin_put_u16(std::string& out, uint16_t value) {
+    out.push_back((char) (value & 0xff));
+    out.push_back((char) (value >> 8));
+}
+
+static void gva_bin_put_u32(std::string& out, uint32_t value) {
+    for(int i = 0; i < 4; i++)
+        out.push_back((char) ((value >> (8 * i)) & 0xff));
+}
+
+static void gva_bin_put_u64(std::string& out, uint64_t value) {
+    for(int i = 0; i < 8; i++)
+        out.push_back((char) ((value >> (8 * i)) & 0xff));
+}
+
+/**
+ * Get the offset of a string in the string table, adding it if it is not
+ * there yet. Offset 0 is the empty string.
+ */
+static uint32_t gva_bin_string(std::string& table,
+                               std::vector<std::pair<const char*, uint32_t>>& seen,
+                               const char* str) {
+    if(str == NULL || str[0] == '\0')
+        return 0;
+    // Scenes typically only contain a handful of distinct labels, so a
+    // linear search is cheaper than hashing every string
+    for(auto& entry : seen) {
+        if(entry.first == str || strcmp(entry.first, str) == 0)
+            return entry.second;
+    }
+    uint32_t offset = (uint32_t) table.size();
+    table.append(str);
+    table.push_back('\0');
+    seen.push_back(std::make_pair(str, offset));
+    return offset;
+}
+
+/**
+ * Base64 encode a buffer
+ */
+static void base64_encode(const std::string& in, std::string& out) {
+    static const char table[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    const uint8_t* data = (const uint8_t*) in.data();
+    size_t len = in.size();
+    out.clear();
+    out.reserve(((len + 2) / 3) * 4);
+    size_t i = 0;
+    for(; i + 2 < len; i += 3) {
+        uint32_t v = (data[i] << 16) | (data[i + 1] << 8) | data[i + 2];
+        out.push_back(table[(v >> 18) & 0x3f]);
+        out.push_back(table[(v >> 12) & 0x3f]);
+        out.push_back(table[(v >> 6) & 0x3f]);
+        out.push_back(table[v & 0x3f]);
+    }
+    if(i < len) {
+        uint32_t v = data[i] << 16;
+        if(i + 1 < len)
+            v |= data[i + 1] << 8;
+        out.push_back(table[(v >> 18) & 0x3f]);
+        out.push_back(table[(v >> 12) & 0x3f]);
+        out.push_back((i + 1 < len) ? table[(v >> 6) & 0x3f] : '=');
+        out.push_back('=');
+    }
+}
+
+bool eii::vi::encode_gva_meta_binary(GstBuffer* buf, std::string& out) {
+    // First pass to size the buffer, the ROI metas are walked directly to
+    // avoid building the GVA::RegionOfInterestList vectors
+    uint32_t num_rois = 0;
+    uint32_t num_tensors = 0;
+    GstVideoRegionOfInterestMeta* meta = NULL;
+    gpointer state = NULL;
+    while((meta = GST_VIDEO_REGION_OF_INTEREST_META_ITERATE(buf, &state))) {
+        num_rois++;
+        num_tensors += g_list_length(meta->params);
+    }
+
+    std::string strings(1, '\0');
+    std::vector<std::pair<const char*, uint32_t>> seen;
+
+    out.clear();
+    out.reserve(GVA_META_BIN_HEADER_SIZE +
+                num_rois * GVA_META_BIN_ROI_SIZE +
+                num_tensors * GVA_META_BIN_TENSOR_SIZE + 256);
+
+    // Header, the string table size is patched in at the end
+    out.append(GVA_META_BIN_MAGIC, 4);
+    gva_bin_put_u16(out, GVA_META_BIN_VERSION);
+    gva_bin_put_u16(out, GVA_META_BIN_HEADER_SIZE);
+    gva_bin_put_u32(out, num_rois);
+    gva_bin_put_u32(out, num_tensors);
+    gva_bin_put_u16(out, GVA_META_BIN_ROI_SIZE);
+    gva_bin_put_u16(out, GVA_META_BIN_TENSOR_SIZE);
+    gva_bin_put_u32(out, 0);
+    gva_bin_put_u64(out, 0);
+
+    // ROI records
+    uint32_t first_tensor = 0;
+    state = NULL;
+    while((meta = GST_VIDEO_REGION_OF_INTEREST_META_ITERATE(buf, &state))) {
+        uint32_t roi_tensors = g_list_length(meta->params);
+        gva_bin_put_u32(out, (uint32_t) meta->x);
+        gva_bin_put_u32(out, (uint32_t) meta->y);
+        gva_bin_put_u32(out, (uint32_t) meta->w);
+        gva_bin_put_u32(out, (uint32_t) meta->h);
+        gva_bin_put_u32(out, first_tensor);
+        gva_bin_put_u32(out, roi_tensors);
+        first_tensor += roi_tensors;
+    }
+
+    // Tensor records, in ROI order
+    state = NULL;
+    while((meta = GST_VIDEO_REGION_OF_INTEREST_META_ITERATE(buf, &state))) {
+        for(GList* l = meta->params; l; l = g_list_next(l)) {
+            GstStructure* s = (GstStructure*) l->data;
+            gint label_id = 0;
+            gdouble confidence = 0;
+            gst_structure_get_int(s, "label_id", &label_id);
+            gst_structure_get_double(s, "confidence", &confidence);
+            uint64_t confidence_bits;
+            memcpy(&confidence_bits, &confidence, sizeof(confidence_bits));
+
+            gva_bin_put_u32(out, gva_bin_string(strings, seen, gst_structure_get_name(s)));
+            gva_bin_put_u32(out, gva_bin_string(strings, seen, gst_structure_get_string(s, "label")));
+            gva_bin_put_u32(out, (uint32_t) label_id);
+            gva_bin_put_u32(out, 0);
+            gva_bin_put_u64(out, confidence_bits);
+        }
+    }
+
+    if(strings.size() > UINT32_MAX) {
+        LOG_ERROR_0("GVA metadata string table too large");
+        return false;
+    }
+    uint32_t strings_size = (uint32_t) strings.size();
+    for(int i = 0; i < 4; i++)
+        out[GVA_META_BIN_STRINGS_SIZE_OFFSET + i] =
+            (char) ((strings_size >> (8 * i)) & 0xff);
+    out.append(strings);
+    return true;
+}
+
+bool eii::vi::add_gva_meta_binary(GstBuffer* buf, msg_envelope_t* meta_data) {
+    std::string blob;
+    if(!encode_gva_meta_binary(buf, blob))
+        return false;
+
+    // Frame payloads occupy the message blobs, so the metadata blob is
+    // carried as a base64 string in the JSON envelope
+    std::string encoded;
+    base64_encode(blob, encoded);
+
+    msg_envelope_elem_body_t* elem = msgbus_msg_envelope_new_string(encoded.c_str());
+    if(elem == NULL) {
+        LOG_ERROR_0("Failed to initialize gva metadata");
+        return false;
+    }
+    if(msgbus_msg_envelope_put(meta_data, "gva_meta", elem) != MSG_SUCCESS) {
+        LOG_ERROR_0("Failed to put gva metadata");
+        msgbus_msg_envelope_elem_destroy(elem);
+        return false;
+    }
+    elem = msgbus_msg_envelope_new_string(GVA_META_FORMAT_BINARY);
+    if(elem == NULL) {
+        LOG_ERROR_0("Failed to initialize gva metadata format");
+        return false;
+    }
+    if(msgbus_msg_envelope_put(meta_data, "gva_meta_format", elem) != MSG_SUCCESS) {
+        LOG_ERROR_0("Failed to put gva metadata format");
+        msgbus_msg_envelope_elem_destroy(elem);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Free callback of the tensor frames, releases the sample reference
+ * keeping the tensor data alive
+ */
+static void free_gst_sample(void* obj) {
+    gst_sample_unref((GstSample*) obj);
+}
+
+/**
+ * Check whether a tensor was selected by name or layer name
+ */
+static bool gva_tensor_selected(GstStructure* s, const std::vector<std::string>& selected) {
+    const char* name = gst_structure_get_name(s);
+    const char* layer_name = gst_structure_get_string(s, "layer_name");
+    for(const std::string& sel : selected) {
+        if((name != NULL && sel == name) ||
+           (layer_name != NULL && sel == layer_name))
+            return true;
+    }
+    return false;
+}
+
+bool eii::vi::add_gva_raw_tensors(GstSample* sample, Frame* frame, const std::vector<std::string>& selected) {
+    GstBuffer* buf = gst_sample_get_buffer(sample);
+    msg_envelope_t* meta_data = frame->get_meta_data();
+    msg_envelope_elem_body_t* tensor_arr = NULL;
+
+    int roi_index = 0;
+    GstVideoRegionOfInterestMeta* meta = NULL;
+    gpointer state = NULL;
+    while((meta = GST_VIDEO_REGION_OF_INTEREST_META_ITERATE(buf, &state))) {
+        for(GList* l = meta->params; l; l = g_list_next(l)) {
+            GstStructure* s = (GstStructure*) l->data;
+            if(!gva_tensor_selected(s, selected))
+                continue;
+            gsize nbytes = 0;
+            const void* data = gva_get_tensor_data(s, &nbytes);
+            if(data == NULL || nbytes == 0)
+                continue;
+            if(nbytes > INT_MAX) {
+                LOG_ERROR("Tensor %s too large to attach", gst_structure_get_name(s));
+                continue;
+            }
+
+            if(tensor_arr == NULL) {
+                tensor_arr = msgbus_msg_envelope_new_array();
+                if(tensor_arr == NULL) {
+                    LOG_ERROR_0("Failed to initialize gva tensors metadata");
+                    return false;
                 }
+            }
+
+            GVA::Tensor tensor(s);
+            msg_envelope_elem_body_t* tensor_obj = msgbus_msg_envelope_new_object();
+            if(tensor_obj == NULL) {
+                LOG_ERROR_0("Failed to initialize gva tensor metadata");
+                msgbus_msg_envelope_elem_destroy(tensor_arr);
+                return false;
+            }
+            if(!gva_put_integer(tensor_obj, "frame_index", frame->get_number_of_frames()) ||
+               !gva_put_integer(tensor_obj, "roi_index", roi_index) ||
+               !gva_put_string(tensor_obj, "name", tensor.name().c_str()) ||
+               !gva_put_string(tensor_obj, "layer_name", tensor.layer_name().c_str()) ||
+               !gva_put_string(tensor_obj, "model_name", tensor.model_name().c_str()) ||
+               !gva_put_string(tensor_obj, "precision", tensor.precision_as_string().c_str()) ||
+               !gva_put_string(tensor_obj, "layout", tensor.layout_as_string().c_str()) ||
+               !gva_put_integer(tensor_obj, "size", (int64_t) nbytes)) {
+                msgbus_msg_envelope_elem_destroy(tensor_obj);
+                msgbus_msg_envelope_elem_destroy(tensor_arr);
+                return false;
+            }
+            if(msgbus_msg_envelope_elem_array_add(tensor_arr, tensor_obj) != MSG_SUCCESS) {
+                LOG_ERROR_0("Failed to add tensor object to gva tensors metadata");
+                msgbus_msg_envelope_elem_destroy(tensor_obj);
+                msgbus_msg_envelope_elem_destroy(tensor_arr);
+                return false;
+            }
+
+            // The tensor data lives in the buffer metadata, so the frame
+            // only needs to hold a reference on the sample
+            frame->add_frame((void*) gst_sample_ref(sample), free_gst_sample,
+                             (void*) data, (int) nbytes, 1, 1);
+        }
+        roi_index++;
+    }
 
-                for(GVA::RegionOfInterest& roi : roi_list) {
-                    GstVideoRegionOfInterestMeta* meta = roi.meta();
+    if(tensor_arr == NULL)
+        return true;
+    if(msgbus_msg_envelope_put(meta_data, "gva_tensors", tensor_arr) != MSG_SUCCESS) {
+        LOG_ERROR_0("Failed to put gva tensors metadata");
+        msgbus_msg_envelope_elem_destroy(tensor_arr);
+        return false;
+    }
+    return true;
+}
 
-                    LOG_DEBUG("Object Bounding Box: [%d, %d] [%d, %d]",
-                            meta->x, meta->y, meta->w, meta->h)
+/**
+ * Collect the parameter set NAL units (SPS/PPS and the VPS of H.265) of a
+ * byte-stream access unit, each prefixed with a 4 byte start code
+ */
+static void get_parameter_sets(const guint8* data, size_t len, bool h265, std::string& out) {
+    out.clear();
+    size_t i = 0;
+    while(i + 3 <= len) {
+        // Find the next start code
+        if(data[i] != 0 || data[i + 1] != 0 || data[i + 2] != 1) {
+            i++;
+            continue;
+        }
+        size_t start = i + 3;
+        size_t end = start;
+        while(end + 3 <= len && (data[end] != 0 || data[end + 1] != 0 || data[end + 2] > 1))
+            end++;
+        if(end + 3 > len)
+            end = len;
+        i = end;
+        // Trailing zero bytes belong to the next start code
+        while(end > start && data[end - 1] == 0)
+            end--;
+        if(end == start)
+            continue;
+        int type = h265 ? (data[start] >> 1) & 0x3f : data[start] & 0x1f;
+        bool parameter_set = h265 ? (type >= 32 && type <= 34) : (type == 7 || type == 8);
+        if(parameter_set) {
+            out.append("\0\0\0\1", 4);
+            out.append((const char*) data + start, end - start);
+        }
+    }
+}
 
-                    msg_envelope_elem_body_t* roi_obj= msgbus_msg_envelope_new_object();
-                    if(roi_obj == NULL) {
-                        LOG_ERROR_0("Failed to initialize roi metadata");
-                        delete frame;
-                        return GST_FLOW_ERROR;
-                    }
+/**
+ * Add the keyframe flag and, for keyframes, the codec configuration of a
+ * video access unit to the frame metadata
+ */
+static bool add_video_meta(GstBuffer* buf, const guint8* data, size_t len, bool h265,
+                           msg_envelope_t* meta_data) {
+    bool keyframe = !GST_BUFFER_FLAG_IS_SET(buf, GST_BUFFER_FLAG_DELTA_UNIT);
+    msg_envelope_elem_body_t* elem = msgbus_msg_envelope_new_bool(keyframe);
+    if(elem == NULL || msgbus_msg_envelope_put(meta_data, KEYFRAME, elem) != MSG_SUCCESS) {
+        LOG_ERROR_0("Failed to put keyframe meta-data");
+        if(elem != NULL)
+            msgbus_msg_envelope_elem_destroy(elem);
+        return false;
+    }
+    if(!keyframe)
+        return true;
+
+    // The parameter sets are repeated in every keyframe by the parser with
+    // config-interval=-1
+    std::string parameter_sets;
+    get_parameter_sets(data, len, h265, parameter_sets);
+    if(parameter_sets.empty())
+        return true;
+    std::string encoded;
+    base64_encode(parameter_sets, encoded);
+    elem = msgbus_msg_envelope_new_string(encoded.c_str());
+    if(elem == NULL || msgbus_msg_envelope_put(meta_data, CODEC_CONFIG, elem) != MSG_SUCCESS) {
+        LOG_ERROR_0("Failed to put codec_config meta-data");
+        if(elem != NULL)
+            msgbus_msg_envelope_elem_destroy(elem);
+        return false;
+    }
+    return true;
+}
 
-                    msg_envelope_elem_body_t* x = msgbus_msg_envelope_new_integer(meta->x);
-                    if(x == NULL) {
-                        LOG_ERROR_0("Failed to initialize horizontal offset metadata");
-                        delete frame;
-                        return GST_FLOW_ERROR;
-                    }
+bool GstreamerIngestor::update_caps(GstreamerStream* stream, GstCaps* caps) {
+    if(stream->caps != NULL) {
+        gst_caps_unref(stream->caps);
+        stream->caps = NULL;
+    }
 
-                    msg_envelope_elem_body_t* y = msgbus_msg_envelope_new_integer(meta->y);
-                    if(y == NULL) {
-                        LOG_ERROR_0("Failed to initialize vertical offset metadata");
-                        delete frame;
-                        return GST_FLOW_ERROR;
-                    }
+    // Compressed samples are not parsed, they are passed on as is
+    GstStructure* structure = (caps != NULL) ? gst_caps_get_structure(caps, 0) : NULL;
+    const char* compressed_format = NULL;
+    if(structure != NULL && gst_structure_has_name(structure, "image/jpeg")) {
+        compressed_format = PIXEL_FORMAT_JPEG;
+    } else if(structure != NULL && gst_structure_has_name(structure, "video/x-h264")) {
+        compressed_format = PIXEL_FORMAT_H264;
+    } else if(structure != NULL && gst_structure_has_name(structure, "video/x-h265")) {
+        compressed_format = PIXEL_FORMAT_H265;
+    }
+    if(compressed_format != NULL) {
+        if(strcmp(compressed_format, PIXEL_FORMAT_JPEG) != 0) {
+            // Access units have to be self-contained so that they can be
+            // published and decoded one by one
+            const gchar* stream_format = gst_structure_get_string(structure, "stream-format");
+            const gchar* alignment = gst_structure_get_string(structure, "alignment");
+            if(stream_format == NULL || strcmp(stream_format, "byte-stream") != 0 ||
+               alignment == NULL || strcmp(alignment, "au") != 0) {
+                LOG_ERROR("%s samples must be in byte-stream format with au "
+                          "alignment, please add \"%s,stream-format=byte-stream,"
+                          "alignment=au\" caps before the appsink",
+                          compressed_format, gst_structure_get_name(structure));
+                return false;
+            }
+        }
+        int width = 0;
+        int height = 0;
+        gst_structure_get_int(structure, "width", &width);
+        gst_structure_get_int(structure, "height", &height);
+        if(stream->compressed_format == NULL ||
+           strcmp(stream->compressed_format, compressed_format) != 0) {
+            LOG_INFO("%s format: %s, Size: %dx%d, frames are passed on without "
+                     "decoding", stream->sink_name.c_str(), compressed_format,
+                     width, height);
+        }
+        stream->compressed_format = compressed_format;
+        stream->encodable = false;
+        stream->frame_width = width;
+        stream->frame_height = height;
+        stream->frame_channels = 1;
+        stream->caps = gst_caps_ref(caps);
+        return true;
+    }
+    if(stream->compressed_format != NULL) {
+        // No raw video caps to compare to
+        stream->compressed_format = NULL;
+        stream->frame_width = 0;
+    }
 
+    GstVideoInfo info;
+    if(caps == NULL || !gst_video_info_from_caps(&info, caps)) {
+        LOG_ERROR_0("Failed to read the sample caps");
+        return false;
+    }
+    int width;
+    int height;
+    int channels;
+    if(!get_frame_layout(&info, width, height, channels)) {
+        LOG_ERROR("%s image format is not supported, please use BGR, "
+                  "BGRx, GRAY8, GRAY16_LE, NV12, I420 or image/jpeg",
+                  GST_VIDEO_INFO_NAME(&info));
+        return false;
+    }
 
-                    msg_envelope_elem_body_t* w = msgbus_msg_envelope_new_integer(meta->w);
-                    if(w == NULL) {
-                        LOG_ERROR_0("Failed to initialize width metadata");
-                        delete frame;
-                        return GST_FLOW_ERROR;
-                    }
+    if(stream->frame_width == 0) {
+        LOG_INFO("%s format: %s, Size: %dx%d", stream->sink_name.c_str(),
+                 GST_VIDEO_INFO_NAME(&info),
+                 GST_VIDEO_INFO_WIDTH(&info), GST_VIDEO_INFO_HEIGHT(&info));
+    } else if(GST_VIDEO_INFO_FORMAT(&info) != GST_VIDEO_INFO_FORMAT(&stream->video_info) ||
+              GST_VIDEO_INFO_WIDTH(&info) != GST_VIDEO_INFO_WIDTH(&stream->video_info) ||
+              GST_VIDEO_INFO_HEIGHT(&info) != GST_VIDEO_INFO_HEIGHT(&stream->video_info)) {
+        LOG_INFO("%s caps changed from %s %dx%d to %s %dx%d",
+                 stream->sink_name.c_str(), GST_VIDEO_INFO_NAME(&stream->video_info),
+                 GST_VIDEO_INFO_WIDTH(&stream->video_info),
+                 GST_VIDEO_INFO_HEIGHT(&stream->video_info),
+                 GST_VIDEO_INFO_NAME(&info),
+                 GST_VIDEO_INFO_WIDTH(&info), GST_VIDEO_INFO_HEIGHT(&info));
+    }
+    stream->encodable = is_encodable(GST_VIDEO_INFO_FORMAT(&info));
+    if(!stream->encodable) {
+        LOG_INFO("%s frames are published without encoding",
+                 GST_VIDEO_INFO_NAME(&info));
+    }
 
-                    msg_envelope_elem_body_t* h = msgbus_msg_envelope_new_integer(meta->h);
-                    if(h == NULL) {
-                        LOG_ERROR_0("Failed to initialize height metadata");
-                        delete frame;
-                        return GST_FLOW_ERROR;
-                    }
+    stream->video_info = info;
+    stream->frame_width = width;
+    stream->frame_height = height;
+    stream->frame_channels = channels;
+    stream->caps = gst_caps_ref(caps);
+    return true;
+}
 
-                    ret = msgbus_msg_envelope_elem_object_put(roi_obj, "x", x);
-                    if(ret != MSG_SUCCESS) {
-                        LOG_ERROR_0("Failed to put horizontal offset metadata");
-                        delete frame;
-                        return GST_FLOW_ERROR;
-                    }
+/**
+ * Time elapsed between the capture of a sample, as given by its running
+ * time, and now on the pipeline clock. Samples of non-live sources may be
+ * ahead of the clock, which gives a negative age.
+ * @param age_ns - Age of the sample in nanoseconds
+ * @return false if the age cannot be determined
+ */
+static bool get_sample_age(GstElement* sink, GstSample* sample, gint64& age_ns) {
+    GstBuffer* buf = gst_sample_get_buffer(sample);
+    const GstSegment* segment = gst_sample_get_segment(sample);
+    if(buf == NULL || segment == NULL || !GST_CLOCK_TIME_IS_VALID(GST_BUFFER_PTS(buf)))
+        return false;
+    GstClockTime running_time = gst_segment_to_running_time(
+            segment, GST_FORMAT_TIME, GST_BUFFER_PTS(buf));
+    if(!GST_CLOCK_TIME_IS_VALID(running_time))
+        return false;
+    GstClock* clock = gst_element_get_clock(sink);
+    if(clock == NULL)
+        return false;
+    GstClockTime now = gst_clock_get_time(clock);
+    gst_object_unref(clock);
+    age_ns = (gint64) now - (gint64) (gst_element_get_base_time(sink) + running_time);
+    return true;
+}
 
-                    ret = msgbus_msg_envelope_elem_object_put(roi_obj, "y", y);
-                    if(ret != MSG_SUCCESS) {
-                        LOG_ERROR_0("Failed to put vertical offset metadata");
-                        delete frame;
-                        return GST_FLOW_ERROR;
-                    }
+/**
+ * Wall clock time a sample of the given age was captured at, so that a
+ * recording keeps the timing of the source rather than the time the sample
+ * was pulled
+ */
+static uint64_t get_capture_time_ns(gint64 age_ns) {
+    int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+    return (now > age_ns) ? (uint64_t) (now - age_ns) : 0;
+}
 
-                    ret = msgbus_msg_envelope_elem_object_put(roi_obj, "width", w);
-                    if(ret != MSG_SUCCESS) {
-                        LOG_ERROR_0("Failed to put width metadata");
-                        delete frame;
+/**
+ * A new sample has been received in the appsink
+ */
+GstFlowReturn GstreamerIngestor::new_sample(GstElement *sink,
+GstreamerStream* stream) {
+    GstreamerIngestor* ctx = stream->ingestor;
+    // Do not hand out any more frames once the ingestor is stopping
+    if(ctx->m_stop.load())
+        return GST_FLOW_EOS;
+
+    GstSample* sample;
+    g_signal_emit_by_name(sink, "pull-sample", &sample);
+    // Snapshots are only taken of the main stream
+    if(sample && ctx->m_snapshot && stream->queue != NULL) {
+        gst_sample_unref(sample);
+        return GST_FLOW_OK;
+    }
+    if(sample) {
+        // Age of the sample at the time it was pulled, giving the latency
+        // from capture until now. The time until the frame is queued is
+        // added once it has been pushed. Latency and recording only cover
+        // the main stream, the appsinks of the other streams run in their
+        // own threads.
+        gint64 sample_latency_ns = -1;
+        uint64_t capture_ts_ns = 0;
+        auto sample_time = std::chrono::steady_clock::now();
+        gint64 age_ns = 0;
+        if(stream->queue == NULL && (ctx->m_live || ctx->m_recorder != NULL) &&
+           get_sample_age(sink, sample, age_ns)) {
+            if(ctx->m_live)
+                sample_latency_ns = (age_ns > 0) ? age_ns : 0;
+            if(ctx->m_recorder != NULL)
+                capture_ts_ns = get_capture_time_ns(age_ns);
+        }
+        ctx->m_last_frame_ns.store(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                sample_time.time_since_epoch()).count());
+        ctx->m_frame_received.store(true);
+
+        GstBuffer* buf = gst_sample_get_buffer(sample); // no lifetime transfer
+        if(buf) {
+            // The caps only need to be parsed when they were renegotiated,
+            // e.g. on a resolution change of an RTSP stream
+            GstCaps* frame_caps = gst_sample_get_caps(sample);  // no lifetime transfer
+            if(frame_caps != stream->caps && !ctx->update_caps(stream, frame_caps)) {
+                gst_sample_unref(sample);
+                return GST_FLOW_ERROR;
+            }
+            int width = stream->frame_width;
+            int height = stream->frame_height;
+            int channels = stream->frame_channels;
+            bool encodable = stream->encodable;
+            GstVideoInfo* info = &stream->video_info;
+
+            const char* compressed_format = stream->compressed_format;
+
+            GstreamerFrame* gst_frame = new GstreamerFrame(sample);
+            bool mapped = (compressed_format != NULL) ?
+                gst_buffer_map(buf, &gst_frame->map, GST_MAP_READ) :
+                gst_video_frame_map(&gst_frame->vframe, info, buf, GST_MAP_READ);
+            if(!mapped) {
+                LOG_ERROR_0("Failed to map GStreamer buffer to system memory");
+                delete gst_frame;
+                return GST_FLOW_ERROR;
+            } else {
+                void* data = NULL;
+                if(compressed_format != NULL) {
+                    // Compressed data is passed on as a byte blob
+                    gst_frame->buffer = buf;
+                    data = gst_frame->map.data;
+                } else {
+                    gst_frame->mapped = true;
+                    data = GST_VIDEO_FRAME_PLANE_DATA(&gst_frame->vframe, 0);
+                }
+                if(compressed_format == NULL && !is_packed(&gst_frame->vframe)) {
+                    // Padded strides or non contiguous planes, e.g. from
+                    // hardware decoders, are packed into a single copy
+                    gst_frame->copy = malloc((size_t) width * height * channels);
+                    if(gst_frame->copy == NULL) {
+                        LOG_ERROR_0("Failed to allocate memory for the frame");
+                        delete gst_frame;
                         return GST_FLOW_ERROR;
                     }
+                    copy_packed(&gst_frame->vframe, (guint8*) gst_frame->copy);
+                    gst_video_frame_unmap(&gst_frame->vframe);
+                    gst_frame->mapped = false;
+                    data = gst_frame->copy;
+                }
+
+                Frame* frame = NULL;
+                if(compressed_format != NULL) {
+                    frame = new CompressedFrame(
+                            (void*) gst_frame, free_gst_frame, data, gst_frame->map.size);
+                } else {
+                    frame = new Frame(
+                            (void*) gst_frame, free_gst_frame, data,
+                            width, height, channels);
+                }
+
+                msg_envelope_t* gva_meta_data = frame->get_meta_data();
+                if(gva_meta_data == NULL) {
+                    LOG_ERROR_0("Failed to initialize frame metadata");
+                    delete frame;
+                    return GST_FLOW_ERROR;
+                }
 
-                    ret = msgbus_msg_envelope_elem_object_put(roi_obj, "height", h);
-                    if(ret != MSG_SUCCESS) {
-                        LOG_ERROR_0("Failed to put height metadata");
+                // Consumers interpret the frame data based on its pixel format
+                if(compressed_format != NULL) {
+                    // The image size of the caps, if any, is published
+                    if(!set_compressed_format(frame, compressed_format, width, height)) {
+                        LOG_ERROR_0("Failed to put pixel_format meta-data");
                         delete frame;
                         return GST_FLOW_ERROR;
                     }
-
-                    msg_envelope_elem_body_t* tensor_arr = msgbus_msg_envelope_new_array();
-                    if(tensor_arr == NULL) {
-                        LOG_ERROR_0("Failed to initialize tensor metadata");
+                    if(strcmp(compressed_format, PIXEL_FORMAT_JPEG) != 0 &&
+                       !add_video_meta(buf, gst_frame->map.data, gst_frame->map.size,
+                                       !strcmp(compressed_format, PIXEL_FORMAT_H265),
+                                       gva_meta_data)) {
                         delete frame;
                         return GST_FLOW_ERROR;
                     }
-
-                    for(GVA::Tensor& tensor : roi) {
-                        LOG_DEBUG("Attribute: %s, Label: %s, Confidence: %f Label_id:%d",
-                                tensor.name().c_str(), tensor.label().c_str(),
-                                tensor.confidence(), tensor.label_id());
-
-                        msg_envelope_elem_body_t* tensor_obj= msgbus_msg_envelope_new_object();
-                        if(tensor_obj == NULL) {
-                            LOG_ERROR_0("Failed to initialize tensor metadata for each roi");
-                            delete frame;
-                            return GST_FLOW_ERROR;
-                        }
-
-                        msg_envelope_elem_body_t* attribute = msgbus_msg_envelope_new_string(tensor.name().c_str());
-                        if(attribute == NULL) {
-                            LOG_ERROR_0("Failed to initialize attribute metadata");
-                            delete frame;
-                            return GST_FLOW_ERROR;
-                        }
-
-                        msg_envelope_elem_body_t* label = msgbus_msg_envelope_new_string(tensor.label().c_str());
-                        if(label == NULL) {
-                            LOG_ERROR_0("Failed to initialize label metadata");
-                            delete frame;
-                            return GST_FLOW_ERROR;
-                        }
-
-                        msg_envelope_elem_body_t* confidence = msgbus_msg_envelope_new_floating(tensor.confidence());
-                        if(confidence == NULL) {
-                            LOG_ERROR_0("Failed to initialize confidence metadata");
-                            delete frame;
-                            return GST_FLOW_ERROR;
-                        }
-
-                        msg_envelope_elem_body_t* label_id = msgbus_msg_envelope_new_integer(tensor.label_id());
-                        if(label_id == NULL) {
-                            LOG_ERROR_0("Failed to initialize label_id metadata");
-                            delete frame;
-                            return GST_FLOW_ERROR;
-                        }
-
-                        ret = msgbus_msg_envelope_elem_object_put(tensor_obj, "attribute", attribute);
-                        if(ret != MSG_SUCCESS) {
-                            LOG_ERROR_0("Failed to put attribute metadata");
-                            delete frame;
-                            return GST_FLOW_ERROR;
-                        }
-
-                        ret = msgbus_msg_envelope_elem_object_put(tensor_obj, "label", label);
-                        if(ret != MSG_SUCCESS) {
-                            LOG_ERROR_0("Failed to put label metadata");
-                            delete frame;
-                            return GST_FLOW_ERROR;
-                        }
-
-                        ret = msgbus_msg_envelope_elem_object_put(tensor_obj, "confidence", confidence);
-                        if(ret != MSG_SUCCESS) {
-                            LOG_ERROR_0("Failed to put confidence metadata");
-                            delete frame;
-                            return GST_FLOW_ERROR;
-                        }
-
-                        ret = msgbus_msg_envelope_elem_object_put(tensor_obj, "label_id", label_id);
-                        if(ret != MSG_SUCCESS) {
-                            LOG_ERROR_0("Failed to put label_id metadata");
-                            delete frame;
-                            return GST_FLOW_ERROR;
-                        }
-
-                        ret = msgbus_msg_envelope_elem_array_add(tensor_arr, tensor_obj);
-                        if(ret != MSG_SUCCESS) {
-                            LOG_ERROR_0("Failed to add tensor object to tensor array metadata");
-                            delete frame;
-                            return GST_FLOW_ERROR;
-                        }
-                    }
-
-                    ret = msgbus_msg_envelope_elem_object_put(roi_obj, "tensor", tensor_arr);
-                    if(ret != MSG_SUCCESS) {
-                        LOG_ERROR_0("Failed to put tensor array to roi object metadata");
+                } else {
+                    msg_envelope_elem_body_t* format_elem = msgbus_msg_envelope_new_string(
+                            GST_VIDEO_INFO_NAME(info));
+                    if(format_elem == NULL) {
+                        LOG_ERROR_0("Failed to create pixel_format element");
                         delete frame;
                         return GST_FLOW_ERROR;
                     }
-
-                    ret = msgbus_msg_envelope_elem_array_add(gva_meta_arr,roi_obj);
-                    if(ret != MSG_SUCCESS) {
-                        LOG_ERROR_0("Failed to add roi object to gva metadata");
+                    if(msgbus_msg_envelope_put(gva_meta_data, "pixel_format", format_elem) != MSG_SUCCESS) {
+                        LOG_ERROR_0("Failed to put pixel_format meta-data");
+                        msgbus_msg_envelope_elem_destroy(format_elem);
                         delete frame;
                         return GST_FLOW_ERROR;
                     }
                 }
 
-                msg_envelope_t* gva_meta_data = frame->get_meta_data();
-                if(gva_meta_data == NULL) {
-                    LOG_ERROR_0("Failed to initialize frame metadata");
+                //Get the GVA metadata from the GST buffer
+                bool gva_ret = ctx->m_gva_meta_binary ?
+                    add_gva_meta_binary(buf, gva_meta_data) :
+                    add_gva_meta(buf, gva_meta_data);
+                if(!gva_ret) {
                     delete frame;
                     return GST_FLOW_ERROR;
                 }
 
-                ret = msgbus_msg_envelope_put(gva_meta_data, "gva_meta", gva_meta_arr);
-                if(ret != MSG_SUCCESS) {
-                    LOG_ERROR_0("Failed to put gva metadata");
+                // Attach the raw data of the selected GVA tensors
+                if(!ctx->m_raw_tensors.empty() &&
+                   !add_gva_raw_tensors(sample, frame, ctx->m_raw_tensors)) {
                     delete frame;
                     return GST_FLOW_ERROR;
                 }
 
+                msgbus_ret_t ret = MSG_SUCCESS;
+
                 msg_envelope_elem_body_t* elem = NULL;
-                if(ctx->m_frame_count == INT64_MAX) {
+                if(stream->frame_count == INT64_MAX) {
                     LOG_WARN_0("frame count has reached INT64_MAX, so resetting \
                                 it back to zero");
-                    ctx->m_frame_count = 0;
+                    stream->frame_count = 0;
                 }
-                ctx->m_frame_count++;
+                stream->frame_count++;
 
                 // Deleting subsequent frames in snapshot mode if GST_FLOW_EOS
                 // takes time/doesn't stop gstreamer loop with video source
                 if (ctx->m_snapshot) {
-                    if (ctx->m_frame_count > 1) {
+                    if (stream->frame_count > 1) {
                       delete frame;
                       return GST_FLOW_EOS;
                      }
                 }
-                elem = msgbus_msg_envelope_new_integer(ctx->m_frame_count);
+                elem = msgbus_msg_envelope_new_integer(stream->frame_count);
                 if (elem == NULL) {
                     LOG_ERROR_0("Failed to create frame_number element");
                     delete frame;
@@ -495,7 +1850,7 @@ GstreamerIngestor* ctx) {
                     delete frame;
                     return GST_FLOW_ERROR;
                 }
-                LOG_DEBUG("Frame number: %ld", ctx->m_frame_count);
+                LOG_DEBUG("Frame number: %ld", stream->frame_count);
 
                 // Adding image handle to frame
                 msg_envelope_t* meta_data = frame->get_meta_data();
@@ -506,22 +1861,14 @@ GstreamerIngestor* ctx) {
                 DO_PROFILING(ctx->m_profile, meta_data, "ts_filterQ_entry");
                 // Profiling end
 
-                try {
-                    frame->set_encoding(g_enc_type, g_enc_lvl);
-                } catch(const char *err) {
-                    LOG_ERROR("Exception: %s", err);
-                } catch(...) {
-                    LOG_ERROR("Exception occurred in set_encoding()");
-                }
+                ctx->push_frame(frame, (stream->queue != NULL) ?
+                                stream->queue : ctx->m_udf_input_queue,
+                                encodable, capture_ts_ns);
 
-                QueueRetCode ret_queue = ctx->m_udf_input_queue->push(frame);
-                if(ret_queue == QueueRetCode::QUEUE_FULL) {
-                    if(ctx->m_udf_input_queue->push_wait(frame) != QueueRetCode::SUCCESS) {
-                        LOG_ERROR_0("Failed to enqueue message, "
-                                    "message dropped");
-                    }
-                    // Add timestamp which acts as a marker if queue if blocked
-                    DO_PROFILING(ctx->m_profile, meta_data, ctx->m_ingestor_block_key.c_str());
+                if(sample_latency_ns >= 0) {
+                    auto queued_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                            std::chrono::steady_clock::now() - sample_time).count();
+                    ctx->record_latency((uint64_t) (sample_latency_ns / 1000 + queued_us));
                 }
             }
         } else {
@@ -529,7 +1876,7 @@ GstreamerIngestor* ctx) {
         }
 
         if(ctx->m_snapshot) {
-            ctx->m_frame_count = 1;
+            stream->frame_count = 1;
             ctx->m_snapshot_cv.notify_all();
             return GST_FLOW_EOS;
         }
@@ -34,13 +34,18 @@
 #include "eii/vi/opencv_ingestor.h"
 #include "eii/vi/gstreamer_ingestor.h"
 #include "eii/vi/realsense_ingestor.h"
+#include "eii/vi/replay_ingestor.h"
 
 using namespace eii::vi;
 using namespace eii::utils;
 using namespace eii::udf;
 
+// Reference point for uptime_ms(), initialized before main() runs
+static const std::chrono::steady_clock::time_point g_process_start =
+    std::chrono::steady_clock::now();
+
 Ingestor::Ingestor(config_t* config, FrameQueue* frame_queue, std::string service_name, std::condition_variable& snapshot_cv, EncodeType enc_type=EncodeType::NONE, int enc_lvl=0) :
-      m_service_name(service_name), m_th(NULL), m_initialized(false), m_stop(false), m_udf_input_queue(frame_queue), m_snapshot_cv(snapshot_cv), m_enc_type(enc_type), m_enc_lvl(enc_lvl) {
+      m_service_name(service_name), m_th(NULL), m_initialized(false), m_stop(false), m_hung(false), m_udf_input_queue(frame_queue), m_snapshot_cv(snapshot_cv), m_enc_type(enc_type), m_enc_lvl(enc_lvl) {
 
         // Initializing snapshot variable
         m_snapshot = false;
@@ -63,10 +68,83 @@ Ingestor::Ingestor(config_t* config, FrameQueue* frame_queue, std::string servic
         } else {
             m_poll_interval = 0.0 ;
         }
-        LOG_INFO("Poll interval: %lf", m_poll_interval);
+        LOG_INFO("Poll interval: %lf", m_poll_interval.load());
+
+        m_decode_config = -1;
+        config_value_t* cvt_decode = config->get_config_value(config->cfg, DECODE_COMPRESSED);
+        if(cvt_decode != NULL) {
+            if(cvt_decode->type != CVT_BOOLEAN) {
+                const char* err = "JSON value must be a boolean";
+                LOG_ERROR("%s for \'%s\'", err, DECODE_COMPRESSED);
+                config_value_destroy(cvt_decode);
+                throw(err);
+            }
+            m_decode_config = cvt_decode->body.boolean ? 1 : 0;
+            config_value_destroy(cvt_decode);
+        }
+        m_decode_compressed.store(m_decode_config == 1);
 
+        m_capture_thread = true;
         m_running.store(false);
+        m_first_frame_pending.store(false);
+        m_queue_wait_ns.store(0);
         this->m_profile = new Profiling();
+
+        m_recorder = NULL;
+        m_roi_cropper = NULL;
+        m_pyramid = NULL;
+        m_motion_gate = NULL;
+        m_duplicate_filter = NULL;
+        m_decoder = NULL;
+        m_allocator = NULL;
+        config_value_t* cvt_placement = NULL;
+        config_value_t* cvt_roi = NULL;
+        try {
+            cvt_placement = config->get_config_value(config->cfg, PLACEMENT);
+            m_placement = ThreadPlacement("ingestor", cvt_placement);
+
+            // The pool is faulted in on the NUMA node of the ingestion thread
+            {
+                ScopedPlacement placement(m_placement);
+                m_allocator = init_frame_allocator(config);
+            }
+
+            m_recorder = get_frame_recorder(config);
+
+            cvt_roi = config->get_config_value(config->cfg, ROI);
+            m_roi_cropper = new RoiCropper(cvt_roi);
+
+            m_pyramid = get_frame_pyramid(config);
+            m_motion_gate = get_motion_gate(config);
+            m_duplicate_filter = get_duplicate_filter(config);
+        } catch(const char*) {
+            if(cvt_placement != NULL)
+                config_value_destroy(cvt_placement);
+            if(cvt_roi != NULL)
+                config_value_destroy(cvt_roi);
+            delete m_profile;
+            release_stages();
+            throw;
+        }
+        if(cvt_placement != NULL)
+            config_value_destroy(cvt_placement);
+        if(cvt_roi != NULL)
+            config_value_destroy(cvt_roi);
+}
+
+void Ingestor::release_stages() {
+    delete m_recorder;
+    delete m_roi_cropper;
+    delete m_pyramid;
+    delete m_motion_gate;
+    delete m_duplicate_filter;
+    delete m_decoder;
+    m_recorder = NULL;
+    m_roi_cropper = NULL;
+    m_pyramid = NULL;
+    m_motion_gate = NULL;
+    m_duplicate_filter = NULL;
+    m_decoder = NULL;
 }
 
 Ingestor& Ingestor::operator=(const Ingestor& src) {
@@ -81,6 +159,7 @@ Ingestor::~Ingestor() {
         // Delete profiling variable
         delete m_profile;
     }
+    release_stages();
 }
 
 IngestRetCode Ingestor::start(bool snapshot_mode) {
@@ -92,11 +171,161 @@ IngestRetCode Ingestor::start(bool snapshot_mode) {
     else if (m_running.load())
         return IngestRetCode::ALREAD_RUNNING;
 
-    m_th = new std::thread(&Ingestor::run, this, snapshot_mode);
+    m_start_time = std::chrono::steady_clock::now();
+    m_first_frame_pending.store(true);
+    m_th = new std::thread([this, snapshot_mode]() {
+        m_placement.apply(m_capture_thread);
+        run(snapshot_mode);
+    });
 
     return IngestRetCode::SUCCESS;
 }
 
+void Ingestor::push_frame(Frame* frame, bool encode, uint64_t capture_ts_ns) {
+    push_frame(frame, m_udf_input_queue, encode, capture_ts_ns);
+}
+
+void Ingestor::push_frame(Frame* frame, FrameQueue* queue, bool encode,
+                          uint64_t capture_ts_ns) {
+    if(m_first_frame_pending.load() && m_first_frame_pending.exchange(false)) {
+        LOG_INFO("First frame ingested %ld ms after ingestor start, "
+                 "%ld ms after process start",
+                 (long) elapsed_ms(m_start_time), (long) uptime_ms());
+    }
+
+    msg_envelope_t* meta_data = frame->get_meta_data();
+
+    // Compressed frames are recorded as ingested and then either decoded
+    // or passed on without re-encoding
+    bool recorded = false;
+    const char* codec = get_compressed_codec(frame);
+    bool compressed = (codec != NULL);
+    if(compressed && m_decode_compressed.load() && queue == m_udf_input_queue) {
+        if(m_recorder != NULL)
+            m_recorder->record(frame, capture_ts_ns);
+        recorded = true;
+        // The reason has been logged
+        if(!decode_frame(frame, codec)) {
+            delete frame;
+            return;
+        }
+        compressed = false;
+        encode = true;
+    } else if(compressed) {
+        encode = false;
+        // The decoder has to restart at a keyframe once decoding resumes
+        if(m_decoder != NULL && queue == m_udf_input_queue) {
+            delete m_decoder;
+            m_decoder = NULL;
+        }
+    }
+
+    EncodeType enc_type = EncodeType::NONE;
+    int enc_lvl = 0;
+    if(encode) {
+        {
+            std::lock_guard<std::mutex> lk(m_enc_mtx);
+            enc_type = m_enc_type;
+            enc_lvl = m_enc_lvl;
+        }
+
+        // Set encoding type and level
+        try {
+            frame->set_encoding(enc_type, enc_lvl);
+        } catch(const char *err) {
+            LOG_ERROR("Exception: %s", err);
+        } catch(...) {
+            LOG_ERROR("Exception occurred in set_encoding()");
+        }
+    }
+
+    // Frames are recorded as ingested, so that replays can be gated and
+    // cropped differently
+    if(queue == m_udf_input_queue) {
+        if(m_recorder != NULL && !recorded)
+            m_recorder->record(frame, capture_ts_ns);
+        // The remaining stages need pixels, so compressed frames skip them
+        if(!compressed) {
+            // Snapshots are always delivered
+            if(!m_snapshot &&
+               ((m_duplicate_filter != NULL && !m_duplicate_filter->check(frame)) ||
+                (m_motion_gate != NULL && !m_motion_gate->check(frame)))) {
+                delete frame;
+                return;
+            }
+            m_roi_cropper->crop(frame, enc_type, enc_lvl);
+            if(m_pyramid != NULL)
+                m_pyramid->apply(frame, enc_type, enc_lvl);
+        }
+    }
+
+    QueueRetCode ret_queue = queue->push(frame);
+    if(ret_queue == QueueRetCode::QUEUE_FULL) {
+        // Add timestamp which acts as a marker if queue is blocked. This is
+        // done before waiting as the frame belongs to the queue afterwards
+        DO_PROFILING(this->m_profile, meta_data, m_ingestor_block_key.c_str());
+        auto wait_start = std::chrono::steady_clock::now();
+        if(queue->push_wait(frame) != QueueRetCode::SUCCESS) {
+            LOG_ERROR_0("Failed to enqueue message, "
+                        "message dropped");
+        }
+        if(queue == m_udf_input_queue) {
+            m_queue_wait_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - wait_start).count();
+        }
+    }
+}
+
+bool Ingestor::decode_frame(Frame* frame, const char* codec) {
+    if(!strcmp(codec, "jpeg"))
+        return decode_jpeg(frame);
+    if(m_decoder != NULL && m_decoder->get_codec() != codec) {
+        delete m_decoder;
+        m_decoder = NULL;
+    }
+    if(m_decoder == NULL)
+        m_decoder = new VideoDecoder(codec);
+    return m_decoder->decode(frame);
+}
+
+void Ingestor::set_encoding(EncodeType enc_type, int enc_lvl) {
+    std::lock_guard<std::mutex> lk(m_enc_mtx);
+    m_enc_type = enc_type;
+    m_enc_lvl = enc_lvl;
+    LOG_INFO("Encoding changed to type: %d, level: %d", enc_type, enc_lvl);
+}
+
+void Ingestor::set_poll_interval(double poll_interval) {
+    m_poll_interval.store(poll_interval);
+    LOG_INFO("Poll interval changed to: %lf", poll_interval);
+}
+
+void Ingestor::set_roi(const config_value_t* roi) {
+    m_roi_cropper->update(roi);
+}
+
+void Ingestor::set_udfs_configured(bool configured) {
+    bool decode = (m_decode_config >= 0) ? (m_decode_config == 1) : configured;
+    if(decode != m_decode_compressed.exchange(decode)) {
+        LOG_INFO("Compressed frames are %s", decode ?
+                 "decoded for the UDFs" : "passed on without decoding");
+    }
+}
+
+void Ingestor::set_queue(FrameQueue* frame_queue, size_t queue_size) {
+    m_udf_input_queue = frame_queue;
+}
+
+void Ingestor::add_stream(const std::string& name, FrameQueue* queue) {
+    const char* err = "Ingestor does not support multiple streams";
+    LOG_ERROR("%s, cannot add \'%s\'", err, name.c_str());
+    throw(err);
+}
+
+bool Ingestor::is_hung() const {
+    return m_hung.load();
+}
+
 Ingestor* eii::vi::get_ingestor(config_t* config, FrameQueue* frame_queue, const char* type, std::string service_name, std::condition_variable& snapshot_cv, EncodeType enc_type, int enc_lvl) {
     Ingestor* ingestor = NULL;
     // Create the ingestor object based on the type specified in the config
@@ -106,8 +335,19 @@ Ingestor* eii::vi::get_ingestor(config_t* config, FrameQueue* frame_queue, const
         ingestor = new GstreamerIngestor(config, frame_queue, service_name, snapshot_cv, enc_type, enc_lvl);
     } else if(!strcmp(type, "realsense")) {
         ingestor = new RealSenseIngestor(config, frame_queue, service_name, snapshot_cv, enc_type, enc_lvl);
+    } else if(!strcmp(type, "replay")) {
+        ingestor = new ReplayIngestor(config, frame_queue, service_name, snapshot_cv, enc_type, enc_lvl);
     } else {
         throw("Unknown ingestor");
     }
     return ingestor;
 }
+
+int64_t eii::vi::elapsed_ms(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - start).count();
+}
+
+int64_t eii::vi::uptime_ms() {
+    return elapsed_ms(g_process_start);
+}
@@ -0,0 +1,115 @@
+// Copyright (c) 2021 Intel Corporation.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM,OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+
+/**
+ * @file
+ * @brief Latency histogram implementation
+ */
+
+#include <cstdio>
+#include "eii/vi/latency_histogram.h"
+
+using namespace eii::vi;
+
+/**
+ * Bucket of a value. Values below VI_HIST_SUB_BUCKETS have a bucket each,
+ * larger values are bucketed by their most significant bit and the
+ * VI_HIST_SUB_BITS bits following it.
+ */
+static size_t bucket_index(uint64_t value) {
+    if(value < VI_HIST_SUB_BUCKETS)
+        return (size_t) value;
+    int msb = 63 - __builtin_clzll(value);
+    int shift = msb - VI_HIST_SUB_BITS;
+    return (size_t) (msb - VI_HIST_SUB_BITS + 1) * VI_HIST_SUB_BUCKETS +
+        (size_t) ((value >> shift) & (VI_HIST_SUB_BUCKETS - 1));
+}
+
+/**
+ * Largest value falling into a bucket
+ */
+static uint64_t bucket_upper_bound(size_t index) {
+    if(index < VI_HIST_SUB_BUCKETS)
+        return (uint64_t) index;
+    int shift = (int) (index / VI_HIST_SUB_BUCKETS) - 1;
+    uint64_t sub = index % VI_HIST_SUB_BUCKETS;
+    uint64_t lower = (VI_HIST_SUB_BUCKETS + sub) << shift;
+    return lower + ((uint64_t) 1 << shift) - 1;
+}
+
+LatencyHistogram::LatencyHistogram() {
+    reset();
+}
+
+void LatencyHistogram::record(uint64_t value_us) {
+    m_buckets[bucket_index(value_us)].fetch_add(1, std::memory_order_relaxed);
+    m_count.fetch_add(1, std::memory_order_relaxed);
+    uint64_t cur = m_max.load(std::memory_order_relaxed);
+    while(value_us > cur &&
+          !m_max.compare_exchange_weak(cur, value_us, std::memory_order_relaxed));
+}
+
+uint64_t LatencyHistogram::count() const {
+    return m_count.load(std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::max() const {
+    return m_max.load(std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::percentile(double percentile) const {
+    uint64_t total = count();
+    if(total == 0)
+        return 0;
+    // Rank of the requested percentile, at least the first value
+    uint64_t rank = (uint64_t) ((percentile / 100.0) * total + 0.5);
+    if(rank == 0)
+        rank = 1;
+    uint64_t seen = 0;
+    for(size_t i = 0; i < VI_HIST_NUM_BUCKETS; i++) {
+        seen += m_buckets[i].load(std::memory_order_relaxed);
+        if(seen >= rank) {
+            uint64_t upper = bucket_upper_bound(i);
+            return upper < max() ? upper : max();
+        }
+    }
+    return max();
+}
+
+void LatencyHistogram::reset() {
+    for(size_t i = 0; i < VI_HIST_NUM_BUCKETS; i++)
+        m_buckets[i].store(0, std::memory_order_relaxed);
+    m_count.store(0, std::memory_order_relaxed);
+    m_max.store(0, std::memory_order_relaxed);
+}
+
+std::string LatencyHistogram::summary() const {
+    char buf[256];
+    snprintf(buf, sizeof(buf),
+             "count=%lu p50=%luus p90=%luus p99=%luus p99.9=%luus max=%luus",
+             (unsigned long) count(),
+             (unsigned long) percentile(50),
+             (unsigned long) percentile(90),
+             (unsigned long) percentile(99),
+             (unsigned long) percentile(99.9),
+             (unsigned long) max());
+    return std::string(buf);
+}
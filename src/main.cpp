@@ -33,7 +33,9 @@
 #include <stdbool.h>
 #include <eii/utils/json_validator.h>
 #include <fstream>
+#include <sstream>
 #include <iostream>
+#include <chrono>
 
 #define MAX_CONFIG_KEY_LENGTH 250
 
@@ -48,6 +50,10 @@ static char* g_vi_config = NULL;
 static std::condition_variable g_err_cv;
 static ConfigMgr* g_cfg_mgr = NULL;
 static std::atomic<bool> g_cfg_change;
+// Guards g_new_vi_config, the latest config received by the watch callback
+static std::mutex g_cfg_mtx;
+static char* g_new_vi_config = NULL;
+static std::string g_schema;
 
 void usage(const char* name) {
     printf("Usage: %s \n", name);
@@ -71,30 +77,60 @@ void signal_callback_handler(int signum){
 void clean_up() {
     if (g_ch) {
         delete g_ch;
+        g_ch = NULL;
     }
     if (g_vi) {
         delete g_vi;
+        g_vi = NULL;
     }
     if (g_cfg_mgr) {
         delete g_cfg_mgr;
+        g_cfg_mgr = NULL;
     }
 }
 
-void vi_initialize(char* vi_config, std::string app_name){
+/**
+ * (Re)create and start VideoIngestion.
+ * @return false if VideoIngestion failed to start, in which case all
+ *      components including the config manager have been released
+ */
+bool vi_initialize(char* vi_config, std::string app_name){
     if (g_ch) {
         delete g_ch;
         g_ch = NULL;
     }
 
     if (g_vi) {
+        // The detached thread of a hung ingestor still uses VideoIngestion
+        g_vi->stop();
+        if (g_vi->is_hung()) {
+            LOG_ERROR_0("Ingestor failed to stop, exiting to restart Video Ingestion");
+            _Exit(-1);
+        }
         delete g_vi;
         g_vi = NULL;
     }
 
+    auto phase_start = std::chrono::steady_clock::now();
     int server_num = g_cfg_mgr->getNumServers();
     if (server_num != -1) {
         try {
+            // The command handler threads inherit its placement
+            ThreadPlacement placement;
+            config_t* config = json_config_new_from_buffer(vi_config);
+            if (config != NULL) {
+                try {
+                    placement = get_thread_placement(config, PLACEMENT_COMMAND_HANDLER);
+                } catch(const char*) {
+                    config_destroy(config);
+                    throw;
+                }
+                config_destroy(config);
+            }
+            ScopedPlacement scoped_placement(placement);
             g_ch = new CommandHandler(g_cfg_mgr);
+            LOG_INFO("Command handler initialized in %ld ms",
+                     (long) elapsed_ms(phase_start));
         } catch(const char *err) {
             LOG_ERROR("Exception occurred : %s", err);
             if (g_ch) {
@@ -107,157 +143,135 @@ void vi_initialize(char* vi_config, std::string app_name){
     }
 
     try {
+        phase_start = std::chrono::steady_clock::now();
         g_vi = new VideoIngestion(app_name, g_err_cv, vi_config, g_cfg_mgr, g_ch);
+        LOG_INFO("Video Ingestion initialized in %ld ms",
+                 (long) elapsed_ms(phase_start));
+        phase_start = std::chrono::steady_clock::now();
         g_vi->start();
+        LOG_INFO("Video Ingestion started in %ld ms, %ld ms after process start",
+                 (long) elapsed_ms(phase_start), (long) uptime_ms());
     } catch(const std::exception& ex) {
         LOG_ERROR("Exception '%s' occurred", ex.what());
         clean_up();
+        return false;
     } catch(...) {
         LOG_ERROR("Exception occurred in Video Ingestion");
         clean_up();
+        return false;
     }
+    return true;
 }
 
 void on_change_config_callback(const char* key, config_t* value, void* user_data) {
     LOG_INFO("Callback triggered for key %s", key);
     char* vi_config = configt_to_char(value);
-    if(strcmp(g_vi_config, vi_config)){
-	// Deleting of g_vi, g_vi_config was hanging with gstreamer ingestor.
-	// Making a forceful exit until this is fixed.
-	// This shouldnt cause memory leaks as the application process is
-	// exiting and re-spawned by docker clearing all process allocated
-	// memory.
-        _Exit(-1);
-        /*if(g_vi) {
-            delete g_vi;
-            g_vi = NULL;
-        }
-        delete g_vi_config;*/
-        // TODO: Uncomment the below logic once the dynamic cfg fix works as
-        // expected
-        //g_vi_config = vi_config;
-        //g_cfg_change.store(true);
-        //g_err_cv.notify_one();
+    if (vi_config == NULL) {
+        LOG_ERROR_0("Unable to fetch changed app config string");
+        return;
+    }
+    // The change is applied by the main thread, only the latest config
+    // received is kept
+    std::lock_guard<std::mutex> lk(g_cfg_mtx);
+    if (g_new_vi_config != NULL) {
+        free(g_new_vi_config);
     }
+    g_new_vi_config = vi_config;
+    g_cfg_change.store(true);
+    g_err_cv.notify_one();
 }
 
 bool validate_config(char config_key[]) {
-    // Writing to external file
-    std::ofstream out;
-    out.open("/var/tmp/config.json", std::ios::binary);
-    out << config_key;
-    out.close();
-
-    WJReader readjson = NULL;
-    WJReader readschema = NULL;
-    WJElement json = NULL;
-    WJElement schema = NULL;
-
-    // Fetch config file
-    FILE* config_fp = fopen("/var/tmp/config.json", "r");
-    if(config_fp == NULL) {
-        return false;
+    // The schema does not change at runtime, so it is only read once
+    if(g_schema.empty()) {
+        std::ifstream schema_file("./VideoIngestion/schema.json", std::ios::binary);
+        if(!schema_file) {
+            LOG_ERROR_0("schema json could not be read");
+            return false;
+        }
+        std::stringstream schema_stream;
+        schema_stream << schema_file.rdbuf();
+        g_schema = schema_stream.str();
     }
-    readjson = WJROpenFILEDocument(config_fp, NULL, 0);
+
+    // Both documents are parsed from memory
+    WJReader readjson = WJROpenMemDocument(config_key, NULL, 0);
     if(readjson == NULL) {
         LOG_ERROR_0("config json could not be read");
-        if(config_fp != NULL) {
-            fclose(config_fp);
-        }
         return false;
     }
-    json = WJEOpenDocument(readjson, NULL, NULL, NULL);
+    WJElement json = WJEOpenDocument(readjson, NULL, NULL, NULL);
     if(json == NULL) {
         LOG_ERROR_0("config json could not be read");
-        if(readjson != NULL) {
-            free(readjson);
-        }
-        if(config_fp != NULL) {
-            fclose(config_fp);
-        }
+        WJRCloseDocument(readjson);
         return false;
     }
 
-    // Fetch schema file
-    FILE* schema_fp = fopen("./VideoIngestion/schema.json", "r");
-    if(schema_fp == NULL) {
-        if(config_fp != NULL) {
-            fclose(config_fp);
-        }
-        return false;
-    }
-    readschema = WJROpenFILEDocument(schema_fp, NULL, 0);
+    WJReader readschema = WJROpenMemDocument(&g_schema[0], NULL, 0);
     if(readschema == NULL) {
         LOG_ERROR_0("schema json could not be read");
-        if(schema_fp != NULL) {
-            fclose(schema_fp);
-        }
-        if(config_fp != NULL) {
-            fclose(config_fp);
-        }
+        WJECloseDocument(json);
+        WJRCloseDocument(readjson);
         return false;
     }
-    schema = WJEOpenDocument(readschema, NULL, NULL, NULL);
+    WJElement schema = WJEOpenDocument(readschema, NULL, NULL, NULL);
     if(schema == NULL) {
         LOG_ERROR_0("schema json could not be read");
-        if(readschema != NULL) {
-            free(readschema);
-        }
-        if(schema_fp != NULL) {
-            fclose(schema_fp);
-        }
-        if(config_fp != NULL) {
-            fclose(config_fp);
-        }
+        WJRCloseDocument(readschema);
+        WJECloseDocument(json);
+        WJRCloseDocument(readjson);
         return false;
     }
 
     // Validating config against schema
-    bool result = false;
-    if(schema != NULL && json != NULL) {
-        result = validate_json(schema, json);
-    }
+    bool result = validate_json(schema, json);
 
     // Close schema validation related documents
-    if(json != NULL) {
-        WJECloseDocument(json);
-    }
-    if(schema != NULL) {
-        WJECloseDocument(schema);
-    }
-    if(readjson != NULL) {
-        WJRCloseDocument(readjson);
-    }
-    if(readschema != NULL) {
-        WJRCloseDocument(readschema);
-    }
+    WJECloseDocument(json);
+    WJECloseDocument(schema);
+    WJRCloseDocument(readjson);
+    WJRCloseDocument(readschema);
 
-    // Closing json config & schema file pointers
-    if(config_fp != NULL) {
-        fclose(config_fp);
+    return result;
+}
+
+/**
+ * Apply a changed app config. The change is applied in place if possible,
+ * otherwise VideoIngestion is recreated. If the pipeline is left in an
+ * unusable state the process exits so that it gets restarted.
+ */
+void apply_config_change(char* vi_config, std::string app_name) {
+    if (!strcmp(g_vi_config, vi_config)) {
+        free(vi_config);
+        return;
     }
-    if(schema_fp != NULL) {
-        fclose(schema_fp);
+    if (!validate_config(vi_config)) {
+        LOG_ERROR_0("Schema validation failed for the changed config, keeping the current config");
+        free(vi_config);
+        return;
     }
 
-    if(!result) {
-        // Clean up and return if failure
-        clean_up();
-        if(readjson != NULL) {
-            free(readjson);
-        }
-        if(json != NULL) {
-            free(json);
-        }
-        if(readschema != NULL) {
-            free(readschema);
+    bool applied = false;
+    if (g_vi != NULL) {
+        try {
+            applied = g_vi->reconfigure(vi_config);
+        } catch(const char* err) {
+            LOG_ERROR("Failed to reconfigure Video Ingestion: %s", err);
+            _Exit(-1);
+        } catch(...) {
+            LOG_ERROR_0("Failed to reconfigure Video Ingestion");
+            _Exit(-1);
         }
-        if(schema != NULL) {
-            free(schema);
+    }
+    if (!applied) {
+        LOG_INFO_0("Restarting Video Ingestion with the changed config");
+        if (!vi_initialize(vi_config, app_name)) {
+            LOG_ERROR_0("Failed to restart Video Ingestion with the changed config");
+            _Exit(-1);
         }
-        return false;
     }
-    return true;
+    free(g_vi_config);
+    g_vi_config = vi_config;
 }
 
 int main(int argc, char** argv) {
@@ -272,6 +286,7 @@ int main(int argc, char** argv) {
         }
 
         // Get the configuration from the configuration manager
+        auto phase_start = std::chrono::steady_clock::now();
         g_cfg_mgr = new ConfigMgr();
         AppCfg* cfg = g_cfg_mgr->getAppConfig();
         if(cfg == NULL) {
@@ -288,12 +303,16 @@ int main(int argc, char** argv) {
             throw "Unable to fetch app config string";
         }
         LOG_DEBUG("App config: %s", g_vi_config);
+        int64_t config_ms = elapsed_ms(phase_start);
 
         // Validating config against schema
+        phase_start = std::chrono::steady_clock::now();
         if (!validate_config(g_vi_config)) {
             LOG_ERROR_0("Schema validation failed");
+            clean_up();
             return -1;
         }
+        int64_t validate_ms = elapsed_ms(phase_start);
 
         char* str_log_level = NULL;
         log_lvl_t log_level = LOG_LVL_ERROR; // default log level is `ERROR`
@@ -316,22 +335,31 @@ int main(int argc, char** argv) {
 
         set_log_level(log_level);
 
+        // Logged once the log level is known
+        LOG_INFO("App config fetched in %ld ms", (long) config_ms);
+        LOG_INFO("Schema validation done in %ld ms", (long) validate_ms);
+
         LOG_DEBUG_0("Registering watch on app config");
         bool ret = cfg->watchConfig(on_change_config_callback, NULL);
         if (!ret) {
             throw "Failed to register callback";
         }
 
-        vi_initialize(g_vi_config, app_name);
-
-        std::mutex mtx;
+        if (!vi_initialize(g_vi_config, app_name)) {
+            return -1;
+        }
 
         while(true) {
-            std::unique_lock<std::mutex> lk(mtx);
-            g_err_cv.wait(lk);
+            std::unique_lock<std::mutex> lk(g_cfg_mtx);
+            if(!g_cfg_change.load()) {
+                g_err_cv.wait(lk);
+            }
             if(g_cfg_change.load()) {
-                vi_initialize(g_vi_config, app_name);
+                char* vi_config = g_new_vi_config;
+                g_new_vi_config = NULL;
                 g_cfg_change.store(false);
+                lk.unlock();
+                apply_config_change(vi_config, app_name);
             } else {
                 break;
             }
@@ -0,0 +1,235 @@
+// Copyright (c) 2021 Intel Corporation.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM,OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+
+/**
+ * @file
+ * @brief Motion gate implementation
+ */
+
+#include <string.h>
+#include <algorithm>
+#include <eii/utils/logger.h>
+#include "eii/vi/motion_gate.h"
+#include "eii/vi/utils.h"
+
+// Defaults
+#define DEFAULT_THRESHOLD 0.005
+#define DEFAULT_PIXEL_THRESHOLD 25
+#define DEFAULT_HOLD_FRAMES 5
+#define DEFAULT_KEEP_ALIVE_MS 1000
+#define DEFAULT_SCALE 8
+
+// Interval of the passed/gated frame statistics
+#define REPORT_INTERVAL_S 60
+
+using namespace eii::vi;
+using namespace eii::udf;
+
+// Pixel formats starting with a full resolution luma plane
+static const char* const g_luma_formats[] = {
+    "GRAY8", "I420", "YV12", "NV12", "NV21", "NV16", "Y42B", "Y444", "Y41B", NULL
+};
+
+MotionGate::MotionGate(const config_value_t* config) :
+    m_open(true), m_hold(0), m_passed(0), m_gated(0), m_format_warned(false) {
+    if(config->type != CVT_OBJECT) {
+        const char* err = "JSON value must be an object";
+        LOG_ERROR("%s for \'%s\'", err, MOTION_GATE);
+        throw(err);
+    }
+    m_threshold = get_config_number(config, "threshold", DEFAULT_THRESHOLD, 0.0);
+    m_release_threshold = get_config_number(config, "release_threshold",
+                                            m_threshold / 2, 0.0);
+    m_pixel_threshold = get_config_number(config, "pixel_threshold",
+                                          DEFAULT_PIXEL_THRESHOLD, 0.0);
+    m_hold_frames = (int) get_config_int(config, "hold_frames",
+                                         DEFAULT_HOLD_FRAMES, 0);
+    m_keep_alive = std::chrono::milliseconds(get_config_int(
+                config, "keep_alive_ms", DEFAULT_KEEP_ALIVE_MS, 0, INT64_MAX));
+    m_scale = (int) get_config_int(config, "scale", DEFAULT_SCALE, 1);
+    if(m_threshold > 1.0 || m_release_threshold > m_threshold) {
+        const char* err = "Motion gate requires release_threshold <= threshold <= 1";
+        LOG_ERROR("%s", err);
+        throw(err);
+    }
+
+    m_drop = true;
+    config_value_t* cvt_action = config_value_object_get(config, "action");
+    if(cvt_action != NULL) {
+        if(cvt_action->type != CVT_STRING) {
+            config_value_destroy(cvt_action);
+            const char* err = "JSON value must be a string";
+            LOG_ERROR("%s for \'action\'", err);
+            throw(err);
+        }
+        std::string action = cvt_action->body.string;
+        config_value_destroy(cvt_action);
+        if(action == MOTION_GATE_ACTION_MARK) {
+            m_drop = false;
+        } else if(action != MOTION_GATE_ACTION_DROP) {
+            const char* err = "Unsupported motion gate action";
+            LOG_ERROR("%s \'%s\'", err, action.c_str());
+            throw(err);
+        }
+    }
+    m_last_pass = std::chrono::steady_clock::now();
+    m_report_time = m_last_pass;
+    LOG_INFO("Motion gate: threshold %.4f, release %.4f, pixel threshold %.0f, "
+             "hold %d frames, keep alive %ld ms, scale 1/%d, action %s",
+             m_threshold, m_release_threshold, m_pixel_threshold, m_hold_frames,
+             (long) m_keep_alive.count(), m_scale,
+             m_drop ? MOTION_GATE_ACTION_DROP : MOTION_GATE_ACTION_MARK);
+}
+
+bool MotionGate::extract_luma(Frame* frame) {
+    int width = frame->get_width(0);
+    int height = frame->get_height(0);
+    int channels = frame->get_channels(0);
+    const char* pixel_format = get_pixel_format(frame);
+
+    bool luma_plane = pixel_format == NULL && channels == 1;
+    for(int i = 0; pixel_format != NULL && g_luma_formats[i] != NULL; i++) {
+        if(!strcmp(pixel_format, g_luma_formats[i]))
+            luma_plane = true;
+    }
+    int conversion = -1;
+    if(!luma_plane) {
+        bool packed = pixel_format == NULL || !strcmp(pixel_format, "BGR") ||
+            !strcmp(pixel_format, "RGB") || !strcmp(pixel_format, "BGRx") ||
+            !strcmp(pixel_format, "BGRA") || !strcmp(pixel_format, "RGBx") ||
+            !strcmp(pixel_format, "RGBA");
+        if(packed && channels == 3)
+            conversion = cv::COLOR_BGR2GRAY;
+        else if(packed && channels == 4)
+            conversion = cv::COLOR_BGRA2GRAY;
+        else
+            return false;
+    }
+
+    // Downscale first, so that only the small image is converted. The
+    // weights of the color conversion do not matter for the change score.
+    cv::Size size(std::max(width / m_scale, 1), std::max(height / m_scale, 1));
+    if(luma_plane) {
+        // Planar YUV frames are handed out with the chroma planes as
+        // additional rows, e.g. 3/2 of the height for I420 and NV12
+        if(pixel_format != NULL && strcmp(pixel_format, "GRAY8") != 0) {
+            if(!strcmp(pixel_format, "Y444"))
+                height /= 3;
+            else if(!strcmp(pixel_format, "NV16") || !strcmp(pixel_format, "Y42B"))
+                height /= 2;
+            else
+                height = height * 2 / 3;
+            size.height = std::max(height / m_scale, 1);
+        }
+        cv::Mat luma(height, width, CV_8UC1, frame->get_data(0));
+        cv::resize(luma, m_luma, size, 0, 0, cv::INTER_AREA);
+    } else {
+        cv::Mat pixels(height, width, CV_MAKETYPE(CV_8U, channels), frame->get_data(0));
+        cv::Mat small;
+        cv::resize(pixels, small, size, 0, 0, cv::INTER_AREA);
+        cv::cvtColor(small, m_luma, conversion);
+    }
+    return true;
+}
+
+double MotionGate::score(const cv::Mat& luma, const cv::Mat& reference, cv::Mat& diff) {
+    cv::absdiff(luma, reference, diff);
+    cv::threshold(diff, diff, m_pixel_threshold, 255, cv::THRESH_BINARY);
+    return (double) cv::countNonZero(diff) / diff.total();
+}
+
+bool MotionGate::check(Frame* frame) {
+    if(!extract_luma(frame)) {
+        if(!m_format_warned.exchange(true)) {
+            LOG_WARN_0("Motion gate does not support the pixel format, "
+                       "frames are not gated");
+        }
+        return true;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    double change = 1.0;
+    if(m_reference.size() == m_luma.size())
+        change = score(m_luma, m_reference, m_diff);
+
+    bool was_open = m_open;
+    if(change >= m_threshold || (m_open && change >= m_release_threshold)) {
+        m_open = true;
+        m_hold = m_hold_frames;
+    } else if(m_hold > 0) {
+        m_hold--;
+    } else {
+        m_open = false;
+    }
+    if(m_open != was_open) {
+        LOG_DEBUG("Motion gate %s, change score %.4f",
+                  m_open ? "opened" : "closed", change);
+    }
+
+    bool pass = m_open ||
+        (m_keep_alive.count() > 0 && now - m_last_pass >= m_keep_alive);
+    if(pass) {
+        m_last_pass = now;
+        std::swap(m_reference, m_luma);
+        m_passed++;
+    } else {
+        m_gated++;
+    }
+
+    if(now - m_report_time >= std::chrono::seconds(REPORT_INTERVAL_S)) {
+        LOG_INFO("Motion gate: %lu frames passed, %lu static frames %s",
+                 (unsigned long) m_passed, (unsigned long) m_gated,
+                 m_drop ? "dropped" : "marked");
+        m_passed = 0;
+        m_gated = 0;
+        m_report_time = now;
+    }
+
+    msg_envelope_t* meta_data = frame->get_meta_data();
+    msg_envelope_elem_body_t* score_elem = msgbus_msg_envelope_new_floating(change);
+    if(score_elem != NULL &&
+       msgbus_msg_envelope_put(meta_data, MOTION_SCORE_KEY, score_elem) != MSG_SUCCESS) {
+        msgbus_msg_envelope_elem_destroy(score_elem);
+    }
+    if(!pass && !m_drop) {
+        msg_envelope_elem_body_t* static_elem = msgbus_msg_envelope_new_bool(true);
+        if(static_elem != NULL &&
+           msgbus_msg_envelope_put(meta_data, MOTION_STATIC_KEY, static_elem) != MSG_SUCCESS) {
+            msgbus_msg_envelope_elem_destroy(static_elem);
+        }
+    }
+    return pass || !m_drop;
+}
+
+MotionGate* eii::vi::get_motion_gate(config_t* config) {
+    config_value_t* cvt_gate = config->get_config_value(config->cfg, MOTION_GATE);
+    if(cvt_gate == NULL)
+        return NULL;
+    MotionGate* gate = NULL;
+    try {
+        gate = new MotionGate(cvt_gate);
+    } catch(...) {
+        config_value_destroy(cvt_gate);
+        throw;
+    }
+    config_value_destroy(cvt_gate);
+    return gate;
+}
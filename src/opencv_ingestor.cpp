@@ -40,6 +40,7 @@ using namespace eii::udf;
 
 #define PIPELINE "pipeline"
 #define LOOP_VIDEO "loop_video"
+#define JPEG_PASSTHROUGH "jpeg_passthrough"
 #define UUID_LENGTH 5
 
 OpenCvIngestor::OpenCvIngestor(config_t* config, FrameQueue* frame_queue, std::string service_name, std::condition_variable& snapshot_cv, EncodeType enc_type, int enc_lvl):
@@ -50,6 +51,10 @@ OpenCvIngestor::OpenCvIngestor(config_t* config, FrameQueue* frame_queue, std::s
     m_encoding = false;
     m_loop_video = false;
     m_double_frames = false;
+    m_jpeg_passthrough = false;
+    m_frame_rows = 0;
+    m_frame_cols = 0;
+    m_frame_type = -1;
     m_initialized.store(true);
 
     config_value_t* cvt_double = config_get(config, "double_frames");
@@ -93,9 +98,34 @@ OpenCvIngestor::OpenCvIngestor(config_t* config, FrameQueue* frame_queue, std::s
         config_value_destroy(cvt_loop_video);
     }
 
+    config_value_t* cvt_passthrough = config->get_config_value(
+            config->cfg, JPEG_PASSTHROUGH);
+    if(cvt_passthrough != NULL) {
+        if(cvt_passthrough->type != CVT_BOOLEAN) {
+            config_value_destroy(cvt_passthrough);
+            const char* err = "JSON value must be a boolean";
+            LOG_ERROR("%s for \'%s\'", err, JPEG_PASSTHROUGH);
+            throw(err);
+        }
+        m_jpeg_passthrough = cvt_passthrough->body.boolean;
+        config_value_destroy(cvt_passthrough);
+    }
+
+    open_capture();
+}
+
+void OpenCvIngestor::open_capture() {
     m_cap = new cv::VideoCapture(m_pipeline);
     if(!m_cap->isOpened()) {
         LOG_ERROR("Failed to open gstreamer pipeline: %s", m_pipeline.c_str());
+    } else if(m_jpeg_passthrough) {
+        // Request the MJPEG stream of the camera and have the capture
+        // return the undecoded images
+        m_cap->set(cv::CAP_PROP_FOURCC, cv::VideoWriter::fourcc('M', 'J', 'P', 'G'));
+        if(!m_cap->set(cv::CAP_PROP_FORMAT, -1)) {
+            LOG_WARN("Capture of %s does not support raw mode, frames are "
+                     "decoded", m_pipeline.c_str());
+        }
     }
 }
 
@@ -113,6 +143,16 @@ void free_cv_frame(void* obj) {
     delete frame;
 }
 
+/**
+ * Free method of frames read into a block of the frame allocator
+ */
+static void free_pooled_cv_frame(void* obj) {
+    cv::Mat* frame = (cv::Mat*) obj;
+    void* block = frame->data;
+    delete frame;
+    get_frame_allocator()->release(block);
+}
+
 void OpenCvIngestor::run(bool snapshot_mode) {
     // indicate that the run() function corresponding to the m_th thread has started
     m_running.store(true);
@@ -163,24 +203,7 @@ void OpenCvIngestor::run(bool snapshot_mode) {
             DO_PROFILING(this->m_profile, meta_data, "ts_filterQ_entry")
             // Profiling end
 
-            // Set encding type and level
-            try {
-                frame->set_encoding(m_enc_type, m_enc_lvl);
-            } catch(const char *err) {
-                LOG_ERROR("Exception: %s", err);
-            } catch(...) {
-                LOG_ERROR("Exception occurred in set_encoding()");
-            }
-
-            QueueRetCode ret_queue = m_udf_input_queue->push(frame);
-            if(ret_queue == QueueRetCode::QUEUE_FULL) {
-                if(m_udf_input_queue->push_wait(frame) != QueueRetCode::SUCCESS) {
-                    LOG_ERROR_0("Failed to enqueue message, "
-                                "message dropped");
-                }
-                // Add timestamp which acts as a marker if queue if blocked
-                DO_PROFILING(this->m_profile, meta_data, m_ingestor_block_key.c_str());
-            }
+            this->push_frame(frame);
 
             frame = NULL;
 
@@ -218,11 +241,17 @@ void OpenCvIngestor::read(Frame*& frame) {
     cv::Mat* cv_frame = new cv::Mat();
     cv::Mat* frame_copy = NULL;
 
+    // The capture reuses the buffer of a frame of the same geometry
+    void* block = NULL;
+    if(m_allocator != NULL && !m_jpeg_passthrough && m_frame_type >= 0) {
+        block = m_allocator->allocate(
+                (size_t) m_frame_rows * m_frame_cols * CV_ELEM_SIZE(m_frame_type));
+        if(block != NULL)
+            *cv_frame = cv::Mat(m_frame_rows, m_frame_cols, m_frame_type, block);
+    }
+
     if (m_cap == NULL) {
-        m_cap = new cv::VideoCapture(m_pipeline);
-        if(!m_cap->isOpened()) {
-            LOG_ERROR("Failed to open gstreamer pipeline: %s", m_pipeline.c_str());
-        }
+        open_capture();
     }
 
     if(!m_cap->read(*cv_frame)) {
@@ -233,7 +262,7 @@ void OpenCvIngestor::read(Frame*& frame) {
                 LOG_WARN_0("Video ended. Looping...");
                 m_cap->release();
                 delete m_cap;
-                m_cap = new cv::VideoCapture(m_pipeline);
+                open_capture();
             } else {
                 const char* err = "Video ended...";
                 LOG_WARN("%s", err);
@@ -252,9 +281,36 @@ void OpenCvIngestor::read(Frame*& frame) {
 
     LOG_DEBUG_0("Frame read successfully");
 
-    frame = new Frame(
-            (void*) cv_frame, free_cv_frame, (void*) cv_frame->data,
-            cv_frame->cols, cv_frame->rows, cv_frame->channels());
+    if(m_allocator != NULL) {
+        // The capture allocated a new buffer if the geometry changed
+        if(block != NULL && (void*) cv_frame->data != block) {
+            m_allocator->release(block);
+            block = NULL;
+        }
+        m_frame_rows = cv_frame->rows;
+        m_frame_cols = cv_frame->cols;
+        m_frame_type = (cv_frame->empty()) ? -1 : cv_frame->type();
+    }
+
+    // In raw mode the capture returns the JPEG image as a single row
+    if(m_jpeg_passthrough && cv_frame->type() == CV_8UC1 && cv_frame->isContinuous() &&
+       is_jpeg(cv_frame->data, cv_frame->total())) {
+        frame = new CompressedFrame(
+                (void*) cv_frame, free_cv_frame, (void*) cv_frame->data,
+                cv_frame->total());
+        if(!set_compressed_format(frame, PIXEL_FORMAT_JPEG)) {
+            delete frame;
+            frame = NULL;
+            const char* err = "Failed to put pixel_format in meta-data";
+            LOG_ERROR("%s", err);
+            throw err;
+        }
+    } else {
+        frame = new Frame(
+                (void*) cv_frame, (block != NULL) ? free_pooled_cv_frame : free_cv_frame,
+                (void*) cv_frame->data, cv_frame->cols, cv_frame->rows,
+                cv_frame->channels());
+    }
 
     if (m_double_frames) {
         frame_copy = new cv::Mat();
@@ -275,7 +331,7 @@ void OpenCvIngestor::stop() {
         if(!m_stop.load()) {
             m_stop.store(true);
             // wait for the ingestor thread function run() to finish its execution.
-            if(m_th != NULL) {
+            if(m_th != NULL && m_th->joinable()) {
                 m_th->join();
             }
         }
@@ -0,0 +1,607 @@
+// Copyright (c) 2021 Intel Corporation.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM,OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+
+/**
+ * @file
+ * @brief Output router implementation
+ */
+
+#include <string.h>
+#include <algorithm>
+#include <cjson/cJSON.h>
+#include <eii/utils/logger.h>
+#include "eii/vi/output_router.h"
+#include "eii/vi/utils.h"
+
+// Maximum time the router thread waits for a frame before checking whether
+// it has to stop
+#define QUEUE_WAIT_MS 250
+
+using namespace eii::vi;
+using namespace eii::udf;
+using namespace eii::msgbus;
+
+// Metadata keys describing the published frame, set by OutputFrame instead
+// of being taken from the source frame
+static const char* const g_frame_keys[] = {
+    "img_handle", "width", "height", "channels", "encoding_type",
+    "encoding_level", KEYFRAME, COMPRESSION_FILTER_KEY, IMAGE_WIDTH, IMAGE_HEIGHT,
+    COMPRESSED_SIZE, SHM_SOCKET, SHM_SLOT, SHM_SEQ, SHM_OFFSET, SHM_SIZE, NULL
+};
+
+/**
+ * Free callback of published output frames
+ */
+static void free_output_frame(void* obj) {
+    delete (OutputFrame*) obj;
+}
+
+/**
+ * Add an element to a message, destroying the element on failure
+ */
+static bool put_elem(msg_envelope_t* msg, const char* key, msg_envelope_elem_body_t* elem) {
+    if(elem == NULL)
+        return false;
+    if(msgbus_msg_envelope_put(msg, key, elem) != MSG_SUCCESS) {
+        msgbus_msg_envelope_elem_destroy(elem);
+        return false;
+    }
+    return true;
+}
+
+OutputFrame::OutputFrame(std::shared_ptr<FrameVariant> variant, std::shared_ptr<std::string> meta, const std::string& img_handle) :
+    m_variant(variant), m_meta(meta), m_img_handle(img_handle) {}
+
+void OutputFrame::set_shm_slot(const std::string& socket, const ShmSlot& slot) {
+    m_shm_socket = socket;
+    m_shm_slot = slot;
+}
+
+msg_envelope_t* OutputFrame::serialize() {
+    msg_envelope_t* msg = msgbus_msg_envelope_new(CT_JSON);
+    if(msg == NULL) {
+        LOG_ERROR_0("Failed to initialize output message");
+        return NULL;
+    }
+    if(!m_shm_socket.empty()) {
+        msg = serialize_meta(msg);
+        delete this;
+        return msg;
+    }
+
+    // The message takes ownership of this object, which keeps the variant
+    // data alive until the message has been sent
+    msg_envelope_elem_body_t* blob = msgbus_msg_envelope_new_blob(
+            (char*) m_variant->data, m_variant->len);
+    if(blob == NULL) {
+        LOG_ERROR_0("Failed to initialize output frame blob");
+        msgbus_msg_envelope_destroy(msg);
+        return NULL;
+    }
+    blob->body.blob->shared->ptr = (void*) this;
+    blob->body.blob->shared->free = free_output_frame;
+    if(msgbus_msg_envelope_put(msg, NULL, blob) != MSG_SUCCESS) {
+        LOG_ERROR_0("Failed to put output frame blob");
+        msgbus_msg_envelope_elem_destroy(blob);
+        msgbus_msg_envelope_destroy(msg);
+        return NULL;
+    }
+    return serialize_meta(msg);
+}
+
+msg_envelope_t* OutputFrame::serialize_meta(msg_envelope_t* msg) {
+    cJSON* root = cJSON_Parse(m_meta->c_str());
+    if(root == NULL) {
+        LOG_ERROR_0("Failed to parse frame meta-data");
+        msgbus_msg_envelope_destroy(msg);
+        return NULL;
+    }
+    merge_json_meta(msg, root, g_frame_keys);
+    cJSON_Delete(root);
+
+    const FrameVariant* variant = m_variant.get();
+    bool ret = put_elem(msg, "img_handle", msgbus_msg_envelope_new_string(m_img_handle.c_str())) &&
+               put_elem(msg, "width", msgbus_msg_envelope_new_integer(variant->width)) &&
+               put_elem(msg, "height", msgbus_msg_envelope_new_integer(variant->height)) &&
+               put_elem(msg, "channels", msgbus_msg_envelope_new_integer(variant->channels));
+    if(ret && VideoEncoder::is_video_codec(variant->codec.c_str())) {
+        ret = put_elem(msg, "encoding_type", msgbus_msg_envelope_new_string(variant->codec.c_str())) &&
+              put_elem(msg, KEYFRAME, msgbus_msg_envelope_new_bool(variant->keyframe));
+    } else if(ret && !variant->codec.empty()) {
+        ret = put_elem(msg, "encoding_type", msgbus_msg_envelope_new_string(variant->codec.c_str())) &&
+              put_elem(msg, "encoding_level", msgbus_msg_envelope_new_integer(variant->codec_level));
+        if(ret && variant->filter != NULL)
+            ret = put_elem(msg, COMPRESSION_FILTER_KEY, msgbus_msg_envelope_new_string(variant->filter));
+    } else if(ret && variant->source_codec != NULL) {
+        // Published with the size of the image rather than of the data
+        ret = put_elem(msg, "encoding_type", msgbus_msg_envelope_new_string(variant->source_codec)) &&
+              put_compressed_size(msg, variant->image_width, variant->image_height, variant->len);
+        if(ret && VideoEncoder::is_video_codec(variant->source_codec))
+            ret = put_elem(msg, KEYFRAME, msgbus_msg_envelope_new_bool(variant->keyframe));
+    } else if(ret && variant->enc_type != EncodeType::NONE) {
+        const char* type = (variant->enc_type == EncodeType::JPEG) ? "jpeg" : "png";
+        ret = put_elem(msg, "encoding_type", msgbus_msg_envelope_new_string(type)) &&
+              put_elem(msg, "encoding_level", msgbus_msg_envelope_new_integer(variant->enc_lvl));
+    }
+    if(ret && !m_shm_socket.empty()) {
+        ret = put_elem(msg, SHM_SOCKET, msgbus_msg_envelope_new_string(m_shm_socket.c_str())) &&
+              put_elem(msg, SHM_SLOT, msgbus_msg_envelope_new_integer(m_shm_slot.index)) &&
+              put_elem(msg, SHM_SEQ, msgbus_msg_envelope_new_integer((int64_t) m_shm_slot.seq)) &&
+              put_elem(msg, SHM_OFFSET, msgbus_msg_envelope_new_integer((int64_t) m_shm_slot.offset)) &&
+              put_elem(msg, SHM_SIZE, msgbus_msg_envelope_new_integer((int64_t) m_shm_slot.size));
+    }
+    if(!ret) {
+        LOG_ERROR_0("Failed to put output frame meta-data");
+        // Also releases this object if it is published inline
+        msgbus_msg_envelope_destroy(msg);
+        return NULL;
+    }
+    return msg;
+}
+
+/**
+ * Parse the optional "encoding" object of an output config
+ */
+static void parse_output_encoding(const config_value_t* config, const std::string& name,
+                                  EncodeType& enc_type, int& enc_lvl, VideoEncoder*& encoder,
+                                  FrameCompressor*& compressor) {
+    enc_type = EncodeType::NONE;
+    enc_lvl = 0;
+    encoder = NULL;
+    compressor = NULL;
+    config_value_t* encoding = config_value_object_get(config, "encoding");
+    if(encoding == NULL)
+        return;
+    config_value_t* type = config_value_object_get(encoding, "type");
+    config_value_t* level = config_value_object_get(encoding, "level");
+    const char* err = NULL;
+    if(type == NULL || type->type != CVT_STRING) {
+        err = "Output encoding \"type\" has to be a string";
+    } else if(VideoEncoder::is_video_codec(type->body.string)) {
+        // Video encoders have no level, they are configured by bitrate
+        try {
+            encoder = new VideoEncoder(encoding, name);
+        } catch(const char* e) {
+            err = e;
+        }
+    } else if(FrameCompressor::is_compression(type->body.string)) {
+        try {
+            compressor = new FrameCompressor(encoding);
+        } catch(const char* e) {
+            err = e;
+        }
+    } else if(level == NULL || level->type != CVT_INTEGER) {
+        err = "Output encoding \"level\" has to be an integer";
+    } else if(!strcmp(type->body.string, "jpeg")) {
+        enc_type = EncodeType::JPEG;
+        if(level->body.integer < 0 || level->body.integer > 100)
+            err = "Output jpeg encoding level has to be between 0 and 100";
+    } else if(!strcmp(type->body.string, "png")) {
+        enc_type = EncodeType::PNG;
+        if(level->body.integer < 0 || level->body.integer > 9)
+            err = "Output png encoding level has to be between 0 and 9";
+    } else {
+        err = "Output encoding type is not supported";
+    }
+    if(err == NULL && encoder == NULL && compressor == NULL)
+        enc_lvl = (int) level->body.integer;
+    if(type != NULL)
+        config_value_destroy(type);
+    if(level != NULL)
+        config_value_destroy(level);
+    config_value_destroy(encoding);
+    if(err != NULL) {
+        LOG_ERROR("%s", err);
+        throw(err);
+    }
+}
+
+OutputRouter::OutputRouter(const config_value_t* outputs, FrameQueue* input_queue, size_t queue_size, PublisherFactory create_publisher) :
+    m_input_queue(input_queue), m_th(NULL), m_stop(false) {
+    if(outputs->type != CVT_ARRAY || config_value_array_len(outputs) == 0) {
+        const char* err = "\"outputs\" has to be a non-empty array";
+        LOG_ERROR("%s", err);
+        throw(err);
+    }
+    try {
+        size_t len = config_value_array_len(outputs);
+        for(size_t i = 0; i < len; ++i) {
+            config_value_t* cvt_output = config_value_array_get(outputs, i);
+            if(cvt_output == NULL || cvt_output->type != CVT_OBJECT) {
+                if(cvt_output != NULL)
+                    config_value_destroy(cvt_output);
+                const char* err = "\"outputs\" values have to be objects";
+                LOG_ERROR("%s", err);
+                throw(err);
+            }
+            Output output;
+            output.interval = std::chrono::steady_clock::duration::zero();
+            output.queue = NULL;
+            output.publisher = NULL;
+            output.shm = NULL;
+            output.encoder = NULL;
+            output.compressor = NULL;
+            output.conversion_warned = false;
+            try {
+                config_value_t* cvt_publisher = config_value_object_get(cvt_output, "publisher");
+                if(cvt_publisher == NULL || cvt_publisher->type != CVT_STRING) {
+                    if(cvt_publisher != NULL)
+                        config_value_destroy(cvt_publisher);
+                    const char* err = "Output \"publisher\" has to be a string";
+                    LOG_ERROR("%s", err);
+                    throw(err);
+                }
+                output.publisher_name = cvt_publisher->body.string;
+                config_value_destroy(cvt_publisher);
+
+                config_value_t* cvt_max_fps = config_value_object_get(cvt_output, "max_fps");
+                if(cvt_max_fps != NULL) {
+                    double max_fps = (cvt_max_fps->type == CVT_INTEGER) ?
+                        (double) cvt_max_fps->body.integer :
+                        (cvt_max_fps->type == CVT_FLOATING) ? cvt_max_fps->body.floating : -1.0;
+                    config_value_destroy(cvt_max_fps);
+                    if(max_fps <= 0.0) {
+                        const char* err = "Output \"max_fps\" has to be a positive number";
+                        LOG_ERROR("%s", err);
+                        throw(err);
+                    }
+                    output.interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                            std::chrono::duration<double>(1.0 / max_fps));
+                }
+                output.max_width = (int) get_config_int(cvt_output, "width", 0, 0);
+                output.max_height = (int) get_config_int(cvt_output, "height", 0, 0);
+                parse_output_encoding(cvt_output, output.publisher_name, output.enc_type,
+                                      output.enc_lvl, output.encoder, output.compressor);
+
+                config_value_t* cvt_shm = config_value_object_get(cvt_output, SHARED_MEMORY);
+                if(cvt_shm != NULL) {
+                    try {
+                        output.shm = new ShmRing(cvt_shm, output.publisher_name);
+                    } catch(const char*) {
+                        config_value_destroy(cvt_shm);
+                        delete output.encoder;
+                        delete output.compressor;
+                        throw;
+                    }
+                    config_value_destroy(cvt_shm);
+                }
+            } catch(const char*) {
+                config_value_destroy(cvt_output);
+                throw;
+            }
+            config_value_destroy(cvt_output);
+
+            output.queue = new MessageQueue(queue_size);
+            m_outputs.push_back(output);
+            m_outputs.back().publisher = create_publisher(output.publisher_name, output.queue);
+            LOG_INFO("Output on %s, max fps: %s, max size: %dx%d, encoding type: %d, level: %d%s",
+                     output.publisher_name.c_str(),
+                     (output.interval.count() > 0) ? "limited" : "unlimited",
+                     output.max_width, output.max_height, output.enc_type, output.enc_lvl,
+                     (output.shm != NULL) ? ", shared memory" : "");
+        }
+    } catch(...) {
+        for(Output& output : m_outputs) {
+            delete output.publisher;
+            delete output.queue;
+            delete output.shm;
+            delete output.encoder;
+            delete output.compressor;
+        }
+        throw;
+    }
+}
+
+OutputRouter::~OutputRouter() {
+    stop();
+    for(Output& output : m_outputs) {
+        delete output.publisher;
+        while(!output.queue->empty()) {
+            Serializable* msg = output.queue->front();
+            output.queue->pop();
+            delete msg;
+        }
+        delete output.queue;
+        delete output.shm;
+        delete output.encoder;
+        delete output.compressor;
+    }
+}
+
+void OutputRouter::start() {
+    if(m_th != NULL)
+        return;
+    for(Output& output : m_outputs)
+        output.publisher->start();
+    m_stop.store(false);
+    m_th = new std::thread(&OutputRouter::run, this);
+}
+
+void OutputRouter::stop() {
+    if(m_th == NULL)
+        return;
+    m_stop.store(true);
+    m_th->join();
+    delete m_th;
+    m_th = NULL;
+    for(Output& output : m_outputs)
+        output.publisher->stop();
+}
+
+void OutputRouter::set_queue(FrameQueue* input_queue) {
+    m_input_queue = input_queue;
+}
+
+bool OutputRouter::force_keyframe() {
+    bool forced = false;
+    for(Output& output : m_outputs) {
+        if(output.encoder != NULL) {
+            output.encoder->force_keyframe();
+            forced = true;
+        }
+    }
+    return forced;
+}
+
+void OutputRouter::run() {
+    LOG_INFO_0("Output router thread started");
+    while(!m_stop.load()) {
+        if(!m_input_queue->wait_for(std::chrono::milliseconds(QUEUE_WAIT_MS)))
+            continue;
+        Frame* frame = m_input_queue->front();
+        m_input_queue->pop();
+        route(frame);
+    }
+    LOG_INFO_0("Output router thread stopped");
+}
+
+/**
+ * Check whether a frame can be downscaled and encoded, i.e. it is a BGR or
+ * grayscale image
+ */
+static bool is_convertible(Frame* frame) {
+    int channels = frame->get_channels(0);
+    if(channels != 1 && channels != 3)
+        return false;
+    const char* format = get_pixel_format(frame);
+    return format == NULL || !strcmp(format, "BGR") || !strcmp(format, "GRAY8");
+}
+
+/**
+ * Check whether two compression filter names, NULL if unfiltered, are the same
+ */
+static bool is_same_filter(const char* a, const char* b) {
+    return (a == NULL || b == NULL) ? a == b : !strcmp(a, b);
+}
+
+void OutputRouter::route(Frame* frame) {
+    // The frame is released once no output refers to its data anymore
+    std::shared_ptr<Frame> source(frame);
+    auto now = std::chrono::steady_clock::now();
+    int src_width = frame->get_width(0);
+    int src_height = frame->get_height(0);
+
+    std::shared_ptr<std::string> meta;
+    std::vector<std::shared_ptr<FrameVariant>> variants;
+    for(Output& output : m_outputs) {
+        if(output.interval.count() > 0) {
+            if(now < output.next)
+                continue;
+            // Keep the cadence unless the output fell behind
+            output.next = (now - output.next < output.interval) ?
+                output.next + output.interval : now + output.interval;
+        }
+
+        if(meta == NULL) {
+            msg_envelope_serialized_part_t* parts = NULL;
+            int num_parts = msgbus_msg_envelope_serialize(frame->get_meta_data(), &parts);
+            if(num_parts <= 0) {
+                LOG_ERROR_0("Failed to serialize frame meta-data, frame dropped");
+                return;
+            }
+            meta = std::make_shared<std::string>(parts[0].bytes, parts[0].len);
+            msgbus_msg_envelope_serialize_destroy(parts, num_parts);
+        }
+
+        // Downscale to fit the maximum resolution, keeping the aspect ratio
+        int width = src_width;
+        int height = src_height;
+        double scale = 1.0;
+        if(output.max_width > 0 && width > output.max_width)
+            scale = (double) output.max_width / width;
+        if(output.max_height > 0 && height > output.max_height)
+            scale = std::min(scale, (double) output.max_height / height);
+        if(scale < 1.0) {
+            width = std::max(1, (int) (width * scale + 0.5));
+            height = std::max(1, (int) (height * scale + 0.5));
+        }
+        EncodeType enc_type = output.enc_type;
+        int enc_lvl = output.enc_lvl;
+        bool video_encode = (output.encoder != NULL);
+        if((scale < 1.0 || enc_type != EncodeType::NONE || video_encode) && !is_convertible(frame)) {
+            if(!output.conversion_warned) {
+                LOG_WARN("Frames cannot be downscaled or encoded for %s, "
+                         "they are published as ingested",
+                         output.publisher_name.c_str());
+                output.conversion_warned = true;
+            }
+            width = src_width;
+            height = src_height;
+            enc_type = EncodeType::NONE;
+            enc_lvl = 0;
+            video_encode = false;
+        }
+
+        std::shared_ptr<FrameVariant> variant;
+        for(const std::shared_ptr<FrameVariant>& v : variants) {
+            if(v->width == width && v->height == height && v->codec.empty() &&
+               v->enc_type == enc_type && v->enc_lvl == enc_lvl) {
+                variant = v;
+                break;
+            }
+        }
+        if(variant == NULL) {
+            variant = create_variant(source, width, height, enc_type, enc_lvl);
+            if(variant == NULL)
+                continue;
+            variants.push_back(variant);
+        }
+        if(video_encode) {
+            variant = encode_variant(output, variant);
+            if(variant == NULL)
+                continue;
+        } else if(output.compressor != NULL && variant->source_codec == NULL) {
+            // Compressed variants are shared like the other variants
+            const FrameCompressor& compressor = *output.compressor;
+            std::shared_ptr<FrameVariant> compressed;
+            for(const std::shared_ptr<FrameVariant>& v : variants) {
+                if(v->width == width && v->height == height && v->codec == compressor.get_type() &&
+                   v->codec_level == compressor.get_level() &&
+                   is_same_filter(v->filter, compressor.get_filter_name())) {
+                    compressed = v;
+                    break;
+                }
+            }
+            if(compressed == NULL) {
+                compressed = compress_variant(compressor, variant, get_pixel_format(frame));
+                if(compressed == NULL)
+                    continue;
+                variants.push_back(compressed);
+            }
+            variant = compressed;
+        }
+
+        OutputFrame* msg = new OutputFrame(variant, meta, frame->get_img_handle(0));
+        ShmSlot slot;
+        if(output.shm != NULL && output.shm->write(variant->data, variant->len, slot))
+            msg->set_shm_slot(output.shm->get_socket_path(), slot);
+        QueueRetCode ret = output.queue->push(msg);
+        if(ret == QueueRetCode::QUEUE_FULL &&
+           output.queue->push_wait(msg) != QueueRetCode::SUCCESS) {
+            LOG_ERROR("Failed to enqueue frame for %s, frame dropped",
+                      output.publisher_name.c_str());
+            delete msg;
+        }
+    }
+}
+
+std::shared_ptr<FrameVariant> OutputRouter::encode_variant(Output& output, const std::shared_ptr<FrameVariant>& raw) {
+    std::shared_ptr<FrameVariant> variant = std::make_shared<FrameVariant>();
+    // The encoder crops odd dimensions
+    variant->width = raw->width & ~1;
+    variant->height = raw->height & ~1;
+    variant->channels = raw->channels;
+    variant->enc_type = EncodeType::NONE;
+    variant->enc_lvl = 0;
+    variant->codec = output.encoder->get_codec();
+    variant->codec_level = 0;
+    variant->filter = NULL;
+    variant->keyframe = false;
+    variant->source_codec = NULL;
+    if(!output.encoder->encode(raw->data, raw->width, raw->height, raw->channels, raw,
+                               variant->encoded, variant->keyframe)) {
+        LOG_ERROR("Failed to %s encode frame for %s, frame dropped",
+                  variant->codec.c_str(), output.publisher_name.c_str());
+        return NULL;
+    }
+    variant->data = variant->encoded.data();
+    variant->len = variant->encoded.size();
+    return variant;
+}
+
+std::shared_ptr<FrameVariant> OutputRouter::compress_variant(const FrameCompressor& compressor, const std::shared_ptr<FrameVariant>& raw, const char* pixel_format) {
+    std::shared_ptr<FrameVariant> variant = std::make_shared<FrameVariant>();
+    variant->width = raw->width;
+    variant->height = raw->height;
+    variant->channels = raw->channels;
+    variant->enc_type = EncodeType::NONE;
+    variant->enc_lvl = 0;
+    variant->codec = compressor.get_type();
+    variant->codec_level = compressor.get_level();
+    variant->filter = compressor.get_filter_name();
+    variant->keyframe = false;
+    variant->source_codec = NULL;
+    if(!compressor.compress(raw->data, raw->width, raw->height, raw->channels, pixel_format,
+                            variant->encoded)) {
+        LOG_ERROR("Failed to %s compress frame, frame dropped", variant->codec.c_str());
+        return NULL;
+    }
+    variant->data = variant->encoded.data();
+    variant->len = variant->encoded.size();
+    return variant;
+}
+
+std::shared_ptr<FrameVariant> OutputRouter::create_variant(const std::shared_ptr<Frame>& source, int width, int height, EncodeType enc_type, int enc_lvl) {
+    Frame* frame = source.get();
+    std::shared_ptr<FrameVariant> variant = std::make_shared<FrameVariant>();
+    variant->width = width;
+    variant->height = height;
+    variant->channels = frame->get_channels(0);
+    variant->enc_type = enc_type;
+    variant->enc_lvl = enc_lvl;
+    variant->source_codec = NULL;
+
+    // Published as ingested, the data of the source frame is shared
+    if(width == frame->get_width(0) && height == frame->get_height(0) &&
+       enc_type == EncodeType::NONE) {
+        variant->source = source;
+        variant->source_codec = get_compressed_codec(frame);
+        variant->image_width = 0;
+        variant->image_height = 0;
+        if(variant->source_codec != NULL)
+            get_image_size(frame, variant->image_width, variant->image_height);
+        variant->keyframe = (variant->source_codec != NULL) && is_keyframe(frame);
+        variant->data = frame->get_data(0);
+        variant->len = (size_t) width * height * variant->channels;
+        return variant;
+    }
+
+    cv::Mat mat(frame->get_height(0), frame->get_width(0),
+                CV_MAKETYPE(CV_8U, variant->channels), frame->get_data(0));
+    if(width != mat.cols || height != mat.rows) {
+        cv::resize(mat, variant->pixels, cv::Size(width, height), 0, 0, cv::INTER_AREA);
+        mat = variant->pixels;
+    }
+    if(enc_type == EncodeType::NONE) {
+        variant->data = variant->pixels.data;
+        variant->len = variant->pixels.total() * variant->pixels.elemSize();
+        return variant;
+    }
+
+    std::vector<int> params;
+    const char* ext = NULL;
+    if(enc_type == EncodeType::JPEG) {
+        ext = ".jpeg";
+        params.push_back(cv::IMWRITE_JPEG_QUALITY);
+    } else {
+        ext = ".png";
+        params.push_back(cv::IMWRITE_PNG_COMPRESSION);
+    }
+    params.push_back(enc_lvl);
+    if(!cv::imencode(ext, mat, variant->encoded, params)) {
+        LOG_ERROR("Failed to encode frame with type: %d, level: %d", enc_type, enc_lvl);
+        return NULL;
+    }
+    variant->pixels.release();
+    variant->data = variant->encoded.data();
+    variant->len = variant->encoded.size();
+    return variant;
+}
@@ -165,6 +165,42 @@ void free_rs2_frame(void* obj) {
 
 }
 
+/**
+ * Helper to put a single intrinsics value into the frame meta-data
+ */
+static void put_rs2_meta(msg_envelope_t* meta, const std::string& key,
+                         msg_envelope_elem_body_t* elem) {
+    if(elem == NULL) {
+        LOG_ERROR("Failed to initialize %s meta-data", key.c_str());
+        throw "Failed to initialize intrinsics meta-data";
+    }
+    msgbus_ret_t ret = msgbus_msg_envelope_put(meta, key.c_str(), elem);
+    if(ret != MSG_SUCCESS) {
+        msgbus_msg_envelope_elem_destroy(elem);
+        LOG_ERROR("Failed to put %s in meta-data", key.c_str());
+        throw "Failed to put intrinsics in meta-data";
+    }
+}
+
+void eii::vi::add_rs2_intrinsics_meta(msg_envelope_t* meta, const char* prefix,
+                                      const rs2_intrinsics& intrinsics) {
+    std::string key(prefix);
+    put_rs2_meta(meta, key + "_width",
+                 msgbus_msg_envelope_new_integer(intrinsics.width));
+    put_rs2_meta(meta, key + "_height",
+                 msgbus_msg_envelope_new_integer(intrinsics.height));
+    put_rs2_meta(meta, key + "_ppx",
+                 msgbus_msg_envelope_new_floating(intrinsics.ppx));
+    put_rs2_meta(meta, key + "_ppy",
+                 msgbus_msg_envelope_new_floating(intrinsics.ppy));
+    put_rs2_meta(meta, key + "_fx",
+                 msgbus_msg_envelope_new_floating(intrinsics.fx));
+    put_rs2_meta(meta, key + "_fy",
+                 msgbus_msg_envelope_new_floating(intrinsics.fy));
+    put_rs2_meta(meta, key + "_model",
+                 msgbus_msg_envelope_new_integer((int)intrinsics.model));
+}
+
 void RealSenseIngestor::run(bool snapshot_mode) {
     // indicate that the run() function corresponding to the m_th thread has started
     m_running.store(true);
@@ -215,24 +251,7 @@ void RealSenseIngestor::run(bool snapshot_mode) {
             DO_PROFILING(this->m_profile, meta_data, "ts_filterQ_entry")
             // Profiling end
 
-            // Set encding type and level
-            try {
-                frame->set_encoding(m_enc_type, m_enc_lvl);
-            } catch(const char *err) {
-                LOG_ERROR("Exception: %s", err);
-            } catch(...) {
-                LOG_ERROR("Exception occurred in set_encoding()");
-            }
-
-            QueueRetCode ret_queue = m_udf_input_queue->push(frame);
-            if(ret_queue == QueueRetCode::QUEUE_FULL) {
-                if(m_udf_input_queue->push_wait(frame) != QueueRetCode::SUCCESS) {
-                    LOG_ERROR_0("Failed to enqueue message, "
-                                "message dropped");
-                }
-                // Add timestamp which acts as a marker if queue if blocked
-                DO_PROFILING(this->m_profile, meta_data, m_ingestor_block_key.c_str());
-            }
+            this->push_frame(frame);
 
             frame = NULL;
 
@@ -315,247 +334,22 @@ void RealSenseIngestor::read(Frame*& frame) {
 
     msg_envelope_t* rs2_meta = frame->get_meta_data();
 
-    msg_envelope_elem_body_t* e_di_width = msgbus_msg_envelope_new_integer(depth_intrinsics.width);
-    if(e_di_width == NULL) {
-        delete frame;
-        const char* err =  "Failed to initialize depth instrinsics width meta-data";
-        LOG_ERROR("%s", err);
-        throw err;
-    }
-
-    ret = msgbus_msg_envelope_put(rs2_meta, "rs2_depth_intrinsics_width", e_di_width);
-    if(ret != MSG_SUCCESS) {
-        delete frame;
-        msgbus_msg_envelope_elem_destroy(e_di_width);
-        const char* err = "Failed to put depth intrinsics width in meta-data";
-        LOG_ERROR("%s", err);
-        throw err;
-    }
-
-    msg_envelope_elem_body_t* e_di_height = msgbus_msg_envelope_new_integer(depth_intrinsics.height);
-    if(e_di_height == NULL) {
-        delete frame;
-        const char* err =  "Failed to initialize depth instrinsics height meta-data";
-        LOG_ERROR("%s", err);
-        throw err;
-    }
-
-    ret = msgbus_msg_envelope_put(rs2_meta, "rs2_depth_intrinsics_height", e_di_height);
-    if(ret != MSG_SUCCESS) {
-        delete frame;
-        msgbus_msg_envelope_elem_destroy(e_di_height);
-        const char* err = "Failed to put depth intrinsics height in meta-data";
-        LOG_ERROR("%s", err);
-        throw err;
-    }
-
-    msg_envelope_elem_body_t* e_di_ppx = msgbus_msg_envelope_new_floating(depth_intrinsics.ppx);
-    if(e_di_ppx == NULL) {
-        delete frame;
-        const char* err =  "Failed to initialize depth instrinsics x-principal-point meta-data";
-        LOG_ERROR("%s", err);
-        throw err;
-    }
-
-    ret = msgbus_msg_envelope_put(rs2_meta, "rs2_depth_intrinsics_ppx", e_di_ppx);
-    if(ret != MSG_SUCCESS) {
-        delete frame;
-        msgbus_msg_envelope_elem_destroy(e_di_ppx);
-        const char* err = "Failed to put depth intrinsics x-principal-point in meta-data";
-        LOG_ERROR("%s", err);
-        throw err;
-    }
-
-    msg_envelope_elem_body_t* e_di_ppy = msgbus_msg_envelope_new_floating(depth_intrinsics.ppy);
-    if(e_di_ppy == NULL) {
-        delete frame;
-        const char* err =  "Failed to initialize depth instrinsics y-principal-point meta-data";
-        LOG_ERROR("%s", err);
-        throw err;
-    }
-
-    ret = msgbus_msg_envelope_put(rs2_meta, "rs2_depth_intrinsics_ppy", e_di_ppy);
-    if(ret != MSG_SUCCESS) {
-        delete frame;
-        msgbus_msg_envelope_elem_destroy(e_di_ppy);
-        const char* err = "Failed to put depth intrinsics y-principal-point in meta-data";
-        LOG_ERROR("%s", err);
-        throw err;
-    }
-
-    msg_envelope_elem_body_t* e_di_fx = msgbus_msg_envelope_new_floating(depth_intrinsics.fx);
-    if(e_di_fx == NULL) {
-        delete frame;
-        const char* err =  "Failed to initialize depth instrinsics x-focal-point meta-data";
-        LOG_ERROR("%s", err);
-        throw err;
-    }
-
-    ret = msgbus_msg_envelope_put(rs2_meta, "rs2_depth_intrinsics_fx", e_di_fx);
-    if(ret != MSG_SUCCESS) {
-        delete frame;
-        msgbus_msg_envelope_elem_destroy(e_di_fx);
-        const char* err = "Failed to put depth intrinsics x-focal-point in meta-data";
-        LOG_ERROR("%s", err);
-        throw err;
-    }
-
-    msg_envelope_elem_body_t* e_di_fy = msgbus_msg_envelope_new_floating(depth_intrinsics.fy);
-    if(e_di_fy == NULL) {
-        delete frame;
-        const char* err =  "Failed to initialize depth instrinsics y-focal-point meta-data";
-        LOG_ERROR("%s", err);
-        throw err;
-    }
-
-    ret = msgbus_msg_envelope_put(rs2_meta, "rs2_depth_intrinsics_fy", e_di_fy);
-    if(ret != MSG_SUCCESS) {
-        delete frame;
-        msgbus_msg_envelope_elem_destroy(e_di_fy);
-        const char* err = "Failed to put depth intrinsics y-focal-point in meta-data";
-        LOG_ERROR("%s", err);
-        throw err;
-    }
-
-
-    msg_envelope_elem_body_t* e_di_model = msgbus_msg_envelope_new_integer((int)depth_intrinsics.model);
-    if(e_di_model == NULL) {
-        delete frame;
-        const char* err =  "Failed to initialize depth instrinsics model meta-data";
-        LOG_ERROR("%s", err);
-        throw err;
-    }
-
-    ret = msgbus_msg_envelope_put(rs2_meta, "rs2_depth_intrinsics_model", e_di_model);
-    if(ret != MSG_SUCCESS) {
+    try {
+        add_rs2_intrinsics_meta(rs2_meta, "rs2_depth_intrinsics", depth_intrinsics);
+    } catch(const char* err) {
         delete frame;
-        msgbus_msg_envelope_elem_destroy(e_di_model);
-        const char* err = "Failed to put depth intrinsics model in meta-data";
-        LOG_ERROR("%s", err);
-        throw err;
+        throw;
     }
 
     auto color_profile = color.get_profile().as<rs2::video_stream_profile>();
 
     auto color_intrinsics = color_profile.get_intrinsics();
 
-    msg_envelope_elem_body_t* e_ci_width = msgbus_msg_envelope_new_integer(color_intrinsics.width);
-    if(e_ci_width == NULL) {
-        delete frame;
-        const char* err =  "Failed to initialize color instrinsics width meta-data";
-        LOG_ERROR("%s", err);
-        throw err;
-    }
-
-    ret = msgbus_msg_envelope_put(rs2_meta, "rs2_color_intrinsics_width", e_ci_width);
-    if(ret != MSG_SUCCESS) {
-        delete frame;
-        msgbus_msg_envelope_elem_destroy(e_ci_width);
-        const char* err = "Failed to put color intrinsics width in meta-data";
-        LOG_ERROR("%s", err);
-        throw err;
-    }
-
-    msg_envelope_elem_body_t* e_ci_height = msgbus_msg_envelope_new_integer(color_intrinsics.height);
-    if(e_ci_height == NULL) {
-        delete frame;
-        const char* err =  "Failed to initialize color instrinsics height meta-data";
-        LOG_ERROR("%s", err);
-        throw err;
-    }
-
-    ret = msgbus_msg_envelope_put(rs2_meta, "rs2_color_intrinsics_height", e_ci_height);
-    if(ret != MSG_SUCCESS) {
-        delete frame;
-        msgbus_msg_envelope_elem_destroy(e_ci_height);
-        const char* err = "Failed to put color intrinsics height in meta-data";
-        LOG_ERROR("%s", err);
-        throw err;
-    }
-
-    msg_envelope_elem_body_t* e_ci_ppx = msgbus_msg_envelope_new_floating(color_intrinsics.ppx);
-    if(e_ci_ppx == NULL) {
-        delete frame;
-        const char* err =  "Failed to initialize color instrinsics x-principal-point meta-data";
-        LOG_ERROR("%s", err);
-        throw err;
-    }
-
-    ret = msgbus_msg_envelope_put(rs2_meta, "rs2_color_intrinsics_ppx", e_ci_ppx);
-    if(ret != MSG_SUCCESS) {
-        delete frame;
-        msgbus_msg_envelope_elem_destroy(e_ci_ppx);
-        const char* err = "Failed to put color intrinsics x-principal-point in meta-data";
-        LOG_ERROR("%s", err);
-        throw err;
-    }
-
-    msg_envelope_elem_body_t* e_ci_ppy = msgbus_msg_envelope_new_floating(color_intrinsics.ppy);
-    if(e_ci_ppy == NULL) {
-        delete frame;
-        const char* err =  "Failed to initialize color instrinsics y-principal-point meta-data";
-        LOG_ERROR("%s", err);
-        throw err;
-    }
-
-    ret = msgbus_msg_envelope_put(rs2_meta, "rs2_color_intrinsics_ppy", e_ci_ppy);
-    if(ret != MSG_SUCCESS) {
-        delete frame;
-        msgbus_msg_envelope_elem_destroy(e_ci_ppy);
-        const char* err = "Failed to put color intrinsics y-principal-point in meta-data";
-        LOG_ERROR("%s", err);
-        throw err;
-    }
-
-    msg_envelope_elem_body_t* e_ci_fx = msgbus_msg_envelope_new_floating(color_intrinsics.fx);
-    if(e_ci_fx == NULL) {
-        delete frame;
-        const char* err =  "Failed to initialize color instrinsics x-focal-point meta-data";
-        LOG_ERROR("%s", err);
-        throw err;
-    }
-
-    ret = msgbus_msg_envelope_put(rs2_meta, "rs2_color_intrinsics_fx", e_ci_fx);
-    if(ret != MSG_SUCCESS) {
-        delete frame;
-        msgbus_msg_envelope_elem_destroy(e_ci_fx);
-        const char* err = "Failed to put color intrinsics x-focal-point in meta-data";
-        LOG_ERROR("%s", err);
-        throw err;
-    }
-
-    msg_envelope_elem_body_t* e_ci_fy = msgbus_msg_envelope_new_floating(color_intrinsics.fy);
-    if(e_ci_fy == NULL) {
-        delete frame;
-        const char* err =  "Failed to initialize color instrinsics y-focal-point meta-data";
-        LOG_ERROR("%s", err);
-        throw err;
-    }
-
-    ret = msgbus_msg_envelope_put(rs2_meta, "rs2_color_intrinsics_fy", e_ci_fy);
-    if(ret != MSG_SUCCESS) {
-        delete frame;
-        msgbus_msg_envelope_elem_destroy(e_ci_fy);
-        const char* err = "Failed to put color intrinsics y-focal-point in meta-data";
-        LOG_ERROR("%s", err);
-        throw err;
-    }
-
-    msg_envelope_elem_body_t* e_ci_model = msgbus_msg_envelope_new_integer((int)color_intrinsics.model);
-    if(e_ci_model == NULL) {
-        delete frame;
-        const char* err =  "Failed to initialize color instrinsics model meta-data";
-        LOG_ERROR("%s", err);
-        throw err;
-    }
-
-    ret = msgbus_msg_envelope_put(rs2_meta, "rs2_color_intrinsics_model", e_ci_model);
-    if(ret != MSG_SUCCESS) {
+    try {
+        add_rs2_intrinsics_meta(rs2_meta, "rs2_color_intrinsics", color_intrinsics);
+    } catch(const char* err) {
         delete frame;
-        msgbus_msg_envelope_elem_destroy(e_ci_model);
-        const char* err = "Failed to put color intrinsics model in meta-data";
-        LOG_ERROR("%s", err);
-        throw err;
+        throw;
     }
 
     auto depth_to_color_extrinsics = depth_profile.get_extrinsics_to(color_profile);
@@ -936,7 +730,7 @@ void RealSenseIngestor::stop() {
         if(!m_stop.load()) {
             m_stop.store(true);
             // wait for the ingestor thread run() to finish its execution.
-            if(m_th != NULL) {
+            if(m_th != NULL && m_th->joinable()) {
                 m_th->join();
             }
         }
@@ -0,0 +1,422 @@
+// Copyright (c) 2021 Intel Corporation.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM,OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+/**
+ * @file
+ * @brief Replay Ingestor implementation
+ */
+
+#include <string>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <cjson/cJSON.h>
+#include <eii/msgbus/msgbus.h>
+#include <eii/utils/logger.h>
+#include "eii/vi/replay_ingestor.h"
+#include "eii/vi/utils.h"
+
+using namespace eii::vi;
+using namespace eii::utils;
+using namespace eii::udf;
+
+#define LOOP_VIDEO "loop_video"
+#define REALTIME "realtime"
+
+// Longest single sleep while pacing, so that stop() is not held up
+#define PACE_SLEEP_MAX std::chrono::milliseconds(100)
+
+// Meta-data keys which are regenerated for every replayed frame and hence
+// are not restored from the recording
+static const char* const g_regenerated_keys[] = {
+    "frame_number", "img_handle", "width", "height", "channels",
+    "encoding_type", "encoding_level", NULL
+};
+
+ReplaySegment::~ReplaySegment() {
+    if(addr != NULL)
+        munmap(addr, size);
+}
+
+/**
+ * Free callback of replayed frames, releases the frame's reference on its
+ * segment mapping
+ */
+static void free_replay_frame(void* obj) {
+    delete (std::shared_ptr<ReplaySegment>*) obj;
+}
+
+/**
+ * Restore the recorded meta-data of a frame. The recorded frame number is
+ * kept as "recorded_frame_number" and profiling timestamps are dropped.
+ */
+static void restore_meta_data(msg_envelope_t* meta_data, const char* json, size_t len) {
+    std::string buf(json, len);
+    cJSON* root = cJSON_Parse(buf.c_str());
+    if(root == NULL || !cJSON_IsObject(root)) {
+        LOG_WARN_0("Failed to parse recorded meta-data, ignoring it");
+        if(root != NULL)
+            cJSON_Delete(root);
+        return;
+    }
+
+    cJSON* child = root->child;
+    while(child != NULL) {
+        cJSON* next = child->next;
+        if(!strncmp(child->string, "ts_", 3))
+            cJSON_Delete(cJSON_DetachItemViaPointer(root, child));
+        child = next;
+    }
+    cJSON* frame_number = cJSON_DetachItemFromObjectCaseSensitive(root, "frame_number");
+    if(frame_number != NULL)
+        cJSON_AddItemToObject(root, "recorded_frame_number", frame_number);
+
+    merge_json_meta(meta_data, root, g_regenerated_keys);
+    cJSON_Delete(root);
+}
+
+/**
+ * Restore the recorded pixel format of a frame, unless the recorded meta-data
+ * already provided it
+ */
+static void restore_pixel_format(msg_envelope_t* meta_data, const char* pixel_format) {
+    if(pixel_format[0] == '\0')
+        return;
+    msg_envelope_elem_body_t* elem = msgbus_msg_envelope_new_string(pixel_format);
+    if(elem == NULL) {
+        LOG_WARN_0("Failed to restore recorded pixel format");
+        return;
+    }
+    if(msgbus_msg_envelope_put(meta_data, "pixel_format", elem) != MSG_SUCCESS)
+        msgbus_msg_envelope_elem_destroy(elem);
+}
+
+ReplayIngestor::ReplayIngestor(config_t* config, FrameQueue* frame_queue, std::string service_name, std::condition_variable& snapshot_cv, EncodeType enc_type, int enc_lvl):
+    Ingestor(config, frame_queue, service_name, snapshot_cv, enc_type, enc_lvl) {
+    m_seg_pos = 0;
+    m_record_pos = 0;
+    m_realtime = true;
+    m_loop_video = false;
+    m_pace_ts = 0;
+
+    config_value_t* cvt_pipeline = config->get_config_value(config->cfg, PIPELINE);
+    if(cvt_pipeline == NULL) {
+        const char* err = "JSON missing key";
+        LOG_ERROR("%s \'%s\'", err, PIPELINE);
+        throw(err);
+    } else if(cvt_pipeline->type != CVT_STRING) {
+        config_value_destroy(cvt_pipeline);
+        const char* err = "JSON value must be a string";
+        LOG_ERROR("%s for \'%s\'", err, PIPELINE);
+        throw(err);
+    }
+    m_path = std::string(cvt_pipeline->body.string);
+    config_value_destroy(cvt_pipeline);
+
+    config_value_t* cvt_realtime = config->get_config_value(config->cfg, REALTIME);
+    if(cvt_realtime != NULL) {
+        if(cvt_realtime->type != CVT_BOOLEAN) {
+            config_value_destroy(cvt_realtime);
+            const char* err = "JSON value must be a boolean";
+            LOG_ERROR("%s for \'%s\'", err, REALTIME);
+            throw(err);
+        }
+        m_realtime = cvt_realtime->body.boolean;
+        config_value_destroy(cvt_realtime);
+    }
+
+    config_value_t* cvt_loop_video = config->get_config_value(config->cfg, LOOP_VIDEO);
+    if(cvt_loop_video != NULL) {
+        if(cvt_loop_video->type != CVT_BOOLEAN) {
+            config_value_destroy(cvt_loop_video);
+            const char* err = "JSON value must be a boolean";
+            LOG_ERROR("%s for \'%s\'", err, LOOP_VIDEO);
+            throw(err);
+        }
+        m_loop_video = cvt_loop_video->body.boolean;
+        config_value_destroy(cvt_loop_video);
+    }
+
+    m_segments = list_recording_segments(m_path);
+    if(m_segments.empty()) {
+        const char* err = "No recording segments found";
+        LOG_ERROR("%s in %s", err, m_path.c_str());
+        throw(err);
+    }
+    LOG_INFO("Replaying %zu segment(s) from %s (realtime: %s, loop: %s)",
+             m_segments.size(), m_path.c_str(),
+             m_realtime ? "true" : "false", m_loop_video ? "true" : "false");
+
+    m_initialized.store(true);
+}
+
+ReplayIngestor::~ReplayIngestor() {
+    LOG_DEBUG_0("Replay ingestor destructor");
+}
+
+std::shared_ptr<ReplaySegment> ReplayIngestor::open_segment(uint32_t seq) {
+    std::string base = recording_segment_path(m_path, seq);
+    std::string data_path = base + VI_REC_DATA_EXT;
+    std::string idx_path = base + VI_REC_INDEX_EXT;
+    std::shared_ptr<ReplaySegment> segment = std::make_shared<ReplaySegment>();
+
+    int fd = open(data_path.c_str(), O_RDONLY);
+    if(fd < 0) {
+        LOG_ERROR("Failed to open segment %s: %s", data_path.c_str(), strerror(errno));
+        return nullptr;
+    }
+    struct stat st;
+    if(fstat(fd, &st) != 0 || (size_t) st.st_size < VI_REC_ALIGN) {
+        LOG_ERROR("Invalid segment %s", data_path.c_str());
+        close(fd);
+        return nullptr;
+    }
+    // Mapped private and writable so that UDFs may modify frames in place
+    // without touching the recording
+    void* addr = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(addr == MAP_FAILED) {
+        LOG_ERROR("Failed to map segment %s: %s", data_path.c_str(), strerror(errno));
+        return nullptr;
+    }
+    segment->addr = (uint8_t*) addr;
+    segment->size = st.st_size;
+    madvise(addr, st.st_size, MADV_SEQUENTIAL);
+
+    const RecSegmentHeader* hdr = (const RecSegmentHeader*) segment->addr;
+    if(memcmp(hdr->magic, VI_REC_SEGMENT_MAGIC, sizeof(hdr->magic)) ||
+            hdr->version != VI_REC_VERSION) {
+        LOG_ERROR("Segment %s is not a supported recording", data_path.c_str());
+        return nullptr;
+    }
+
+    FILE* idx = fopen(idx_path.c_str(), "rb");
+    if(idx == NULL) {
+        LOG_ERROR("Failed to open index %s: %s", idx_path.c_str(), strerror(errno));
+        return nullptr;
+    }
+    RecIndexEntry entry;
+    while(fread(&entry, sizeof(entry), 1, idx) == 1) {
+        // Ignore entries of records which did not make it to disk
+        if(entry.offset + entry.record_size > segment->size)
+            break;
+        segment->index.push_back(entry);
+    }
+    fclose(idx);
+
+    LOG_INFO("Replaying segment %s (%zu frames)", data_path.c_str(), segment->index.size());
+    return segment;
+}
+
+void ReplayIngestor::pace(uint64_t capture_ts_ns) {
+    auto now = std::chrono::steady_clock::now();
+    if(m_pace_ts == 0 || capture_ts_ns < m_pace_ts) {
+        m_pace_ts = capture_ts_ns;
+        m_pace_start = now;
+        return;
+    }
+    auto due = m_pace_start + std::chrono::nanoseconds(capture_ts_ns - m_pace_ts);
+    while(!m_stop.load() && now < due) {
+        auto remaining = due - now;
+        if(remaining > PACE_SLEEP_MAX)
+            remaining = PACE_SLEEP_MAX;
+        std::this_thread::sleep_for(remaining);
+        now = std::chrono::steady_clock::now();
+    }
+}
+
+void ReplayIngestor::read(Frame*& frame) {
+    frame = NULL;
+    while(!m_stop.load()) {
+        if(m_segment == nullptr) {
+            if(m_seg_pos >= m_segments.size()) {
+                if(!m_loop_video)
+                    return;
+                LOG_WARN_0("Recording ended. Looping...");
+                m_seg_pos = 0;
+                m_pace_ts = 0;
+            }
+            m_segment = open_segment(m_segments[m_seg_pos++]);
+            m_record_pos = 0;
+            if(m_segment == nullptr)
+                continue;
+        }
+        if(m_record_pos >= m_segment->index.size()) {
+            m_segment.reset();
+            continue;
+        }
+
+        const RecIndexEntry& entry = m_segment->index[m_record_pos++];
+        uint8_t* rec = m_segment->addr + entry.offset;
+        const RecRecordHeader* hdr = (const RecRecordHeader*) rec;
+        if(hdr->magic != VI_REC_RECORD_MAGIC || hdr->record_size != entry.record_size ||
+                hdr->num_frames == 0 ||
+                sizeof(RecRecordHeader) + hdr->num_frames * sizeof(RecFrameDesc) > hdr->record_size ||
+                hdr->meta_offset + hdr->meta_size > hdr->record_size) {
+            LOG_ERROR("Corrupt record at offset %lu, skipping", entry.offset);
+            continue;
+        }
+        const RecFrameDesc* descs = (const RecFrameDesc*)(rec + sizeof(RecRecordHeader));
+        bool valid = true;
+        for(uint32_t i = 0; i < hdr->num_frames; ++i) {
+            if(descs[i].data_size != (uint64_t) descs[i].width * descs[i].height * descs[i].channels ||
+                    descs[i].data_offset + descs[i].data_size > hdr->record_size ||
+                    descs[i].pixel_format[VI_REC_FORMAT_SIZE - 1] != '\0') {
+                valid = false;
+                break;
+            }
+        }
+        if(!valid) {
+            LOG_ERROR("Corrupt frame descriptor in record at offset %lu, skipping", entry.offset);
+            continue;
+        }
+
+        if(m_realtime)
+            pace(hdr->capture_ts_ns);
+
+        // Every frame holds a reference on the segment mapping, which keeps
+        // the zero-copy data valid until the last consumer frees the frame
+        frame = new Frame(
+                (void*) new std::shared_ptr<ReplaySegment>(m_segment),
+                free_replay_frame, (void*)(rec + descs[0].data_offset),
+                descs[0].width, descs[0].height, descs[0].channels);
+        for(uint32_t i = 1; i < hdr->num_frames; ++i) {
+            frame->add_frame(
+                    (void*) new std::shared_ptr<ReplaySegment>(m_segment),
+                    free_replay_frame, (void*)(rec + descs[i].data_offset),
+                    descs[i].width, descs[i].height, descs[i].channels,
+                    EncodeType::NONE, 0);
+        }
+        restore_meta_data(frame->get_meta_data(),
+                          (const char*)(rec + hdr->meta_offset), hdr->meta_size);
+        restore_pixel_format(frame->get_meta_data(), descs[0].pixel_format);
+
+        if(m_poll_interval > 0) {
+            usleep(m_poll_interval * 1000 * 1000);
+        }
+        return;
+    }
+}
+
+void ReplayIngestor::run(bool snapshot_mode) {
+    // indicate that the run() function corresponding to the m_th thread has started
+    m_running.store(true);
+    LOG_INFO_0("Ingestor thread running publishing on stream");
+
+    Frame* frame = NULL;
+
+    int64_t frame_count = 0;
+
+    msg_envelope_elem_body_t* elem = NULL;
+
+    try {
+        while (!m_stop.load()) {
+            this->read(frame);
+            if(frame == NULL) {
+                if(!m_stop.load()) {
+                    LOG_WARN_0("Recording ended...");
+                    // Wait for the ingestor to be stopped instead of exiting
+                    // to avoid a restart
+                    while(!m_stop.load()) {
+                        std::this_thread::sleep_for(PACE_SLEEP_MAX);
+                    }
+                }
+                break;
+            }
+
+            msg_envelope_t* meta_data = frame->get_meta_data();
+            // Profiling start
+            DO_PROFILING(this->m_profile, meta_data, "ts_Ingestor_entry")
+            // Profiling end
+
+            msgbus_ret_t ret;
+            if(frame_count == INT64_MAX) {
+                LOG_WARN_0("frame count has reached INT64_MAX, so resetting \
+                            it back to zero");
+                frame_count = 0;
+            }
+            frame_count++;
+
+            elem = msgbus_msg_envelope_new_integer(frame_count);
+            if (elem == NULL) {
+                delete frame;
+                const char* err = "Failed to create frame_number element";
+                LOG_ERROR("%s", err);
+                throw err;
+            }
+            ret = msgbus_msg_envelope_put(meta_data, "frame_number", elem);
+            if(ret != MSG_SUCCESS) {
+                delete frame;
+                const char* err = "Failed to put frame_number in meta-data";
+                LOG_ERROR("%s", err);
+                throw err;
+            }
+            elem = NULL;
+            LOG_DEBUG("Frame number: %ld", frame_count);
+
+            // Profiling start
+            DO_PROFILING(this->m_profile, meta_data, "ts_filterQ_entry")
+            // Profiling end
+
+            this->push_frame(frame);
+            frame = NULL;
+
+            if(snapshot_mode) {
+                m_stop.store(true);
+                m_snapshot_cv.notify_all();
+            }
+        }
+    } catch(const char* err) {
+        LOG_ERROR("Exception: %s", err);
+        if (elem != NULL)
+            msgbus_msg_envelope_elem_destroy(elem);
+        if(frame != NULL)
+            delete frame;
+        throw err;
+    } catch(...) {
+        LOG_ERROR("Exception occured in replay ingestor run()");
+        if (elem != NULL)
+            msgbus_msg_envelope_elem_destroy(elem);
+        if(frame != NULL)
+            delete frame;
+        throw;
+    }
+    LOG_INFO_0("Ingestor thread stopped");
+    if(snapshot_mode)
+        m_running.store(false);
+}
+
+void ReplayIngestor::stop() {
+    if(m_initialized.load()) {
+        if(!m_stop.load()) {
+            m_stop.store(true);
+            // wait for the ingestor thread function run() to finish its execution.
+            if(m_th != NULL && m_th->joinable()) {
+                m_th->join();
+            }
+        }
+        // Reset so that the ingestor is ready for the next ingestion.
+        m_running.store(false);
+        m_stop.store(false);
+    }
+}
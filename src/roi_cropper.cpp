@@ -0,0 +1,236 @@
+// Copyright (c) 2021 Intel Corporation.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM,OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+
+/**
+ * @file
+ * @brief Static region of interest cropping implementation
+ */
+
+#include <string.h>
+#include <cjson/cJSON.h>
+#include <eii/utils/logger.h>
+#include "eii/vi/ingestor.h"
+#include "eii/vi/roi_cropper.h"
+#include "eii/vi/utils.h"
+
+using namespace eii::vi;
+using namespace eii::udf;
+
+// Planar pixel formats, whose planes cannot be cropped as a single image
+static const char* const g_planar_formats[] = {
+    "I420", "YV12", "NV12", "NV21", "NV16", "Y42B", "Y444", "Y41B", NULL
+};
+
+/**
+ * Free callback of the cropped frames
+ */
+static void free_roi_frame(void* obj) {
+    delete (cv::Mat*) obj;
+}
+
+/**
+ * Check whether a frame is in a planar pixel format
+ */
+static bool is_planar(Frame* frame) {
+    const char* format = get_pixel_format(frame);
+    if(format == NULL)
+        return false;
+    for(int i = 0; g_planar_formats[i] != NULL; i++) {
+        if(!strcmp(format, g_planar_formats[i]))
+            return true;
+    }
+    return false;
+}
+
+std::shared_ptr<const RoiConfig> RoiCropper::parse(const config_value_t* roi) {
+    std::shared_ptr<RoiConfig> config = std::make_shared<RoiConfig>();
+    config->replace = false;
+    if(roi == NULL)
+        return config;
+    if(roi->type != CVT_OBJECT) {
+        const char* err = "ROI config must be an object";
+        LOG_ERROR("%s", err);
+        throw(err);
+    }
+
+    config_value_t* cvt_mode = config_value_object_get(roi, ROI_MODE);
+    if(cvt_mode != NULL) {
+        if(cvt_mode->type != CVT_STRING) {
+            config_value_destroy(cvt_mode);
+            const char* err = "JSON value must be a string";
+            LOG_ERROR("%s for \'%s\'", err, ROI_MODE);
+            throw(err);
+        }
+        std::string mode = cvt_mode->body.string;
+        config_value_destroy(cvt_mode);
+        if(mode == ROI_MODE_REPLACE) {
+            config->replace = true;
+        } else if(mode != ROI_MODE_APPEND) {
+            const char* err = "Unsupported ROI mode";
+            LOG_ERROR("%s \'%s\'", err, mode.c_str());
+            throw(err);
+        }
+    }
+
+    config_value_t* cvt_regions = config_value_object_get(roi, ROI_REGIONS);
+    if(cvt_regions == NULL || cvt_regions->type != CVT_ARRAY) {
+        if(cvt_regions != NULL)
+            config_value_destroy(cvt_regions);
+        const char* err = "JSON array missing";
+        LOG_ERROR("%s for \'%s\'", err, ROI_REGIONS);
+        throw(err);
+    }
+    size_t len = config_value_array_len(cvt_regions);
+    for(size_t i = 0; i < len; i++) {
+        config_value_t* cvt_region = config_value_array_get(cvt_regions, i);
+        try {
+            if(cvt_region == NULL || cvt_region->type != CVT_OBJECT) {
+                const char* err = "ROI regions must be objects";
+                LOG_ERROR("%s", err);
+                throw(err);
+            }
+            config_value_t* cvt_name = config_value_object_get(cvt_region, "name");
+            if(cvt_name == NULL || cvt_name->type != CVT_STRING) {
+                if(cvt_name != NULL)
+                    config_value_destroy(cvt_name);
+                const char* err = "ROI region name must be a string";
+                LOG_ERROR("%s", err);
+                throw(err);
+            }
+            RoiRegion region;
+            region.name = cvt_name->body.string;
+            config_value_destroy(cvt_name);
+            region.rect = cv::Rect((int) get_required_config_int(cvt_region, "x", 0),
+                                   (int) get_required_config_int(cvt_region, "y", 0),
+                                   (int) get_required_config_int(cvt_region, "width", 1),
+                                   (int) get_required_config_int(cvt_region, "height", 1));
+            config->regions.push_back(region);
+        } catch(const char* err) {
+            if(cvt_region != NULL)
+                config_value_destroy(cvt_region);
+            config_value_destroy(cvt_regions);
+            throw;
+        }
+        config_value_destroy(cvt_region);
+    }
+    config_value_destroy(cvt_regions);
+    if(config->regions.empty()) {
+        const char* err = "ROI config has no regions";
+        LOG_ERROR("%s", err);
+        throw(err);
+    }
+    return config;
+}
+
+RoiCropper::RoiCropper(const config_value_t* roi) :
+    m_format_warned(false), m_region_warned(false) {
+    update(roi);
+}
+
+void RoiCropper::update(const config_value_t* roi) {
+    std::shared_ptr<const RoiConfig> config = parse(roi);
+    {
+        std::lock_guard<std::mutex> lk(m_mtx);
+        m_config = config;
+    }
+    m_region_warned.store(false);
+    for(const RoiRegion& region : config->regions) {
+        LOG_INFO("ROI %s: %dx%d at %d,%d (%s)", region.name.c_str(),
+                 region.rect.width, region.rect.height, region.rect.x,
+                 region.rect.y, config->replace ? ROI_MODE_REPLACE : ROI_MODE_APPEND);
+    }
+}
+
+void RoiCropper::crop(Frame* frame, EncodeType enc_type, int enc_lvl) {
+    std::shared_ptr<const RoiConfig> config;
+    {
+        std::lock_guard<std::mutex> lk(m_mtx);
+        config = m_config;
+    }
+    if(config->regions.empty())
+        return;
+
+    if(is_planar(frame)) {
+        if(!m_format_warned.exchange(true)) {
+            LOG_WARN_0("Frames in planar pixel formats are not cropped");
+        }
+        return;
+    }
+
+    // Frames are handled as packed pixels of channels bytes, which also
+    // covers 16 bit formats
+    int width = frame->get_width(0);
+    int height = frame->get_height(0);
+    int channels = frame->get_channels(0);
+    cv::Mat full(height, width, CV_MAKETYPE(CV_8U, channels), frame->get_data(0));
+
+    std::vector<cv::Mat*> crops;
+    cJSON* rois = cJSON_CreateArray();
+    int index = config->replace ? 0 : frame->get_number_of_frames();
+    for(const RoiRegion& region : config->regions) {
+        cv::Rect rect = region.rect & cv::Rect(0, 0, width, height);
+        if(rect.area() == 0) {
+            if(!m_region_warned.exchange(true)) {
+                LOG_WARN("ROI %s is outside of the %dx%d frame",
+                         region.name.c_str(), width, height);
+            }
+            continue;
+        }
+        cv::Mat view = full(rect);
+
+        // The header refers to the ingested buffer, which lives as long as
+        // the frame unless the frame is replaced
+        bool copied = config->replace || !view.isContinuous();
+        crops.push_back(new cv::Mat(copied ? view.clone() : view));
+
+        cJSON* desc = cJSON_CreateObject();
+        cJSON_AddStringToObject(desc, "name", region.name.c_str());
+        cJSON_AddNumberToObject(desc, "frame", index++);
+        cJSON_AddNumberToObject(desc, "x", rect.x);
+        cJSON_AddNumberToObject(desc, "y", rect.y);
+        cJSON_AddNumberToObject(desc, "width", rect.width);
+        cJSON_AddNumberToObject(desc, "height", rect.height);
+        cJSON_AddBoolToObject(desc, "copied", copied);
+        cJSON_AddItemToArray(rois, desc);
+    }
+
+    for(size_t i = 0; i < crops.size(); i++) {
+        cv::Mat* mat = crops[i];
+        if(config->replace && i == 0) {
+            // Releases the ingested buffer, all crops are copies by now
+            frame->set_data(0, (void*) mat, free_roi_frame, (void*) mat->data,
+                            mat->cols, mat->rows, channels);
+            frame->set_encoding(enc_type, enc_lvl, 0);
+        } else {
+            frame->add_frame((void*) mat, free_roi_frame, (void*) mat->data,
+                             mat->cols, mat->rows, channels, enc_type, enc_lvl);
+        }
+    }
+
+    msg_envelope_elem_body_t* elem = json_to_elem(rois);
+    cJSON_Delete(rois);
+    if(elem == NULL ||
+       msgbus_msg_envelope_put(frame->get_meta_data(), ROI_META_KEY, elem) != MSG_SUCCESS) {
+        LOG_ERROR_0("Failed to put ROI meta-data");
+        if(elem != NULL)
+            msgbus_msg_envelope_elem_destroy(elem);
+    }
+}
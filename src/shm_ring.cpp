@@ -0,0 +1,424 @@
+// Copyright (c) 2021 Intel Corporation.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM,OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+/**
+ * @file
+ * @brief Shared memory ring implementation
+ */
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <eii/utils/logger.h>
+#include "eii/vi/shm_ring.h"
+#include "eii/vi/utils.h"
+
+using namespace eii::vi;
+
+#define SOCKET_PATH "socket_path"
+#define NUM_SLOTS "num_slots"
+#define SLOT_SIZE_MB "slot_size_mb"
+#define LEASE_MS "lease_ms"
+
+#define DEFAULT_SOCKET_DIR "/EII/sockets"
+#define DEFAULT_NUM_SLOTS 4
+#define DEFAULT_SLOT_SIZE_MB 32
+#define DEFAULT_LEASE_MS 5000
+
+// Maximum time the socket thread waits for events before checking whether
+// it has to stop
+#define POLL_TIMEOUT_MS 250
+
+// Interval of the reports on frames no slot was available for and evicted
+// subscribers
+#define REPORT_INTERVAL std::chrono::seconds(60)
+
+// Frame data in the slots is aligned to this
+#define SLOT_ALIGN 4096
+
+#define ALIGN_UP(x, a) ((((x) + (a) - 1) / (a)) * (a))
+
+static_assert(sizeof(std::atomic<uint64_t>) == sizeof(uint64_t) && ATOMIC_LLONG_LOCK_FREE == 2,
+              "Sequence numbers in shared memory require lock-free 64-bit atomics");
+
+ShmRing::ShmRing(const config_value_t* config, const std::string& name) :
+    m_memfd(-1), m_ro_fd(-1), m_listen_fd(-1), m_base(NULL), m_map_size(0),
+    m_seqs(NULL), m_next(0), m_seq(0), m_written(0), m_busy(0), m_evicted(0),
+    m_last_report(std::chrono::steady_clock::now()), m_th(NULL), m_stop(false) {
+    m_wake_fd[0] = m_wake_fd[1] = -1;
+    if(config->type != CVT_OBJECT) {
+        const char* err = "\"shared_memory\" has to be an object";
+        LOG_ERROR("%s", err);
+        throw(err);
+    }
+    config_value_t* cvt_path = config_value_object_get(config, SOCKET_PATH);
+    if(cvt_path != NULL) {
+        if(cvt_path->type != CVT_STRING) {
+            config_value_destroy(cvt_path);
+            const char* err = "Shared memory \"socket_path\" has to be a string";
+            LOG_ERROR("%s", err);
+            throw(err);
+        }
+        m_socket_path = cvt_path->body.string;
+        config_value_destroy(cvt_path);
+    } else {
+        m_socket_path = std::string(DEFAULT_SOCKET_DIR) + "/" + name + ".shm";
+    }
+    m_num_slots = (size_t) get_config_int(config, NUM_SLOTS, DEFAULT_NUM_SLOTS, 1);
+    m_slot_size = (size_t) get_config_int(config, SLOT_SIZE_MB, DEFAULT_SLOT_SIZE_MB, 1) << 20;
+    m_lease = std::chrono::milliseconds(get_config_int(config, LEASE_MS, DEFAULT_LEASE_MS, 1));
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if(m_socket_path.size() >= sizeof(addr.sun_path)) {
+        const char* err = "Shared memory socket path is too long";
+        LOG_ERROR("%s: %s", err, m_socket_path.c_str());
+        throw(err);
+    }
+    strncpy(addr.sun_path, m_socket_path.c_str(), sizeof(addr.sun_path) - 1);
+
+    const char* err = NULL;
+    size_t seqs_size = ALIGN_UP(m_num_slots * sizeof(uint64_t), SLOT_ALIGN);
+    m_map_size = VI_SHM_HEADER_SIZE + seqs_size + m_num_slots * m_slot_size;
+    m_memfd = memfd_create(name.c_str(), MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if(m_memfd < 0) {
+        err = "Failed to create shared memory";
+    } else if(ftruncate(m_memfd, m_map_size) != 0) {
+        err = "Failed to size shared memory";
+    } else if(fcntl(m_memfd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) != 0) {
+        err = "Failed to seal shared memory";
+    } else {
+        m_base = (uint8_t*) mmap(NULL, m_map_size, PROT_READ | PROT_WRITE, MAP_SHARED, m_memfd, 0);
+        if(m_base == MAP_FAILED) {
+            m_base = NULL;
+            err = "Failed to map shared memory";
+        }
+    }
+    if(err == NULL) {
+        // Subscribers get a read-only open file description of the memfd,
+        // so they cannot map it writable
+        char fd_path[64];
+        snprintf(fd_path, sizeof(fd_path), "/proc/self/fd/%d", m_memfd);
+        m_ro_fd = open(fd_path, O_RDONLY | O_CLOEXEC);
+        if(m_ro_fd < 0) {
+            err = "Failed to open read-only shared memory descriptor";
+        } else if(pipe2(m_wake_fd, O_CLOEXEC) != 0) {
+            err = "Failed to create socket thread pipe";
+        } else if((m_listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0) {
+            err = "Failed to create shared memory socket";
+        } else {
+            unlink(m_socket_path.c_str());
+            if(bind(m_listen_fd, (struct sockaddr*) &addr, sizeof(addr)) != 0 ||
+                    listen(m_listen_fd, 16) != 0) {
+                err = "Failed to listen on shared memory socket";
+            }
+        }
+    }
+    if(err != NULL) {
+        LOG_ERROR("%s (%s): %s", err, m_socket_path.c_str(), strerror(errno));
+        cleanup();
+        throw(err);
+    }
+
+    ShmRingHeader* hdr = (ShmRingHeader*) m_base;
+    memcpy(hdr->magic, VI_SHM_MAGIC, sizeof(hdr->magic));
+    hdr->version = VI_SHM_VERSION;
+    hdr->num_slots = (uint32_t) m_num_slots;
+    hdr->slot_size = m_slot_size;
+    hdr->seqs_offset = VI_SHM_HEADER_SIZE;
+    hdr->slots_offset = VI_SHM_HEADER_SIZE + seqs_size;
+    m_seqs = (std::atomic<uint64_t>*) (m_base + hdr->seqs_offset);
+    for(size_t i = 0; i < m_num_slots; ++i)
+        m_seqs[i].store(0, std::memory_order_relaxed);
+
+    Slot slot;
+    slot.seq = 0;
+    slot.refs = 0;
+    m_slots.assign(m_num_slots, slot);
+
+    m_th = new std::thread(&ShmRing::run, this);
+    LOG_INFO("Publishing frames through shared memory on %s (%zu x %zu MB slots)",
+             m_socket_path.c_str(), m_num_slots, m_slot_size >> 20);
+}
+
+ShmRing::~ShmRing() {
+    if(m_th != NULL) {
+        m_stop.store(true);
+        char c = 0;
+        if(::write(m_wake_fd[1], &c, 1) < 0)
+            LOG_WARN("Failed to wake up shared memory socket thread: %s", strerror(errno));
+        m_th->join();
+        delete m_th;
+    }
+    for(Client& client : m_clients)
+        close(client.fd);
+    cleanup();
+}
+
+void ShmRing::cleanup() {
+    if(m_listen_fd >= 0) {
+        close(m_listen_fd);
+        unlink(m_socket_path.c_str());
+    }
+    if(m_wake_fd[0] >= 0)
+        close(m_wake_fd[0]);
+    if(m_wake_fd[1] >= 0)
+        close(m_wake_fd[1]);
+    if(m_ro_fd >= 0)
+        close(m_ro_fd);
+    if(m_base != NULL)
+        munmap(m_base, m_map_size);
+    // Subscribers keep their mapping of the memory until they unmap it
+    if(m_memfd >= 0)
+        close(m_memfd);
+}
+
+const std::string& ShmRing::get_socket_path() const {
+    return m_socket_path;
+}
+
+void ShmRing::run() {
+    LOG_INFO_0("Shared memory socket thread started");
+    std::vector<struct pollfd> fds;
+    while(!m_stop.load()) {
+        fds.clear();
+        fds.push_back({m_wake_fd[0], POLLIN, 0});
+        fds.push_back({m_listen_fd, POLLIN, 0});
+        {
+            std::lock_guard<std::mutex> lk(m_mtx);
+            for(const Client& client : m_clients)
+                fds.push_back({client.fd, POLLIN, 0});
+        }
+        int ret = poll(fds.data(), fds.size(), POLL_TIMEOUT_MS);
+        if(ret < 0) {
+            if(errno == EINTR)
+                continue;
+            LOG_ERROR("Failed to poll shared memory socket: %s", strerror(errno));
+            break;
+        }
+        if(ret == 0)
+            continue;
+        if(fds[1].revents & POLLIN)
+            accept_client();
+
+        // Only this thread adds and drops subscribers, so the polled
+        // descriptors are still at their index
+        std::lock_guard<std::mutex> lk(m_mtx);
+        for(size_t i = fds.size(); i-- > 2;) {
+            if(fds[i].revents == 0)
+                continue;
+            if(!receive_releases(m_clients[i - 2]))
+                drop_client(i - 2);
+        }
+    }
+    LOG_INFO_0("Shared memory socket thread stopped");
+}
+
+void ShmRing::accept_client() {
+    int fd = accept4(m_listen_fd, NULL, NULL, SOCK_CLOEXEC);
+    if(fd < 0) {
+        LOG_WARN("Failed to accept shared memory subscriber: %s", strerror(errno));
+        return;
+    }
+
+    // The header is sent along with the descriptor, so subscribers can
+    // check it before mapping the memory
+    ShmRingHeader hdr;
+    memcpy(&hdr, m_base, sizeof(hdr));
+    struct iovec iov = {&hdr, sizeof(hdr)};
+    char control[CMSG_SPACE(sizeof(int))];
+    memset(control, 0, sizeof(control));
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &m_ro_fd, sizeof(int));
+    if(sendmsg(fd, &msg, MSG_NOSIGNAL) != (ssize_t) sizeof(hdr)) {
+        LOG_WARN("Failed to pass shared memory to subscriber: %s", strerror(errno));
+        close(fd);
+        return;
+    }
+    if(fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) != 0) {
+        LOG_WARN("Failed to make shared memory subscriber socket non-blocking: %s",
+                 strerror(errno));
+        close(fd);
+        return;
+    }
+
+    std::lock_guard<std::mutex> lk(m_mtx);
+    Client client;
+    client.fd = fd;
+    client.evicted = false;
+    m_clients.push_back(client);
+    LOG_INFO("Shared memory subscriber connected to %s (%zu connected)",
+             m_socket_path.c_str(), m_clients.size());
+}
+
+bool ShmRing::receive_releases(Client& client) {
+    char buf[512];
+    while(true) {
+        ssize_t n = recv(client.fd, buf, sizeof(buf), 0);
+        if(n == 0)
+            return false;
+        if(n < 0) {
+            if(errno == EINTR)
+                continue;
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+        client.pending.append(buf, n);
+        size_t pos = 0;
+        for(; pos + sizeof(uint64_t) <= client.pending.size(); pos += sizeof(uint64_t)) {
+            uint64_t seq = 0;
+            memcpy(&seq, client.pending.data() + pos, sizeof(seq));
+            release(client, seq);
+        }
+        client.pending.erase(0, pos);
+    }
+}
+
+void ShmRing::drop_client(size_t index) {
+    Client& client = m_clients[index];
+    while(!client.held.empty())
+        release(client, *client.held.begin());
+    close(client.fd);
+    m_clients.erase(m_clients.begin() + index);
+    LOG_INFO("Shared memory subscriber disconnected from %s (%zu connected)",
+             m_socket_path.c_str(), m_clients.size());
+}
+
+void ShmRing::release(Client& client, uint64_t seq) {
+    // Frames the subscriber does not hold, e.g. written before it connected
+    // or released on its eviction, are ignored
+    if(client.held.erase(seq) == 0)
+        return;
+    for(Slot& slot : m_slots) {
+        if(slot.seq == seq && slot.refs > 0) {
+            slot.refs--;
+            return;
+        }
+    }
+}
+
+void ShmRing::evict_expired(std::chrono::steady_clock::time_point now) {
+    for(Slot& slot : m_slots) {
+        if(slot.refs == 0 || now - slot.written < m_lease)
+            continue;
+        // Only the socket thread drops subscribers, it sees the socket shut
+        // down and drops the evicted ones
+        for(Client& client : m_clients) {
+            if(client.evicted || client.held.count(slot.seq) == 0)
+                continue;
+            LOG_WARN("Evicting shared memory subscriber of %s, it held a "
+                     "frame for more than %ld ms", m_socket_path.c_str(),
+                     (long) m_lease.count());
+            client.evicted = true;
+            shutdown(client.fd, SHUT_RDWR);
+            while(!client.held.empty())
+                release(client, *client.held.begin());
+            m_evicted++;
+        }
+    }
+}
+
+size_t ShmRing::find_free_slot() {
+    // Slots are used in order, so the frames subscribers are still reading
+    // are overwritten as late as possible
+    for(size_t i = 0; i < m_num_slots; ++i) {
+        size_t index = (m_next + i) % m_num_slots;
+        if(m_slots[index].refs == 0)
+            return index;
+    }
+    return m_num_slots;
+}
+
+bool ShmRing::write(const void* data, size_t len, ShmSlot& slot) {
+    if(len > m_slot_size) {
+        std::lock_guard<std::mutex> lk(m_mtx);
+        m_busy++;
+        if(m_busy == 1)
+            LOG_WARN("Frame of %zu bytes does not fit into a %zu MB shared memory slot",
+                     len, m_slot_size >> 20);
+        return false;
+    }
+
+    std::unique_lock<std::mutex> lk(m_mtx);
+    auto now = std::chrono::steady_clock::now();
+    if(now - m_last_report >= REPORT_INTERVAL) {
+        if(m_busy > 0 || m_evicted > 0)
+            LOG_WARN("%s: %lu frames written to shared memory, %lu published inline, "
+                     "%lu subscribers evicted",
+                     m_socket_path.c_str(), (unsigned long) m_written,
+                     (unsigned long) m_busy, (unsigned long) m_evicted);
+        m_written = m_busy = m_evicted = 0;
+        m_last_report = now;
+    }
+
+    // Without a free slot the frame is published inline right away, the
+    // outputs are not held up by slow subscribers
+    evict_expired(now);
+    size_t index = find_free_slot();
+    if(index == m_num_slots) {
+        m_busy++;
+        return false;
+    }
+    uint64_t seq = ++m_seq;
+    m_next = (index + 1) % m_num_slots;
+    lk.unlock();
+
+    // Readers check the sequence number before and after reading a slot,
+    // so it is cleared while the slot is written
+    const ShmRingHeader* hdr = (const ShmRingHeader*) m_base;
+    slot.index = (uint32_t) index;
+    slot.seq = seq;
+    slot.offset = hdr->slots_offset + index * m_slot_size;
+    slot.size = len;
+    m_seqs[index].store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(m_base + slot.offset, data, len);
+    m_seqs[index].store(seq, std::memory_order_release);
+
+    lk.lock();
+    Slot& state = m_slots[index];
+    state.seq = seq;
+    state.refs = 0;
+    state.written = std::chrono::steady_clock::now();
+    for(Client& client : m_clients) {
+        if(client.evicted)
+            continue;
+        client.held.insert(seq);
+        state.refs++;
+    }
+    m_written++;
+    return true;
+}
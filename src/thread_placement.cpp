@@ -0,0 +1,292 @@
+// Copyright (c) 2021 Intel Corporation.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM,OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+
+/**
+ * @file
+ * @brief Thread placement implementation
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#include <eii/utils/logger.h>
+#include "eii/vi/thread_placement.h"
+#include "eii/vi/utils.h"
+
+#define NODE_SYSFS "/sys/devices/system/node"
+#define NODE_MASK_BITS (8 * sizeof(unsigned long))
+
+using namespace eii::vi;
+
+/**
+ * Parse a CPU list like "0-3,8,10-11", as used by the config and sysfs
+ */
+static bool parse_cpu_list(const char* list, cpu_set_t* cpus) {
+    CPU_ZERO(cpus);
+    const char* p = list;
+    while(*p != '\0' && *p != '\n') {
+        char* end = NULL;
+        long first = strtol(p, &end, 10);
+        if(end == p || first < 0 || first >= CPU_SETSIZE)
+            return false;
+        long last = first;
+        p = end;
+        if(*p == '-') {
+            last = strtol(p + 1, &end, 10);
+            if(end == p + 1 || last < first || last >= CPU_SETSIZE)
+                return false;
+            p = end;
+        }
+        for(long cpu = first; cpu <= last; cpu++)
+            CPU_SET(cpu, cpus);
+        if(*p == ',')
+            p++;
+        else if(*p != '\0' && *p != '\n')
+            return false;
+    }
+    return CPU_COUNT(cpus) > 0;
+}
+
+/**
+ * Format a CPU set as a CPU list
+ */
+static std::string format_cpu_list(const cpu_set_t* cpus) {
+    std::string list;
+    for(int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if(!CPU_ISSET(cpu, cpus))
+            continue;
+        int last = cpu;
+        while(last + 1 < CPU_SETSIZE && CPU_ISSET(last + 1, cpus))
+            last++;
+        if(!list.empty())
+            list += ",";
+        list += std::to_string(cpu);
+        if(last > cpu)
+            list += "-" + std::to_string(last);
+        cpu = last;
+    }
+    return list;
+}
+
+/**
+ * Read a CPU list from sysfs
+ */
+static bool read_cpu_list(const char* path, cpu_set_t* cpus) {
+    FILE* file = fopen(path, "r");
+    if(file == NULL)
+        return false;
+    char buf[1024];
+    bool ret = fgets(buf, sizeof(buf), file) != NULL && parse_cpu_list(buf, cpus);
+    fclose(file);
+    return ret;
+}
+
+/**
+ * NUMA nodes of a CPU set as a list, empty if unknown
+ */
+static std::string cpu_nodes(const cpu_set_t* cpus) {
+    // The node list has the same format as CPU lists
+    cpu_set_t nodes;
+    if(!read_cpu_list(NODE_SYSFS "/online", &nodes))
+        return "";
+    cpu_set_t cpu_nodes;
+    CPU_ZERO(&cpu_nodes);
+    for(int node = 0; node < CPU_SETSIZE; node++) {
+        if(!CPU_ISSET(node, &nodes))
+            continue;
+        char path[64];
+        snprintf(path, sizeof(path), NODE_SYSFS "/node%d/cpulist", node);
+        cpu_set_t node_cpus;
+        if(!read_cpu_list(path, &node_cpus))
+            continue;
+        CPU_AND(&node_cpus, &node_cpus, cpus);
+        if(CPU_COUNT(&node_cpus) > 0)
+            CPU_SET(node, &cpu_nodes);
+    }
+    return format_cpu_list(&cpu_nodes);
+}
+
+ThreadPlacement::ThreadPlacement() :
+    m_has_cpus(false), m_priority(0), m_numa_node(-1) {
+    CPU_ZERO(&m_cpus);
+}
+
+ThreadPlacement::ThreadPlacement(const char* stage, const config_value_t* config) :
+    m_stage(stage), m_has_cpus(false), m_priority(0), m_numa_node(-1) {
+    CPU_ZERO(&m_cpus);
+    if(config == NULL)
+        return;
+    if(config->type != CVT_OBJECT) {
+        const char* err = "JSON value must be an object";
+        LOG_ERROR("%s for \'%s\' placement", err, stage);
+        throw(err);
+    }
+    config_value_t* cvt_cpus = config_value_object_get(config, "cpus");
+    if(cvt_cpus != NULL) {
+        if(cvt_cpus->type != CVT_STRING) {
+            config_value_destroy(cvt_cpus);
+            const char* err = "JSON value must be a string";
+            LOG_ERROR("%s for \'cpus\'", err);
+            throw(err);
+        }
+        m_has_cpus = parse_cpu_list(cvt_cpus->body.string, &m_cpus);
+        if(!m_has_cpus) {
+            const char* err = "Invalid CPU list";
+            LOG_ERROR("%s \'%s\' for \'%s\' placement", err,
+                      cvt_cpus->body.string, stage);
+            config_value_destroy(cvt_cpus);
+            throw(err);
+        }
+        config_value_destroy(cvt_cpus);
+    }
+    m_priority = (int) get_config_int(config, "priority", 0, 0,
+                                      sched_get_priority_max(SCHED_FIFO));
+    m_numa_node = (int) get_config_int(config, "numa_node", -1, 0,
+                                       MAX_NUMA_NODES - 1);
+}
+
+bool ThreadPlacement::empty() const {
+    return !m_has_cpus && m_priority == 0 && m_numa_node < 0;
+}
+
+bool ThreadPlacement::apply(bool realtime) const {
+    if(empty())
+        return true;
+    bool ret = true;
+    long tid = syscall(SYS_gettid);
+    if(m_has_cpus) {
+        int err = pthread_setaffinity_np(pthread_self(), sizeof(m_cpus), &m_cpus);
+        if(err != 0) {
+            LOG_WARN("Failed to set the CPU affinity of %s thread %ld: %s",
+                     m_stage.c_str(), tid, strerror(err));
+            ret = false;
+        }
+    }
+    if(m_numa_node >= 0) {
+        unsigned long nodes[MAX_NUMA_NODES / NODE_MASK_BITS] = {0};
+        nodes[m_numa_node / NODE_MASK_BITS] |= 1UL << (m_numa_node % NODE_MASK_BITS);
+        if(syscall(SYS_set_mempolicy, MPOL_PREFERRED, nodes, MAX_NUMA_NODES + 1) != 0) {
+            LOG_WARN("Failed to set the NUMA node of %s thread %ld: %s",
+                     m_stage.c_str(), tid, strerror(errno));
+            ret = false;
+        }
+    }
+    if(m_priority > 0 && realtime) {
+        struct sched_param param;
+        memset(&param, 0, sizeof(param));
+        param.sched_priority = m_priority;
+        int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+        if(err != 0) {
+            LOG_WARN("Failed to set the SCHED_FIFO priority of %s thread %ld: %s%s",
+                     m_stage.c_str(), tid, strerror(err),
+                     (err == EPERM) ? " (CAP_SYS_NICE is required)" : "");
+            ret = false;
+        }
+    }
+    LOG_INFO("Placed %s thread %ld: %s%s", m_stage.c_str(), tid,
+             to_string().c_str(),
+             (m_priority > 0 && !realtime) ? " (without priority)" : "");
+    return ret;
+}
+
+std::string ThreadPlacement::to_string() const {
+    std::string str;
+    if(m_has_cpus) {
+        str = "CPUs " + format_cpu_list(&m_cpus);
+        std::string nodes = cpu_nodes(&m_cpus);
+        if(!nodes.empty())
+            str += " (NUMA node " + nodes + ")";
+    } else {
+        str = "any CPU";
+    }
+    if(m_numa_node >= 0)
+        str += ", memory on NUMA node " + std::to_string(m_numa_node);
+    if(m_priority > 0)
+        str += ", SCHED_FIFO " + std::to_string(m_priority);
+    return str;
+}
+
+ScopedPlacement::ScopedPlacement(const ThreadPlacement& placement) :
+    m_applied(false) {
+    if(placement.empty())
+        return;
+    pthread_t self = pthread_self();
+    if(pthread_getaffinity_np(self, sizeof(m_cpus), &m_cpus) != 0 ||
+       pthread_getschedparam(self, &m_policy, &m_param) != 0) {
+        LOG_WARN_0("Failed to get the placement of the calling thread");
+        return;
+    }
+    if(syscall(SYS_get_mempolicy, &m_mem_mode, m_mem_nodes,
+               MAX_NUMA_NODES, NULL, 0) != 0) {
+        m_mem_mode = MPOL_DEFAULT;
+    }
+    m_applied = true;
+    placement.apply();
+}
+
+ScopedPlacement::~ScopedPlacement() {
+    if(!m_applied)
+        return;
+    pthread_t self = pthread_self();
+    pthread_setaffinity_np(self, sizeof(m_cpus), &m_cpus);
+    pthread_setschedparam(self, m_policy, &m_param);
+    if(m_mem_mode == MPOL_DEFAULT) {
+        syscall(SYS_set_mempolicy, MPOL_DEFAULT, NULL, 0);
+    } else {
+        syscall(SYS_set_mempolicy, m_mem_mode, m_mem_nodes, MAX_NUMA_NODES + 1);
+    }
+}
+
+ScopedPlacement::ScopedPlacement(const ScopedPlacement& src) {}
+
+ScopedPlacement& ScopedPlacement::operator=(const ScopedPlacement& src) {
+    return *this;
+}
+
+ThreadPlacement eii::vi::get_thread_placement(config_t* config, const char* stage) {
+    config_value_t* cvt_placement = config->get_config_value(config->cfg, PLACEMENT);
+    if(cvt_placement == NULL)
+        return ThreadPlacement();
+    if(cvt_placement->type != CVT_OBJECT) {
+        config_value_destroy(cvt_placement);
+        const char* err = "JSON value must be an object";
+        LOG_ERROR("%s for \'%s\'", err, PLACEMENT);
+        throw(err);
+    }
+    config_value_t* cvt_stage = config_value_object_get(cvt_placement, stage);
+    try {
+        ThreadPlacement placement(stage, cvt_stage);
+        if(cvt_stage != NULL)
+            config_value_destroy(cvt_stage);
+        config_value_destroy(cvt_placement);
+        return placement;
+    } catch(const char*) {
+        if(cvt_stage != NULL)
+            config_value_destroy(cvt_stage);
+        config_value_destroy(cvt_placement);
+        throw;
+    }
+}
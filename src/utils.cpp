@@ -0,0 +1,172 @@
+// Copyright (c) 2021 Intel Corporation.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM,OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+
+/**
+ * @file
+ * @brief Implementation of the shared config and metadata helpers
+ */
+
+#include <cstring>
+#include <string>
+#include <eii/utils/logger.h>
+#include "eii/vi/utils.h"
+
+using namespace eii::vi;
+using namespace eii::udf;
+
+int64_t eii::vi::get_config_int(const config_value_t* config, const char* key,
+                                int64_t def, int64_t min, int64_t max) {
+    config_value_t* cvt = config_value_object_get(config, key);
+    if(cvt == NULL)
+        return def;
+    int64_t value = 0;
+    bool valid = cvt->type == CVT_INTEGER;
+    if(valid)
+        value = cvt->body.integer;
+    config_value_destroy(cvt);
+    if(!valid || value < min || value > max) {
+        const char* err = "Config value must be an integer in range";
+        LOG_ERROR("%s [%ld, %ld] for \'%s\'", err, (long) min, (long) max, key);
+        throw(err);
+    }
+    return value;
+}
+
+int64_t eii::vi::get_required_config_int(const config_value_t* config, const char* key,
+                                         int64_t min, int64_t max) {
+    config_value_t* cvt = config_value_object_get(config, key);
+    if(cvt == NULL) {
+        const char* err = "JSON missing key";
+        LOG_ERROR("%s \'%s\'", err, key);
+        throw(err);
+    }
+    config_value_destroy(cvt);
+    return get_config_int(config, key, 0, min, max);
+}
+
+double eii::vi::get_config_number(const config_value_t* config, const char* key,
+                                  double def, double min) {
+    config_value_t* cvt = config_value_object_get(config, key);
+    if(cvt == NULL)
+        return def;
+    double value = 0.0;
+    bool valid = true;
+    if(cvt->type == CVT_FLOATING)
+        value = cvt->body.floating;
+    else if(cvt->type == CVT_INTEGER)
+        value = (double) cvt->body.integer;
+    else
+        valid = false;
+    config_value_destroy(cvt);
+    if(!valid || value < min) {
+        const char* err = "Config value must be a number in range";
+        LOG_ERROR("%s [%g, inf) for \'%s\'", err, min, key);
+        throw(err);
+    }
+    return value;
+}
+
+const char* eii::vi::get_pixel_format(Frame* frame) {
+    msg_envelope_elem_body_t* format = NULL;
+    if(msgbus_msg_envelope_get(frame->get_meta_data(), "pixel_format", &format) != MSG_SUCCESS ||
+       format->type != MSG_ENV_DT_STRING)
+        return NULL;
+    return format->body.string;
+}
+
+msg_envelope_elem_body_t* eii::vi::json_to_elem(const cJSON* json) {
+    msg_envelope_elem_body_t* elem = NULL;
+    if(cJSON_IsObject(json)) {
+        elem = msgbus_msg_envelope_new_object();
+        if(elem == NULL)
+            return NULL;
+        const cJSON* child = NULL;
+        cJSON_ArrayForEach(child, json) {
+            msg_envelope_elem_body_t* value = json_to_elem(child);
+            if(value == NULL || msgbus_msg_envelope_elem_object_put(elem, child->string, value) != MSG_SUCCESS) {
+                if(value != NULL)
+                    msgbus_msg_envelope_elem_destroy(value);
+                msgbus_msg_envelope_elem_destroy(elem);
+                return NULL;
+            }
+        }
+    } else if(cJSON_IsArray(json)) {
+        elem = msgbus_msg_envelope_new_array();
+        if(elem == NULL)
+            return NULL;
+        const cJSON* child = NULL;
+        cJSON_ArrayForEach(child, json) {
+            msg_envelope_elem_body_t* value = json_to_elem(child);
+            if(value == NULL || msgbus_msg_envelope_elem_array_add(elem, value) != MSG_SUCCESS) {
+                if(value != NULL)
+                    msgbus_msg_envelope_elem_destroy(value);
+                msgbus_msg_envelope_elem_destroy(elem);
+                return NULL;
+            }
+        }
+    } else if(cJSON_IsString(json)) {
+        elem = msgbus_msg_envelope_new_string(json->valuestring);
+    } else if(cJSON_IsBool(json)) {
+        elem = msgbus_msg_envelope_new_bool(cJSON_IsTrue(json));
+    } else if(cJSON_IsNumber(json)) {
+        double value = json->valuedouble;
+        if(value == (double)(int64_t) value)
+            elem = msgbus_msg_envelope_new_integer((int64_t) value);
+        else
+            elem = msgbus_msg_envelope_new_floating(value);
+    } else {
+        elem = msgbus_msg_envelope_new_none();
+    }
+    return elem;
+}
+
+cJSON* eii::vi::meta_to_json(msg_envelope_t* meta) {
+    msg_envelope_serialized_part_t* parts = NULL;
+    int num_parts = msgbus_msg_envelope_serialize(meta, &parts);
+    if(num_parts <= 0)
+        return NULL;
+    std::string json(parts[0].bytes, parts[0].len);
+    msgbus_msg_envelope_serialize_destroy(parts, num_parts);
+    return cJSON_Parse(json.c_str());
+}
+
+void eii::vi::merge_json_meta(msg_envelope_t* meta, const cJSON* json,
+                              const char* const* skip_keys) {
+    const cJSON* child = NULL;
+    cJSON_ArrayForEach(child, json) {
+        bool skip = false;
+        for(int i = 0; skip_keys != NULL && skip_keys[i] != NULL; ++i) {
+            if(!strcmp(child->string, skip_keys[i])) {
+                skip = true;
+                break;
+            }
+        }
+        msg_envelope_elem_body_t* elem = NULL;
+        if(skip || msgbus_msg_envelope_get(meta, child->string, &elem) == MSG_SUCCESS)
+            continue;
+        elem = json_to_elem(child);
+        if(elem == NULL || msgbus_msg_envelope_put(meta, child->string, elem) != MSG_SUCCESS) {
+            LOG_WARN("Failed to put meta-data key %s", child->string);
+            if(elem != NULL)
+                msgbus_msg_envelope_elem_destroy(elem);
+        }
+    }
+}
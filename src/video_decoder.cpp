@@ -0,0 +1,217 @@
+// Copyright (c) 2021 Intel Corporation.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM,OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+
+/**
+ * @file
+ * @brief Video decoder implementation
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <opencv2/opencv.hpp>
+#include <gst/video/video.h>
+#include <eii/utils/logger.h>
+#include "eii/vi/video_decoder.h"
+#include "eii/vi/video_encoder.h"
+#include "eii/vi/compressed_frame.h"
+
+using namespace eii::vi;
+using namespace eii::udf;
+
+// Maximum time to wait for the picture of an access unit. Streams without
+// B-frames, as sent by most cameras, yield every picture right away.
+#define PULL_TIMEOUT (1 * GST_SECOND)
+
+/**
+ * Decoded sample whose packed pixels are handed out without copying
+ */
+struct DecodedSample {
+    GstSample* sample;
+    GstBuffer* buffer;
+    GstMapInfo map;
+};
+
+/**
+ * Free callback of the frames decoded into a @c DecodedSample
+ */
+static void free_decoded_sample(void* obj) {
+    DecodedSample* decoded = (DecodedSample*) obj;
+    gst_buffer_unmap(decoded->buffer, &decoded->map);
+    gst_sample_unref(decoded->sample);
+    delete decoded;
+}
+
+/**
+ * Free callback of the frames copied out of padded samples
+ */
+static void free_decoded_mat(void* obj) {
+    delete (cv::Mat*) obj;
+}
+
+VideoDecoder::VideoDecoder(const std::string& codec) :
+    m_codec(codec), m_pipeline(NULL), m_src(NULL), m_sink(NULL), m_wait_keyframe(true) {
+    if(!VideoEncoder::is_video_codec(codec.c_str())) {
+        const char* err = "Video decoding type has to be h264 or hevc";
+        LOG_ERROR("%s", err);
+        throw(err);
+    }
+    // The ingestor only initializes GStreamer if it uses it
+    int argc = 0;
+    gst_init(&argc, NULL);
+    m_start = std::chrono::steady_clock::now();
+}
+
+VideoDecoder::~VideoDecoder() {
+    destroy_pipeline();
+}
+
+const std::string& VideoDecoder::get_codec() const {
+    return m_codec;
+}
+
+bool VideoDecoder::create_pipeline() {
+    bool h264 = (m_codec == VIDEO_CODEC_H264);
+    char desc[512];
+    snprintf(desc, sizeof(desc),
+             "appsrc name=src format=time is-live=true "
+             "caps=%s,stream-format=byte-stream,alignment=au ! "
+             "%s ! decodebin ! videoconvert ! video/x-raw,format=BGR ! "
+             "appsink name=sink sync=false",
+             h264 ? "video/x-h264" : "video/x-h265",
+             h264 ? "h264parse" : "h265parse");
+
+    GError* error = NULL;
+    m_pipeline = gst_parse_launch(desc, &error);
+    if(m_pipeline == NULL || error != NULL) {
+        LOG_ERROR("Failed to create %s decoder: %s", m_codec.c_str(),
+                  (error != NULL) ? error->message : "unknown error");
+        if(error != NULL)
+            g_error_free(error);
+        if(m_pipeline != NULL) {
+            gst_object_unref(m_pipeline);
+            m_pipeline = NULL;
+        }
+        return false;
+    }
+    m_src = gst_bin_get_by_name(GST_BIN(m_pipeline), "src");
+    m_sink = gst_bin_get_by_name(GST_BIN(m_pipeline), "sink");
+    if(m_src == NULL || m_sink == NULL ||
+       gst_element_set_state(m_pipeline, GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE) {
+        LOG_ERROR("Failed to start %s decoder", m_codec.c_str());
+        destroy_pipeline();
+        return false;
+    }
+    LOG_INFO("%s decoder started", m_codec.c_str());
+    return true;
+}
+
+void VideoDecoder::destroy_pipeline() {
+    if(m_pipeline == NULL)
+        return;
+    gst_element_set_state(m_pipeline, GST_STATE_NULL);
+    if(m_src != NULL)
+        gst_object_unref(m_src);
+    if(m_sink != NULL)
+        gst_object_unref(m_sink);
+    gst_object_unref(m_pipeline);
+    m_pipeline = NULL;
+    m_src = NULL;
+    m_sink = NULL;
+}
+
+bool VideoDecoder::decode(Frame* frame) {
+    if(m_wait_keyframe) {
+        if(!is_keyframe(frame)) {
+            LOG_DEBUG("%s decoder waiting for a keyframe, frame dropped", m_codec.c_str());
+            return false;
+        }
+        m_wait_keyframe = false;
+    }
+    if(m_pipeline == NULL && !create_pipeline()) {
+        m_wait_keyframe = true;
+        return false;
+    }
+
+    // The access unit is copied as the frame data is replaced by the
+    // decoded pixels
+    size_t len = (size_t) frame->get_width(0);
+    GstBuffer* buf = gst_buffer_new_allocate(NULL, len, NULL);
+    gst_buffer_fill(buf, 0, frame->get_data(0), len);
+    GST_BUFFER_PTS(buf) = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - m_start).count();
+    GstFlowReturn ret = GST_FLOW_ERROR;
+    g_signal_emit_by_name(m_src, "push-buffer", buf, &ret);
+    gst_buffer_unref(buf);
+
+    GstSample* sample = NULL;
+    if(ret == GST_FLOW_OK)
+        g_signal_emit_by_name(m_sink, "try-pull-sample", PULL_TIMEOUT, &sample);
+    if(sample == NULL) {
+        GstBus* bus = gst_element_get_bus(m_pipeline);
+        GstMessage* msg = gst_bus_timed_pop_filtered(bus, 0, GST_MESSAGE_ERROR);
+        if(msg != NULL) {
+            GError* err = NULL;
+            gchar* debug = NULL;
+            gst_message_parse_error(msg, &err, &debug);
+            LOG_ERROR("%s decoder error: %s", m_codec.c_str(),
+                      (err != NULL) ? err->message : "unknown error");
+            if(err != NULL)
+                g_error_free(err);
+            g_free(debug);
+            gst_message_unref(msg);
+        } else {
+            LOG_ERROR("%s decoder did not output the frame", m_codec.c_str());
+        }
+        gst_object_unref(bus);
+        // Recreated at the next keyframe
+        destroy_pipeline();
+        m_wait_keyframe = true;
+        return false;
+    }
+
+    GstVideoInfo info;
+    GstBuffer* picture = gst_sample_get_buffer(sample);  // no lifetime transfer
+    DecodedSample* decoded = new DecodedSample();
+    if(picture == NULL || !gst_video_info_from_caps(&info, gst_sample_get_caps(sample)) ||
+       !gst_buffer_map(picture, &decoded->map, GST_MAP_READ)) {
+        LOG_ERROR("Failed to map decoded %s frame", m_codec.c_str());
+        delete decoded;
+        gst_sample_unref(sample);
+        return false;
+    }
+    decoded->sample = sample;
+    decoded->buffer = picture;
+
+    int width = GST_VIDEO_INFO_WIDTH(&info);
+    int height = GST_VIDEO_INFO_HEIGHT(&info);
+    int stride = GST_VIDEO_INFO_PLANE_STRIDE(&info, 0);
+    if(stride == width * 3) {
+        return set_decoded_data(frame, (void*) decoded, free_decoded_sample,
+                                (void*) decoded->map.data, width, height);
+    }
+
+    // Rows are padded to 4 bytes for widths which are not a multiple of 4
+    cv::Mat* mat = new cv::Mat();
+    *mat = cv::Mat(height, width, CV_8UC3, decoded->map.data, stride).clone();
+    free_decoded_sample(decoded);
+    return set_decoded_data(frame, (void*) mat, free_decoded_mat,
+                            (void*) mat->data, width, height);
+}
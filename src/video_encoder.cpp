@@ -0,0 +1,262 @@
+// Copyright (c) 2021 Intel Corporation.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM,OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+/**
+ * @file
+ * @brief H.264/HEVC software encoder implementation
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <gst/video/video.h>
+#include <eii/utils/logger.h>
+#include "eii/vi/video_encoder.h"
+#include "eii/vi/utils.h"
+
+using namespace eii::vi;
+
+#define BITRATE_KBPS "bitrate_kbps"
+#define GOP "gop"
+#define PRESET "preset"
+
+#define DEFAULT_BITRATE_KBPS 4000
+#define DEFAULT_GOP 30
+#define DEFAULT_PRESET "veryfast"
+
+// Maximum time to wait for the access unit of a frame, the encoders are
+// configured without lookahead so every frame is encoded right away
+#define PULL_TIMEOUT (2 * GST_SECOND)
+
+// Speed presets supported by x264enc and x265enc
+static const char* const g_presets[] = {
+    "ultrafast", "superfast", "veryfast", "faster", "fast", "medium",
+    "slow", "slower", "veryslow", NULL
+};
+
+/**
+ * Destroy notify of the frames pushed into the encoder, releases their owner
+ */
+static void release_owner(gpointer owner) {
+    delete (std::shared_ptr<void>*) owner;
+}
+
+VideoEncoder::VideoEncoder(const config_value_t* encoding, const std::string& name) :
+    m_name(name), m_pipeline(NULL), m_src(NULL), m_sink(NULL),
+    m_width(0), m_height(0), m_channels(0), m_force_keyframe(false) {
+    config_value_t* type = config_value_object_get(encoding, "type");
+    if(type == NULL || type->type != CVT_STRING || !is_video_codec(type->body.string)) {
+        if(type != NULL)
+            config_value_destroy(type);
+        const char* err = "Video encoding type has to be h264 or hevc";
+        LOG_ERROR("%s", err);
+        throw(err);
+    }
+    m_codec = type->body.string;
+    config_value_destroy(type);
+
+    m_bitrate = (int) get_config_int(encoding, BITRATE_KBPS, DEFAULT_BITRATE_KBPS, 1);
+    m_gop = (int) get_config_int(encoding, GOP, DEFAULT_GOP, 1);
+    m_preset = DEFAULT_PRESET;
+    config_value_t* preset = config_value_object_get(encoding, PRESET);
+    if(preset != NULL) {
+        bool valid = false;
+        if(preset->type == CVT_STRING) {
+            for(int i = 0; g_presets[i] != NULL; ++i) {
+                if(!strcmp(preset->body.string, g_presets[i])) {
+                    valid = true;
+                    break;
+                }
+            }
+        }
+        if(valid)
+            m_preset = preset->body.string;
+        config_value_destroy(preset);
+        if(!valid) {
+            const char* err = "Video encoding preset is not supported";
+            LOG_ERROR("%s", err);
+            throw(err);
+        }
+    }
+
+    // The ingestor only initializes GStreamer if it uses it
+    int argc = 0;
+    gst_init(&argc, NULL);
+    m_start = std::chrono::steady_clock::now();
+    LOG_INFO("%s: %s encoding, bitrate: %d kbps, GOP: %d, preset: %s",
+             m_name.c_str(), m_codec.c_str(), m_bitrate, m_gop, m_preset.c_str());
+}
+
+VideoEncoder::~VideoEncoder() {
+    destroy_pipeline();
+}
+
+bool VideoEncoder::is_video_codec(const char* type) {
+    return !strcmp(type, VIDEO_CODEC_H264) || !strcmp(type, VIDEO_CODEC_HEVC);
+}
+
+const std::string& VideoEncoder::get_codec() const {
+    return m_codec;
+}
+
+void VideoEncoder::force_keyframe() {
+    m_force_keyframe.store(true);
+}
+
+bool VideoEncoder::create_pipeline(int width, int height, int channels) {
+    // 4:2:0 encoding needs even dimensions, odd frames lose their last
+    // column or row
+    int enc_width = width & ~1;
+    int enc_height = height & ~1;
+    if(enc_width == 0 || enc_height == 0) {
+        LOG_ERROR("%s: %dx%d frames are too small for %s encoding", m_name.c_str(),
+                  width, height, m_codec.c_str());
+        return false;
+    }
+
+    // zerolatency disables lookahead and B-frames, so every frame pushed
+    // yields its access unit right away
+    bool h264 = (m_codec == VIDEO_CODEC_H264);
+    char desc[1024];
+    snprintf(desc, sizeof(desc),
+             "appsrc name=src format=time is-live=true "
+             "caps=video/x-raw,format=%s,width=%d,height=%d,framerate=0/1 ! "
+             "videoconvert ! "
+             "%s bitrate=%d key-int-max=%d speed-preset=%s tune=zerolatency ! "
+             "%s config-interval=-1 ! "
+             "%s,stream-format=byte-stream,alignment=au ! "
+             "appsink name=sink sync=false",
+             (channels == 1) ? "GRAY8" : "BGR", enc_width, enc_height,
+             h264 ? "x264enc" : "x265enc", m_bitrate, m_gop, m_preset.c_str(),
+             h264 ? "h264parse" : "h265parse",
+             h264 ? "video/x-h264" : "video/x-h265");
+
+    GError* error = NULL;
+    m_pipeline = gst_parse_launch(desc, &error);
+    if(m_pipeline == NULL || error != NULL) {
+        LOG_ERROR("%s: Failed to create %s encoder: %s", m_name.c_str(), m_codec.c_str(),
+                  (error != NULL) ? error->message : "unknown error");
+        if(error != NULL)
+            g_error_free(error);
+        if(m_pipeline != NULL) {
+            gst_object_unref(m_pipeline);
+            m_pipeline = NULL;
+        }
+        return false;
+    }
+    m_src = gst_bin_get_by_name(GST_BIN(m_pipeline), "src");
+    m_sink = gst_bin_get_by_name(GST_BIN(m_pipeline), "sink");
+    if(m_src == NULL || m_sink == NULL ||
+       gst_element_set_state(m_pipeline, GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE) {
+        LOG_ERROR("%s: Failed to start %s encoder", m_name.c_str(), m_codec.c_str());
+        destroy_pipeline();
+        return false;
+    }
+    m_width = width;
+    m_height = height;
+    m_channels = channels;
+    LOG_INFO("%s: %s encoder started for %dx%d frames with %d channels",
+             m_name.c_str(), m_codec.c_str(), enc_width, enc_height, channels);
+    return true;
+}
+
+void VideoEncoder::destroy_pipeline() {
+    if(m_pipeline == NULL)
+        return;
+    gst_element_set_state(m_pipeline, GST_STATE_NULL);
+    if(m_src != NULL)
+        gst_object_unref(m_src);
+    if(m_sink != NULL)
+        gst_object_unref(m_sink);
+    gst_object_unref(m_pipeline);
+    m_pipeline = NULL;
+    m_src = NULL;
+    m_sink = NULL;
+}
+
+bool VideoEncoder::encode(const void* data, int width, int height, int channels,
+                          std::shared_ptr<void> owner, std::vector<unsigned char>& out,
+                          bool& keyframe) {
+    if(m_pipeline == NULL || width != m_width || height != m_height || channels != m_channels) {
+        destroy_pipeline();
+        if(!create_pipeline(width, height, channels))
+            return false;
+    }
+    if(m_force_keyframe.exchange(false)) {
+        gst_element_send_event(m_sink, gst_video_event_new_upstream_force_key_unit(
+                GST_CLOCK_TIME_NONE, TRUE, 0));
+        LOG_DEBUG("%s: keyframe requested", m_name.c_str());
+    }
+
+    // The frame data is handed to the encoder without copying
+    size_t len = (size_t) width * height * channels;
+    GstBuffer* buf = gst_buffer_new_wrapped_full(GST_MEMORY_FLAG_READONLY, (gpointer) data,
+            len, 0, len, new std::shared_ptr<void>(owner), release_owner);
+    // The rows are tightly packed while GStreamer assumes strides rounded
+    // up to 4 bytes unless told otherwise
+    gsize offset[GST_VIDEO_MAX_PLANES] = { 0 };
+    gint stride[GST_VIDEO_MAX_PLANES] = { width * channels };
+    gst_buffer_add_video_meta_full(buf, GST_VIDEO_FRAME_FLAG_NONE,
+            (channels == 1) ? GST_VIDEO_FORMAT_GRAY8 : GST_VIDEO_FORMAT_BGR,
+            width & ~1, height & ~1, 1, offset, stride);
+    GST_BUFFER_PTS(buf) = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - m_start).count();
+    GstFlowReturn ret = GST_FLOW_ERROR;
+    g_signal_emit_by_name(m_src, "push-buffer", buf, &ret);
+    gst_buffer_unref(buf);
+
+    GstSample* sample = NULL;
+    if(ret == GST_FLOW_OK)
+        g_signal_emit_by_name(m_sink, "try-pull-sample", PULL_TIMEOUT, &sample);
+    if(sample == NULL) {
+        GstBus* bus = gst_element_get_bus(m_pipeline);
+        GstMessage* msg = gst_bus_timed_pop_filtered(bus, 0, GST_MESSAGE_ERROR);
+        if(msg != NULL) {
+            GError* err = NULL;
+            gchar* debug = NULL;
+            gst_message_parse_error(msg, &err, &debug);
+            LOG_ERROR("%s: %s encoder error: %s", m_name.c_str(), m_codec.c_str(),
+                      (err != NULL) ? err->message : "unknown error");
+            if(err != NULL)
+                g_error_free(err);
+            g_free(debug);
+            gst_message_unref(msg);
+        } else {
+            LOG_ERROR("%s: %s encoder did not output the frame", m_name.c_str(),
+                      m_codec.c_str());
+        }
+        gst_object_unref(bus);
+        // Recreated for the next frame
+        destroy_pipeline();
+        return false;
+    }
+
+    GstBuffer* au = gst_sample_get_buffer(sample);  // no lifetime transfer
+    GstMapInfo map;
+    if(au == NULL || !gst_buffer_map(au, &map, GST_MAP_READ)) {
+        LOG_ERROR("%s: Failed to map encoded frame", m_name.c_str());
+        gst_sample_unref(sample);
+        return false;
+    }
+    out.assign(map.data, map.data + map.size);
+    keyframe = !GST_BUFFER_FLAG_IS_SET(au, GST_BUFFER_FLAG_DELTA_UNIT);
+    gst_buffer_unmap(au, &map);
+    gst_sample_unref(sample);
+    return true;
+}
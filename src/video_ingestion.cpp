@@ -29,12 +29,17 @@
 #include "eii/vi/ingestor.h"
 #include "eii/vi/gstreamer_ingestor.h"
 #include <mutex>
+#include <future>
+#include <chrono>
+#include <exception>
+#include <cjson/cJSON.h>
 
 #define INTEL_VENDOR "GenuineIntel"
 #define INTEL_VENDOR_LENGTH 12
 #define DEFAULT_QUEUE_SIZE 10
 #define PUB "pub"
 #define SW_TRIGGER "sw_trigger"
+#define STREAMS "streams"
 #define ARGUMENTS "arguments"
 
 using namespace eii::vi;
@@ -42,9 +47,134 @@ using namespace eii::utils;
 using namespace eii::msgbus;
 using namespace eii::udf;
 
+/**
+ * Get the result of a component initialized asynchronously. The first
+ * exception thrown by any of the components is kept in @p err.
+ */
+template<typename T>
+static T* wait_component(std::future<T*>& future, std::exception_ptr& err) {
+    try {
+        return future.get();
+    } catch(...) {
+        if (!err) {
+            err = std::current_exception();
+        }
+        return NULL;
+    }
+}
+
+/**
+ * Parse the optional "encoding" object of the VideoIngestion config. Frames
+ * are not encoded if it is missing.
+ */
+static void parse_encoding(config_t* config, EncodeType& enc_type, int& enc_lvl) {
+    enc_type = EncodeType::NONE;
+    enc_lvl = 0;
+    config_value_t* encoding_value = config->get_config_value(config->cfg,
+                                                              "encoding");
+    if (encoding_value == NULL) {
+        const char* err = "\"encoding\" key is missing";
+        LOG_WARN("%s", err);
+        return;
+    }
+    config_value_t* encoding_type_cvt = config_value_object_get(encoding_value,
+                                                                "type");
+    if (encoding_type_cvt == NULL) {
+        const char* err = "encoding \"type\" key missing";
+        LOG_ERROR("%s", err);
+        config_value_destroy(encoding_value);
+        throw(err);
+    }
+    if (encoding_type_cvt->type != CVT_STRING) {
+        const char* err = "encoding \"type\" value has to be of string type";
+        LOG_ERROR("%s", err);
+        config_value_destroy(encoding_type_cvt);
+        config_value_destroy(encoding_value);
+        throw(err);
+    }
+    char* type = encoding_type_cvt->body.string;
+    if (strcmp(type, "jpeg") == 0) {
+        enc_type = EncodeType::JPEG;
+        LOG_DEBUG_0("Encoding type is jpeg");
+    } else if (strcmp(type, "png") == 0) {
+        enc_type = EncodeType::PNG;
+        LOG_DEBUG_0("Encoding type is png");
+    } else {
+        config_value_destroy(encoding_type_cvt);
+        config_value_destroy(encoding_value);
+        throw "Encoding type is not supported";
+    }
+    config_value_destroy(encoding_type_cvt);
+
+    config_value_t* encoding_level_cvt = config_value_object_get(encoding_value,
+                                                                 "level");
+    if (encoding_level_cvt == NULL) {
+        const char* err = "encoding \"level\" key missing";
+        LOG_ERROR("%s", err);
+        config_value_destroy(encoding_value);
+        throw(err);
+    }
+    if (encoding_level_cvt->type != CVT_INTEGER) {
+        const char* err = "encoding \"level\" value has to be of integer type";
+        LOG_ERROR("%s", err);
+        config_value_destroy(encoding_level_cvt);
+        config_value_destroy(encoding_value);
+        throw(err);
+    }
+    enc_lvl = encoding_level_cvt->body.integer;
+    LOG_DEBUG("Encoding value is %d", enc_lvl);
+    config_value_destroy(encoding_level_cvt);
+    config_value_destroy(encoding_value);
+}
+
+/**
+ * Create a standalone config object for the "ingestor" object of the
+ * VideoIngestion config.
+ */
+static config_t* get_ingestor_config(const char* vi_config) {
+    cJSON* json = cJSON_Parse(vi_config);
+    if (json == NULL) {
+        return NULL;
+    }
+    config_t* ingestor_cfg = NULL;
+    cJSON* ingestor = cJSON_GetObjectItem(json, "ingestor");
+    if (ingestor != NULL) {
+        char* ingestor_str = cJSON_PrintUnformatted(ingestor);
+        if (ingestor_str != NULL) {
+            ingestor_cfg = json_config_new_from_buffer(ingestor_str);
+            free(ingestor_str);
+        }
+    }
+    cJSON_Delete(json);
+    return ingestor_cfg;
+}
+
+/**
+ * Delete all frames left in a queue.
+ */
+static void drain_queue(FrameQueue* queue) {
+    while (!queue->empty()) {
+        Frame* frame = queue->front();
+        queue->pop();
+        delete frame;
+    }
+}
+
+/**
+ * Check whether the value of a key differs between two JSON objects.
+ */
+static bool json_key_changed(const cJSON* old_json, const cJSON* new_json, const char* key) {
+    const cJSON* old_value = cJSON_GetObjectItem(old_json, key);
+    const cJSON* new_value = cJSON_GetObjectItem(new_json, key);
+    if (old_value == NULL || new_value == NULL) {
+        return old_value != new_value;
+    }
+    return !cJSON_Compare(old_value, new_value, true);
+}
+
 VideoIngestion::VideoIngestion(
         std::string app_name, std::condition_variable& err_cv, char* vi_config, ConfigMgr* ctx, CommandHandler* commandhandler) :
-    m_app_name(app_name), m_commandhandler(commandhandler), m_err_cv(err_cv), m_enc_type(EncodeType::NONE), m_enc_lvl(0) {
+    m_app_name(app_name), m_vi_config(vi_config), m_cfg_mgr(ctx), m_commandhandler(commandhandler), m_publisher(NULL), m_output_router(NULL), m_batcher(NULL), m_err_cv(err_cv), m_enc_type(EncodeType::NONE), m_enc_lvl(0) {
 
     // Parse the configuration
     config_t* config = json_config_new_from_buffer(vi_config);
@@ -53,55 +183,13 @@ VideoIngestion::VideoIngestion(
         LOG_ERROR("%s", err);
         throw(err);
     }
-    config_value_t* encoding_value = config->get_config_value(config->cfg,
-                                                              "encoding");
-    if (encoding_value == NULL) {
-        const char* err = "\"encoding\" key is missing";
-        LOG_WARN("%s", err);
-    } else {
-        config_value_t* encoding_type_cvt = config_value_object_get(encoding_value,
-                                                                    "type");
-        if ( encoding_type_cvt == NULL ) {
-            const char* err = "encoding \"type\" key missing";
-            LOG_ERROR("%s", err);
-            config_destroy(config);
-            throw(err);
-        }
-        if (encoding_type_cvt->type != CVT_STRING) {
-            const char* err = "encoding \"type\" value has to be of string type";
-            LOG_ERROR("%s", err);
-            config_destroy(config);
-            config_value_destroy(encoding_type_cvt);
-            throw(err);
-        }
-        char* enc_type = encoding_type_cvt->body.string;
-        if (strcmp(enc_type, "jpeg") == 0) {
-            m_enc_type = EncodeType::JPEG;
-            LOG_DEBUG_0("Encoding type is jpeg");
-        } else if (strcmp(enc_type, "png") == 0) {
-            m_enc_type = EncodeType::PNG;
-            LOG_DEBUG_0("Encoding type is png");
-        } else {
-            throw "Encoding type is not supported";
-        }
-
-        config_value_t* encoding_level_cvt = config_value_object_get(encoding_value,
-                                                                    "level");
-        if (encoding_level_cvt == NULL) {
-            const char* err = "encoding \"level\" key missing";
-            LOG_ERROR("%s", err);
-            config_destroy(config);
-            throw(err);
-        }
-        if (encoding_level_cvt->type != CVT_INTEGER) {
-            const char* err = "encoding \"level\" value has to be of string type";
-            LOG_ERROR("%s", err);
-            config_destroy(config);
-            config_value_destroy(encoding_level_cvt);
-            throw(err);
-        }
-        m_enc_lvl = encoding_level_cvt->body.integer;
-        LOG_DEBUG("Encoding value is %d", m_enc_lvl);
+    try {
+        parse_encoding(config, m_enc_type, m_enc_lvl);
+        m_udf_placement = get_thread_placement(config, PLACEMENT_UDFS);
+        m_publisher_placement = get_thread_placement(config, PLACEMENT_PUBLISHER);
+    } catch(...) {
+        config_destroy(config);
+        throw;
     }
 
     config_value_t* ingestor_value = config->get_config_value(config->cfg,
@@ -146,10 +234,10 @@ VideoIngestion::VideoIngestion(
         queue_size = ingestor_queue_cvt->body.integer;
     }
 
+    m_queue_size = queue_size;
     m_udf_input_queue = new FrameQueue(queue_size);
 
-    config_value_object_t* ingestor_cvt = ingestor_value->body.object;
-    m_ingestor_cfg = config_new(ingestor_cvt->object, free, get_config_value, NULL);
+    m_ingestor_cfg = get_ingestor_config(vi_config);
     if (m_ingestor_cfg == NULL) {
         const char* err = "Unable to get ingestor config";
         LOG_ERROR("%s", err);
@@ -157,6 +245,11 @@ VideoIngestion::VideoIngestion(
         throw(err);
     }
 
+    // Keyframes can be requested regardless of the software trigger
+    if (m_commandhandler != NULL) {
+        m_commandhandler->register_callback((int)FORCE_KEYFRAME, std::bind(&VideoIngestion::process_force_keyframe, this, std::placeholders::_1));
+    }
+
     // get config SW_Trigger logic start
     config_value_t* sw_trigger = config->get_config_value(config->cfg,
                                                             SW_TRIGGER);
@@ -212,44 +305,113 @@ VideoIngestion::VideoIngestion(
         m_udf_manager = NULL;
     } else {
         m_udf_output_queue = new FrameQueue(queue_size);
-        m_udf_manager = new UdfManager(config, m_udf_input_queue, m_udf_output_queue, m_app_name,
-                                        m_enc_type, m_enc_lvl);
     }
 
-    // Get ingestor
-    m_ingestor = get_ingestor( m_ingestor_cfg, m_udf_input_queue, m_ingestor_type.c_str(), m_app_name, m_snapshot_cv, m_enc_type, m_enc_lvl);
+    // The frames of the UDF output queue are either published directly or
+    // routed to the configured outputs
+    config_value_t* outputs_value = config->get_config_value(config->cfg,
+                                                             OUTPUTS);
 
-    PublisherCfg* pub_ctx = ctx->getPublisherByIndex(0);
-    if (pub_ctx == NULL) {
-        const char* err = "pub_ctx initialization failed";
-        LOG_ERROR("%s", err);
-        throw(err);
+    // The ingestor (which opens the camera or prerolls the pipeline), the
+    // publisher or output router and the UDF manager (which may load models)
+    // do not depend on each other, so they are initialized concurrently. The
+    // UDF manager is created on this thread, since the Python interpreter it
+    // may initialize has to stay with a thread which outlives it.
+    auto init_start = std::chrono::steady_clock::now();
+    std::future<Ingestor*> ingestor_future = std::async(std::launch::async,
+            [this]() -> Ingestor* {
+        auto start = std::chrono::steady_clock::now();
+        Ingestor* ingestor = get_ingestor(m_ingestor_cfg, m_udf_input_queue, m_ingestor_type.c_str(), m_app_name, m_snapshot_cv, m_enc_type, m_enc_lvl);
+        LOG_INFO("Ingestor initialized in %ld ms", (long) elapsed_ms(start));
+        return ingestor;
+    });
+    std::future<Publisher*> publisher_future = std::async(std::launch::async,
+            [this, outputs_value]() -> Publisher* {
+        if (outputs_value != NULL) {
+            return NULL;
+        }
+        auto start = std::chrono::steady_clock::now();
+        Publisher* publisher = create_publisher(m_cfg_mgr->getPublisherByIndex(0),
+                                                (MessageQueue*) m_udf_output_queue);
+        LOG_INFO("Publisher initialized in %ld ms", (long) elapsed_ms(start));
+        return publisher;
+    });
+    std::future<OutputRouter*> router_future = std::async(std::launch::async,
+            [this, outputs_value]() -> OutputRouter* {
+        if (outputs_value == NULL) {
+            return NULL;
+        }
+        auto start = std::chrono::steady_clock::now();
+        OutputRouter* router = new OutputRouter(outputs_value, m_udf_output_queue, m_queue_size,
+                [this](const std::string& publisher, MessageQueue* queue) {
+            return create_publisher(m_cfg_mgr->getPublisherByName(publisher.c_str()), queue);
+        });
+        LOG_INFO("Output router initialized in %ld ms", (long) elapsed_ms(start));
+        return router;
+    });
+
+    std::exception_ptr init_err;
+    m_udf_manager = NULL;
+    if (udf_value != NULL) {
+        try {
+            auto start = std::chrono::steady_clock::now();
+            m_udf_manager = create_udf_manager(config);
+            LOG_INFO("UDF manager initialized in %ld ms", (long) elapsed_ms(start));
+        } catch(...) {
+            init_err = std::current_exception();
+        }
     }
-    config_t* pub_config = pub_ctx->getMsgBusConfig();
-    if (pub_config == NULL) {
-        const char* err = "Failed to fetch msgbus config for Publisher";
-        LOG_ERROR("%s", err);
-        throw(err);
+
+    // Wait for every component before reporting a failure, so that none of
+    // them is still being initialized when the others are released
+    m_ingestor = wait_component(ingestor_future, init_err);
+    m_publisher = wait_component(publisher_future, init_err);
+    m_output_router = wait_component(router_future, init_err);
+    if (!init_err) {
+        try {
+            create_streams(vi_config);
+            add_streams();
+        } catch(...) {
+            init_err = std::current_exception();
+        }
     }
-    std::vector<std::string> topics = pub_ctx->getTopics();
-    if (topics.empty()) {
-        const char* err = "Topics list cannot be empty";
-        LOG_ERROR("%s", err);
-        throw(err);
+    if (init_err) {
+        destroy_streams();
+        delete m_output_router;
+        delete m_publisher;
+        delete m_ingestor;
+        delete m_udf_manager;
+        delete m_batcher;
+        if (m_udf_output_queue != m_udf_input_queue) {
+            delete m_udf_output_queue;
+        }
+        delete m_udf_input_queue;
+        config_destroy(m_ingestor_cfg);
+        config_destroy(config);
+        config_value_destroy(ingestor_type_cvt);
+        config_value_destroy(ingestor_queue_cvt);
+        config_value_destroy(ingestor_value);
+        config_value_destroy(udf_value);
+        if (outputs_value != NULL) {
+            config_value_destroy(outputs_value);
+        }
+        std::rethrow_exception(init_err);
     }
-    LOG_DEBUG_0("Publisher Config received...");
-
-    m_publisher = new Publisher(
-            pub_config, m_err_cv, topics[0], (MessageQueue*) m_udf_output_queue, m_app_name);
+    LOG_INFO("Components initialized in %ld ms", (long) elapsed_ms(init_start));
+    m_ingestor->set_udfs_configured(m_udf_manager != NULL);
 
     config_destroy(config);
     config_value_destroy(ingestor_type_cvt);
     config_value_destroy(ingestor_queue_cvt);
-    config_value_destroy(encoding_value);
+    config_value_destroy(ingestor_value);
     config_value_destroy(udf_value);
+    if (outputs_value != NULL) {
+        config_value_destroy(outputs_value);
+    }
 }
 
 msg_envelope_elem_body_t* VideoIngestion::process_start_ingestion(msg_envelope_elem_body_t *arg_payload) {
+    std::lock_guard<std::mutex> lk(m_mtx);
     try {
             LOG_INFO_0("START INGESTION request received from client");
             if (m_ingestion_running.load()) {
@@ -275,6 +437,7 @@ msg_envelope_elem_body_t* VideoIngestion::process_start_ingestion(msg_envelope_e
 }
 
 msg_envelope_elem_body_t* VideoIngestion::process_stop_ingestion(msg_envelope_elem_body_t *arg_payload) {
+    std::lock_guard<std::mutex> lk(m_mtx);
     try {
             LOG_INFO_0("STOP INGESTION request received from client");
 
@@ -300,6 +463,7 @@ msg_envelope_elem_body_t* VideoIngestion::process_stop_ingestion(msg_envelope_el
 }
 
 msg_envelope_elem_body_t* VideoIngestion::process_snapshot(msg_envelope_elem_body_t *arg_payload) {
+    std::lock_guard<std::mutex> lk(m_mtx);
     try {
             LOG_INFO_0("SNAPSHOT request received from client");
 
@@ -335,18 +499,220 @@ msg_envelope_elem_body_t* VideoIngestion::process_snapshot(msg_envelope_elem_bod
     }
 }
 
+msg_envelope_elem_body_t* VideoIngestion::process_force_keyframe(msg_envelope_elem_body_t *arg_payload) {
+    std::lock_guard<std::mutex> lk(m_mtx);
+    LOG_INFO_0("FORCE_KEYFRAME request received from client");
+    if (m_output_router == NULL || !m_output_router->force_keyframe()) {
+        std::string err = "No output is H.264/HEVC encoded";
+        return m_commandhandler->form_reply_payload((int)REQ_NOT_HONORED, err, NULL);
+    }
+    return m_commandhandler->form_reply_payload((int)REQ_HONORED, "SUCCESS", NULL);
+}
+
+Publisher* VideoIngestion::create_publisher(PublisherCfg* pub_ctx, MessageQueue* queue) {
+    if (pub_ctx == NULL) {
+        const char* err = "pub_ctx initialization failed";
+        LOG_ERROR("%s", err);
+        throw(err);
+    }
+    config_t* pub_config = pub_ctx->getMsgBusConfig();
+    if (pub_config == NULL) {
+        const char* err = "Failed to fetch msgbus config for Publisher";
+        LOG_ERROR("%s", err);
+        throw(err);
+    }
+    std::vector<std::string> topics = pub_ctx->getTopics();
+    if (topics.empty()) {
+        const char* err = "Topics list cannot be empty";
+        LOG_ERROR("%s", err);
+        throw(err);
+    }
+    LOG_DEBUG_0("Publisher Config received...");
+
+    ScopedPlacement placement(m_publisher_placement);
+
+    return new Publisher(
+            pub_config, m_err_cv, topics[0], queue, m_app_name);
+}
+
+UdfManager* VideoIngestion::create_udf_manager(config_t* config) {
+    ScopedPlacement placement(m_udf_placement);
+    config_value_t* batching = config->get_config_value(config->cfg, BATCHING);
+    if (batching == NULL) {
+        return new UdfManager(config, m_udf_input_queue, m_udf_output_queue, m_app_name,
+                              m_enc_type, m_enc_lvl);
+    }
+    try {
+        m_batcher = new FrameBatcher(batching, m_udf_input_queue, m_udf_output_queue, m_queue_size);
+    } catch(...) {
+        config_value_destroy(batching);
+        throw;
+    }
+    config_value_destroy(batching);
+    try {
+        return new UdfManager(config, m_batcher->get_udf_input_queue(), m_batcher->get_udf_output_queue(),
+                              m_app_name, m_enc_type, m_enc_lvl);
+    } catch(...) {
+        delete m_batcher;
+        m_batcher = NULL;
+        throw;
+    }
+}
+
+void VideoIngestion::destroy_udf_manager() {
+    // The batcher hands its pending frames to the running UDF manager
+    if (m_batcher) {
+        m_batcher->stop();
+    }
+    if (m_udf_manager) {
+        m_udf_manager->stop();
+        delete m_udf_manager;
+        m_udf_manager = NULL;
+    }
+    if (m_batcher) {
+        delete m_batcher;
+        m_batcher = NULL;
+    }
+}
+
+void VideoIngestion::create_streams(const char* vi_config) {
+    cJSON* json = cJSON_Parse(vi_config);
+    if (json == NULL) {
+        const char* err = "Failed to parse config";
+        LOG_ERROR("%s", err);
+        throw(err);
+    }
+    const cJSON* streams = cJSON_GetObjectItem(json, STREAMS);
+    if (streams == NULL) {
+        cJSON_Delete(json);
+        return;
+    }
+    try {
+        if (!cJSON_IsArray(streams)) {
+            const char* err = "\"streams\" value has to be of array type";
+            LOG_ERROR("%s", err);
+            throw(err);
+        }
+        const cJSON* item = NULL;
+        cJSON_ArrayForEach(item, streams) {
+            const cJSON* sink = cJSON_GetObjectItem(item, "sink");
+            const cJSON* publisher = cJSON_GetObjectItem(item, "publisher");
+            if (!cJSON_IsString(sink) || !cJSON_IsString(publisher)) {
+                const char* err = "stream \"sink\" and \"publisher\" values have to be of string type";
+                LOG_ERROR("%s", err);
+                throw(err);
+            }
+            IngestionStream* stream = new IngestionStream();
+            m_streams.push_back(stream);
+            stream->name = sink->valuestring;
+            stream->udf_input_queue = new FrameQueue(m_queue_size);
+            if (cJSON_GetObjectItem(item, "udfs") != NULL) {
+                // The stream object holds the "udfs" and "max_workers" keys
+                // of its UDF manager
+                config_t* stream_cfg = NULL;
+                char* stream_str = cJSON_PrintUnformatted(item);
+                if (stream_str != NULL) {
+                    stream_cfg = json_config_new_from_buffer(stream_str);
+                    free(stream_str);
+                }
+                if (stream_cfg == NULL) {
+                    const char* err = "Failed to initialize stream configuration object";
+                    LOG_ERROR("%s", err);
+                    throw(err);
+                }
+                stream->udf_output_queue = new FrameQueue(m_queue_size);
+                try {
+                    ScopedPlacement placement(m_udf_placement);
+                    stream->udf_manager = new UdfManager(stream_cfg, stream->udf_input_queue, stream->udf_output_queue,
+                                                         m_app_name, m_enc_type, m_enc_lvl);
+                } catch(...) {
+                    config_destroy(stream_cfg);
+                    throw;
+                }
+                config_destroy(stream_cfg);
+            } else {
+                stream->udf_output_queue = stream->udf_input_queue;
+            }
+            stream->publisher = create_publisher(
+                    m_cfg_mgr->getPublisherByName(publisher->valuestring),
+                    (MessageQueue*) stream->udf_output_queue);
+            LOG_INFO("Stream %s is published by %s", stream->name.c_str(), publisher->valuestring);
+        }
+    } catch(...) {
+        cJSON_Delete(json);
+        throw;
+    }
+    cJSON_Delete(json);
+}
+
+void VideoIngestion::add_streams() {
+    for (IngestionStream* stream : m_streams) {
+        m_ingestor->add_stream(stream->name, stream->udf_input_queue);
+    }
+}
+
+void VideoIngestion::destroy_streams(bool keep_input_queues) {
+    for (IngestionStream* stream : m_streams) {
+        if (stream->udf_manager) {
+            stream->udf_manager->stop();
+            delete stream->udf_manager;
+        }
+        if (stream->publisher) {
+            stream->publisher->stop();
+            delete stream->publisher;
+        }
+        if (stream->udf_output_queue && stream->udf_output_queue != stream->udf_input_queue) {
+            drain_queue(stream->udf_output_queue);
+            delete stream->udf_output_queue;
+        }
+        if (stream->udf_input_queue && !keep_input_queues) {
+            drain_queue(stream->udf_input_queue);
+            delete stream->udf_input_queue;
+        }
+        delete stream;
+    }
+    m_streams.clear();
+}
+
 VideoIngestion& VideoIngestion::operator=(const VideoIngestion& src) {
     return *this;
 }
 
 void VideoIngestion::start() {
-    if (m_publisher) {
-        m_publisher->start();
-        LOG_INFO("Publisher thread started...");
+    // Threads started by the components inherit the placement of their
+    // stage
+    {
+        ScopedPlacement placement(m_publisher_placement);
+        if (m_publisher) {
+            m_publisher->start();
+            LOG_INFO("Publisher thread started...");
+        }
+        if (m_output_router) {
+            m_output_router->start();
+            LOG_INFO("Output router started...");
+        }
     }
-    if (m_udf_manager) {
-        m_udf_manager->start();
-        LOG_INFO("Started udf manager");
+    {
+        ScopedPlacement placement(m_udf_placement);
+        if (m_udf_manager) {
+            m_udf_manager->start();
+            LOG_INFO("Started udf manager");
+        }
+        if (m_batcher) {
+            m_batcher->start();
+            LOG_INFO("Started batcher");
+        }
+    }
+    for (IngestionStream* stream : m_streams) {
+        {
+            ScopedPlacement placement(m_publisher_placement);
+            stream->publisher->start();
+        }
+        if (stream->udf_manager) {
+            ScopedPlacement placement(m_udf_placement);
+            stream->udf_manager->start();
+        }
+        LOG_INFO("Stream %s started...", stream->name.c_str());
     }
 
     // if SW trigger is disabled OR (if sw trigger is enabled && init_state = running) then start ingestion
@@ -365,12 +731,287 @@ void VideoIngestion::stop() {
     if (m_ingestor) {
         m_ingestor->stop();
     }
+    if (m_batcher) {
+        m_batcher->stop();
+    }
     if (m_udf_manager) {
         m_udf_manager->stop();
     }
     if (m_publisher) {
         m_publisher->stop();
     }
+    if (m_output_router) {
+        m_output_router->stop();
+    }
+    for (IngestionStream* stream : m_streams) {
+        if (stream->udf_manager) {
+            stream->udf_manager->stop();
+        }
+        stream->publisher->stop();
+    }
+}
+
+bool VideoIngestion::is_hung() const {
+    return m_ingestor != NULL && m_ingestor->is_hung();
+}
+
+void VideoIngestion::rebuild_ingestor(config_t* ingestor_cfg, const char* type) {
+    bool running = !m_sw_trgr_en || m_ingestion_running.load();
+    LOG_INFO("Rebuilding %s ingestor", type);
+    if (m_ingestor) {
+        m_ingestor->stop();
+        if (m_ingestor->is_hung()) {
+            const char* err = "Ingestor failed to stop";
+            LOG_ERROR("%s", err);
+            throw(err);
+        }
+        delete m_ingestor;
+        m_ingestor = NULL;
+    }
+    if (m_ingestor_cfg) {
+        config_destroy(m_ingestor_cfg);
+    }
+    m_ingestor_cfg = ingestor_cfg;
+    m_ingestor_type = type;
+    m_ingestor = get_ingestor(m_ingestor_cfg, m_udf_input_queue, type, m_app_name, m_snapshot_cv, m_enc_type, m_enc_lvl);
+    m_ingestor->set_udfs_configured(m_udf_manager != NULL);
+    add_streams();
+    if (running) {
+        IngestRetCode ret = m_ingestor->start();
+        if (ret != IngestRetCode::SUCCESS) {
+            LOG_ERROR("Failed to start ingestor thread: %d", ret);
+        }
+    }
+}
+
+bool VideoIngestion::reconfigure(const char* vi_config) {
+    std::lock_guard<std::mutex> lk(m_mtx);
+
+    cJSON* old_json = cJSON_Parse(m_vi_config.c_str());
+    cJSON* new_json = cJSON_Parse(vi_config);
+    if (old_json == NULL || new_json == NULL) {
+        LOG_ERROR_0("Failed to parse config for reconfiguration");
+        cJSON_Delete(old_json);
+        cJSON_Delete(new_json);
+        return false;
+    }
+
+    // Only changes to these keys can be applied in place, anything else
+    // (e.g. the software trigger) requires VideoIngestion to be recreated
+    static const char* const live_keys[] = {
+        "encoding", "ingestor", "udfs", "max_workers", NULL
+    };
+    const cJSON* const configs[] = { old_json, new_json };
+    for (int i = 0; i < 2; i++) {
+        const cJSON* item = NULL;
+        cJSON_ArrayForEach(item, configs[i]) {
+            bool live = false;
+            for (int j = 0; live_keys[j] != NULL; j++) {
+                if (!strcmp(item->string, live_keys[j])) {
+                    live = true;
+                    break;
+                }
+            }
+            if (!live && json_key_changed(old_json, new_json, item->string)) {
+                LOG_INFO("\"%s\" changed, VideoIngestion has to be restarted", item->string);
+                cJSON_Delete(old_json);
+                cJSON_Delete(new_json);
+                return false;
+            }
+        }
+    }
+
+    const cJSON* old_ingestor = cJSON_GetObjectItem(old_json, "ingestor");
+    const cJSON* new_ingestor = cJSON_GetObjectItem(new_json, "ingestor");
+    bool enc_changed = json_key_changed(old_json, new_json, "encoding");
+    bool udfs_changed = json_key_changed(old_json, new_json, "udfs") ||
+                        json_key_changed(old_json, new_json, "max_workers");
+    bool queue_changed = json_key_changed(old_ingestor, new_ingestor, "queue_size");
+    bool poll_changed = json_key_changed(old_ingestor, new_ingestor, "poll_interval");
+    bool roi_changed = json_key_changed(old_ingestor, new_ingestor, ROI);
+    bool has_udfs = cJSON_GetObjectItem(new_json, "udfs") != NULL;
+
+    // Any other ingestor change requires the ingestor to be rebuilt
+    cJSON* old_ingestor_rest = cJSON_Duplicate(old_ingestor, true);
+    cJSON* new_ingestor_rest = cJSON_Duplicate(new_ingestor, true);
+    cJSON_DeleteItemFromObject(old_ingestor_rest, "queue_size");
+    cJSON_DeleteItemFromObject(old_ingestor_rest, "poll_interval");
+    cJSON_DeleteItemFromObject(old_ingestor_rest, ROI);
+    cJSON_DeleteItemFromObject(new_ingestor_rest, "queue_size");
+    cJSON_DeleteItemFromObject(new_ingestor_rest, "poll_interval");
+    cJSON_DeleteItemFromObject(new_ingestor_rest, ROI);
+    bool ingestor_changed = !cJSON_Compare(old_ingestor_rest, new_ingestor_rest, true);
+    cJSON_Delete(old_ingestor_rest);
+    cJSON_Delete(new_ingestor_rest);
+
+    size_t queue_size = DEFAULT_QUEUE_SIZE;
+    const cJSON* queue_size_json = cJSON_GetObjectItem(new_ingestor, "queue_size");
+    if (cJSON_IsNumber(queue_size_json) && queue_size_json->valueint > 0) {
+        queue_size = queue_size_json->valueint;
+    }
+    double poll_interval = 0.0;
+    const cJSON* poll_interval_json = cJSON_GetObjectItem(new_ingestor, "poll_interval");
+    if (cJSON_IsNumber(poll_interval_json)) {
+        poll_interval = poll_interval_json->valuedouble;
+    }
+    const cJSON* type_json = cJSON_GetObjectItem(new_ingestor, "type");
+    std::string ingestor_type = cJSON_IsString(type_json) ? type_json->valuestring : m_ingestor_type;
+
+    cJSON_Delete(old_json);
+    cJSON_Delete(new_json);
+
+    // Queues are recreated if their size changes, or if UDFs are added or
+    // removed since the output queue is the input queue without UDFs
+    bool queues_changed = queue_changed || (has_udfs != (m_udf_manager != NULL));
+    bool udf_manager_changed = has_udfs && (udfs_changed || enc_changed || queues_changed);
+
+    config_t* config = json_config_new_from_buffer(vi_config);
+    if (config == NULL) {
+        LOG_ERROR_0("Failed to initialize configuration object");
+        return false;
+    }
+    config_t* ingestor_cfg = NULL;
+
+    // Validate the new config before touching the running pipeline
+    EncodeType enc_type = m_enc_type;
+    int enc_lvl = m_enc_lvl;
+    try {
+        if (enc_changed) {
+            parse_encoding(config, enc_type, enc_lvl);
+        }
+        if (ingestor_changed) {
+            ingestor_cfg = get_ingestor_config(vi_config);
+            if (ingestor_cfg == NULL) {
+                const char* err = "Unable to get ingestor config";
+                LOG_ERROR("%s", err);
+                throw(err);
+            }
+        } else if (roi_changed) {
+            // Applied right away as the regions are only swapped if the
+            // new ones are valid, a rebuilt ingestor reads them itself
+            config_t* roi_cfg = get_ingestor_config(vi_config);
+            if (roi_cfg == NULL) {
+                const char* err = "Unable to get ingestor config";
+                LOG_ERROR("%s", err);
+                throw(err);
+            }
+            config_value_t* roi = roi_cfg->get_config_value(roi_cfg->cfg, ROI);
+            try {
+                m_ingestor->set_roi(roi);
+            } catch(const char*) {
+                if (roi != NULL) {
+                    config_value_destroy(roi);
+                }
+                config_destroy(roi_cfg);
+                throw;
+            }
+            if (roi != NULL) {
+                config_value_destroy(roi);
+            }
+            config_destroy(roi_cfg);
+        }
+    } catch(const char* err) {
+        LOG_ERROR("Invalid config change: %s", err);
+        config_destroy(config);
+        return false;
+    }
+
+    try {
+        if (enc_changed) {
+            m_enc_type = enc_type;
+            m_enc_lvl = enc_lvl;
+            m_ingestor->set_encoding(m_enc_type, m_enc_lvl);
+        }
+        if (poll_changed) {
+            m_ingestor->set_poll_interval(poll_interval);
+        }
+
+        if (queues_changed) {
+            LOG_INFO("Recreating queues with size %zu", queue_size);
+            bool running = !m_sw_trgr_en || m_ingestion_running.load();
+            m_ingestor->stop();
+            if (m_ingestor->is_hung()) {
+                const char* err = "Ingestor failed to stop";
+                LOG_ERROR("%s", err);
+                throw(err);
+            }
+            destroy_udf_manager();
+            if (m_publisher) {
+                m_publisher->stop();
+                delete m_publisher;
+                m_publisher = NULL;
+            }
+            if (m_output_router) {
+                m_output_router->stop();
+            }
+            if (m_udf_output_queue != m_udf_input_queue) {
+                drain_queue(m_udf_output_queue);
+                delete m_udf_output_queue;
+            }
+            drain_queue(m_udf_input_queue);
+            delete m_udf_input_queue;
+
+            m_queue_size = queue_size;
+            m_udf_input_queue = new FrameQueue(queue_size);
+            m_udf_output_queue = (has_udfs) ? new FrameQueue(queue_size) : m_udf_input_queue;
+            if (has_udfs) {
+                m_udf_manager = create_udf_manager(config);
+            }
+            m_ingestor->set_udfs_configured(has_udfs);
+            if (m_output_router) {
+                m_output_router->set_queue(m_udf_output_queue);
+                ScopedPlacement placement(m_publisher_placement);
+                m_output_router->start();
+            } else {
+                m_publisher = create_publisher(m_cfg_mgr->getPublisherByIndex(0),
+                                               (MessageQueue*) m_udf_output_queue);
+                ScopedPlacement placement(m_publisher_placement);
+                m_publisher->start();
+            }
+            if (m_udf_manager) {
+                ScopedPlacement placement(m_udf_placement);
+                m_udf_manager->start();
+                if (m_batcher) {
+                    m_batcher->start();
+                }
+            }
+            if (ingestor_cfg != NULL) {
+                rebuild_ingestor(ingestor_cfg, ingestor_type.c_str());
+                ingestor_cfg = NULL;
+            } else {
+                m_ingestor->set_queue(m_udf_input_queue, queue_size);
+                if (running) {
+                    m_ingestor->start();
+                }
+            }
+        } else {
+            if (udf_manager_changed) {
+                LOG_INFO_0("Rebuilding UDF manager");
+                destroy_udf_manager();
+                m_udf_manager = create_udf_manager(config);
+                ScopedPlacement placement(m_udf_placement);
+                m_udf_manager->start();
+                if (m_batcher) {
+                    m_batcher->start();
+                }
+            }
+            if (ingestor_cfg != NULL) {
+                rebuild_ingestor(ingestor_cfg, ingestor_type.c_str());
+                ingestor_cfg = NULL;
+            }
+        }
+    } catch(...) {
+        if (ingestor_cfg != NULL) {
+            config_destroy(ingestor_cfg);
+        }
+        config_destroy(config);
+        throw;
+    }
+    config_destroy(config);
+
+    m_vi_config = vi_config;
+    LOG_INFO_0("Config change applied");
+    return true;
 }
 
 VideoIngestion::~VideoIngestion() {
@@ -378,19 +1019,37 @@ VideoIngestion::~VideoIngestion() {
     if (m_ingestor) {
         m_ingestor->stop();
     }
-    if (m_ingestor) {
+    // The detached thread of a hung ingestor still uses the ingestor and
+    // pushes into its queues, so they are leaked in that case
+    bool hung = is_hung();
+    if (hung) {
+        LOG_ERROR_0("Ingestor failed to stop, leaking it along with its queues");
+    } else if (m_ingestor) {
         delete m_ingestor;
     }
+    destroy_streams(hung);
+    if (m_batcher) {
+        m_batcher->stop();
+    }
     if (m_udf_manager) {
         delete m_udf_manager;
     }
+    if (m_batcher) {
+        delete m_batcher;
+    }
     if (m_publisher) {
         delete m_publisher;
     }
-    if (m_udf_input_queue) {
-        delete m_udf_input_queue;
+    if (m_output_router) {
+        delete m_output_router;
     }
-    if (m_udf_output_queue) {
+    if (m_udf_output_queue && m_udf_output_queue != m_udf_input_queue) {
         delete m_udf_output_queue;
     }
+    if (m_udf_input_queue && !hung) {
+        delete m_udf_input_queue;
+    }
+    if (m_ingestor_cfg && !hung) {
+        config_destroy(m_ingestor_cfg);
+    }
 }